@@ -10,6 +10,14 @@ BOARD :=
 PLATFORM :=
 NAME :=
 CLK_ID := 0
+F_STRUCT := FS_DENSE
+SEQ_UPDATE := 0
+SQRT_COV := 0
+STEADY_GAIN := 0
+H_SPARSE := 0
+STEP34 :=
+NSTREAM := 1
+PROF := 0
 
 # Target OS: linux (Default), standalone
 TARGET_OS := linux
@@ -43,12 +51,23 @@ VIV_TCL := _sds/p0/vivado/prj/prj.srcs/sources_1/bd/*/hw_handoff/*_bd.tcl
 
 # Source Files
 SRC_PROJ_DIR := src/$(NAME)
+# the nXmY variants keep only ekf_config.h (and optionally main.cpp) and
+# share the hybrid kernel
+SRC_KERNEL_DIR := $(if $(wildcard $(SRC_PROJ_DIR)/ekf.cpp),$(SRC_PROJ_DIR),src/hybrid)
 SRC_PYNQLIB_DIR := src/pynqlib
+SRC_FXCONV_DIR := src/fxconv
 OBJECTS += \
 $(pwd)/$(BUILD_DIR)/main.o \
 $(pwd)/$(BUILD_DIR)/top_ekf.o \
 $(pwd)/$(BUILD_DIR)/ekf.o \
-$(pwd)/$(BUILD_DIR)/pynqlib.o
+$(pwd)/$(BUILD_DIR)/pynqlib.o \
+$(pwd)/$(BUILD_DIR)/cma_arena.o \
+$(pwd)/$(BUILD_DIR)/fxconv.o
+# the ekf_async, ekf_traj and ekf_sched drivers of the hybrid kernel, see
+# src/hybrid/ekf_async.h, ekf_traj.h and ekf_sched.h
+ASYNC_OBJ := $(if $(filter src/hybrid,$(SRC_KERNEL_DIR)),$(pwd)/$(BUILD_DIR)/ekf_async.o \
+	$(pwd)/$(BUILD_DIR)/ekf_traj.o $(pwd)/$(BUILD_DIR)/ekf_sched.o)
+OBJECTS += $(ASYNC_OBJ)
 
 # Compiled Stub Files
 DISTS += \
@@ -56,11 +75,14 @@ $(pwd)/$(BUILD_DIR)/_sds/swstubs/cf_stub.o \
 $(pwd)/$(BUILD_DIR)/_sds/swstubs/portinfo.o \
 $(pwd)/$(BUILD_DIR)/_sds/swstubs/top_ekf.o \
 $(pwd)/$(BUILD_DIR)/ekf.o \
-$(pwd)/$(BUILD_DIR)/pynqlib.o
+$(pwd)/$(BUILD_DIR)/pynqlib.o \
+$(pwd)/$(BUILD_DIR)/cma_arena.o \
+$(pwd)/$(BUILD_DIR)/fxconv.o \
+$(ASYNC_OBJ)
 
 
 # SDS Options
-HW_FLAGS += -sds-hw top_ekf top_ekf.cpp -files $(pwd)/$(SRC_PROJ_DIR)/ekf.cpp 
+HW_FLAGS += -sds-hw top_ekf top_ekf.cpp -files $(pwd)/$(SRC_KERNEL_DIR)/ekf.cpp 
 HW_FLAGS += -clkid $(CLK_ID) -sds-end
 
 
@@ -69,11 +91,25 @@ IFLAGS := -I.
 CFLAGS = -Wall -O3 -c -fPIC
 CFLAGS += -MT"$@" -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@)" 
 CFLAGS += $(ADDL_FLAGS)
+CFLAGS += -I$(pwd)/$(SRC_PROJ_DIR)
+# the CPU engine of ekf_sched
+CFLAGS += -I$(pwd)/../utils/tiny-ekf
 LFLAGS = "$@" "$<" 
+LDLIBS := -lpthread
+# NEON for the bulk conversions of src/fxconv; always on for the 64-bit boards
+SIMD_FLAGS := $(if $(filter Pynq-Z1 Pynq-Z2,$(BOARD)),-mfpu=neon)
 #+---------------------------------------------------------------------
 
 CONFIG_FLAGS += -DP_ENABLE=${P_ENABLE} 
 CONFIG_FLAGS += -DP_CACHEABLE=${P_CACHEABLE} 
+CONFIG_FLAGS += -DF_STRUCT=${F_STRUCT} 
+CONFIG_FLAGS += -DSEQ_UPDATE=${SEQ_UPDATE} 
+CONFIG_FLAGS += -DSQRT_COV=${SQRT_COV} 
+CONFIG_FLAGS += -DSTEADY_GAIN=${STEADY_GAIN} 
+CONFIG_FLAGS += -DH_SPARSE=${H_SPARSE} 
+CONFIG_FLAGS += $(if ${STEP34},-DSTEP34=${STEP34}) 
+CONFIG_FLAGS += -DNSTREAM=${NSTREAM} 
+CONFIG_FLAGS += -DPROF_ENABLE=${PROF} 
 SDSFLAGS := -sds-pf $(PLATFORM) -target-os $(TARGET_OS) 
 ifeq ($(VERBOSE), 1)
 SDSFLAGS += -verbose 
@@ -93,14 +129,14 @@ $(BUILD_DIR)/$(EXECUTABLE): $(OBJECTS)
 	mkdir -p $(BUILD_DIR)
 	@echo 'Building Target: $@'
 	@echo 'Trigerring: SDS++ Linker'
-	cd $(BUILD_DIR) ; $(CPP) -fPIC -Wall -O3 -o $(EXECUTABLE) $(OBJECTS)
+	cd $(BUILD_DIR) ; $(CPP) -fPIC -Wall -O3 -o $(EXECUTABLE) $(OBJECTS) $(LDLIBS)
 	@echo ' '
 
 $(BUILD_DIR)/$(LIBRARY): $(OBJECTS)
 	mkdir -p $(BUILD_DIR)
 	@echo 'Building Target: $@'
 	@echo 'Trigerring: SDS++ Linker'
-	cd $(BUILD_DIR) ; $(CPP) -fPIC -Wall -shared -o $(LIBRARY) $(OBJECTS)
+	cd $(BUILD_DIR) ; $(CPP) -fPIC -Wall -shared -o $(LIBRARY) $(OBJECTS) $(LDLIBS)
 	@echo 'SDx Completed Building Target: $@'
 	mkdir -p ../boards/$(BOARD)/$(NAME)
 	@echo 'Copy shared object...'
@@ -118,6 +154,14 @@ $(pwd)/$(BUILD_DIR)/%.o: $(pwd)/$(SRC_PROJ_DIR)/%.cpp
 	@echo 'Finished building: $<'
 	@echo ' '
 
+$(pwd)/$(BUILD_DIR)/%.o: $(pwd)/$(SRC_KERNEL_DIR)/%.cpp
+	@echo 'Building file: $<'
+	@echo 'Invoking: SDS++ Compiler'
+	mkdir -p $(BUILD_DIR)
+	cd $(BUILD_DIR) ; $(CPP) $(CFLAGS) $(CONFIG_FLAGS) -o $(LFLAGS)
+	@echo 'Finished building: $<'
+	@echo ' '
+
 $(pwd)/$(BUILD_DIR)/%.o: $(pwd)/$(SRC_PROJ_DIR)/%.c
 	@echo 'Building file: $<'
 	@echo 'Invoking: SDSCC Compiler'
@@ -126,7 +170,7 @@ $(pwd)/$(BUILD_DIR)/%.o: $(pwd)/$(SRC_PROJ_DIR)/%.c
 	@echo 'Finished building: $<'
 	@echo ' '
 
-$(pwd)/$(BUILD_DIR)/pynqlib.o: $(pwd)/$(SRC_PYNQLIB_DIR)/pynqlib.c
+$(pwd)/$(BUILD_DIR)/%.o: $(pwd)/$(SRC_PYNQLIB_DIR)/%.c
 	@echo 'Building file: $<'
 	@echo 'Invoking: SDSCC Compiler'
 	mkdir -p $(BUILD_DIR)
@@ -134,5 +178,13 @@ $(pwd)/$(BUILD_DIR)/pynqlib.o: $(pwd)/$(SRC_PYNQLIB_DIR)/pynqlib.c
 	@echo 'Finished building: $<'
 	@echo ' '
 
+$(pwd)/$(BUILD_DIR)/%.o: $(pwd)/$(SRC_FXCONV_DIR)/%.c
+	@echo 'Building file: $<'
+	@echo 'Invoking: SDSCC Compiler'
+	mkdir -p $(BUILD_DIR)
+	cd $(BUILD_DIR) ; $(CC) $(CFLAGS) $(SIMD_FLAGS) -o $(LFLAGS)
+	@echo 'Finished building: $<'
+	@echo ' '
+
 clean:
 	$(RM) $(OBJECTS)
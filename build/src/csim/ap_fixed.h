@@ -0,0 +1,225 @@
+/*  Portable stand-in for the Vivado HLS ap_fixed.h header, for host C-simulation.
+
+    ap_fixed<W,I,Q,O> holds its W-bit two's complement value in V, an ap_int<W>,
+    exactly like the HLS type, so the .V / range() accesses in build/src work
+    unchanged. Arithmetic follows the HLS rules that matter for these kernels:
+
+        - +, -, * are exact (the intermediate is an ap_fixed_wide with enough
+          bits), and quantisation/overflow only happen on assignment back to
+          an ap_fixed
+        - a / b keeps the fractional width of a and truncates towards zero
+        - quantisation modes AP_TRN, AP_TRN_ZERO, AP_RND, AP_RND_ZERO,
+          AP_RND_MIN_INF, AP_RND_INF, AP_RND_CONV and overflow modes AP_WRAP,
+          AP_SAT, AP_SAT_ZERO, AP_SAT_SYM are honoured
+
+    W is limited to 64 bits.
+*/
+
+#ifndef CSIM_AP_FIXED_H
+#define CSIM_AP_FIXED_H
+
+#include <math.h>
+#include <stdint.h>
+#include "ap_int.h"
+
+enum ap_q_mode { AP_RND, AP_RND_ZERO, AP_RND_MIN_INF, AP_RND_INF, AP_RND_CONV,
+                 AP_TRN, AP_TRN_ZERO };
+enum ap_o_mode { AP_SAT, AP_SAT_ZERO, AP_SAT_SYM, AP_WRAP, AP_WRAP_SM };
+
+typedef __int128 ap_wide_t;
+
+/* exact intermediate result: value = raw * 2^-frac */
+struct ap_fixed_wide {
+    ap_wide_t raw;
+    int frac;
+
+    ap_fixed_wide() : raw(0), frac(0) {}
+    ap_fixed_wide(ap_wide_t r, int f) : raw(r), frac(f) {}
+    ap_fixed_wide(int a) : raw(a), frac(0) {}
+    ap_fixed_wide(long a) : raw(a), frac(0) {}
+    ap_fixed_wide(long long a) : raw(a), frac(0) {}
+    ap_fixed_wide(unsigned a) : raw(a), frac(0) {}
+    ap_fixed_wide(double a) : raw((ap_wide_t)ldexp(a, 48)), frac(48) {}
+    ap_fixed_wide(float a) : raw((ap_wide_t)ldexp((double)a, 48)), frac(48) {}
+
+    ap_fixed_wide shifted(int f) const {
+        return ap_fixed_wide(raw << (f - frac), f);
+    }
+
+    double to_double() const { return ldexp((double)raw, -frac); }
+};
+
+static inline void ap_align(ap_fixed_wide &a, ap_fixed_wide &b)
+{
+    if (a.frac < b.frac) a = a.shifted(b.frac);
+    else if (b.frac < a.frac) b = b.shifted(a.frac);
+}
+
+static inline ap_fixed_wide operator+(ap_fixed_wide a, ap_fixed_wide b)
+{
+    ap_align(a, b);
+    return ap_fixed_wide(a.raw + b.raw, a.frac);
+}
+
+static inline ap_fixed_wide operator-(ap_fixed_wide a, ap_fixed_wide b)
+{
+    ap_align(a, b);
+    return ap_fixed_wide(a.raw - b.raw, a.frac);
+}
+
+static inline ap_fixed_wide operator-(ap_fixed_wide a)
+{
+    return ap_fixed_wide(-a.raw, a.frac);
+}
+
+static inline ap_fixed_wide operator*(ap_fixed_wide a, ap_fixed_wide b)
+{
+    return ap_fixed_wide(a.raw * b.raw, a.frac + b.frac);
+}
+
+static inline ap_fixed_wide operator/(ap_fixed_wide a, ap_fixed_wide b)
+{
+    /* quotient keeps the fractional bits of the dividend, truncated to zero */
+    if (b.raw == 0)
+        return ap_fixed_wide(0, a.frac);
+    return ap_fixed_wide((a.raw << b.frac) / b.raw, a.frac);
+}
+
+#define AP_WIDE_CMP(op) \
+static inline bool operator op(ap_fixed_wide a, ap_fixed_wide b) \
+{ \
+    ap_align(a, b); \
+    return a.raw op b.raw; \
+}
+AP_WIDE_CMP(==)
+AP_WIDE_CMP(!=)
+AP_WIDE_CMP(<)
+AP_WIDE_CMP(<=)
+AP_WIDE_CMP(>)
+AP_WIDE_CMP(>=)
+#undef AP_WIDE_CMP
+
+/* number of assignments that overflowed the destination range, whatever
+   the overflow mode; used by the C-simulation harnesses */
+inline unsigned long long &ap_fixed_overflows()
+{
+    static unsigned long long count = 0;
+    return count;
+}
+
+template <int W, int I, ap_q_mode Q = AP_TRN, ap_o_mode O = AP_WRAP, int N = 0>
+struct ap_fixed {
+    ap_int<W> V;
+
+    static const int width = W;
+    static const int iwidth = I;
+    static const int fwidth = W - I;
+
+    /* quantise and overflow an exact value into W bits */
+    void assign(const ap_fixed_wide &a)
+    {
+        const int F = W - I;
+        ap_wide_t r = a.raw;
+        int sh = a.frac - F;
+
+        if (sh > 0) {
+            ap_wide_t one = (ap_wide_t)1 << sh;
+            ap_wide_t half = one >> 1;
+            ap_wide_t fl = r >> sh;                    /* floor */
+            ap_wide_t rem = r - (fl << sh);            /* 0 <= rem < one */
+            bool neg = r < 0;
+            switch (Q) {
+            case AP_TRN:         r = fl; break;
+            case AP_TRN_ZERO:    r = (neg && rem) ? fl + 1 : fl; break;
+            case AP_RND:         r = (rem >= half) ? fl + 1 : fl; break;
+            case AP_RND_MIN_INF: r = (rem > half) ? fl + 1 : fl; break;
+            case AP_RND_ZERO:    r = (rem > half || (rem == half && neg)) ? fl + 1 : fl; break;
+            case AP_RND_INF:     r = (rem > half || (rem == half && !neg)) ? fl + 1 : fl; break;
+            case AP_RND_CONV:    r = (rem > half || (rem == half && (fl & 1))) ? fl + 1 : fl; break;
+            }
+        } else if (sh < 0) {
+            r = r << (-sh);
+        }
+
+        const ap_wide_t maxv = ((ap_wide_t)1 << (W-1)) - 1;
+        const ap_wide_t minv = -((ap_wide_t)1 << (W-1));
+        if (r > maxv || r < minv) {
+            ap_fixed_overflows()++;
+            switch (O) {
+            case AP_SAT:      r = (r > maxv) ? maxv : minv; break;
+            case AP_SAT_SYM:  r = (r > maxv) ? maxv : -maxv; break;
+            case AP_SAT_ZERO: r = 0; break;
+            default:          break;    /* wrap */
+            }
+        }
+        V.set((uint64_t)(int64_t)r);
+    }
+
+    ap_fixed() {}
+    ap_fixed(const ap_fixed_wide &a) { assign(a); }
+    ap_fixed(int a) { assign(ap_fixed_wide(a)); }
+    ap_fixed(unsigned a) { assign(ap_fixed_wide(a)); }
+    ap_fixed(long a) { assign(ap_fixed_wide(a)); }
+    ap_fixed(long long a) { assign(ap_fixed_wide(a)); }
+    ap_fixed(double a) { assign(ap_fixed_wide(a)); }
+    ap_fixed(float a) { assign(ap_fixed_wide(a)); }
+
+    template <int W2, int I2, ap_q_mode Q2, ap_o_mode O2, int N2>
+    ap_fixed(const ap_fixed<W2,I2,Q2,O2,N2> &a) { assign(a.wide()); }
+
+    ap_fixed_wide wide() const { return ap_fixed_wide(V.v, W - I); }
+    operator ap_fixed_wide() const { return wide(); }
+
+    template <typename A> ap_fixed &operator=(const A &a) { assign(ap_fixed_wide(a)); return *this; }
+    template <typename A> ap_fixed &operator+=(const A &a) { assign(wide() + ap_fixed_wide(a)); return *this; }
+    template <typename A> ap_fixed &operator-=(const A &a) { assign(wide() - ap_fixed_wide(a)); return *this; }
+    template <typename A> ap_fixed &operator*=(const A &a) { assign(wide() * ap_fixed_wide(a)); return *this; }
+    template <typename A> ap_fixed &operator/=(const A &a) { assign(wide() / ap_fixed_wide(a)); return *this; }
+
+    double to_double() const { return wide().to_double(); }
+    float to_float() const { return (float)to_double(); }
+    int to_int() const { return (int)(V.v >> (W - I)); }
+    explicit operator double() const { return to_double(); }
+    explicit operator float() const { return to_float(); }
+};
+
+/* mixed ap_fixed / ap_fixed_wide / scalar operands all go through the exact type */
+#define AP_FIXED_BINOP(ret, op) \
+template <int W, int I, ap_q_mode Q, ap_o_mode O, int N, typename B> \
+static inline ret operator op(const ap_fixed<W,I,Q,O,N> &a, const B &b) \
+{ return a.wide() op ap_fixed_wide(b); } \
+template <int W, int I, ap_q_mode Q, ap_o_mode O, int N> \
+static inline ret operator op(const ap_fixed_wide &a, const ap_fixed<W,I,Q,O,N> &b) \
+{ return a op b.wide(); } \
+template <int W, int I, ap_q_mode Q, ap_o_mode O, int N> \
+static inline ret operator op(int a, const ap_fixed<W,I,Q,O,N> &b) \
+{ return ap_fixed_wide(a) op b.wide(); } \
+template <int W, int I, ap_q_mode Q, ap_o_mode O, int N> \
+static inline ret operator op(double a, const ap_fixed<W,I,Q,O,N> &b) \
+{ return ap_fixed_wide(a) op b.wide(); }
+
+AP_FIXED_BINOP(ap_fixed_wide, +)
+AP_FIXED_BINOP(ap_fixed_wide, -)
+AP_FIXED_BINOP(ap_fixed_wide, *)
+AP_FIXED_BINOP(ap_fixed_wide, /)
+AP_FIXED_BINOP(bool, ==)
+AP_FIXED_BINOP(bool, !=)
+AP_FIXED_BINOP(bool, <)
+AP_FIXED_BINOP(bool, <=)
+AP_FIXED_BINOP(bool, >)
+AP_FIXED_BINOP(bool, >=)
+#undef AP_FIXED_BINOP
+
+template <int W, int I, ap_q_mode Q, ap_o_mode O, int N>
+static inline ap_fixed_wide operator-(const ap_fixed<W,I,Q,O,N> &a)
+{
+    return -a.wide();
+}
+
+template <int W, int I, ap_q_mode Q = AP_TRN, ap_o_mode O = AP_WRAP, int N = 0>
+struct ap_ufixed : ap_fixed<W+1, I+1, Q, O, N> {
+    ap_ufixed() {}
+    template <typename A> ap_ufixed(const A &a) : ap_fixed<W+1, I+1, Q, O, N>(a) {}
+};
+
+#endif
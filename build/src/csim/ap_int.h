@@ -0,0 +1,114 @@
+/*  Portable stand-in for the Vivado HLS ap_int.h header, for host C-simulation.
+
+    Only the subset used by build/src is provided: ap_int<W>/ap_uint<W> up to
+    64 bits, integer conversion, and range(hi,lo) get/set. Values are held in
+    a 64-bit integer and masked (ap_uint) or sign-extended (ap_int) to W bits
+    after every assignment, which gives the same wrap-around as hardware.
+*/
+
+#ifndef CSIM_AP_INT_H
+#define CSIM_AP_INT_H
+
+#include <stdint.h>
+
+template <int W, bool S> struct ap_int_base;
+
+/* proxy returned by range(hi,lo) */
+template <int W, bool S>
+struct ap_range_ref {
+    ap_int_base<W,S> *ref;
+    int hi, lo;
+
+    ap_range_ref(ap_int_base<W,S> *r, int h, int l) : ref(r), hi(h), lo(l) {}
+
+    uint64_t mask() const {
+        int n = hi - lo + 1;
+        return (n >= 64) ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+    }
+
+    uint64_t get() const {
+        return ((uint64_t)ref->v >> lo) & mask();
+    }
+
+    operator uint64_t() const { return get(); }
+
+    ap_range_ref &operator=(uint64_t a) {
+        uint64_t m = mask() << lo;
+        ref->set(((uint64_t)ref->v & ~m) | ((a << lo) & m));
+        return *this;
+    }
+
+    ap_range_ref &operator=(const ap_range_ref &a) {
+        return *this = a.get();
+    }
+
+    template <int W2, bool S2>
+    ap_range_ref &operator=(const ap_range_ref<W2,S2> &a) {
+        return *this = a.get();
+    }
+
+    template <int W2, bool S2>
+    ap_range_ref &operator=(const ap_int_base<W2,S2> &a) {
+        return *this = (uint64_t)a.v;
+    }
+};
+
+template <int W, bool S>
+struct ap_int_base {
+    int64_t v;
+
+    void set(uint64_t a) {
+        if (W >= 64) {
+            v = (int64_t)a;
+        } else if (S) {
+            /* sign-extend bit W-1 */
+            uint64_t m = ((uint64_t)1 << W) - 1;
+            a &= m;
+            if (a >> (W-1)) a |= ~m;
+            v = (int64_t)a;
+        } else {
+            v = (int64_t)(a & (((uint64_t)1 << W) - 1));
+        }
+    }
+
+    ap_int_base() : v(0) {}
+    ap_int_base(int a) { set((uint64_t)(int64_t)a); }
+    ap_int_base(unsigned a) { set((uint64_t)a); }
+    ap_int_base(long a) { set((uint64_t)(int64_t)a); }
+    ap_int_base(unsigned long a) { set((uint64_t)a); }
+    ap_int_base(long long a) { set((uint64_t)a); }
+    ap_int_base(unsigned long long a) { set((uint64_t)a); }
+
+    template <int W2, bool S2>
+    ap_int_base(const ap_range_ref<W2,S2> &a) { set(a.get()); }
+
+    template <int W2, bool S2>
+    ap_int_base &operator=(const ap_range_ref<W2,S2> &a) { set(a.get()); return *this; }
+
+    operator long long() const { return v; }
+
+    ap_range_ref<W,S> range(int hi, int lo) { return ap_range_ref<W,S>(this, hi, lo); }
+    ap_range_ref<W,S> range(int hi, int lo) const {
+        return ap_range_ref<W,S>(const_cast<ap_int_base *>(this), hi, lo);
+    }
+    ap_range_ref<W,S> operator()(int hi, int lo) { return range(hi, lo); }
+
+    int length() const { return W; }
+    long long to_int64() const { return v; }
+    int to_int() const { return (int)v; }
+    unsigned to_uint() const { return (unsigned)v; }
+};
+
+template <int W>
+struct ap_int : ap_int_base<W, true> {
+    ap_int() {}
+    template <typename A> ap_int(const A &a) : ap_int_base<W, true>(a) {}
+};
+
+template <int W>
+struct ap_uint : ap_int_base<W, false> {
+    ap_uint() {}
+    template <typename A> ap_uint(const A &a) : ap_int_base<W, false>(a) {}
+};
+
+#endif
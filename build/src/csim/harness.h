@@ -0,0 +1,170 @@
+/*  Host-side helpers shared by the C-simulation harnesses.
+
+    Include after ekf_config.h: conversions use its bit_width/frac_width and
+    port_t. Provides round-to-nearest, saturating conversion between double
+    and port_t words, CSV and trace loaders, a monotonic clock, and error/timing statistics for
+    comparing a kernel against a double-precision reference.
+*/
+
+#ifndef CSIM_HARNESS_H
+#define CSIM_HARNESS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "../trace/trace.h"
+
+/* inputs that did not fit in bit_width bits and were saturated by to_port */
+static inline unsigned long long &port_saturations()
+{
+    static unsigned long long n = 0;
+    return n;
+}
+
+static inline port_t to_port(double a)
+{
+    const long long maxv = (1LL << (bit_width-1)) - 1;
+    long long v = llround(a*(1 << frac_width));
+    if (v > maxv || v < -maxv-1) {
+        port_saturations()++;
+        v = (v > maxv) ? maxv : -maxv-1;
+    }
+    return (uint32_t)v & (uint32_t)((1ULL << bit_width) - 1);
+}
+
+/* sign-extends the bit_width-bit word */
+static inline double from_port(port_t a)
+{
+    int32_t v = (int32_t)((uint32_t)a << (32 - bit_width)) >> (32 - bit_width);
+    return v / (double)(1 << frac_width);
+}
+
+/* monotonic clock in microseconds */
+static inline double now_us()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1e6 + t.tv_nsec*1e-3;
+}
+
+/* Reads a comma separated file of numbers with at least cols columns.
+   A first line that does not start with a number is taken as a header.
+   Returns a malloc'd [rows][cols] array, or NULL if the file is missing. */
+static inline double *read_csv(const char *fname, int cols, int *rows)
+{
+    FILE *fp = fopen(fname, "r");
+    if (fp == NULL)
+        return NULL;
+
+    int cap = 1024, n = 0;
+    double *d = (double *)malloc(cap*cols*sizeof(double));
+    char line[4096];
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line;
+        while (*p == ' ')
+            p++;
+        if (!(isdigit(*p) || *p == '-' || *p == '+' || *p == '.'))
+            continue;
+        if (n == cap) {
+            cap *= 2;
+            d = (double *)realloc(d, cap*cols*sizeof(double));
+        }
+        for (int j=0; j<cols; j++) {
+            d[n*cols + j] = strtod(p, &p);
+            while (*p == ',' || *p == ' ')
+                p++;
+        }
+        n++;
+    }
+
+    fclose(fp);
+    *rows = n;
+    return d;
+}
+
+/* Reads all rows of an EKF trace (src/trace/trace.h) of cols words in the
+   kernel's format, back to double. Same result as read_csv on the CSV the
+   trace was written from, up to the fixed-point rounding. */
+static inline double *read_trace(const char *fname, int cols, int *rows)
+{
+    struct trace tr;
+    if (trace_open(&tr, fname, bit_width, frac_width, cols))
+        return NULL;
+
+    int n = tr.hdr.rows;
+    double *d = (double *)malloc((n ? n : 1)*cols*sizeof(double));
+    port_t *chunk = (port_t *)malloc(256*cols*sizeof(port_t));
+    for (int i=0; i<n; i+=256) {
+        long got = trace_read(&tr, i, 256, chunk);
+        for (long j=0; j<got*cols; j++)
+            d[(long)i*cols + j] = from_port(chunk[j]);
+    }
+    free(chunk);
+    trace_close(&tr);
+    *rows = n;
+    return d;
+}
+
+/* read_trace for a .trc file, read_csv otherwise */
+static inline double *read_rows(const char *fname, int cols, int *rows)
+{
+    size_t len = strlen(fname);
+    if (len > 4 && !strcmp(fname + len - 4, ".trc"))
+        return read_trace(fname, cols, rows);
+    return read_csv(fname, cols, rows);
+}
+
+/* error of a kernel against the reference */
+struct err_stats {
+    double sq, max;
+    long n;
+};
+
+static inline void err_add(struct err_stats *e, double got, double ref)
+{
+    double d = fabs(got - ref);
+    e->sq += d*d;
+    e->max = (d > e->max) ? d : e->max;
+    e->n++;
+}
+
+static inline double err_rms(const struct err_stats *e)
+{
+    return e->n ? sqrt(e->sq/e->n) : 0.0;
+}
+
+/* host time per kernel call */
+struct time_stats {
+    double total, min, max;
+    long n;
+};
+
+static inline void time_add(struct time_stats *t, double us)
+{
+    t->min = (t->n == 0 || us < t->min) ? us : t->min;
+    t->max = (us > t->max) ? us : t->max;
+    t->total += us;
+    t->n++;
+}
+
+/* one summary line; returns 1 if the max error is over tol. ovf counts
+   the kernel's fixed-point overflows plus any input saturated by to_port */
+static inline int report(const char *kernel, const char *data, int steps,
+                         const struct err_stats *e, unsigned long long overflows,
+                         const struct time_stats *t, double tol)
+{
+    int fail = !(e->max <= tol);
+    printf("%-12s %-16s %6d steps  rms %9.3e  max %9.3e  ovf %4llu  "
+           "host us/step %8.2f (min %.2f max %.2f)  %s\n",
+           kernel, data, steps, err_rms(e), e->max, overflows + port_saturations(),
+           t->total/t->n, t->min, t->max, fail ? "FAIL" : "PASS");
+    return fail;
+}
+
+#endif
@@ -0,0 +1,29 @@
+/*  Portable stand-in for the Vivado HLS hls_math.h header, for host C-simulation.
+
+    hls::sqrt of an ap_fixed is evaluated in double precision and truncated
+    back into the argument type, which is what the HLS fixed-point square
+    root returns for the value ranges used here.
+*/
+
+#ifndef CSIM_HLS_MATH_H
+#define CSIM_HLS_MATH_H
+
+#include <math.h>
+#include "ap_fixed.h"
+
+namespace hls {
+
+template <int W, int I, ap_q_mode Q, ap_o_mode O, int N>
+ap_fixed<W,I,Q,O,N> sqrt(const ap_fixed<W,I,Q,O,N> &a)
+{
+    double d = a.to_double();
+    ap_fixed<W,I,AP_TRN,AP_WRAP,N> r = (d > 0) ? ::sqrt(d) : 0.0;
+    return ap_fixed<W,I,Q,O,N>(r);
+}
+
+static inline float sqrt(float a) { return ::sqrtf(a); }
+static inline double sqrt(double a) { return ::sqrt(a); }
+
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*  Double-precision process/measurement models of the bundled examples,
+    used both to drive the hybrid kernels (after conversion to port_t, as the
+    drivers do) and as the reference filter of the C-simulation harnesses.
+
+        gps_model:   You Chong's GPS example, 8 states and 4 pseudoranges,
+                     the same f/h as model() in src/gps and src/n8m4
+        light_model: light sensor fusion, 2 states and 2 sensors,
+                     the same f/h as Light_EKF in ekf/light_ekf.py
+        cv_model:    constant velocity tracking of n/2 axes with m linear
+                     sensors, for sizes without a bundled dataset
+        rw_model:    the same sensors on a random walk, F = I
+
+    F and H are row-major, fully written by each call.
+*/
+
+#ifndef CSIM_MODELS_H
+#define CSIM_MODELS_H
+
+#include <math.h>
+#include <string.h>
+
+/* initial state and noise of the GPS example, see params.dat */
+static const double gps_x0[8] = {0.2574, 0.3, -0.908482, -0.1, -0.378503, 0.3, 0.02, 0.0};
+static const double gps_pval = 0.5, gps_qval = 0.1, gps_rval = 20.0;
+
+/* sv[4*3]: satellite positions of this epoch */
+static inline void gps_model(const double x[8], const double sv[12], double fx[8],
+                             double hx[4], double F[8*8], double H[4*8])
+{
+    memset(F, 0, 8*8*sizeof(double));
+    memset(H, 0, 4*8*sizeof(double));
+
+    for (int j=0; j<8; j+=2) {
+        fx[j] = x[j] + x[j+1];
+        fx[j+1] = x[j+1];
+        F[j*8 + j] = 1;
+        F[j*8 + j+1] = 1;
+        F[(j+1)*8 + j+1] = 1;
+    }
+
+    for (int i=0; i<4; i++) {
+        double dx[3], d2 = 0;
+        for (int j=0; j<3; j++) {
+            dx[j] = fx[j*2] - sv[i*3 + j];
+            d2 += dx[j]*dx[j];
+        }
+        hx[i] = sqrt(d2) + fx[6];
+        for (int j=0; j<3; j++)
+            H[i*8 + j*2] = dx[j]/hx[i];
+        H[i*8 + 6] = 1;
+    }
+}
+
+static const double light_x0[2] = {6.0, 0.1};
+static const double light_pval = 0.01, light_qval = 0.01;
+static const double light_rval[2] = {0.1, 1.0};
+
+static inline void light_model(const double x[2], double fx[2], double hx[2],
+                               double F[2*2], double H[2*2])
+{
+    fx[0] = x[0] + x[1];
+    fx[1] = x[1];
+    hx[0] = fx[0];
+    hx[1] = fx[0];
+
+    F[0] = 1; F[1] = 1;
+    F[2] = 0; F[3] = 1;
+    H[0] = 1; H[1] = 0;
+    H[2] = 1; H[3] = 0;
+}
+
+/* sensor i averages the positions of the axes k with k % m == i */
+static inline void cv_model(int n, int m, const double *x, double *fx, double *hx,
+                            double *F, double *H)
+{
+    memset(F, 0, n*n*sizeof(double));
+    memset(H, 0, m*n*sizeof(double));
+
+    for (int j=0; j<n; j+=2) {
+        fx[j] = x[j] + x[j+1];
+        fx[j+1] = x[j+1];
+        F[j*n + j] = 1;
+        F[j*n + j+1] = 1;
+        F[(j+1)*n + j+1] = 1;
+    }
+
+    int axes = n/2;
+    for (int i=0; i<m; i++) {
+        int cnt = 0;
+        for (int k=i; k<axes; k+=m)
+            cnt++;
+        hx[i] = 0;
+        for (int k=i; k<axes; k+=m) {
+            H[i*n + 2*k] = 1.0/cnt;
+            hx[i] += fx[2*k]/cnt;
+        }
+    }
+}
+
+static inline void rw_model(int n, int m, const double *x, double *fx, double *hx,
+                            double *F, double *H)
+{
+    cv_model(n, m, x, fx, hx, F, H);
+    memset(F, 0, n*n*sizeof(double));
+
+    for (int j=0; j<n; j++) {
+        fx[j] = x[j];
+        F[j*n + j] = 1;
+    }
+    for (int i=0; i<m; i++) {
+        hx[i] = 0;
+        for (int j=0; j<n; j++)
+            hx[i] += H[i*n + j]*fx[j];
+    }
+}
+
+#endif
@@ -0,0 +1,418 @@
+/*  replay: C-simulation regression harness for the hybrid HW-SW kernels
+    (src/n2m2, src/n8m4, src/n72m8).
+
+    Replays a trajectory through top_ekf step by step, the way the drivers
+    do: the model is evaluated on the host in double from the previous
+    kernel output and sent as fx/hx/F/H. The same trajectory is run through
+    a double-precision Ekf<Nsta, Mobs> (utils/tiny-ekf/tiny_ekf.hpp) and
+    every state of every step is compared.
+
+    Build with the kernel's directory on the include path and one of
+        -DREPLAY_GPS    gps_data.csv, needs Nsta=8, Mobs=4
+        -DREPLAY_LIGHT  light_data.csv, needs Nsta=2, Mobs=2
+        (neither)       synthetic constant velocity run of REPLAY_STEPS
+                        steps (default 50), any even Nsta; a random walk
+                        model if F_STRUCT is FS_IDENTITY
+
+    With -DREPLAY_MASK the steps after the first few each leave one
+    measurement out in turn, through the observation mask of ctrl, and
+    every 7th has none, which Ekf<> runs with the same mask.
+
+    With -DSTEADY_GAIN=1 the gain must settle in the first run, at least
+    one step being run with a frozen K (unless -DREPLAY_MASK keeps thawing
+    it), and the trajectory is then run again from an init, which must
+    thaw the gain and give the same words.
+
+    With -DREPLAY_TRAJ (and src/hybrid/ekf_traj.cpp, src/fxconv/fxconv.c),
+    the trajectory is then run again in one ekf_run_trajectory() call, with
+    the built-in model for gps/light data and the above through
+    ekf_set_model() otherwise, and must give the same words; a ctx out of
+    range or a ctrl with CTRL_SAVE must be refused with -1.
+
+    The steps of the first run ask for the health word (CTRL_HEALTH), whose
+    counters are summed and its NIS averaged over the steps that form one.
+
+    usage: replay [data.csv|data.trc] [max abs error]
+    Exits non-zero if the max error is over the tolerance, if any step
+    does not return EKF_OK or if one leaves a diagonal entry of P that is
+    not positive.
+*/
+
+/* before ekf_config.h, whose Nsta/Mobs macros clash with its template
+   parameter names */
+#include "tiny_ekf.hpp"
+
+#include "sds_lib.h"
+#include "ekf_config.h"
+#include "harness.h"
+#include "models.h"
+#ifdef REPLAY_TRAJ
+#include "ekf_traj.h"
+#endif
+
+#define PARAMS_IN ((2*Nsta*Nsta)+(Mobs*Mobs))
+
+#if defined(REPLAY_GPS)
+#define REPLAY_NAME "gps_data.csv"
+#define REPLAY_COLS 16
+#define REPLAY_TOL 2e-3
+#elif defined(REPLAY_LIGHT)
+#define REPLAY_NAME "light_data.csv"
+#define REPLAY_COLS 2
+#define REPLAY_TOL 1e-4
+#else
+#define REPLAY_NAME "synthetic"
+#define REPLAY_COLS Mobs
+#ifndef REPLAY_STEPS
+#define REPLAY_STEPS 50
+#endif
+#define REPLAY_TOL 2e-3
+#endif
+
+#define STR(a) #a
+#define XSTR(a) STR(a)
+#if (F_STRUCT == FS_CV)
+#define FS_NAME "/cv"
+#elif (F_STRUCT == FS_IDENTITY)
+#define FS_NAME "/id"
+#else
+#define FS_NAME ""
+#endif
+#if (SEQ_UPDATE == 1)
+#define UPD_NAME "/seq"
+#else
+#define UPD_NAME ""
+#endif
+#if (H_SPARSE == 1)
+#define HS_NAME "/hs"
+#else
+#define HS_NAME ""
+#endif
+#if (SQRT_COV == 1)
+#define SRF_NAME "/srf"
+#else
+#define SRF_NAME ""
+#endif
+#if (bit_width != 32)
+#define W_NAME "/w" XSTR(bit_width)
+#else
+#define W_NAME ""
+#endif
+#if (STEADY_GAIN == 1)
+#define SS_NAME "/ss"
+#else
+#define SS_NAME ""
+#endif
+#ifdef REPLAY_MASK
+#define MASK_NAME "/mask"
+#else
+#define MASK_NAME ""
+#endif
+#ifdef REPLAY_TRAJ
+#define TRAJ_NAME "/traj"
+#else
+#define TRAJ_NAME ""
+#endif
+#define KERNEL_NAME "n" XSTR(Nsta) "m" XSTR(Mobs) FS_NAME HS_NAME UPD_NAME SRF_NAME SS_NAME MASK_NAME W_NAME TRAJ_NAME
+
+static double x0[Nsta], pval[Nsta], qval[Nsta], rval[Mobs];
+
+/* kernel buffers */
+static port_t *obs, *fx_i, *hx_i, *F_i, *H_i, *params, *xout, *state;
+
+/* data: one row per step, model inputs then the Mobs measurements */
+static double *load(const char *fname, int *steps)
+{
+#if defined(REPLAY_GPS)
+    for (int i=0; i<Nsta; i++) {
+        x0[i] = gps_x0[i];
+        pval[i] = gps_pval;
+        qval[i] = gps_qval;
+    }
+    for (int i=0; i<Mobs; i++)
+        rval[i] = gps_rval;
+    return read_rows(fname, REPLAY_COLS, steps);
+#elif defined(REPLAY_LIGHT)
+    for (int i=0; i<Nsta; i++) {
+        x0[i] = light_x0[i];
+        pval[i] = light_pval;
+        qval[i] = light_qval;
+    }
+    for (int i=0; i<Mobs; i++)
+        rval[i] = light_rval[i];
+    return read_rows(fname, REPLAY_COLS, steps);
+#else
+    /* truth moves at a constant velocity per axis, measured with noise */
+    uint32_t seed = 1;
+    double truth[Nsta], fx[Nsta], F[Nsta*Nsta], H[Mobs*Nsta];
+    double *d = (double *)malloc(REPLAY_STEPS*Mobs*sizeof(double));
+
+    for (int i=0; i<Nsta; i+=2) {
+        seed = seed*1664525 + 1013904223;
+        truth[i] = (double)(seed >> 8)/(1 << 24) - 0.5;
+        seed = seed*1664525 + 1013904223;
+        truth[i+1] = 0.1*((double)(seed >> 8)/(1 << 24) - 0.5);
+    }
+    for (int i=0; i<Nsta; i++) {
+        x0[i] = 0;
+        pval[i] = 0.5;
+        qval[i] = 0.001;
+    }
+    for (int i=0; i<Mobs; i++)
+        rval[i] = 1.0;
+
+    for (int s=0; s<REPLAY_STEPS; s++) {
+        cv_model(Nsta, Mobs, truth, fx, &d[s*Mobs], F, H);
+        memcpy(truth, fx, sizeof(truth));
+        for (int i=0; i<Mobs; i++) {
+            seed = seed*1664525 + 1013904223;
+            d[s*Mobs + i] += 0.5*((double)(seed >> 8)/(1 << 24) - 0.5);
+        }
+    }
+    *steps = REPLAY_STEPS;
+    return d;
+#endif
+}
+
+static void model(const double *row, const double *x, double *fx, double *hx,
+                  double *F, double *H)
+{
+#if defined(REPLAY_GPS)
+    gps_model(x, row, fx, hx, F, H);
+#elif defined(REPLAY_LIGHT)
+    light_model(x, fx, hx, F, H);
+#elif (F_STRUCT == FS_IDENTITY)
+    rw_model(Nsta, Mobs, x, fx, hx, F, H);
+#else
+    cv_model(Nsta, Mobs, x, fx, hx, F, H);
+#endif
+}
+
+#define ALL_OBS ((1u << Mobs) - 1)
+
+/* the measurements present at step s */
+static unsigned step_mask(int s)
+{
+#ifdef REPLAY_MASK
+    if (s < 4)
+        return ALL_OBS;
+    if (s % 7 == 0)
+        return 0;
+    return ALL_OBS & ~(1u << (s % Mobs));
+#else
+    return ALL_OBS;
+#endif
+}
+
+/* one step of the kernel on row, its model evaluated at x, which gets the
+   output; the output words are left in xout */
+static int kernel_step(const double *row, double *x, int ctrl, unsigned mask)
+{
+    double fx[Nsta], hx[Mobs], F[Nsta*Nsta], H[Mobs*Nsta];
+    const double *z = row + REPLAY_COLS - Mobs;
+
+    model(row, x, fx, hx, F, H);
+    for (int i=0; i<Nsta; i++)
+        fx_i[i] = to_port(fx[i]);
+    for (int i=0; i<Mobs; i++) {
+        hx_i[i] = to_port(hx[i]);
+        obs[i] = to_port(z[i]);
+    }
+    for (int i=0; i<Nsta*Nsta; i++)
+        F_i[i] = to_port(F[i]);
+    // the NHC columns of H the kernel reads, packed, of the present rows
+    int w2 = 0;
+    for (int i=0; i<Mobs; i++) {
+        if (!((mask >> i) & 1))
+            continue;
+        for (int k=0; k<NHC; k++)
+            H_i[w2*NHC + k] = to_port(H[i*Nsta + HCOL(k)]);
+        w2++;
+    }
+    if (mask != ALL_OBS)
+        ctrl |= CTRL_OBS(mask);
+
+    int status = top_ekf(obs, fx_i, hx_i, F_i, H_i, params, xout, state, state,
+                         ctrl, 0, Nsta, w2, 0, 0);
+    for (int i=0; i<Nsta; i++)
+        x[i] = from_port(xout[i]);
+    return status;
+}
+
+#ifdef REPLAY_TRAJ
+static void user_model(const double *x, const double *row, double *fx, double *hx,
+                       double *F, double *H, void *)
+{
+    model(row, x, fx, hx, F, H);
+}
+#endif
+
+int main(int argc, char ** argv)
+{
+    const char *fname = (argc > 1) ? argv[1] : REPLAY_NAME;
+    double tol = (argc > 2) ? atof(argv[2]) : REPLAY_TOL;
+    int steps;
+
+    double *data = load(fname, &steps);
+    if (data == NULL) {
+        fprintf(stderr, "replay: cannot read %s\n", fname);
+        return 2;
+    }
+
+    obs = (port_t *)sds_alloc(Mobs*sizeof(port_t));
+    fx_i = (port_t *)sds_alloc(Nsta*sizeof(port_t));
+    hx_i = (port_t *)sds_alloc(Mobs*sizeof(port_t));
+    F_i = (port_t *)sds_alloc(Nsta*Nsta*sizeof(port_t));
+    H_i = (port_t *)sds_alloc(Mobs*Nsta*sizeof(port_t));
+    params = (port_t *)sds_alloc(PARAMS_IN*sizeof(port_t));
+    xout = (port_t *)sds_alloc(Nsta*sizeof(port_t));
+    state = (port_t *)sds_alloc(NSAVE*sizeof(port_t));
+
+    /* params: P, Q, R, or their factors with SQRT_COV, all diagonal here */
+    for (int i=0; i<PARAMS_IN; i++)
+        params[i] = 0;
+    for (int i=0; i<Nsta; i++) {
+        params[i*Nsta + i] = to_port(SQRT_COV ? sqrt(pval[i]) : pval[i]);
+        params[Nsta*Nsta + i*Nsta + i] = to_port(SQRT_COV ? sqrt(qval[i]) : qval[i]);
+    }
+    for (int i=0; i<Mobs; i++)
+        params[2*Nsta*Nsta + i*Mobs + i] = to_port(SQRT_COV ? sqrt(rval[i]) : rval[i]);
+
+    tinyekf::Ekf<Nsta, Mobs, double> *ref = new tinyekf::Ekf<Nsta, Mobs, double>();
+    for (int i=0; i<Nsta; i++) {
+        ref->x[i] = x0[i];
+        ref->P[i][i] = pval[i];
+        ref->Q[i][i] = qval[i];
+    }
+    for (int i=0; i<Mobs; i++)
+        ref->R[i][i] = rval[i];
+
+    double x[Nsta], fx[Nsta], hx[Mobs], F[Nsta*Nsta], H[Mobs*Nsta];
+    memcpy(x, x0, sizeof(x));
+    port_t *words = (port_t *)malloc(steps*Nsta*sizeof(port_t));
+
+    struct err_stats err = {0, 0, 0};
+    struct time_stats tm = {0, 0, 0, 0};
+    int notpd = 0;
+    long hl_range = 0, hl_pivot = 0, hl_negp = 0, hl_nis = 0, hl_n = 0;
+    ap_fixed_overflows() = 0;
+    ekf_frozen = 0;
+
+    for (int s=0; s<steps; s++) {
+        const double *row = &data[s*REPLAY_COLS];
+        const double *z = row + REPLAY_COLS - Mobs;
+
+        // kernel, driven from its own previous output
+        double t0 = now_us();
+        int hw = kernel_step(row, x, ((s == 0) ? 0 : CTRL_KEEP) | CTRL_HEALTH, step_mask(s));
+        time_add(&tm, now_us() - t0);
+        if (HL_STATUS(hw) != EKF_OK)
+            notpd++;
+        hl_range += HL_RANGE(hw);
+        hl_pivot += HL_PIVOT(hw);
+        hl_negp += HL_NEGP(hw);
+        if (HL_NIS(hw) != 0) {
+            hl_nis += HL_NIS(hw);
+            hl_n++;
+        }
+
+        for (int i=0; i<Nsta; i++)
+            words[s*Nsta + i] = xout[i];
+
+        // reference
+        model(row, ref->x, fx, hx, F, H);
+        for (int i=0; i<Nsta; i++) {
+            ref->fx[i] = fx[i];
+            for (int j=0; j<Nsta; j++)
+                ref->F[i][j] = F[i*Nsta + j];
+        }
+        for (int i=0; i<Mobs; i++) {
+            ref->hx[i] = hx[i];
+            for (int j=0; j<Nsta; j++)
+                ref->H[i][j] = H[i*Nsta + j];
+        }
+        ref->step(z, step_mask(s));
+
+        for (int i=0; i<Nsta; i++)
+            err_add(&err, x[i], ref->x[i]);
+    }
+
+    const char *base = strrchr(fname, '/');
+    int fail = report(KERNEL_NAME, base ? base + 1 : fname, steps, &err,
+                      ap_fixed_overflows(), &tm, tol);
+    if (notpd) {
+        printf("%-12s %d steps not positive definite  FAIL\n", "", notpd);
+        fail = 1;
+    }
+    printf("%-12s health: mean NIS/m %.2f, %ld range, %ld pivot, %ld negative P  %s\n",
+           "", hl_n ? hl_nis/16.0/hl_n : 0.0, hl_range, hl_pivot, hl_negp,
+           hl_negp ? "FAIL" : "PASS");
+    fail |= (hl_negp != 0);
+
+#if (STEADY_GAIN == 1)
+    long frozen = ekf_frozen;
+#ifdef REPLAY_MASK
+    int frozen_fail = 0;
+#else
+    int frozen_fail = (frozen == 0);
+#endif
+    printf("%-12s steady gain: %ld of %d steps frozen  %s\n", "", frozen, steps,
+           frozen_fail ? "FAIL" : "PASS");
+    fail |= frozen_fail;
+
+    int rediff = 0;
+    memcpy(x, x0, sizeof(x));
+    for (int s=0; s<steps; s++) {
+        kernel_step(&data[s*REPLAY_COLS], x, (s == 0) ? 0 : CTRL_KEEP, step_mask(s));
+        for (int i=0; i<Nsta; i++)
+            rediff += (xout[i] != words[s*Nsta + i]);
+    }
+    printf("%-12s run again from init: %d words differ  %s\n", "", rediff,
+           rediff ? "FAIL" : "PASS");
+    fail |= (rediff != 0);
+#endif
+
+#ifdef REPLAY_TRAJ
+#if defined(REPLAY_GPS)
+    int traj_model = EKF_MODEL_GPS;
+#elif defined(REPLAY_LIGHT)
+    int traj_model = EKF_MODEL_LIGHT;
+#else
+    int traj_model = EKF_MODEL_USER;
+    ekf_set_model(user_model, NULL);
+#endif
+    port_t *out = (port_t *)sds_alloc(steps*Nsta*sizeof(port_t));
+    double t0 = now_us();
+    long fails = ekf_run_trajectory(data, steps, REPLAY_COLS, traj_model, x0,
+                                    params, out, 0, 0, NULL);
+    double us = now_us() - t0;
+    int diff = 0;
+    for (int i=0; i<steps*Nsta; i++)
+        diff += (out[i] != words[i]);
+    // refused up front rather than dropped step by step
+    long bad_ctx = ekf_run_trajectory(data, steps, REPLAY_COLS, traj_model, x0,
+                                      params, out, 0, NCTX, NULL);
+    long bad_ctrl = ekf_run_trajectory(data, steps, REPLAY_COLS, traj_model, x0,
+                                       params, out, CTRL_SAVE, 0, NULL);
+    int traj_fail = (fails != notpd) || diff || bad_ctx != -1 || bad_ctrl != -1;
+    printf("%-12s trajectory: %d words differ, %ld not PD, bad ctx %ld, "
+           "bad ctrl %ld  host us/step %8.2f  %s\n", "", diff, fails, bad_ctx,
+           bad_ctrl, us/steps, traj_fail ? "FAIL" : "PASS");
+    fail |= traj_fail;
+    sds_free(out);
+#endif
+
+    delete ref;
+    free(data);
+    free(words);
+    sds_free(obs);
+    sds_free(fx_i);
+    sds_free(hx_i);
+    sds_free(F_i);
+    sds_free(H_i);
+    sds_free(params);
+    sds_free(xout);
+    sds_free(state);
+
+    return fail;
+}
@@ -0,0 +1,147 @@
+/*  replay_gps: C-simulation regression harness for the HW-only GPS kernel
+    (src/gps).
+
+    Sends the whole gps_data.csv trajectory to top_ekf in one call, as
+    src/gps/main.cpp does, and compares the returned positions and final P
+    against a double-precision Ekf<8, 4> (utils/tiny-ekf/tiny_ekf.hpp)
+    running the same model. Built with NSTREAM > 1, every stream gets the
+    same data from a different initial position, and each is checked
+    against its own reference.
+
+    usage: replay_gps [gps_data.csv|gps_data.trc] [max abs error]
+    Exits non-zero if the max error is over the tolerance.
+*/
+
+/* before ekf_config.h, whose Nsta/Mobs macros clash with its template
+   parameter names */
+#include "tiny_ekf.hpp"
+
+#include "sds_lib.h"
+#include "ekf_config.h"
+#include "harness.h"
+#include "models.h"
+
+#define COLS (Nsats*(Nxyz+1))
+
+#define STR(a) #a
+#define XSTR(a) STR(a)
+#if (NSTREAM > 1)
+#define KERNEL_NAME "gps/k" XSTR(NSTREAM)
+#else
+#define KERNEL_NAME "gps"
+#endif
+
+/* initial state of stream s */
+static void stream_x0(int s, double x0[Nsta])
+{
+    for (int i=0; i<Nsta; i++)
+        x0[i] = gps_x0[i];
+    for (int k=0; k<Nxyz; k++)
+        x0[2*k] += 0.05*s;
+}
+
+
+int main(int argc, char ** argv)
+{
+    const char *fname = (argc > 1) ? argv[1] : "gps_data.csv";
+    double tol = (argc > 2) ? atof(argv[2]) : 2e-3;
+    int datalen;
+
+    double *data = read_rows(fname, COLS, &datalen);
+    if (data == NULL) {
+        fprintf(stderr, "replay_gps: cannot read %s\n", fname);
+        return 2;
+    }
+
+    port_t *xin = (port_t *)sds_alloc(datalen*NSTREAM*COLS*sizeof(port_t));
+    port_t *params = (port_t *)sds_alloc(NSTREAM*NPARAMS*sizeof(port_t));
+    port_t *output = (port_t *)sds_alloc(datalen*NSTREAM*Nxyz*sizeof(port_t));
+    port_t *pout = (port_t *)sds_alloc(NSTREAM*Nsta*Nsta*sizeof(port_t));
+
+    /* row i*NSTREAM + s is step i of stream s */
+    for (int i=0; i<datalen; i++)
+        for (int s=0; s<NSTREAM; s++)
+            for (int j=0; j<COLS; j++)
+                xin[(i*NSTREAM + s)*COLS + j] = to_port(data[i*COLS + j]);
+
+    /* params: x, fx, hx, F, H, P, qval, rval (see init() in top_ekf.cpp) */
+    double x0[Nsta], fx[Nsta], hx[Mobs], F[Nsta*Nsta], H[Mobs*Nsta];
+    gps_model(gps_x0, data, fx, hx, F, H);
+    for (int i=0; i<NSTREAM*NPARAMS; i++)
+        params[i] = 0;
+    for (int s=0; s<NSTREAM; s++) {
+        int offset = s*NPARAMS;
+        stream_x0(s, x0);
+        for (int i=0; i<Nsta; i++)
+            params[offset + i] = to_port(x0[i]);
+        offset += 2*Nsta + Mobs;            /* fx, hx are recomputed by the kernel */
+        for (int i=0; i<Nsta*Nsta; i++)
+            params[offset + i] = to_port(F[i]);
+        offset += Nsta*Nsta + Mobs*Nsta;    /* H too */
+        for (int i=0; i<Nsta; i++)
+            params[offset + i*Nsta + i] = to_port(gps_pval);
+        offset += Nsta*Nsta;
+        params[offset] = to_port(gps_qval);
+        params[offset + 1] = to_port(gps_rval);
+    }
+
+    struct time_stats tm = {0, 0, 0, 0};
+    ap_fixed_overflows() = 0;
+
+    double t0 = now_us();
+    top_ekf(xin, params, output, pout, datalen);
+    time_add(&tm, (now_us() - t0)/(datalen*NSTREAM));
+
+    // reference, one per stream
+    struct err_stats err = {0, 0, 0};
+    struct err_stats perr = {0, 0, 0};
+    for (int s=0; s<NSTREAM; s++) {
+        tinyekf::Ekf<Nsta, Mobs, double> *ref = new tinyekf::Ekf<Nsta, Mobs, double>();
+        stream_x0(s, x0);
+        for (int i=0; i<Nsta; i++) {
+            ref->x[i] = x0[i];
+            ref->P[i][i] = gps_pval;
+            ref->Q[i][i] = gps_qval;
+        }
+        for (int i=0; i<Mobs; i++)
+            ref->R[i][i] = gps_rval;
+
+        for (int i=0; i<datalen; i++) {
+            const double *row = &data[i*COLS];
+            gps_model(ref->x, row, fx, hx, F, H);
+            for (int k=0; k<Nsta; k++) {
+                ref->fx[k] = fx[k];
+                for (int j=0; j<Nsta; j++)
+                    ref->F[k][j] = F[k*Nsta + j];
+            }
+            for (int k=0; k<Mobs; k++) {
+                ref->hx[k] = hx[k];
+                for (int j=0; j<Nsta; j++)
+                    ref->H[k][j] = H[k*Nsta + j];
+            }
+            ref->step(row + Nsats*Nxyz);
+
+            for (int k=0; k<Nxyz; k++)
+                err_add(&err, from_port(output[(i*NSTREAM + s)*Nxyz + k]), ref->x[2*k]);
+        }
+
+        for (int i=0; i<Nsta; i++)
+            for (int j=0; j<Nsta; j++)
+                err_add(&perr, from_port(pout[(s*Nsta + i)*Nsta + j]), ref->P[i][j]);
+        delete ref;
+    }
+
+    const char *base = strrchr(fname, '/');
+    int fail = report(KERNEL_NAME, base ? base + 1 : fname, datalen*NSTREAM, &err,
+                      ap_fixed_overflows(), &tm, tol);
+    printf("%-12s %-16s %6s        final P rms %9.3e  max %9.3e\n", "", "", "",
+           err_rms(&perr), perr.max);
+
+    free(data);
+    sds_free(xin);
+    sds_free(params);
+    sds_free(output);
+    sds_free(pout);
+
+    return fail;
+}
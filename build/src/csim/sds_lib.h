@@ -0,0 +1,25 @@
+/*  Portable stand-in for the SDSoC sds_lib.h header, for host C-simulation.
+
+    Contiguous-memory allocation falls back to aligned malloc; there is no
+    cache to manage on the host.
+*/
+
+#ifndef CSIM_SDS_LIB_H
+#define CSIM_SDS_LIB_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+static inline void *sds_alloc(size_t size)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, 64, size ? size : 64))
+        return NULL;
+    return p;
+}
+
+static inline void *sds_alloc_cacheable(size_t size) { return sds_alloc(size); }
+static inline void *sds_alloc_non_cacheable(size_t size) { return sds_alloc(size); }
+static inline void sds_free(void *p) { free(p); }
+
+#endif
@@ -0,0 +1,66 @@
+#!/bin/sh
+#  sweep.sh: C-simulation precision sweep of the EKF kernels.
+#
+#  Rebuilds the replay harnesses for every data_t format and mode given
+#  below and runs them: gps and n8m4 on gps_data.csv, n2m2 on
+#  light_data.csv, n8m4 on a long synthetic run and n72m8 on the default
+#  50-step one (36 axes seen by 8 sensors are not observable, so its P
+#  grows without bound on long runs whatever the format), and the n2m2 and
+#  n8m4 runs again with the square-root covariance (SQRT_COV=1, "/srf"),
+#  whose factors need about half the integer bits of P. Each line reports
+#  the RMS/max state error against double precision and the overflow count
+#  (kernel overflows plus saturated inputs); PASS/FAIL is against the same
+#  tolerance as `make csim`. The header of each format gives the width of
+#  its multipliers and an estimate of the DSP48 slices per multiplier
+#  (25x18 signed), ceil(W/25)*ceil(W/18).
+#
+#  Run from build/ through `make sweep`, which passes CXX, CSIM_FLAGS and
+#  CSIM_DATA. Override the sweep with:
+#      CONFIGS  "bit_width:frac_width ..."    (default below)
+#      MODES    "quantisation:overflow ..."   (default AP_TRN:AP_WRAP AP_RND:AP_SAT)
+#      STEPS    steps of the synthetic run    (default 500)
+#
+#  The gps kernel evaluates its measurement model on chip, and the squared
+#  satellite ranges of gps_data.csv need 11 integer bits. Only the kernels
+#  see the new format; params.dat and the Python drivers still assume 20
+#  fractional bits.
+
+CXX=${CXX:-g++}
+CSIM_DATA=${CSIM_DATA:-../boards/Pynq-Z1/notebooks/ekf/data}
+CONFIGS=${CONFIGS:-"32:20 28:18 24:16 24:14 20:12 18:12 18:11 18:10 16:10"}
+MODES=${MODES:-"AP_TRN:AP_WRAP AP_RND:AP_SAT"}
+STEPS=${STEPS:-500}
+OUT=csim/sweep
+
+mkdir -p $OUT
+
+# run <kernel> <flags> <harness> [data]
+run() {
+    bin=$OUT/$1
+    src=src/$1
+    [ -f $src/ekf.cpp ] || src=src/hybrid
+    $CXX $CSIM_FLAGS -Isrc/$1 $2 $FMT -o $bin $3 $src/top_ekf.cpp $src/ekf.cpp || exit 1
+    $bin $4
+}
+
+for cfg in $CONFIGS; do
+    w=${cfg%:*}
+    f=${cfg#*:}
+    dsp=$(( ((w+24)/25) * ((w+17)/18) ))
+    for mode in $MODES; do
+        q=${mode%:*}
+        o=${mode#*:}
+        FMT="-Dbit_width=$w -Dfrac_width=$f -DDATA_Q=$q -DDATA_O=$o"
+        echo "== ap_fixed<$w,$((w-f)),$q,$o>  multipliers ${w}x${w}, ~$dsp DSP48 each"
+        run gps "-DP_ENABLE=0" src/csim/replay_gps.cpp $CSIM_DATA/gps_data.csv
+        run n2m2 "-DP_ENABLE=1 -DREPLAY_LIGHT" src/csim/replay.cpp $CSIM_DATA/light_data.csv
+        run n8m4 "-DP_ENABLE=1 -DREPLAY_GPS" src/csim/replay.cpp $CSIM_DATA/gps_data.csv
+        run n8m4 "-DP_ENABLE=1 -DREPLAY_STEPS=$STEPS" src/csim/replay.cpp
+        run n72m8 "-DP_ENABLE=1" src/csim/replay.cpp
+        run n2m2 "-DP_ENABLE=1 -DREPLAY_LIGHT -DSQRT_COV=1" src/csim/replay.cpp $CSIM_DATA/light_data.csv
+        run n8m4 "-DP_ENABLE=1 -DREPLAY_GPS -DSQRT_COV=1" src/csim/replay.cpp $CSIM_DATA/gps_data.csv
+        run n8m4 "-DP_ENABLE=1 -DREPLAY_STEPS=$STEPS -DSQRT_COV=1" src/csim/replay.cpp
+    done
+done
+
+exit 0
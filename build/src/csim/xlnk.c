@@ -0,0 +1,27 @@
+/*  Portable stand-in for the xlnk cache functions, for host C-simulation
+    of the P_CACHEABLE=2 drivers (src/hybrid/ekf_block.h).
+
+    A physical address is the virtual one, and there is no cache: the
+    operations are only counted, so that a test can check that every
+    kernel call came with its flush and invalidate.
+*/
+
+#include "xlnk.h"
+
+long xlnk_flushes;
+long xlnk_invalidates;
+
+unsigned long xlnkGetBufPhyAddr(void *buf)
+{
+    return (unsigned long)buf;
+}
+
+void cma_flush_cache(void *buf, unsigned int phys_addr, int size)
+{
+    xlnk_flushes++;
+}
+
+void cma_invalidate_cache(void *buf, unsigned int phys_addr, int size)
+{
+    xlnk_invalidates++;
+}
@@ -0,0 +1,14 @@
+/*  Counters of the xlnk stand-in (xlnk.c), for host C-simulation. */
+
+#ifndef CSIM_XLNK_H
+#define CSIM_XLNK_H
+
+unsigned long xlnkGetBufPhyAddr(void *buf);
+void cma_flush_cache(void *buf, unsigned int phys_addr, int size);
+void cma_invalidate_cache(void *buf, unsigned int phys_addr, int size);
+
+/* cache operations so far */
+extern long xlnk_flushes;
+extern long xlnk_invalidates;
+
+#endif
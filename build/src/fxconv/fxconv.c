@@ -0,0 +1,297 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "fxconv.h"
+
+#if defined(FX_NO_SIMD)
+#define FX_LANES 1
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define FX_LANES 8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FX_LANES 4
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FX_LANES 4
+#else
+#define FX_LANES 1
+#endif
+
+/* values are clamped to these before the conversion to int32 (float, HI
+   the largest below 2^31) or int64 (double, past 32 bits so that values
+   just beyond a 32-bit word still truncate or round into it) */
+#define LO_F (-2147483648.0f)
+#define HI_F (2147483520.0f)
+#define LO_D (-4294967296.0)
+#define HI_D (4294967296.0)
+
+struct fmt {
+    int32_t min;
+    int32_t max;
+    int shift;          /* 32 - width, for sign extension */
+    int mode;
+};
+
+static struct fmt make_fmt(int width, int mode)
+{
+    struct fmt f;
+    f.max = (int32_t)(((int64_t)1 << (width-1)) - 1);
+    f.min = -f.max - 1;
+    f.shift = 32 - width;
+    f.mode = mode;
+    return f;
+}
+
+/* a clamped, truncated and possibly rounded value to the word it gives;
+   y is the unclamped value, c the clamped one and t its conversion */
+static inline int32_t finish(double y, double c, int64_t t, const struct fmt *f, long *ovf)
+{
+    if (f->mode & FX_RND) {
+        double d = c - t;
+        t += (d >= 0.5) - (d <= -0.5);
+    }
+    int o = (c != y) || (t > f->max) || (t < f->min);
+    *ovf += o;
+    if (!o)
+        return (int32_t)t;
+    if (f->mode & FX_SAT)
+        return (y > 0) ? f->max : f->min;
+    return (int32_t)((uint32_t)t << f->shift) >> f->shift;
+}
+
+static inline int32_t from_float1(float x, float scale, const struct fmt *f, long *ovf)
+{
+    float y = x*scale;
+    float c = (y >= LO_F) ? ((y <= HI_F) ? y : HI_F) : LO_F;    /* NaN to LO_F */
+    return finish(y, c, (int32_t)c, f, ovf);
+}
+
+static inline int32_t from_double1(double x, double scale, const struct fmt *f, long *ovf)
+{
+    double y = x*scale;
+    double c = (y >= LO_D) ? ((y <= HI_D) ? y : HI_D) : LO_D;
+    return finish(y, c, (int64_t)c, f, ovf);
+}
+
+
+#if FX_LANES == 8
+
+static long from_float_simd(int32_t *dst, const float *src, long n, float scale, const struct fmt *f)
+{
+    const __m256 vs = _mm256_set1_ps(scale);
+    const __m256 vlo = _mm256_set1_ps(LO_F), vhi = _mm256_set1_ps(HI_F);
+    const __m256 half = _mm256_set1_ps(0.5f), mhalf = _mm256_set1_ps(-0.5f);
+    const __m256i vmax = _mm256_set1_epi32(f->max), vmin = _mm256_set1_epi32(f->min);
+    const __m128i shift = _mm_cvtsi32_si128(f->shift);
+    __m256i cnt = _mm256_setzero_si256();
+
+    for (long i=0; i<n; i+=8) {
+        __m256 y = _mm256_mul_ps(_mm256_loadu_ps(src + i), vs);
+        __m256 c = _mm256_min_ps(_mm256_max_ps(y, vlo), vhi);  /* NaN to vlo */
+        __m256i t = _mm256_cvttps_epi32(c);
+        if (f->mode & FX_RND) {
+            __m256 d = _mm256_sub_ps(c, _mm256_cvtepi32_ps(t));
+            t = _mm256_sub_epi32(t, _mm256_castps_si256(_mm256_cmp_ps(d, half, _CMP_GE_OQ)));
+            t = _mm256_add_epi32(t, _mm256_castps_si256(_mm256_cmp_ps(d, mhalf, _CMP_LE_OQ)));
+        }
+        __m256i o = _mm256_castps_si256(_mm256_cmp_ps(c, y, _CMP_NEQ_UQ));
+        o = _mm256_or_si256(o, _mm256_cmpgt_epi32(t, vmax));
+        o = _mm256_or_si256(o, _mm256_cmpgt_epi32(vmin, t));
+        cnt = _mm256_sub_epi32(cnt, o);
+        if (f->mode & FX_SAT) {
+            __m256i pos = _mm256_castps_si256(_mm256_cmp_ps(y, _mm256_setzero_ps(), _CMP_GT_OQ));
+            t = _mm256_blendv_epi8(t, _mm256_blendv_epi8(vmin, vmax, pos), o);
+        } else {
+            t = _mm256_sra_epi32(_mm256_sll_epi32(t, shift), shift);
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), t);
+    }
+
+    int32_t lanes[8];
+    long ovf = 0;
+    _mm256_storeu_si256((__m256i *)lanes, cnt);
+    for (int k=0; k<8; k++)
+        ovf += lanes[k];
+    return ovf;
+}
+
+static void to_float_simd(float *dst, const int32_t *src, long n, float scale, const struct fmt *f)
+{
+    const __m256 vs = _mm256_set1_ps(scale);
+    const __m128i shift = _mm_cvtsi32_si128(f->shift);
+
+    for (long i=0; i<n; i+=8) {
+        __m256i t = _mm256_loadu_si256((const __m256i *)(src + i));
+        t = _mm256_sra_epi32(_mm256_sll_epi32(t, shift), shift);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(t), vs));
+    }
+}
+
+#elif FX_LANES == 4 && defined(__SSE2__)
+
+static inline __m128i blend(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static long from_float_simd(int32_t *dst, const float *src, long n, float scale, const struct fmt *f)
+{
+    const __m128 vs = _mm_set1_ps(scale);
+    const __m128 vlo = _mm_set1_ps(LO_F), vhi = _mm_set1_ps(HI_F);
+    const __m128 half = _mm_set1_ps(0.5f), mhalf = _mm_set1_ps(-0.5f);
+    const __m128i vmax = _mm_set1_epi32(f->max), vmin = _mm_set1_epi32(f->min);
+    const __m128i shift = _mm_cvtsi32_si128(f->shift);
+    __m128i cnt = _mm_setzero_si128();
+
+    for (long i=0; i<n; i+=4) {
+        __m128 y = _mm_mul_ps(_mm_loadu_ps(src + i), vs);
+        __m128 c = _mm_min_ps(_mm_max_ps(y, vlo), vhi);     /* NaN to vlo */
+        __m128i t = _mm_cvttps_epi32(c);
+        if (f->mode & FX_RND) {
+            __m128 d = _mm_sub_ps(c, _mm_cvtepi32_ps(t));
+            t = _mm_sub_epi32(t, _mm_castps_si128(_mm_cmpge_ps(d, half)));
+            t = _mm_add_epi32(t, _mm_castps_si128(_mm_cmple_ps(d, mhalf)));
+        }
+        __m128i o = _mm_castps_si128(_mm_cmpneq_ps(c, y));
+        o = _mm_or_si128(o, _mm_cmpgt_epi32(t, vmax));
+        o = _mm_or_si128(o, _mm_cmplt_epi32(t, vmin));
+        cnt = _mm_sub_epi32(cnt, o);
+        if (f->mode & FX_SAT) {
+            __m128i pos = _mm_castps_si128(_mm_cmpgt_ps(y, _mm_setzero_ps()));
+            t = blend(o, blend(pos, vmax, vmin), t);
+        } else {
+            t = _mm_sra_epi32(_mm_sll_epi32(t, shift), shift);
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), t);
+    }
+
+    int32_t lanes[4];
+    long ovf = 0;
+    _mm_storeu_si128((__m128i *)lanes, cnt);
+    for (int k=0; k<4; k++)
+        ovf += lanes[k];
+    return ovf;
+}
+
+static void to_float_simd(float *dst, const int32_t *src, long n, float scale, const struct fmt *f)
+{
+    const __m128 vs = _mm_set1_ps(scale);
+    const __m128i shift = _mm_cvtsi32_si128(f->shift);
+
+    for (long i=0; i<n; i+=4) {
+        __m128i t = _mm_loadu_si128((const __m128i *)(src + i));
+        t = _mm_sra_epi32(_mm_sll_epi32(t, shift), shift);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(t), vs));
+    }
+}
+
+#elif FX_LANES == 4
+
+static long from_float_simd(int32_t *dst, const float *src, long n, float scale, const struct fmt *f)
+{
+    const float32x4_t vs = vdupq_n_f32(scale);
+    const float32x4_t vlo = vdupq_n_f32(LO_F), vhi = vdupq_n_f32(HI_F);
+    const float32x4_t half = vdupq_n_f32(0.5f), mhalf = vdupq_n_f32(-0.5f);
+    const int32x4_t vmax = vdupq_n_s32(f->max), vmin = vdupq_n_s32(f->min);
+    const int32x4_t shl = vdupq_n_s32(f->shift), shr = vdupq_n_s32(-f->shift);
+    uint32x4_t cnt = vdupq_n_u32(0);
+
+    for (long i=0; i<n; i+=4) {
+        float32x4_t y = vmulq_f32(vld1q_f32(src + i), vs);
+        float32x4_t c = vbslq_f32(vcgeq_f32(y, vlo), y, vlo);   /* NaN to vlo */
+        c = vminq_f32(c, vhi);
+        int32x4_t t = vcvtq_s32_f32(c);
+        if (f->mode & FX_RND) {
+            float32x4_t d = vsubq_f32(c, vcvtq_f32_s32(t));
+            t = vsubq_s32(t, vreinterpretq_s32_u32(vcgeq_f32(d, half)));
+            t = vaddq_s32(t, vreinterpretq_s32_u32(vcleq_f32(d, mhalf)));
+        }
+        uint32x4_t o = vmvnq_u32(vceqq_f32(c, y));
+        o = vorrq_u32(o, vcgtq_s32(t, vmax));
+        o = vorrq_u32(o, vcltq_s32(t, vmin));
+        cnt = vsubq_u32(cnt, o);
+        if (f->mode & FX_SAT) {
+            int32x4_t s = vbslq_s32(vcgtq_f32(y, vdupq_n_f32(0)), vmax, vmin);
+            t = vbslq_s32(o, s, t);
+        } else {
+            t = vshlq_s32(vshlq_s32(t, shl), shr);
+        }
+        vst1q_s32(dst + i, t);
+    }
+
+    uint32_t lanes[4];
+    long ovf = 0;
+    vst1q_u32(lanes, cnt);
+    for (int k=0; k<4; k++)
+        ovf += lanes[k];
+    return ovf;
+}
+
+static void to_float_simd(float *dst, const int32_t *src, long n, float scale, const struct fmt *f)
+{
+    const float32x4_t vs = vdupq_n_f32(scale);
+    const int32x4_t shl = vdupq_n_s32(f->shift), shr = vdupq_n_s32(-f->shift);
+
+    for (long i=0; i<n; i+=4) {
+        int32x4_t t = vshlq_s32(vshlq_s32(vld1q_s32(src + i), shl), shr);
+        vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(t), vs));
+    }
+}
+
+#else
+
+static long from_float_simd(int32_t *dst, const float *src, long n, float scale, const struct fmt *f)
+{
+    return 0;
+}
+
+static void to_float_simd(float *dst, const int32_t *src, long n, float scale, const struct fmt *f)
+{
+}
+
+#endif
+
+
+long fx_from_float(int32_t *dst, const float *src, long n, int width, int frac, int mode)
+{
+    struct fmt f = make_fmt(width, mode);
+    float scale = ldexpf(1.0f, frac);
+    long body = (FX_LANES > 1) ? n - n % FX_LANES : 0;
+    long ovf = from_float_simd(dst, src, body, scale, &f);
+
+    for (long i=body; i<n; i++)
+        dst[i] = from_float1(src[i], scale, &f, &ovf);
+    return ovf;
+}
+
+long fx_from_double(int32_t *dst, const double *src, long n, int width, int frac, int mode)
+{
+    struct fmt f = make_fmt(width, mode);
+    double scale = ldexp(1.0, frac);
+    long ovf = 0;
+
+    for (long i=0; i<n; i++)
+        dst[i] = from_double1(src[i], scale, &f, &ovf);
+    return ovf;
+}
+
+void fx_to_float(float *dst, const int32_t *src, long n, int width, int frac)
+{
+    struct fmt f = make_fmt(width, 0);
+    float scale = ldexpf(1.0f, -frac);
+    long body = (FX_LANES > 1) ? n - n % FX_LANES : 0;
+    to_float_simd(dst, src, body, scale, &f);
+
+    for (long i=body; i<n; i++)
+        dst[i] = (float)((int32_t)((uint32_t)src[i] << f.shift) >> f.shift) * scale;
+}
+
+void fx_to_double(double *dst, const int32_t *src, long n, int width, int frac)
+{
+    struct fmt f = make_fmt(width, 0);
+    double scale = ldexp(1.0, -frac);
+
+    for (long i=0; i<n; i++)
+        dst[i] = (double)((int32_t)((uint32_t)src[i] << f.shift) >> f.shift) * scale;
+}
@@ -0,0 +1,132 @@
+/*
+ * fxconv: bulk conversion between float/double arrays and the kernels'
+ * fixed-point words.
+ *
+ * A word holds a value with `frac` fractional bits in `width` bits (the
+ * kernel's bit_width and frac_width), sign-extended to 32 bits. From
+ * float or double, mode selects:
+ *
+ *   FX_RND  round to nearest, halves away from zero; else truncate
+ *           toward zero, as the old per-element toFixed() did
+ *   FX_SAT  clamp to the most positive/negative word on overflow; else
+ *           wrap to the low width bits
+ *
+ * and the functions return the number of values that overflowed, NaN
+ * included (saturated to the most negative word). Wrap-around is only
+ * defined below 2^31 LSBs; larger values are clamped first. Words
+ * convert back exactly to double, and to float rounded to its 24-bit
+ * mantissa.
+ *
+ * The float paths run 8 lanes at a time with AVX2, 4 with SSE2 or NEON
+ * (build ARMv7 with -mfpu=neon), and give the same words as the scalar
+ * code of the tail and of other targets. The double paths are scalar:
+ * the Cortex-A9 has no double SIMD, and the loops are left to the
+ * compiler elsewhere. NaN and overflow detection need IEEE compares, so
+ * fxconv.c must not be built with -ffast-math.
+ *
+ * The functions are C, so they are exported by the kernels' shared
+ * libraries for the Python drivers.
+ */
+
+#ifndef FXCONV_H
+#define FXCONV_H
+
+#include <stdint.h>
+
+#define FX_TRN  0
+#define FX_RND  1
+#define FX_SAT  2
+
+/* the mode of the host drivers */
+#ifndef FX_MODE
+#define FX_MODE (FX_RND | FX_SAT)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* n values to words; returns the number that overflowed */
+long fx_from_float(int32_t *dst, const float *src, long n, int width, int frac, int mode);
+long fx_from_double(int32_t *dst, const double *src, long n, int width, int frac, int mode);
+
+/* n words back to values */
+void fx_to_float(float *dst, const int32_t *src, long n, int width, int frac);
+void fx_to_double(double *dst, const int32_t *src, long n, int width, int frac);
+
+#ifdef __cplusplus
+}
+
+/* The same on the kernels' port_t buffers: a 32-bit word on the board,
+   converted in place, and wider in C-simulation, where the words go
+   through a staging copy. */
+template <typename P>
+static inline long port_from_float(P *dst, const float *src, long n, int width, int frac, int mode)
+{
+    if (sizeof(P) == sizeof(int32_t))
+        return fx_from_float((int32_t *)dst, src, n, width, frac, mode);
+
+    int32_t tmp[64];
+    long ovf = 0;
+    for (long i=0; i<n; i+=64) {
+        long k = (n - i < 64) ? n - i : 64;
+        ovf += fx_from_float(tmp, src + i, k, width, frac, mode);
+        for (long j=0; j<k; j++)
+            dst[i + j] = (uint32_t)tmp[j];
+    }
+    return ovf;
+}
+
+template <typename P>
+static inline void port_to_float(float *dst, const P *src, long n, int width, int frac)
+{
+    if (sizeof(P) == sizeof(int32_t)) {
+        fx_to_float(dst, (const int32_t *)src, n, width, frac);
+        return;
+    }
+
+    int32_t tmp[64];
+    for (long i=0; i<n; i+=64) {
+        long k = (n - i < 64) ? n - i : 64;
+        for (long j=0; j<k; j++)
+            tmp[j] = (int32_t)(uint32_t)src[i + j];
+        fx_to_float(dst + i, tmp, k, width, frac);
+    }
+}
+
+template <typename P>
+static inline long port_from_double(P *dst, const double *src, long n, int width, int frac, int mode)
+{
+    if (sizeof(P) == sizeof(int32_t))
+        return fx_from_double((int32_t *)dst, src, n, width, frac, mode);
+
+    int32_t tmp[64];
+    long ovf = 0;
+    for (long i=0; i<n; i+=64) {
+        long k = (n - i < 64) ? n - i : 64;
+        ovf += fx_from_double(tmp, src + i, k, width, frac, mode);
+        for (long j=0; j<k; j++)
+            dst[i + j] = (uint32_t)tmp[j];
+    }
+    return ovf;
+}
+
+template <typename P>
+static inline void port_to_double(double *dst, const P *src, long n, int width, int frac)
+{
+    if (sizeof(P) == sizeof(int32_t)) {
+        fx_to_double(dst, (const int32_t *)src, n, width, frac);
+        return;
+    }
+
+    int32_t tmp[64];
+    for (long i=0; i<n; i+=64) {
+        long k = (n - i < 64) ? n - i : 64;
+        for (long j=0; j<k; j++)
+            tmp[j] = (int32_t)(uint32_t)src[i + j];
+        fx_to_double(dst + i, tmp, k, width, frac);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+/*  fxconv_test: host test of the bulk fixed-point conversions (fxconv.c).
+
+    Compares every word and overflow count against a scalar reference in
+    double precision, for a few formats and all four modes, on random
+    values of every magnitude plus halves, format limits, zeros, infinities
+    and NaN. The array length is odd, so both the SIMD body and the scalar
+    tail are covered. Doubles are also checked just beyond the limits of
+    each format, where floats have no values.
+
+    usage: fxconv_test [label]      label names the build in the report
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "fxconv.h"
+
+#define N 1003
+
+static const int formats[][2] = {{32, 20}, {24, 14}, {18, 10}};
+
+/* the word of y = x*2^frac; *skip if wrap-around of y beyond 32 bits,
+   which fxconv leaves unspecified */
+static int32_t ref_word(double y, int width, int mode, long *ovf, int *skip)
+{
+    double max = ldexp(1.0, width-1) - 1, min = -max - 1;
+    int shift = 32 - width;
+
+    *skip = 0;
+    if (isnan(y)) {
+        (*ovf)++;
+        *skip = !(mode & FX_SAT);
+        return (int32_t)min;
+    }
+    double r = (mode & FX_RND) ? round(y) : trunc(y);
+    if (r >= min && r <= max)
+        return (int32_t)r;
+    (*ovf)++;
+    if (mode & FX_SAT)
+        return (int32_t)((y > 0) ? max : min);
+    if (fabs(r) >= ldexp(1.0, 31)) {
+        *skip = 1;
+        return 0;
+    }
+    return (int32_t)((uint32_t)(int64_t)r << shift) >> shift;
+}
+
+static float urand(unsigned *seed)
+{
+    *seed = *seed*1103515245 + 12345;
+    return (*seed >> 8)/16777216.0f;
+}
+
+static void fill(float *x, int width, int frac, unsigned seed)
+{
+    double lim = ldexp(1.0, width-1-frac);
+    double lsb = ldexp(1.0, -frac);
+    int i = 0;
+    const double edges[] = {0.0, -0.0, lim, -lim, lim - lsb, -lim - lsb,
+                            lim - lsb/2, -lim - lsb/2, lim - lsb/4, -lim + lsb/4,
+                            lsb/2, -lsb/2, 1.5*lsb, -1.5*lsb, 2.5*lsb, -2.5*lsb,
+                            INFINITY, -INFINITY, NAN, 1e30, -1e30};
+    for (unsigned k=0; k<sizeof(edges)/sizeof(edges[0]); k++)
+        x[i++] = (float)edges[k];
+    for (; i<N; i++) {
+        float m = urand(&seed)*2 - 1;
+        int e = (int)(urand(&seed)*(width - frac + 24)) - 24;
+        x[i] = ldexpf(m, e);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    static float x[N], xf[N];
+    static double xd[N], yd[N];
+    static int32_t w[N], wd[N];
+    const char *label = (argc > 1) ? argv[1] : "fxconv";
+    int failed = 0;
+
+    for (unsigned k=0; k<sizeof(formats)/sizeof(formats[0]); k++) {
+        int width = formats[k][0], frac = formats[k][1];
+        fill(x, width, frac, 7 + k);
+        for (int i=0; i<N; i++)
+            xd[i] = x[i];
+
+        for (int mode=0; mode<4; mode++) {
+            long ovf = fx_from_float(w, x, N, width, frac, mode);
+            long ovfd = fx_from_double(wd, xd, N, width, frac, mode);
+            long ref_ovf = 0;
+            int errors = 0;
+            for (int i=0; i<N; i++) {
+                int skip;
+                int32_t r = ref_word(ldexp(xd[i], frac), width, mode, &ref_ovf, &skip);
+                errors += !skip && (w[i] != r || wd[i] != r);
+            }
+            errors += (ovf != ref_ovf) + (ovfd != ref_ovf);
+
+            // back to values: exact, and within an LSB of the input unless it overflowed
+            fx_to_float(xf, w, N, width, frac);
+            fx_to_double(yd, w, N, width, frac);
+            for (int i=0; i<N; i++) {
+                int32_t s = (int32_t)((uint32_t)w[i] << (32 - width)) >> (32 - width);
+                errors += (xf[i] != (float)ldexp(s, -frac)) + (yd[i] != ldexp(s, -frac));
+                if (fabs(xd[i]) < ldexp(1.0, width-1-frac) - ldexp(1.0, -frac))
+                    errors += (fabs(yd[i] - xd[i]) > ldexp(1.0, -frac));
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "%s Q%d.%d %s/%s", label, width - frac, frac,
+                     (mode & FX_RND) ? "rnd" : "trn", (mode & FX_SAT) ? "sat" : "wrap");
+            printf("%-40s %s (%d mismatches, %ld overflows)\n", name,
+                   errors ? "FAIL" : "PASS", errors, ovf);
+            failed += (errors != 0);
+        }
+    }
+
+    // doubles just beyond the words, which floats cannot hold
+    for (unsigned k=0; k<sizeof(formats)/sizeof(formats[0]); k++) {
+        int width = formats[k][0], frac = formats[k][1];
+        double max = ldexp(1.0, width-1) - 1, min = -max - 1;
+        const double y[] = {max + 0.3, max + 0.5, max + 0.7, min - 0.3, min - 0.5, min - 0.7};
+        int errors = 0;
+        for (unsigned i=0; i<sizeof(y)/sizeof(y[0]); i++)
+            xd[i] = ldexp(y[i], -frac);
+        for (int mode=0; mode<4; mode++) {
+            long ref_ovf = 0;
+            long ovf = fx_from_double(wd, xd, sizeof(y)/sizeof(y[0]), width, frac, mode);
+            for (unsigned i=0; i<sizeof(y)/sizeof(y[0]); i++) {
+                int skip;
+                int32_t r = ref_word(y[i], width, mode, &ref_ovf, &skip);
+                errors += !skip && (wd[i] != r);
+            }
+            errors += (ovf != ref_ovf);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "%s Q%d.%d double limits", label, width - frac, frac);
+        printf("%-40s %s (%d mismatches)\n", name, errors ? "FAIL" : "PASS", errors);
+        failed += (errors != 0);
+    }
+
+    return failed;
+}
@@ -472,3 +472,53 @@ void ekf_step(	data_t x[Nsta],
 	step4(H, G, Pp, P, tmp7);
 
 }
+
+
+/* The two halves of ekf_step, for the interleaved streams of top_ekf.
+   ekf_predict only touches F, P, Q, Pp, Ft and tmp0, ekf_update only the
+   rest (and P, Pp of its own stream), so the two can run at the same time
+   on different streams. */
+void ekf_predict(	data_t F[Nsta][Nsta],
+					data_t P[Nsta][Nsta],
+					data_t Q[Nsta][Nsta],
+					data_t Pp[Nsta][Nsta],
+					data_t Ft[Nsta][Nsta],
+					data_t tmp0[Nsta][Nsta]
+				)
+{
+	#pragma HLS inline off
+	
+    /* P_k = F_{k-1} P_{k-1} F^T_{k-1} + Q_{k-1} */
+    step1(F, P, Q, Pp, Ft, tmp0);
+}
+
+void ekf_update(	data_t x[Nsta], 
+					data_t fx[Nsta], 
+					data_t hx[Mobs], 
+					data_t H[Mobs][Nsta], 
+					data_t P[Nsta][Nsta],
+					data_t R[Mobs][Mobs],
+					data_t G[Nsta][Mobs],
+					data_t Pp[Nsta][Nsta],
+					data_t SV_Rho[Mobs],
+					data_t Ht[Nsta][Mobs],
+					data_t tmp1[Nsta][Mobs],
+					data_t tmp2[Nsta],
+					data_t tmp3[Mobs][Mobs],
+					data_t tmp4[Mobs][Mobs],
+					data_t tmp5[Mobs],
+					data_t tmp6[Mobs][Nsta],
+					data_t tmp7[Nsta][Nsta]
+				)
+{
+	#pragma HLS inline off
+	
+    /* G_k = P_k H^T_k (H_k P_k H^T_k + R)^{-1} */
+	step2(H, Pp, R, G, Ht, tmp1, tmp3, tmp4, tmp6, tmp5);
+	
+    /* \hat{x}_k = \hat{x_k} + G_k(z_k - h(\hat{x}_k)) */
+    step3(SV_Rho, hx, fx, x, G, tmp2, tmp5);
+	
+    /* P_k = (I - G_k H_k) P_k */
+	step4(H, G, Pp, P, tmp7);
+}
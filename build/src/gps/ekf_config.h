@@ -9,9 +9,21 @@
 #include <ap_fixed.h>
 using namespace std;
 
+/* data_t format; the defaults are the shipped 32-bit datapath, other
+   widths and modes are for the precision sweep (src/csim/sweep.sh) */
+#ifndef bit_width
 #define bit_width 32
+#endif
+#ifndef frac_width
 #define frac_width 20
-typedef ap_fixed<bit_width, (bit_width-frac_width)> data_t;
+#endif
+#ifndef DATA_Q
+#define DATA_Q AP_TRN   /* quantisation mode */
+#endif
+#ifndef DATA_O
+#define DATA_O AP_WRAP  /* overflow mode */
+#endif
+typedef ap_fixed<bit_width, (bit_width-frac_width), DATA_Q, DATA_O> data_t;
 typedef ap_uint<bit_width> port_t;
 
 //typedef ap_uint<bit_width> data_t;
@@ -27,13 +39,34 @@ typedef ap_uint<bit_width> port_t;
 #define Nsats 4  // number of satellites
 #define Nxyz 3   // (x,y,z) co-ordinate system
 
+/* words of params per stream, see init() in top_ekf.cpp */
+#define NPARAMS 182
+
+/*  Streams:
+    -------
+        top_ekf filters NSTREAM independent trajectories in one call. Row
+        i*NSTREAM+s of xin (and of output) is step i of stream s, params
+        holds one NPARAMS block per stream (F, qval and rval must be the
+        same in all of them) and pout the final P of every stream.
+        Each step is split in a front (model and prediction) and a back
+        (gain and update). Streams are stepped round-robin, and each slot
+        runs the front of one stream and the back of the one before it as
+        a DATAFLOW region, on banks of their own: a slot takes the longer
+        of the two halves instead of their sum. Two streams are enough
+        for that; more only fill a call with more trajectories. NSTREAM=1
+        is the original single trajectory, one whole step after the other.
+*/
+#ifndef NSTREAM
+#define NSTREAM 1
+#endif
+
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #pragma SDS data access_pattern(xin:SEQUENTIAL, output:SEQUENTIAL)
-#pragma SDS data copy(xin[0:(datalen*(Nsats*(Nxyz+1)))], output[0:(datalen*Nxyz)])
+#pragma SDS data copy(xin[0:(datalen*NSTREAM*(Nsats*(Nxyz+1)))], output[0:(datalen*NSTREAM*Nxyz)])
 #pragma SDS data data_mover(xin:AXIDMA_SIMPLE, params:AXIDMA_SIMPLE, \
     output:AXIDMA_SIMPLE, pout:AXIDMA_SIMPLE)
 
@@ -49,7 +82,8 @@ extern "C" {
     pout: PHYSICAL_CONTIGUOUS)
 #endif
 
-void top_ekf(port_t *xin, port_t params[182], port_t *output, port_t pout[Nsta*Nsta], int datalen);
+void top_ekf(port_t *xin, port_t params[NSTREAM*NPARAMS], port_t *output,
+				port_t pout[NSTREAM*Nsta*Nsta], int datalen);
 
 #ifdef __cplusplus
 }
@@ -77,10 +111,34 @@ void ekf_step(  data_t x[Nsta],
                 data_t tmp6[Mobs][Nsta],
                 data_t tmp7[Nsta][Nsta]             
             );
+
+void ekf_predict(   data_t F[Nsta][Nsta],
+                    data_t P[Nsta][Nsta],
+                    data_t Q[Nsta][Nsta],
+                    data_t Pp[Nsta][Nsta],
+                    data_t Ft[Nsta][Nsta],
+                    data_t tmp0[Nsta][Nsta]
+                );
+
+void ekf_update(    data_t x[Nsta], 
+                    data_t fx[Nsta], 
+                    data_t hx[Mobs], 
+                    data_t H[Mobs][Nsta], 
+                    data_t P[Nsta][Nsta],
+                    data_t R[Mobs][Mobs],
+                    data_t G[Nsta][Mobs],
+                    data_t Pp[Nsta][Nsta],
+                    data_t SV_Rho[Mobs],
+                    data_t Ht[Nsta][Mobs],
+                    data_t tmp1[Nsta][Mobs],
+                    data_t tmp2[Nsta],
+                    data_t tmp3[Mobs][Mobs],
+                    data_t tmp4[Mobs][Mobs],
+                    data_t tmp5[Mobs],
+                    data_t tmp6[Mobs][Nsta],
+                    data_t tmp7[Nsta][Nsta]
+                );
             
 void model(data_t x[Nsta], data_t fx[Nsta], data_t F[Nsta][Nsta], data_t hx[Mobs],
             data_t H[Mobs][Nsta], data_t SV[4][3]);
 
-float toFloat(int32_t a);
-int32_t toFixed(float a);
-
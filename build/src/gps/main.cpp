@@ -6,7 +6,15 @@
   
         http://www.mathworks.com/matlabcentral/fileexchange/31487-extended-kalman-filter-ekf--for-gps
  
-    Reads file gps.csv of satellite data and writes file ekf.csv of mean-subtracted estimated positions.
+    Reads the satellite data of gps_data.trc, written from gps_data.csv by csv2trace (src/trace),
+    and writes file ekf.csv of mean-subtracted estimated positions. The kernel takes the whole
+    trajectory in one call, so all of it is loaded into xin.
+    With NSTREAM > 1 the same data is sent as every stream, and stream 0 is written.
+    
+    usage: ekf_gps.elf [gps_data.trc] [prof.csv|prof.json]
+    Built with PROF_ENABLE=1 (make PROF=1), also writes the time spent reading the trace,
+    in the kernel and writing the output (src/prof); the kernel runs every step in one call,
+    so this is a single sample.
     
 */
 
@@ -20,47 +28,24 @@
 #include "sds_lib.h"
 
 #include "ekf_config.h"
+#include "../trace/trace.h"
+#include "../prof/prof.h"
+#include "../fxconv/fxconv.h"
 
 #define SEC_TO_NS (1000000000)
 
+enum { ST_READ, ST_KERNEL, ST_WRITE };
+static struct prof prof;
 
-static void readline(char * line, FILE * fp)
-{
-    fgets(line, 1000, fp);
-}
 
-static void skipline(FILE * fp)
+/* rows of the trace into xin, the same row for every stream */
+static void readdata(port_t *xin, struct trace *tr, int datalen)
 {
-    char line[1000];
-    readline(line, fp);
-}
-
-static void readdata(port_t *xin, const char fname[], int datalen)
-{
-    FILE * fp = fopen(fname, "r");
-
-    // Skip CSV header
-    skipline(fp);
-
     for (int i=0; i<datalen; i++) {
-
-        char line[1000];
-
-        readline(line, fp);
-
-        char * p = strtok(line, ",");
-
-        // read transpose, i.e. [Nxyz][Nsats] instead of [Nsats][Nxyz] like csv
-        for (int j=0; j<(Nsats*(Nxyz+1)); j++) {
-            float imm = atof(p);
-            int32_t imm_fx = toFixed(imm);
-            uint32_t imm_uint = (uint32_t) imm_fx;
-            p = strtok(NULL, ",");
-            xin[i*(Nsats*(Nxyz+1)) + j] = imm_uint;
+        for (int s=0; s<NSTREAM; s++) {
+            trace_read(tr, i, 1, &xin[(i*NSTREAM + s)*(Nsats*(Nxyz+1))]);
         }
     }
-
-    fclose(fp);
 }
 
 static void writedata(port_t *output, float *output_fl, const char fname[], int datalen)
@@ -70,12 +55,9 @@ static void writedata(port_t *output, float *output_fl, const char fname[], int
 
     int i,j;
 
-    // convert outputs to float
-    for (i=0; i<datalen*3; i++) {
-        uint32_t oval_uint = output[i];
-        int32_t oval_fx = (int32_t) oval_uint;
-        output_fl[i] = toFloat(oval_fx);
-    }
+    // convert outputs of stream 0 to float
+    for (i=0; i<datalen; i++)
+        port_to_float(&output_fl[i*3], &output[i*NSTREAM*3], 3, bit_width, frac_width);
         
     // Compute means of filtered positions
     double mean_Pos_KF[3] = {0, 0, 0};
@@ -97,51 +79,34 @@ static void writedata(port_t *output, float *output_fl, const char fname[], int
     fclose(fp);
 }
 
-float toFloat(int32_t a)
-{
-    float result;
-    float val = 1 << frac_width;
-    result = a/val;
-    
-    return result;
-}
-
-
-int32_t toFixed(float a)
-{
-    int32_t result;
-    int32_t val = 1 << frac_width; //logical shift
-    
-    if (a<0) result = a*val-0.5; //rounding
-    else result = a*val +0.5;
-    
-    return result;
-}
-
-
 int main(int argc, char ** argv)
 {    
-    // input data file
-    static const char INFILE[] = "gps_data.csv";
+    // input trace, see src/trace/csv2trace.c
+    const char *infile = (argc > 1) ? argv[1] : "gps_data.trc";
     static const char OUTFILE[] = "ekf.csv";
     
+    struct trace tr;
+    if (trace_open(&tr, infile, bit_width, frac_width, Nsats*(Nxyz+1))) {
+        return 1;
+    }
+    
     // Make a place to store the data from the file and the output of the EKF
-    int datalen = 50;
-    int PARAMS_IN = 182; //(((2*Nsta)+2+Mobs)*Nsta)+Mobs+2;
+    int datalen = tr.hdr.rows;
+    int PARAMS_IN = NSTREAM*NPARAMS; //(((2*Nsta)+2+Mobs)*Nsta)+Mobs+2 per stream
     port_t *xin, *output, *params, *pout;
     float *output_fl;
     output_fl = (float *)malloc(datalen*Nxyz*sizeof(float));
 
 #if P_CACHEABLE == 0
-    xin = (port_t *)sds_alloc_non_cacheable(datalen*Nsats*(Nxyz+1)*sizeof(port_t));
-    params = (port_t *)sds_alloc_non_cacheable(182*sizeof(port_t));
-    output = (port_t *)sds_alloc_non_cacheable(datalen*Nxyz*sizeof(port_t));
-    pout = (port_t *)sds_alloc_non_cacheable((Nsta*Nsta)*sizeof(port_t));
+    xin = (port_t *)sds_alloc_non_cacheable(datalen*NSTREAM*Nsats*(Nxyz+1)*sizeof(port_t));
+    params = (port_t *)sds_alloc_non_cacheable(PARAMS_IN*sizeof(port_t));
+    output = (port_t *)sds_alloc_non_cacheable(datalen*NSTREAM*Nxyz*sizeof(port_t));
+    pout = (port_t *)sds_alloc_non_cacheable((NSTREAM*Nsta*Nsta)*sizeof(port_t));
 #else
-    xin = (port_t *)sds_alloc(datalen*Nsats*(Nxyz+1)*sizeof(port_t));
-    params = (port_t *)sds_alloc(182*sizeof(port_t));
-    output = (port_t *)sds_alloc(datalen*Nxyz*sizeof(port_t));
-    pout = (port_t *)sds_alloc((Nsta*Nsta)*sizeof(port_t));
+    xin = (port_t *)sds_alloc(datalen*NSTREAM*Nsats*(Nxyz+1)*sizeof(port_t));
+    params = (port_t *)sds_alloc(PARAMS_IN*sizeof(port_t));
+    output = (port_t *)sds_alloc(datalen*NSTREAM*Nxyz*sizeof(port_t));
+    pout = (port_t *)sds_alloc((NSTREAM*Nsta*Nsta)*sizeof(port_t));
 #endif
 
     /* params[Nsta+Nsta+Mobs+(2*Nsta*Nsta)+(Mobs*Nsta)+2]:
@@ -156,20 +121,37 @@ int main(int argc, char ** argv)
     */
     #include "params.dat"
     
+    // every stream starts from the same params
+    for (int i=NPARAMS; i<PARAMS_IN; i++) {
+        params[i] = params[i % NPARAMS];
+    }
+    
     struct timespec * start = (struct timespec *)malloc(sizeof(struct timespec));
     struct timespec * stop = (struct timespec *)malloc(sizeof(struct timespec));
 
-    // write csv data to xin
-    readdata(xin, INFILE, datalen);
+    prof_init(&prof, "read,kernel,write");
+    PROF_BEGIN(&prof);
 
-    clock_gettime(CLOCK_REALTIME, start);
+    // write trace data to xin
+    readdata(xin, &tr, datalen);
+    trace_close(&tr);
+    PROF_MARK(&prof, ST_READ);
+
+    clock_gettime(CLOCK_MONOTONIC, start);
     top_ekf(xin, params, output, pout, datalen);
-    clock_gettime(CLOCK_REALTIME, stop);
+    clock_gettime(CLOCK_MONOTONIC, stop);
+    PROF_MARK(&prof, ST_KERNEL);
 
     writedata(output, output_fl, OUTFILE, datalen);
+    PROF_MARK(&prof, ST_WRITE);
+    PROF_END(&prof);
 
     int totalTime = (stop->tv_sec*SEC_TO_NS + stop->tv_nsec) - (start->tv_sec*SEC_TO_NS + start->tv_nsec);
     printf("time = %f s\n", ((float)totalTime/1000000000));
+    printf("%d streams, %f steps/s\n", NSTREAM, datalen*NSTREAM/((float)totalTime/1000000000));
+#if PROF_ENABLE
+    prof_write(&prof, (argc > 2) ? argv[2] : "-");
+#endif
     
     sds_free(xin);
     sds_free(params);
@@ -148,33 +148,136 @@ void model(data_t x[Nsta], data_t fx[Nsta], data_t F[Nsta][Nsta],
 
 }
 
-// top function
-void top_ekf(port_t *xin, port_t params[182], port_t *output,
-				port_t pout[Nsta*Nsta], int datalen)
+/* front of row t: read it from xin, run the model and predict,
+   P_k = F P F^T + Q, for its stream; nothing outside rows [0, rows) */
+static void front(port_t *xin, int t, int rows,
+				data_t x[Nsta], data_t P[Nsta][Nsta],
+				data_t fx[Nsta], data_t hx[Mobs], data_t H[Mobs][Nsta],
+				data_t Pp[Nsta][Nsta], data_t SV_Rho[Nsats],
+				data_t F[Nsta][Nsta], data_t Q[Nsta][Nsta],
+				data_t Ft[Nsta][Nsta], data_t tmp0[Nsta][Nsta])
+{
+	#pragma HLS INLINE off
+
+	static const int num_inputs = Nsats*(Nxyz+1);
+	data_t local_xin[num_inputs];
+	data_t SV_Pos[Nsats][Nxyz];
+
+	if (t < 0 || t >= rows)
+		return;
+
+	// read xin into local memory
+	for (int j=0; j<num_inputs; j++) {
+		#pragma HLS PIPELINE
+		local_xin[j].V = xin[t*num_inputs + j].range(bit_width-1, 0);
+	}
+
+	// SV_Pos and SV_rho
+	for (int j=0; j<Nsats; j++)	{
+		for (int k=0; k<Nxyz; k++) {
+			#pragma HLS PIPELINE
+			SV_Pos[j][k] = local_xin[j*Nxyz + k];
+		}
+	}
+	for (int j=0; j<Nsats; j++) {
+		#pragma HLS PIPELINE
+		SV_Rho[j] = local_xin[j + num_inputs - Nsats];
+	}
+
+	// model
+	model(x, fx, F, hx, H, SV_Pos);
+
+	// prediction
+	ekf_predict(F, P, Q, Pp, Ft, tmp0);
+}
+
+/* back of row t: update the prediction of its stream and return the
+   positions, ignoring velocities; nothing outside rows [0, rows) */
+static void back(port_t *output, int t, int rows,
+				data_t fx[Nsta], data_t hx[Mobs], data_t H[Mobs][Nsta],
+				data_t Pp[Nsta][Nsta], data_t SV_Rho[Nsats],
+				data_t x[Nsta], data_t P[Nsta][Nsta],
+				data_t R[Mobs][Mobs], data_t G[Nsta][Mobs], data_t Ht[Nsta][Mobs],
+				data_t tmp1[Nsta][Mobs], data_t tmp2[Nsta],
+				data_t tmp3[Mobs][Mobs], data_t tmp4[Mobs][Mobs],
+				data_t tmp5[Mobs], data_t tmp6[Mobs][Nsta],
+				data_t tmp7[Nsta][Nsta])
 {
+	#pragma HLS INLINE off
+
+	if (t < 0 || t >= rows)
+		return;
 
-	// inputs
-    data_t SV_Pos[Nsats][Nxyz];
-    data_t SV_Rho[Nsats];
+	ekf_update(x, fx, hx, H, P, R, G, Pp, SV_Rho, Ht,
+				tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7);
+
+	for (int k=0; k<Nxyz; k++) {
+		port_t imm;
+		imm.range(bit_width-1,0) = x[2*k].V;
+		output[t*Nxyz + k] = imm;
+	}
+}
 
-    /* ---------------- Application Specific Variables ------------------ */
+#if (NSTREAM > 1)
+/* slot t: the front of row t on the banks of its stream (the _p
+   arguments) and the back of row t-1 on those of the stream before it
+   (_u). The two share no array, so as a DATAFLOW region they run at
+   the same time. */
+static void slot(port_t *xin, port_t *output, int t, int rows,
+				data_t x_p[Nsta], data_t P_p[Nsta][Nsta],
+				data_t fx_p[Nsta], data_t hx_p[Mobs], data_t H_p[Mobs][Nsta],
+				data_t Pp_p[Nsta][Nsta], data_t Rho_p[Nsats],
+				data_t fx_u[Nsta], data_t hx_u[Mobs], data_t H_u[Mobs][Nsta],
+				data_t Pp_u[Nsta][Nsta], data_t Rho_u[Nsats],
+				data_t x_u[Nsta], data_t P_u[Nsta][Nsta],
+				data_t F[Nsta][Nsta], data_t Q[Nsta][Nsta], data_t R[Mobs][Mobs],
+				data_t Ft[Nsta][Nsta], data_t tmp0[Nsta][Nsta],
+				data_t G[Nsta][Mobs], data_t Ht[Nsta][Mobs],
+				data_t tmp1[Nsta][Mobs], data_t tmp2[Nsta],
+				data_t tmp3[Mobs][Mobs], data_t tmp4[Mobs][Mobs],
+				data_t tmp5[Mobs], data_t tmp6[Mobs][Nsta],
+				data_t tmp7[Nsta][Nsta])
+{
+	#pragma HLS INLINE off
+	#pragma HLS DATAFLOW
 
-	static data_t x[Nsta] = {0};
+	front(xin, t, rows, x_p, P_p, fx_p, hx_p, H_p, Pp_p, Rho_p, F, Q, Ft, tmp0);
+	back(output, t-1, rows, fx_u, hx_u, H_u, Pp_u, Rho_u, x_u, P_u, R, G, Ht,
+			tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7);
+}
+#endif
+
+// top function
+void top_ekf(port_t *xin, port_t params[NSTREAM*NPARAMS], port_t *output,
+				port_t pout[NSTREAM*Nsta*Nsta], int datalen)
+{
+
+    /* ------------- Per-Stream State (one bank per stream) ------------- */
+
+	static data_t x[NSTREAM][Nsta] = {{0}};
 
 	// output of state-transition function
-	static data_t fx[Nsta] = {0};
+	static data_t fx[NSTREAM][Nsta] = {{0}};
 
 	// output of observation/measurement function
-	static data_t hx[Mobs] = {0};
+	static data_t hx[NSTREAM][Mobs] = {{0}};
 
-	// Jacobians
-	static data_t F[Nsta][Nsta] = {{0}};
-	static data_t H[Mobs][Nsta] = {{0}};
-
-	/* ------------------ Fixed Covariance Matrices -------------------- */
+	// measurement Jacobian
+	static data_t H[NSTREAM][Mobs][Nsta] = {{{0}}};
 
 	// prediction error covariance, i.e. x_new ~ N(fx, P)
-	static data_t P[Nsta][Nsta] = {{0}};
+	static data_t P[NSTREAM][Nsta][Nsta] = {{{0}}};
+
+	// post-prediction, pre-update, P
+	static data_t Pp[NSTREAM][Nsta][Nsta] = {{{0}}};
+
+	// pseudoranges of the step between prediction and update
+	static data_t SV_Rho[NSTREAM][Nsats] = {{0}};
+
+	/* ------------------ Fixed Model Matrices ------------------------- */
+
+	// state Jacobian, constant
+	static data_t F[Nsta][Nsta] = {{0}};
 
 	// process/state noise covariance, i.e. x ~ N(u, Q)
 	static data_t Q[Nsta][Nsta] = {{0}};
@@ -182,18 +285,15 @@ void top_ekf(port_t *xin, port_t params[182], port_t *output,
 	// measurement/observed error covariance, i.e. z ~ N(u, R)
 	static data_t R[Mobs][Mobs] = {{0}};
 
-	// Kalman Gain
-	static data_t G[Nsta][Mobs] = {{0}};
-
-	// post-prediction, pre-update, P
-	static data_t Pp[Nsta][Nsta] = {{0}};
-
-	/* ----------------- Temporary Variables --------------------------- */
+	/* -------- Temporary Variables (prediction and update apart) ------ */
 
-	static data_t Ht[Nsta][Mobs] = {{0}};
+	// prediction
 	static data_t Ft[Nsta][Nsta] = {{0}};
-
 	static data_t tmp0[Nsta][Nsta] = {{0}};
+
+	// update
+	static data_t G[Nsta][Mobs] = {{0}};
+	static data_t Ht[Nsta][Mobs] = {{0}};
 	static data_t tmp1[Nsta][Mobs] = {{0}};
 	static data_t tmp2[Nsta] = {0};
 	static data_t tmp3[Mobs][Mobs] = {{0}};
@@ -203,22 +303,33 @@ void top_ekf(port_t *xin, port_t params[182], port_t *output,
 	static data_t tmp7[Nsta][Nsta] = {{0}};
 
 	/* ----------------- Load Intital Params -------------------------- */
-	data_t local_mem[182]; //[(((2*Nsta)+2+Mobs)*Nsta)+Mobs+2];
-	// read params sequentially
-	for (int i=0; i<182; i++) {
-		#pragma HLS PIPELINE
-		port_t imm = params[i];
-		local_mem[i].V = imm.range(bit_width-1,0);
+	data_t local_mem[NPARAMS]; //[(((2*Nsta)+2+Mobs)*Nsta)+Mobs+2];
+	for (int s=0; s<NSTREAM; s++) {
+		// read params sequentially
+		for (int i=0; i<NPARAMS; i++) {
+			#pragma HLS PIPELINE
+			port_t imm = params[s*NPARAMS + i];
+			local_mem[i].V = imm.range(bit_width-1,0);
+		}
+		// Initialise state
+		init(x[s], fx[s], hx[s], F, H[s], P[s], Q, R, local_mem);
 	}
-	// Initialise state
-	init(x, fx, hx, F, H, P, Q, R, local_mem);
 
 	/* ---------------------- HLS PRAGMAs ----------------------------- */
 
+	// a bank per stream, each its own memory
+	#pragma HLS array_partition variable=x complete dim=1
+	#pragma HLS array_partition variable=fx complete dim=1
+	#pragma HLS array_partition variable=hx complete dim=1
+	#pragma HLS array_partition variable=H complete dim=1
+	#pragma HLS array_partition variable=P complete dim=1
+	#pragma HLS array_partition variable=Pp complete dim=1
+	#pragma HLS array_partition variable=SV_Rho complete dim=1
+
 	#pragma HLS array_partition variable=F block factor=8 dim=2
-	#pragma HLS array_partition variable=P block factor=8 dim=1
+	#pragma HLS array_partition variable=P block factor=8 dim=2
 	#pragma HLS array_partition variable=Ft block factor=8 dim=1
-	#pragma HLS array_partition variable=H block factor=8 dim=2
+	#pragma HLS array_partition variable=H block factor=8 dim=3
 	#pragma HLS array_partition variable=Ht block factor=8 dim=1
 	
 	#pragma HLS array_partition variable=tmp0 block factor=8 dim=2
@@ -229,57 +340,49 @@ void top_ekf(port_t *xin, port_t params[182], port_t *output,
 	#pragma HLS array_partition variable=tmp7 block factor=8 dim=2
 	
 	#pragma HLS array_partition variable=G block factor=4 dim=2
-	#pragma HLS array_partition variable=Pp block factor=8 dim=1
+	#pragma HLS array_partition variable=Pp block factor=8 dim=2
 	
 	/* ---------------------------------------------------------------- */
 
-	static const int num_inputs = Nsats*(Nxyz+1);
-	data_t local_xin[num_inputs];
-
-    for (int i=0; i<datalen; i++) {  //datalen
+	int rows = datalen*NSTREAM;
 
-        // read xin into local memory
-        for (int j=0; j<num_inputs; j++) {
-			#pragma HLS PIPELINE
-			local_xin[j].V = xin[i*num_inputs + j].range(bit_width-1, 0);
+#if (NSTREAM == 1)
+	// one trajectory: each step whole, as model() and ekf_step()
+steps:	for (int t=0; t<rows; t++) {  //datalen
+		front(xin, t, rows, x[0], P[0], fx[0], hx[0], H[0], Pp[0], SV_Rho[0],
+				F, Q, Ft, tmp0);
+		back(output, t, rows, fx[0], hx[0], H[0], Pp[0], SV_Rho[0], x[0], P[0],
+				R, G, Ht, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7);
+	}
+#else
+	/* Slot t predicts row t (step t/NSTREAM of stream t%NSTREAM) and
+	   updates row t-1, of the stream before. Unrolled by NSTREAM, the
+	   stream of every slot is a constant, so each slot names its banks at
+	   compile time: the fx/hx/H/Pp/SV_Rho bank a front fills is read by
+	   the back of the next slot while the following front fills the next
+	   bank, and x/P of a stream are written by its back one slot before
+	   its next front reads them. */
+slots:	for (int t=0; t<=rows; t+=NSTREAM) {  //datalen*NSTREAM + 1
+		for (int s=0; s<NSTREAM; s++) {
+			#pragma HLS UNROLL
+			const int u = (s + NSTREAM - 1) % NSTREAM;
+			slot(xin, output, t + s, rows,
+					x[s], P[s], fx[s], hx[s], H[s], Pp[s], SV_Rho[s],
+					fx[u], hx[u], H[u], Pp[u], SV_Rho[u], x[u], P[u],
+					F, Q, R, Ft, tmp0, G, Ht,
+					tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7);
 		}
-
-		// SV_Pos and SV_rho
-		for (int j=0; j<Nsats; j++)	{
-            for (int k=0; k<Nxyz; k++) {
-				#pragma HLS PIPELINE
-				SV_Pos[j][k] = local_xin[j*Nxyz + k];
-            }
-        }
-        for (int j=0; j<Nsats; j++) {
-			#pragma HLS PIPELINE
-            SV_Rho[j] = local_xin[j + num_inputs - Nsats];
-        }
-
-
-        // model
-        model(x, fx, F, hx, H, SV_Pos);
-
-        // ekf_step
-        ekf_step(x, fx, F, hx, H, P, Q, R, G, Pp, SV_Rho, Ft, Ht,
-					tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7);
-
-
-        // return positions, ignoring velocities
-        for (int k=0; k<Nxyz; k++) {
-        	port_t imm;
-        	imm.range(bit_width-1,0) = x[2*k].V;
-            output[i*Nxyz + k] = imm;
-        }
-
-    }
-
-	// write out P covariance matrix
-	for (int i=0; i<Nsta; i++) {
-		for (int j=0; j<Nsta; j++) {
-			port_t imm;
-			imm.range(bit_width-1,0) = P[i][j].V;
-			pout[i*Nsta + j] = imm;
+	}
+#endif
+
+	// write out P covariance matrices
+	for (int s=0; s<NSTREAM; s++) {
+		for (int i=0; i<Nsta; i++) {
+			for (int j=0; j<Nsta; j++) {
+				port_t imm;
+				imm.range(bit_width-1,0) = P[s][i][j].V;
+				pout[(s*Nsta + i)*Nsta + j] = imm;
+			}
 		}
 	}
 
@@ -0,0 +1,1021 @@
+#include "ekf_config.h"
+
+/* S = L L^T over its leading mo x mo block, in place: the strictly lower
+   triangle of S is overwritten with L and dinv gets the reciprocals of its
+   diagonal. Returns 1 if S is not positive definite, like cholsl() in
+   tiny_ekf.c; the pivots below PIVOT_TOL are counted in hl */
+static int choldc(data_t S[Mobs][Mobs], data_t dinv[Mobs], int mo,
+				struct ekf_health *hl)
+{
+	#pragma HLS INLINE off
+	
+	int i, j, k;
+	int fail = 0;
+	
+	for (j=0; j<mo; j++) {
+		#pragma HLS loop_tripcount min=1 max=Mobs
+		data_t sum = S[j][j];
+		for (k=0; k<j; k++) {
+			sum -= S[j][k] * S[j][k];
+		}
+		if (sum < (data_t)PIVOT_TOL) {
+			hl->pivots++;
+		}
+		if (sum <= 0) {
+			// carry on with a unit pivot, the caller discards the result
+			fail = 1;
+			sum = 1;
+		}
+		data_t d = hls::sqrt(sum);
+		dinv[j] = (data_t)(1)/d;
+		
+		for (i=j+1; i<mo; i++) {
+			#if (P_ENABLE==1)
+			#pragma HLS PIPELINE
+			#endif
+			data_t s = S[i][j];
+			for (k=0; k<j; k++) {
+				s -= S[i][k] * S[j][k];
+			}
+			S[i][j] = s * dinv[j];
+		}
+	}
+	
+	return fail;
+}
+
+/* e^T S^-1 e for e = din - hx, with S = L L^T from choldc(): the squared
+   norm of y, L y = e, over the first mo measurements */
+static nis_t nis_chol(data_t L[Mobs][Mobs], data_t dinv[Mobs], data_t din[Mobs],
+				data_t hx[Mobs], data_t y[Mobs], int mo)
+{
+	#pragma HLS INLINE off
+	
+	nis_t nis = 0;
+	
+	for (int i=0; i<mo; i++) {
+		#pragma HLS loop_tripcount min=1 max=Mobs
+		data_t result = din[i] - hx[i];
+		for (int k=0; k<i; k++) {
+			result -= L[i][k] * y[k];
+		}
+		y[i] = result * dinv[i];
+		nis += y[i] * y[i];
+	}
+	
+	return nis;
+}
+
+
+
+#if (F_STRUCT == FS_DENSE)
+
+/* tmp0 = F * P */
+static void step1_1(data_t F[Nsta][Nsta], data_t P[NTRI], 
+				data_t tmp0[Nsta][Nsta])
+{
+	#pragma HLS inline off
+	//data_t op1, term, result;
+
+	int bsize = BSIZE_4;	
+	int i, j, l, k;
+	
+	for (i=0; i<Nsta; i++) {
+		for (j=0; j<Nsta; j++) {
+			#if (PARTIAL_N_2==0)
+			#pragma HLS pipeline
+			#endif
+			data_t result = 0;
+			for (l=0; l<(Nsta/bsize); l++) {
+				#pragma HLS pipeline
+				data_t b_result = 0;
+				for (k=0; k<bsize; k++) {
+					data_t op1 = F[i][l*bsize + k];
+					data_t term = op1*P[PSYM(l*bsize + k, j)];
+					//if (op1 == 1) {
+					b_result += term;
+					//}	
+				}
+				result += b_result;
+			}
+			tmp0[i][j] = result;
+		}		
+	}
+
+}
+
+/* Pp = tmp0 * F^T + Q, upper triangle only */
+static void step1_2(data_t tmp0[Nsta][Nsta], data_t Ft[Nsta][Nsta],
+				data_t Q[Nsta][Nsta], data_t Pp[NTRI])
+{
+	#pragma HLS inline off
+	
+	int bsize = BSIZE_4;
+	int i = 0, j = 0, l, k;
+	
+	for (int t=0; t<NTRI; t++) {
+		#if (PARTIAL_N_2==0)
+		#pragma HLS pipeline
+		#endif
+		data_t result = 0;
+		for (l=0; l<(Nsta/bsize); l++) {
+			#pragma HLS pipeline
+			data_t b_result = 0;
+			for (k=0; k<bsize; k++) {
+				data_t term = tmp0[i][l*bsize+k] * Ft[l*bsize+k][j];
+				b_result += term;
+			}
+			result += b_result;
+		}
+		Pp[t] = result + Q[i][j];
+
+		// next (i, j) of the packed triangle
+		if (j == Nsta-1) {
+			i++;
+			j = i;
+		} else {
+			j++;
+		}
+	}
+	
+}
+
+#else
+
+/* Pp = F * P * F^T + Q for the fixed F of F_STRUCT, adds only, upper
+   triangle only */
+static void step1_s(data_t P[NTRI], data_t Q[Nsta][Nsta], data_t Pp[NTRI])
+{
+	#pragma HLS inline off
+	
+	int i = 0, j = 0;
+	
+	for (int t=0; t<NTRI; t++) {
+		#pragma HLS pipeline
+		data_t result = P[t];
+		#if (F_STRUCT == FS_CV)
+		// row i of F*P gains row i+1, column j of F*P*F^T gains column j+1
+		int ei = ((i % 2) == 0);
+		int ej = ((j % 2) == 0);
+		if (ei) {
+			result += P[PSYM(i+1, j)];
+		}
+		if (ej) {
+			result += P[PSYM(i, j+1)];
+		}
+		if (ei && ej) {
+			result += P[PSYM(i+1, j+1)];
+		}
+		#endif
+		Pp[t] = result + Q[i][j];
+
+		// next (i, j) of the packed triangle
+		if (j == Nsta-1) {
+			i++;
+			j = i;
+		} else {
+			j++;
+		}
+	}
+}
+
+#endif
+
+
+/* tmp6 = H * Pp, over the NHC columns of H and its first mo rows */
+static void step2_1(data_t H[Mobs][NHC], data_t Pp[NTRI],
+				data_t tmp6[Mobs][Nsta], int mo)
+{
+
+	#pragma HLS inline off
+	
+	int bsize = BSIZE_H;
+
+	int i, j, l, k;
+	
+	for (i=0; i<mo; i++) {
+		#pragma HLS loop_tripcount min=1 max=Mobs
+		for (j=0; j<Nsta; j++) {
+			#if (PARTIAL_H==0)
+			#pragma HLS pipeline
+			#endif
+			data_t result = 0;
+			for (l=0; l<(NHC/bsize); l++) {
+				#pragma HLS pipeline
+				data_t b_result = 0;
+				for (k=0; k<bsize; k++) {
+					data_t op1 = H[i][l*bsize+k];
+					data_t term = op1 * Pp[PSYM(j, HCOL(l*bsize+k))];
+					result += term;		
+				}					
+				result += b_result;	
+			}
+			tmp6[i][j] = result;
+		}
+	}
+	
+}
+
+/* tmp3 = tmp6 * Ht + R, its leading mo x mo block */
+static void step2_3(data_t tmp6[Mobs][Nsta], data_t Ht[NHC][Mobs], 
+				data_t R[Mobs][Mobs], data_t tmp3[Mobs][Mobs], int mo)
+{
+	#pragma HLS inline off
+	
+	int bsize = BSIZE_H;
+	
+	int i, j, l, k;
+	
+	for (i=0; i<mo; i++) {
+		#pragma HLS loop_tripcount min=1 max=Mobs
+		for (j=0; j<mo; j++) {
+			#pragma HLS loop_tripcount min=1 max=Mobs
+			#if (PARTIAL_H==0)
+			#pragma HLS pipeline
+			#endif
+			data_t result = 0;
+			for (l=0; l<(NHC/bsize); l++) {
+				#pragma HLS pipeline
+				data_t b_result = 0;
+				for (k=0; k<bsize; k++) {
+					data_t term = tmp6[i][HCOL(l*bsize+k)] * Ht[l*bsize+k][j];
+					b_result += term;
+				}
+				result += b_result;
+			}
+			tmp3[i][j] = result + R[i][j];
+		}
+	}
+	
+}
+
+/* K^T = S^-1 * tmp6, with S = L L^T from choldc(): forward and back
+   substitution on each column of tmp6 = (Pp * Ht)^T, no inverse is formed.
+   The columns of K from mo on are zeroed. With STEP34, Kx gets a copy of
+   K for step3, so that step3 and step4 each read their own in step34 */
+static void step2_4(data_t L[Mobs][Mobs], data_t dinv[Mobs], data_t tmp6[Mobs][Nsta],
+				data_t K[Nsta][Mobs], data_t Kx[Nsta][Mobs], int mo)
+{
+
+	#pragma HLS inline off
+	
+	int c, i, k;
+	
+	for (c=0; c<Nsta; c++) {
+		#if (PARTIAL_M==0)
+		#pragma HLS pipeline
+		#endif
+		data_t z[Mobs];
+		
+		// L z = tmp6[:][c]
+		for (i=0; i<mo; i++) {
+			data_t result = tmp6[i][c];
+			for (k=0; k<i; k++) {
+				result -= L[i][k] * z[k];
+			}
+			z[i] = result * dinv[i];
+		}
+		
+		// L^T K[c][:] = z
+		for (i=mo-1; i>=0; i--) {
+			data_t result = z[i];
+			for (k=i+1; k<mo; k++) {
+				result -= L[k][i] * z[k];
+			}
+			z[i] = result * dinv[i];
+		}
+		
+		for (i=0; i<Mobs; i++) {
+			data_t k = (i < mo) ? z[i] : (data_t)0;
+			K[c][i] = k;
+			#if (STEP34 == 1)
+			Kx[c][i] = k;
+			#endif
+		}
+	}
+}
+
+
+
+
+
+/* P = Pp - K * tmp6, upper triangle only */
+static void step4_1(data_t K[Nsta][Mobs], data_t tmp6[Mobs][Nsta], data_t Pp[NTRI],
+				data_t P[NTRI])
+{
+	#pragma HLS inline off
+	
+	int bsize = BSIZE_1;
+	int i = 0, j = 0, l, k;
+	
+	for (int t=0; t<NTRI; t++) {
+		#if (PARTIAL_M==0)
+		#pragma HLS pipeline
+		#endif
+		data_t result = 0;
+		for (l=0; l<(Mobs/bsize); l++) {
+			#pragma HLS pipeline
+			data_t b_result = 0;
+			for (k=0; k<bsize; k++) {
+				data_t term = K[i][l*bsize+k] * tmp6[l*bsize+k][j];
+				b_result += term;
+			}
+			result += b_result;		
+		}
+		P[t] = Pp[t] - result;
+
+		// next (i, j) of the packed triangle
+		if (j == Nsta-1) {
+			i++;
+			j = i;
+		} else {
+			j++;
+		}
+	}
+}
+
+
+/* P_k = F_{k-1} P_{k-1} F^T_{k-1} + Q_{k-1} */
+static void step1(data_t F[Nsta][Nsta], data_t P[NTRI], 
+				data_t Q[Nsta][Nsta], data_t Pp[NTRI],
+				data_t Ft[Nsta][Nsta], data_t tmp0[Nsta][Nsta])
+{
+	#pragma HLS inline off
+	#pragma HLS inline region
+	
+	/*  Note: In the GPS and light examples, F is a constant binary matrix.
+		Build with F_STRUCT=FS_CV to implement the products using adds only */
+
+	#if (F_STRUCT == FS_DENSE)
+	/* tmp0 = F * P */
+	step1_1(F, P, tmp0);
+    
+	/* Pp = tmp0 * F^T + Q */
+	step1_2(tmp0, Ft, Q, Pp);
+	#else
+	/* Pp = F * P * F^T + Q */
+	step1_s(P, Q, Pp);
+	#endif
+
+}
+
+/* K_k = P_k H^T_k (H_k P_k H^T_k + R)^{-1}, over the first mo rows of H_k;
+   returns 1 if H_k P_k H^T_k + R is not positive definite */
+static int step2(data_t H[Mobs][NHC], data_t Pp[NTRI], 
+					data_t R[Mobs][Mobs], data_t K[Nsta][Mobs],
+					data_t Kx[Nsta][Mobs], data_t Ht[NHC][Mobs], data_t tmp3[Mobs][Mobs], 
+					data_t tmp4[Mobs], data_t tmp6[Mobs][Nsta], int mo,
+					struct ekf_health *hl)
+{
+	int i, j;
+	
+	#pragma HLS inline off
+	#pragma HLS inline region
+	
+	/* tmp6 = H * Pp */
+	step2_1(H, Pp, tmp6, mo);
+	
+	/* tmp3 = tmp6 * Ht + R */
+	step2_3(tmp6, Ht, R, tmp3, mo);
+	
+	/* tmp3 = L L^T, tmp4 = 1/diag(L) */
+	if (choldc(tmp3, tmp4, mo, hl)) {
+		return 1;
+	}
+	
+	/* K = tmp6^T * (L L^T)^-1 */
+    step2_4(tmp3, tmp4, tmp6, K, Kx, mo);
+	
+	return 0;
+}
+
+/* \hat{x}_k = \hat{x_k} + K_k(z_k - h(\hat{x}_k)) */
+static void step3(data_t din[4], data_t hx[Mobs], data_t fx[Nsta],
+					data_t x[Nsta], data_t K[Nsta][Mobs], 
+					data_t tmp2[Nsta], data_t tmp5[Mobs])
+{
+	#pragma HLS inline off
+	#pragma HLS inline region
+	
+	int bsize = BSIZE_3;
+	int i, j, k;
+	
+	// err = din - hx
+	for (j=0; j<Mobs; j++) {
+		tmp5[j] = din[j] - hx[j];
+	}
+	
+	// x = K*err + fx
+	for (i=0; i<Nsta; i++) {
+		#if (PARTIAL_M==0)
+		#pragma HLS pipeline
+		#endif
+		data_t result = 0;
+		for (j=0; j<(Mobs/bsize); j++) {
+			#pragma HLS pipeline
+			data_t b_result = 0;
+			for (k=0; k<bsize; k++) {
+				data_t term = K[i][j*bsize+k] * tmp5[j*bsize+k];
+				b_result += term;
+			}
+			result += b_result;
+		}
+		x[i] = fx[i] + result;		
+	}
+	
+}
+
+
+/* P_k = (I - K_k H_k) P_k */
+static void step4(data_t K[Nsta][Mobs], data_t tmp6[Mobs][Nsta], data_t Pp[NTRI], 
+					data_t P[NTRI])
+{
+	#pragma HLS inline off
+	#pragma HLS inline region	
+	
+	/*  (I - K*H) * Pp = Pp - K * (H*Pp), and H*Pp is tmp6 from step2. The
+		result is symmetric, so only its upper triangle is computed */
+	step4_1(K, tmp6, Pp, P);
+}
+
+
+#if (STEP34 == 1)
+/* step3 and step4 as one dataflow region: once K is known the state and
+   the covariance updates share no data, so they overlap and the pair takes
+   the longer of the two rather than their sum. step3 reads the copy Kx of
+   K made by step2_4, as every array of a region needs a single reader */
+static void step34(data_t din[Mobs], data_t hx[Mobs], data_t fx[Nsta],
+					data_t x[Nsta], data_t Kx[Nsta][Mobs], data_t K[Nsta][Mobs],
+					data_t tmp6[Mobs][Nsta], data_t Pp[NTRI], data_t P[NTRI],
+					data_t tmp2[Nsta], data_t tmp5[Mobs])
+{
+	#pragma HLS inline off
+	#pragma HLS DATAFLOW
+	
+	step3(din, hx, fx, x, Kx, tmp2, tmp5);
+	step4(K, tmp6, Pp, P);
+}
+#endif
+
+
+/* no measurement: \hat{x}_k = f(\hat{x}_{k-1}), P_k = Pp (S_k = Sp with
+   SQRT_COV) */
+static void step_none(data_t fx[Nsta], data_t x[Nsta], data_t Pp[NTRI],
+					data_t P[NTRI])
+{
+	#pragma HLS inline off
+	
+	for (int i=0; i<Nsta; i++) {
+		#pragma HLS pipeline
+		x[i] = fx[i];
+	}
+	for (int t=0; t<NTRI; t++) {
+		#pragma HLS pipeline
+		P[t] = Pp[t];
+	}
+}
+
+
+/* u = P * H_k^T, s = H_k * u + R[k][k] and the innovation of z_k at the
+   current x, dy = z_k - hx_k - H_k * (x - fx) */
+static void seq_1(data_t H[Mobs][NHC], data_t P[NTRI], data_t R[Mobs][Mobs],
+				data_t din[Mobs], data_t hx[Mobs], data_t fx[Nsta], 
+				data_t x[Nsta], data_t u[Nsta], data_t *s, data_t *dy, int k)
+{
+	#pragma HLS inline off
+	
+	int bsize = BSIZE_H;
+	int i, l, m;
+	
+	data_t s_acc = R[k][k];
+	data_t h_acc = 0;
+	
+	for (i=0; i<Nsta; i++) {
+		#if (PARTIAL_N_2==0)
+		#pragma HLS pipeline
+		#endif
+		data_t result = 0;
+		for (l=0; l<(NHC/bsize); l++) {
+			#pragma HLS pipeline
+			data_t b_result = 0;
+			for (m=0; m<bsize; m++) {
+				data_t term = P[PSYM(i, HCOL(l*bsize+m))] * H[k][l*bsize+m];
+				b_result += term;
+			}
+			result += b_result;
+		}
+		u[i] = result;
+	}
+	
+	for (l=0; l<NHC; l++) {
+		#pragma HLS pipeline
+		s_acc += H[k][l] * u[HCOL(l)];
+		h_acc += H[k][l] * (x[HCOL(l)] - fx[HCOL(l)]);
+	}
+	
+	*s = s_acc;
+	*dy = din[k] - hx[k] - h_acc;
+}
+
+/* g = u / s, x = x + g * dy, P = P - g * u^T (upper triangle only) */
+static void seq_2(data_t u[Nsta], data_t s, data_t dy, data_t x[Nsta],
+				data_t P[NTRI], data_t g[Nsta])
+{
+	#pragma HLS inline off
+	
+	int i, j;
+	
+	data_t inv = (data_t)(1)/s;
+	
+	for (i=0; i<Nsta; i++) {
+		#pragma HLS pipeline
+		g[i] = u[i] * inv;
+		x[i] = x[i] + g[i] * dy;
+	}
+	
+	i = 0;
+	j = 0;
+	for (int t=0; t<NTRI; t++) {
+		#pragma HLS pipeline
+		P[t] = P[t] - g[i] * u[j];
+
+		// next (i, j) of the packed triangle
+		if (j == Nsta-1) {
+			i++;
+			j = i;
+		} else {
+			j++;
+		}
+	}
+}
+
+/* Measurement update as mo scalar updates, for a diagonal R. Same result
+   as step2-step4 but with one reciprocal per measurement and no inverse.
+   Works on xs and Pp, and only writes x and P if every s is positive;
+   returns 1 otherwise. The dy^2/s of the scalar updates add up to the NIS
+   of the step */
+static int step_seq(data_t H[Mobs][NHC], data_t Pp[NTRI], data_t R[Mobs][Mobs],
+				data_t din[Mobs], data_t hx[Mobs], data_t fx[Nsta],
+				data_t x[Nsta], data_t P[NTRI], data_t u[Nsta], data_t g[Nsta],
+				data_t xs[Nsta], int mo, struct ekf_health *hl)
+{
+	#pragma HLS inline off
+	#pragma HLS inline region
+	
+	nis_t nis = 0;
+	
+	for (int i=0; i<Nsta; i++) {
+		#pragma HLS pipeline
+		xs[i] = fx[i];
+	}
+	
+	for (int k=0; k<mo; k++) {
+		#pragma HLS loop_tripcount min=1 max=Mobs
+		data_t s, dy;
+		seq_1(H, Pp, R, din, hx, fx, xs, u, &s, &dy, k);
+		if (s < (data_t)PIVOT_TOL) {
+			hl->pivots++;
+		}
+		if (s <= 0) {
+			return 1;
+		}
+		seq_2(u, s, dy, xs, Pp, g);
+		nis += dy * dy / s;
+	}
+	
+	for (int i=0; i<Nsta; i++) {
+		#pragma HLS pipeline
+		x[i] = xs[i];
+	}
+	for (int t=0; t<NTRI; t++) {
+		#pragma HLS pipeline
+		P[t] = Pp[t];
+	}
+	hl->nis = nis;
+	
+	return 0;
+}
+
+
+#if (SQRT_COV == 1)
+
+/* Givens rotation [c s; -s c] taking (a, b) to (r, 0). The ratio of the
+   smaller to the larger of |a|, |b| is squared instead of a and b, so
+   nothing leaves the range of the factors */
+static void givens(data_t a, data_t b, rot_t *c, rot_t *s, data_t *r)
+{
+	#pragma HLS INLINE
+	
+	data_t aa = (a < 0) ? (data_t)(-a) : a;
+	data_t bb = (b < 0) ? (data_t)(-b) : b;
+	
+	if (b == 0) {
+		*c = 1;
+		*s = 0;
+		*r = a;
+	} else if (aa >= bb) {
+		rot_t t = (rdiv_t)b / a;
+		ap_fixed<bit_width, 3> v = 1 + t*t;
+		rot_t u = hls::sqrt(v);
+		*c = (rot_t)(1) / u;
+		*s = t * *c;
+		*r = (rnd_t)(a * u);
+	} else {
+		rot_t t = (rdiv_t)a / b;
+		ap_fixed<bit_width, 3> v = 1 + t*t;
+		rot_t u = hls::sqrt(v);
+		*s = (rot_t)(1) / u;
+		*c = t * *s;
+		*r = (rnd_t)(b * u);
+	}
+}
+
+/* Sp = QR of [S F^T; Qh]: Sp starts as Qh, and each row of S F^T is
+   rotated into it, zeroing the row from the left */
+static void srf_1(data_t F[Nsta][Nsta], data_t S[NTRI], data_t Q[Nsta][Nsta],
+				data_t Sp[NTRI], data_t Ft[Nsta][Nsta], data_t a[Nsta])
+{
+	#pragma HLS inline off
+	
+	int bsize = BSIZE_4;
+	int i, j, k, l;
+	
+	for (i=0; i<Nsta; i++) {
+		for (j=i; j<Nsta; j++) {
+			#pragma HLS pipeline
+			Sp[PTRI(i,j)] = Q[i][j];
+		}
+	}
+	
+	for (i=0; i<Nsta; i++) {
+		// a = row i of S F^T, S[i][k] = 0 for k < i
+		for (j=0; j<Nsta; j++) {
+			#pragma HLS pipeline
+			#if (F_STRUCT == FS_DENSE)
+			data_t result = 0;
+			for (l=0; l<(Nsta/bsize); l++) {
+				data_t b_result = 0;
+				for (k=0; k<bsize; k++) {
+					int c = l*bsize + k;
+					if (c >= i) {
+						b_result += S[PTRI(i,c)] * Ft[c][j];
+					}
+				}
+				result += b_result;
+			}
+			a[j] = result;
+			#else
+			data_t result = (j >= i) ? S[PTRI(i,j)] : (data_t)0;
+			#if (F_STRUCT == FS_CV)
+			// column j of S F^T gains column j+1 of S
+			if (((j % 2) == 0) && (j+1 >= i)) {
+				result += S[PTRI(i,j+1)];
+			}
+			#endif
+			a[j] = result;
+			#endif
+		}
+		
+		// a is zero left of i, or of the pair of i, unless F is dense
+		int j0 = (F_STRUCT == FS_DENSE) ? 0 : (i - (i % 2));
+		for (j=j0; j<Nsta; j++) {
+			rot_t c, s;
+			data_t r;
+			givens(Sp[PTRI(j,j)], a[j], &c, &s, &r);
+			Sp[PTRI(j,j)] = r;
+			for (k=j+1; k<Nsta; k++) {
+				#pragma HLS pipeline
+				data_t p = Sp[PTRI(j,k)];
+				Sp[PTRI(j,k)] = (rnd_t)(c*p + s*a[k]);
+				a[k] = (rnd_t)(c*a[k] - s*p);
+			}
+		}
+	}
+}
+
+/* QR of [Rh 0; Sp H^T Sp] into [Re U; 0 Sp], in place on Sp. The rows of
+   the lower block are taken from the last up: row i of Sp is zero left of
+   i, and so is every row of U while it is rotated against it, so Sp stays
+   upper triangular. Only the first mo rows of H and of Rh are used.
+   Returns 1 if a pivot of Re is zero; those whose square is below
+   PIVOT_TOL are counted in hl */
+static int srf_2(data_t H[Mobs][NHC], data_t Sp[NTRI], data_t R[Mobs][Mobs],
+				data_t T[Mobs][Mobs], data_t U[Mobs][Nsta], data_t b[Mobs],
+				int mo, struct ekf_health *hl)
+{
+	#pragma HLS inline off
+	
+	int bsize = BSIZE_H;
+	int i, j, k, l;
+	
+	for (j=0; j<Mobs; j++) {
+		for (k=0; k<Mobs; k++) {
+			#pragma HLS pipeline
+			T[j][k] = (k >= j) ? R[j][k] : (data_t)0;
+		}
+		for (k=0; k<Nsta; k++) {
+			#pragma HLS pipeline
+			U[j][k] = 0;
+		}
+	}
+	
+	for (i=Nsta-1; i>=0; i--) {
+		// b = row i of Sp H^T, over the NHC columns of H
+		for (j=0; j<mo; j++) {
+			#if (PARTIAL_H==0)
+			#pragma HLS pipeline
+			#endif
+			data_t result = 0;
+			for (l=0; l<(NHC/bsize); l++) {
+				#pragma HLS pipeline
+				data_t b_result = 0;
+				for (k=0; k<bsize; k++) {
+					int c = HCOL(l*bsize + k);
+					if (c >= i) {
+						b_result += Sp[PTRI(i,c)] * H[j][l*bsize + k];
+					}
+				}
+				result += b_result;
+			}
+			b[j] = result;
+		}
+		
+		for (j=0; j<mo; j++) {
+			rot_t c, s;
+			data_t r;
+			givens(T[j][j], b[j], &c, &s, &r);
+			T[j][j] = r;
+			for (k=j+1; k<mo; k++) {
+				#pragma HLS pipeline
+				data_t p = T[j][k];
+				T[j][k] = (rnd_t)(c*p + s*b[k]);
+				b[k] = (rnd_t)(c*b[k] - s*p);
+			}
+			for (k=i; k<Nsta; k++) {
+				#pragma HLS pipeline
+				data_t p = U[j][k];
+				data_t q = Sp[PTRI(i,k)];
+				U[j][k] = (rnd_t)(c*p + s*q);
+				Sp[PTRI(i,k)] = (rnd_t)(c*q - s*p);
+			}
+		}
+	}
+	
+	int fail = 0;
+	for (j=0; j<mo; j++) {
+		data_t t2 = T[j][j] * T[j][j];
+		if (t2 < (data_t)PIVOT_TOL) {
+			hl->pivots++;
+		}
+		if (T[j][j] == 0) {
+			fail = 1;
+		}
+	}
+	return fail;
+}
+
+/* x = fx + U^T w, with Re^T w = z - hx by forward substitution over the
+   first mo measurements, and w zero after them; returns w^T w, the NIS */
+static nis_t srf_3(data_t din[Mobs], data_t hx[Mobs], data_t fx[Nsta],
+				data_t x[Nsta], data_t T[Mobs][Mobs], data_t U[Mobs][Nsta],
+				data_t w[Mobs], int mo)
+{
+	#pragma HLS inline off
+	
+	int i, k;
+	nis_t nis = 0;
+	
+	for (i=0; i<mo; i++) {
+		data_t result = din[i] - hx[i];
+		for (k=0; k<i; k++) {
+			result -= T[k][i] * w[k];
+		}
+		w[i] = result / T[i][i];
+		nis += w[i] * w[i];
+	}
+	for (i=mo; i<Mobs; i++) {
+		w[i] = 0;
+	}
+	
+	for (i=0; i<Nsta; i++) {
+		#pragma HLS pipeline
+		data_t result = 0;
+		for (k=0; k<Mobs; k++) {
+			result += U[k][i] * w[k];
+		}
+		x[i] = fx[i] + result;
+	}
+	
+	return nis;
+}
+
+/* Square-root step on S, with P = S^T S: time update into Sp, measurement
+   update of the first mo measurements in place on Sp, and x, S written
+   only if Re is nonsingular; returns 1 otherwise */
+static int step_srf(data_t F[Nsta][Nsta], data_t H[Mobs][NHC], data_t S[NTRI],
+				data_t Q[Nsta][Nsta], data_t R[Mobs][Mobs], data_t Ft[Nsta][Nsta],
+				data_t din[Mobs], data_t hx[Mobs], data_t fx[Nsta],
+				data_t x[Nsta], data_t Sp[NTRI], data_t T[Mobs][Mobs],
+				data_t U[Mobs][Nsta], data_t a[Nsta], data_t b[Mobs], int mo,
+				struct ekf_health *hl)
+{
+	#pragma HLS inline off
+	#pragma HLS inline region
+	
+	/* Sp^T Sp = F P F^T + Q */
+	srf_1(F, S, Q, Sp, Ft, a);
+	
+	if (mo == 0) {
+		step_none(fx, x, Sp, S);
+		return 0;
+	}
+	
+	/* Re^T Re = H Pp H^T + R, U = Re^-T H Pp, Sp^T Sp = Pp - U^T U */
+	if (srf_2(H, Sp, R, T, U, b, mo, hl)) {
+		return 1;
+	}
+	
+	/* x = fx + K (z - hx), K = U^T Re^-T */
+	hl->nis = srf_3(din, hx, fx, x, T, U, b, mo);
+	
+	for (int t=0; t<NTRI; t++) {
+		#pragma HLS pipeline
+		S[t] = Sp[t];
+	}
+	
+	return 0;
+}
+
+#endif
+
+
+/* one step on the first mo rows of H, R, hx and din: Mobs, or the
+   measurements present in a masked step packed in front (see CTRL_MASK);
+   mo = 0 is the prediction alone. hl gets the pivot count and NIS of the
+   step */
+int ekf_step(	data_t x[Nsta], 
+				data_t fx[Nsta],
+				data_t hx[Mobs],				
+				data_t F[Nsta][Nsta],
+				data_t H[Mobs][NHC],
+				data_t P[NTRI],
+				data_t Q[Nsta][Nsta], 
+				data_t R[Mobs][Mobs],
+				data_t Ft[Nsta][Nsta],	 
+				data_t Ht[NHC][Mobs],
+				data_t din[Mobs],
+				data_t K[Nsta][Mobs],
+				int mo,
+				struct ekf_health *hl
+			)
+{        
+	
+	// post-prediction, pre-update, P (packed upper triangle)
+	static data_t Pp[NTRI] = {0};
+
+	// Temporary variables
+	static data_t tmp0[Nsta][Nsta] = {{0}};
+	static data_t tmp2[Nsta] = {0};
+	static data_t tmp3[Mobs][Mobs] = {{0}};
+	static data_t tmp4[Mobs] = {0};
+	static data_t tmp5[Mobs] = {0};
+	static data_t tmp6[Mobs][Nsta] = {{0}};
+	static data_t tmp7[Mobs] = {0};
+	static data_t tmp8[Nsta] = {0};
+	static data_t tmp9[Nsta] = {0};
+	static data_t Kx[Nsta][Mobs] = {{0}};   // copy of K, used with STEP34 only
+
+	#pragma HLS array_partition variable=tmp0 block factor=PART_N dim=2
+	#pragma HLS array_partition variable=Kx block factor=PART_M dim=2
+	#pragma HLS array_partition variable=tmp4 block factor=PART_M dim=1
+	#pragma HLS array_partition variable=tmp6 block factor=PART_N dim=2
+	#pragma HLS array_partition variable=tmp6 block factor=PART_M dim=1
+	#pragma HLS array_partition variable=Pp cyclic factor=PART_N dim=1
+	#pragma HLS array_partition variable=tmp5 block factor=PART_M dim=1
+	
+	int i, j;
+	
+	//#pragma HLS PIPELINE II=512
+	#pragma HLS inline off
+	
+	hl->pivots = 0;
+	hl->nis = 0;
+	
+	/* on failure x and P are left as they were before the step */
+	#if (SQRT_COV==1)
+	/* x_k, S_k by Givens rotations, P is never formed */
+	if (step_srf(F, H, P, Q, R, Ft, din, hx, fx, x, Pp, tmp3, tmp6, tmp2, tmp4, mo, hl)) {
+		return EKF_NOT_PD;
+	}
+	#else
+    /* P_k = F_{k-1} P_{k-1} F^T_{k-1} + Q_{k-1} */
+    step1(F, P, Q, Pp, Ft, tmp0);
+	
+	if (mo == 0) {
+		step_none(fx, x, Pp, P);
+		return EKF_OK;
+	}
+	
+	#if (SEQ_UPDATE==0)
+    /* K_k = P_k H^T_k (H_k P_k H^T_k + R)^{-1} */
+	if (step2(H, Pp, R, K, Kx, Ht, tmp3, tmp4, tmp6, mo, hl)) {
+		return EKF_NOT_PD;
+	}
+	
+	/* e^T (H_k P_k H^T_k + R)^{-1} e, on the factor of step2 */
+	hl->nis = nis_chol(tmp3, tmp4, din, hx, tmp7, mo);
+	
+    /* \hat{x}_k = \hat{x_k} + K_k(z_k - h(\hat{x}_k)) and
+       P_k = (I - K_k H_k) P_k, overlapped with STEP34 */
+	#if (STEP34 == 1)
+	step34(din, hx, fx, x, Kx, K, tmp6, Pp, P, tmp2, tmp5);
+	#else
+	step3(din, hx, fx, x, K, tmp2, tmp5);
+	step4(K, tmp6, Pp, P);
+	#endif
+	#else
+	/* x_k, P_k from one scalar update per measurement */
+	if (step_seq(H, Pp, R, din, hx, fx, x, P, tmp2, tmp8, tmp9, mo, hl)) {
+		return EKF_NOT_PD;
+	}
+	#endif
+	#endif
+	
+	return EKF_OK;
+
+}
+
+#if (STEADY_GAIN == 1)
+/* ekf_step until the gain of the context has settled, then its state update
+   only: *steady counts the full steps in a row in which no entry of K moved
+   by more than SS_TOL, and from SS_WIN on K and P are left as they are
+   (and hl is cleared, no NIS being formed) */
+int ekf_step_steady(data_t x[Nsta],
+				data_t fx[Nsta],
+				data_t hx[Mobs],
+				data_t F[Nsta][Nsta],
+				data_t H[Mobs][NHC],
+				data_t P[NTRI],
+				data_t Q[Nsta][Nsta],
+				data_t R[Mobs][Mobs],
+				data_t Ft[Nsta][Nsta],
+				data_t Ht[NHC][Mobs],
+				data_t din[Mobs],
+				data_t K[Nsta][Mobs],
+				int *steady,
+				struct ekf_health *hl
+			)
+{
+
+	// gain of the previous step
+	static data_t Kp[Nsta][Mobs] = {{0}};
+
+	// Temporary variables
+	static data_t tmp2[Nsta] = {0};
+	static data_t tmp5[Mobs] = {0};
+
+	#pragma HLS array_partition variable=Kp block factor=PART_M dim=2
+	#pragma HLS array_partition variable=tmp5 block factor=PART_M dim=1
+
+	#pragma HLS inline off
+
+	if (*steady >= SS_WIN) {
+		/* \hat{x}_k = f(\hat{x}_{k-1}) + K(z_k - h(\hat{x}_k)), K and P steady */
+		hl->pivots = 0;
+		hl->nis = 0;
+		step3(din, hx, fx, x, K, tmp2, tmp5);
+		FROZEN_STEP();
+		return EKF_OK;
+	}
+
+	for (int i=0; i<Nsta; i++) {
+		for (int j=0; j<Mobs; j++) {
+			#pragma HLS pipeline
+			Kp[i][j] = K[i][j];
+		}
+	}
+
+	if (ekf_step(x, fx, hx, F, H, P, Q, R, Ft, Ht, din, K, Mobs, hl) != EKF_OK) {
+		*steady = 0;
+		return EKF_NOT_PD;
+	}
+
+	// max |K_k - K_{k-1}|
+	data_t dk = 0;
+	for (int i=0; i<Nsta; i++) {
+		for (int j=0; j<Mobs; j++) {
+			#pragma HLS pipeline
+			data_t d = K[i][j] - Kp[i][j];
+			if (d < 0) {
+				d = -d;
+			}
+			if (d > dk) {
+				dk = d;
+			}
+		}
+	}
+	*steady = (dk <= (data_t)SS_TOL) ? (*steady + 1) : 0;
+
+	return EKF_OK;
+}
+#endif
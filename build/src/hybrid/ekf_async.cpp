@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "sds_lib.h"
+
+#include "ekf_async.h"
+#include "ekf_block.h"
+
+#define PARAMS_IN ((2*Nsta*Nsta)+(Mobs*Mobs))
+
+
+struct ekf_ring {
+    struct ekf_buf buf[EKF_RING_MAX];
+    int depth;
+    ekf_kernel_t kernel;
+    struct ekf_block mem;
+    port_t *block;      /* all the buffer sets */
+
+    /* tickets: [0, done) completed, [done, submitted) queued or running,
+       acquired is the next one handed out */
+    long acquired;
+    long submitted;
+    long done;
+    int stop;
+
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+
+/* words of one buffer, rounded up to 64 bytes on the board */
+#define WORDS(n) (((n) + 15) & ~15)
+#define SET_WORDS (WORDS(Mobs) + WORDS(Nsta) + WORDS(Mobs) + WORDS(Nsta*Nsta) + \
+                   WORDS(Mobs*NHC) + WORDS(PARAMS_IN) + WORDS(NSAVE) + WORDS(Nsta))
+
+/* runs the queued buffers in ticket order */
+static void *worker(void *arg)
+{
+    struct ekf_ring *r = (struct ekf_ring *)arg;
+
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (r->done == r->submitted && !r->stop)
+            pthread_cond_wait(&r->cond, &r->lock);
+        if (r->done == r->submitted)
+            break;
+        struct ekf_buf *b = &r->buf[r->done % r->depth];
+        pthread_mutex_unlock(&r->lock);
+
+        // the host does not touch a submitted buffer, no lock needed;
+        // inputs are obs to the end of state_i, outputs state_i to xout
+        ekf_block_flush(&r->mem, b->obs, b->xout - b->obs);
+        b->status = r->kernel(b->obs, b->fx_i, b->hx_i, b->F_i, b->H_i,
+                              b->params, b->xout, b->state_i, b->state_o,
+                              b->ctrl, b->ctx, b->w1, b->w2, b->w3i, b->w3o);
+        ekf_block_invalidate(&r->mem, b->state_i, WORDS(NSAVE) + WORDS(Nsta));
+
+        pthread_mutex_lock(&r->lock);
+        r->done++;
+        pthread_cond_broadcast(&r->cond);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+struct ekf_ring *ekf_ring_open(int depth, ekf_kernel_t kernel)
+{
+    if (depth < 1 || depth > EKF_RING_MAX)
+        return NULL;
+
+    struct ekf_ring *r = (struct ekf_ring *)calloc(1, sizeof(struct ekf_ring));
+    if (r == NULL)
+        return NULL;
+    r->depth = depth;
+    r->kernel = kernel ? kernel : top_ekf;
+
+    /* one contiguous block, each set with its inputs first, so a single
+       CMA buffer serves the whole ring */
+    if (ekf_block_open(&r->mem, depth*SET_WORDS, 1)) {
+        free(r);
+        return NULL;
+    }
+    r->block = ekf_block_alloc(&r->mem, depth*SET_WORDS);
+    if (r->block == NULL) {
+        ekf_block_close(&r->mem);
+        free(r);
+        return NULL;
+    }
+    for (int i=0; i<depth; i++) {
+        struct ekf_buf *b = &r->buf[i];
+        port_t *p = r->block + i*SET_WORDS;
+        b->obs = p;         p += WORDS(Mobs);
+        b->fx_i = p;        p += WORDS(Nsta);
+        b->hx_i = p;        p += WORDS(Mobs);
+        b->F_i = p;         p += WORDS(Nsta*Nsta);
+        b->H_i = p;         p += WORDS(Mobs*NHC);
+        b->params = p;      p += WORDS(PARAMS_IN);
+        b->state_i = p;     p += WORDS(NSAVE);
+        b->xout = p;
+        b->state_o = b->state_i;
+        b->ticket = -1;
+    }
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->worker, NULL, worker, r)) {
+        ekf_block_free(&r->mem, r->block);
+        ekf_block_close(&r->mem);
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->cond);
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+void ekf_ring_close(struct ekf_ring *r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->worker, NULL);
+
+    ekf_block_free(&r->mem, r->block);
+    ekf_block_close(&r->mem);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    free(r);
+}
+
+struct ekf_buf *ekf_acquire(struct ekf_ring *r)
+{
+    pthread_mutex_lock(&r->lock);
+    long t = r->acquired;
+    while (t - r->done >= r->depth)
+        pthread_cond_wait(&r->cond, &r->lock);
+    r->acquired++;
+    pthread_mutex_unlock(&r->lock);
+
+    struct ekf_buf *b = &r->buf[t % r->depth];
+    b->ticket = t;
+    return b;
+}
+
+long ekf_submit(struct ekf_ring *r, struct ekf_buf *b)
+{
+    pthread_mutex_lock(&r->lock);
+    r->submitted++;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    return b->ticket;
+}
+
+int ekf_poll(struct ekf_ring *r, long t)
+{
+    pthread_mutex_lock(&r->lock);
+    int done = (t < r->done);
+    pthread_mutex_unlock(&r->lock);
+    return done;
+}
+
+int ekf_wait(struct ekf_ring *r, long t)
+{
+    pthread_mutex_lock(&r->lock);
+    while (t >= r->done)
+        pthread_cond_wait(&r->cond, &r->lock);
+    pthread_mutex_unlock(&r->lock);
+    return r->buf[t % r->depth].status;
+}
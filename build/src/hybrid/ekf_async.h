@@ -0,0 +1,100 @@
+/*  ekf_async: non-blocking host driver for the hybrid top_ekf kernels.
+
+    A ring of `depth` buffer sets, each a full set of top_ekf arguments
+    carved out of one physically contiguous block, is served in order by a
+    worker thread that owns the kernel. The host fills the next free set and submits it,
+    and gets a ticket back; while the kernel runs, it prepares the next
+    steps, typically of other tracks in other contexts (ctx), since a step
+    of one track needs the output of its last:
+
+        struct ekf_ring *r = ekf_ring_open(4, NULL);
+        struct ekf_buf *b = ekf_acquire(r);     // blocks while all are in flight
+        ... fill b->obs, b->fx_i, b->hx_i, b->F_i, b->H_i, b->params
+        b->ctrl = CTRL_KEEP; b->ctx = trk; b->w1 = Nsta; b->w2 = Mobs;
+        b->w3i = b->w3o = 0;                    // NSAVE with CTRL_RESTORE / CTRL_SAVE
+        long t = ekf_submit(r, b);
+        ...
+        if (ekf_wait(r, t) == EKF_OK)           // or ekf_poll(r, t)
+            ... read b->xout (and b->state_o for CTRL_SAVE)
+        ekf_ring_close(r);
+
+    Buffers are handed out round-robin, so the outputs of ticket t stay
+    valid until the buffer of ticket t+depth is acquired. One buffer is
+    acquired at a time, and it is submitted before the next acquire. The
+    kernel is run in submission order, so steps of one context keep their
+    order, and nothing else may call top_ekf while the ring is open.
+
+    kernel is the function the worker calls, top_ekf if NULL. On the board
+    top_ekf is the stub that drives the accelerator; built on the host
+    against src/csim it is the C model of the kernel, which makes the ring
+    a software emulation of the hardware (see ctx_test and `make csim`).
+    Any function of the same signature can be passed, e.g. to model the
+    accelerator's latency.
+
+    The functions are extern "C", so they are exported by the kernel's
+    shared library for cffi.
+*/
+
+#ifndef EKF_ASYNC_H
+#define EKF_ASYNC_H
+
+#include "ekf_config.h"
+
+#define EKF_RING_MAX 16
+
+typedef int (*ekf_kernel_t)(port_t *obs, port_t *fx_i, port_t *hx_i,
+                            port_t *F_i, port_t *H_i, port_t *params,
+                            port_t *output, port_t *state_i, port_t *state_o,
+                            int ctrl, int ctx, int w1, int w2, int w3i, int w3o);
+
+/* one set of top_ekf arguments; state_i and state_o may be the same words */
+struct ekf_buf {
+    port_t *obs;        /* [Mobs] */
+    port_t *fx_i;       /* [Nsta] */
+    port_t *hx_i;       /* [Mobs] */
+    port_t *F_i;        /* [Nsta*Nsta] */
+    port_t *H_i;        /* [Mobs*NHC] */
+    port_t *params;     /* [2*Nsta*Nsta + Mobs*Mobs] */
+    port_t *xout;       /* [Nsta] */
+    port_t *state_i;    /* [NSAVE] */
+    port_t *state_o;    /* [NSAVE] */
+    int ctrl;
+    int ctx;
+    int w1;
+    int w2;
+    int w3i;
+    int w3o;
+    int status;         /* top_ekf return value, once complete */
+    long ticket;
+};
+
+struct ekf_ring;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* depth buffer sets, 1 to EKF_RING_MAX; NULL if out of memory */
+struct ekf_ring *ekf_ring_open(int depth, ekf_kernel_t kernel);
+
+/* waits for everything submitted, then frees the ring */
+void ekf_ring_close(struct ekf_ring *r);
+
+/* the next buffer set, once its last step has completed */
+struct ekf_buf *ekf_acquire(struct ekf_ring *r);
+
+/* queues b for the kernel and returns its ticket */
+long ekf_submit(struct ekf_ring *r, struct ekf_buf *b);
+
+/* 1 if ticket t has completed, else 0 */
+int ekf_poll(struct ekf_ring *r, long t);
+
+/* waits for ticket t and returns its status, EKF_OK or EKF_NOT_PD, or
+   its health word if the ctrl of the step had CTRL_HEALTH */
+int ekf_wait(struct ekf_ring *r, long t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
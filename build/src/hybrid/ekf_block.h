@@ -0,0 +1,95 @@
+/*  ekf_block: the port buffers of a host driver, and their coherence.
+
+    With P_CACHEABLE=2 the buffers are pieces of one cacheable CMA arena
+    (src/pynqlib/cma_arena.h), which the kernel reads and writes as if it
+    were non-cacheable: the driver flushes the inputs of a step before the
+    call and invalidates its outputs after it, one operation each, since
+    pieces allocated one after the other are adjacent.
+
+        struct ekf_block b;
+        ekf_block_open(&b, words, 3);
+        port_t *in = ekf_block_alloc(&b, n), *in2 = ekf_block_alloc(&b, n2);
+        port_t *out = ekf_block_alloc(&b, k);
+        ...
+        ekf_block_flush(&b, in, out - in);
+        top_ekf(...);
+        ekf_block_invalidate(&b, out, k);
+
+    With P_CACHEABLE=0 every buffer is a non-cacheable CMA buffer of its
+    own and with 1 a cacheable one that the SDSoC stub maintains; flush
+    and invalidate are then no-ops, and the difference of two buffers
+    above is never used.
+*/
+
+#ifndef EKF_BLOCK_H
+#define EKF_BLOCK_H
+
+#include "sds_lib.h"
+#include "../pynqlib/cma_arena.h"
+
+struct ekf_block {
+    void *arena;        /* P_CACHEABLE=2 only */
+};
+
+/* room for words port_t in at most pieces buffers; 0, or -1 if no CMA
+   memory is left */
+static inline int ekf_block_open(struct ekf_block *b, long words, int pieces)
+{
+    b->arena = NULL;
+#if P_CACHEABLE == 2
+    b->arena = cma_arena_create(words*sizeof(port_t) + pieces*CMA_ARENA_ALIGN, 1);
+    if (b->arena == NULL)
+        return -1;
+#endif
+    return 0;
+}
+
+/* frees the arena and every buffer still in it; with P_CACHEABLE 0 or 1
+   the buffers are freed one by one with ekf_block_free() */
+static inline void ekf_block_close(struct ekf_block *b)
+{
+#if P_CACHEABLE == 2
+    cma_arena_destroy(b->arena);
+#endif
+    b->arena = NULL;
+}
+
+static inline port_t *ekf_block_alloc(struct ekf_block *b, long words)
+{
+#if P_CACHEABLE == 2
+    return (port_t *)cma_arena_alloc(b->arena, words*sizeof(port_t));
+#elif P_CACHEABLE == 1
+    return (port_t *)sds_alloc(words*sizeof(port_t));
+#else
+    return (port_t *)sds_alloc_non_cacheable(words*sizeof(port_t));
+#endif
+}
+
+static inline void ekf_block_free(struct ekf_block *b, port_t *p)
+{
+    if (p == NULL)
+        return;
+#if P_CACHEABLE == 2
+    cma_arena_free(b->arena, p);
+#else
+    sds_free(p);
+#endif
+}
+
+/* before a call, the inputs the host wrote in [p, p+words) */
+static inline void ekf_block_flush(struct ekf_block *b, port_t *p, long words)
+{
+#if P_CACHEABLE == 2
+    cma_arena_flush(b->arena, p, words*sizeof(port_t));
+#endif
+}
+
+/* after a call, the outputs the kernel wrote in [p, p+words) */
+static inline void ekf_block_invalidate(struct ekf_block *b, port_t *p, long words)
+{
+#if P_CACHEABLE == 2
+    cma_arena_invalidate(b->arena, p, words*sizeof(port_t));
+#endif
+}
+
+#endif
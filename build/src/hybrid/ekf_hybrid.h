@@ -0,0 +1,486 @@
+
+#ifndef EKF_HYBRID_H
+#define EKF_HYBRID_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <hls_math.h>
+#include <ap_int.h>
+#include <ap_fixed.h>
+using namespace std;
+
+/* data_t format; the defaults are the shipped 32-bit datapath, other
+   widths and modes are for the precision sweep (src/csim/sweep.sh) */
+#ifndef bit_width
+#define bit_width 32
+#endif
+#ifndef frac_width
+#define frac_width 20
+#endif
+#ifndef DATA_Q
+#define DATA_Q AP_TRN   /* quantisation mode */
+#endif
+#ifndef DATA_O
+#define DATA_O AP_WRAP  /* overflow mode */
+#endif
+typedef ap_fixed<bit_width, (bit_width-frac_width), DATA_Q, DATA_O> data_t;
+typedef ap_uint<bit_width> port_t;
+
+/*  Size and inner-loop blocking:
+    -----------------------------
+        Nsta (states), Mobs (observables), EKF_II and NCTX come from the
+        ekf_config.h of each nXmY variant, which is generated by
+        `make variant` (see gen_variant.sh). EKF_II is the target number
+        of cycles per block of a row: the Nsta-long dot products are split
+        into EKF_II blocks of BSIZE_2 = BSIZE_4 = Nsta/EKF_II terms, and
+        every array read by such a block is partitioned into
+        PART_N = BSIZE_4/EKF_II banks, each read EKF_II times per block.
+        The Mobs-long loops are always a single block, PART_M = Mobs. A
+        variant may pin any of these by defining it first, subject to
+            (BSIZE_1 <= Mobs) and (Mobs%BSIZE_1 == 0)
+            (BSIZE_2 <= Nsta) and (Nsta%BSIZE_2 == 0)
+            (BSIZE_3 <= Mobs) and (Mobs%BSIZE_3 == 0)
+            (BSIZE_4 <= Nsta) and (Nsta%BSIZE_4 == 0)
+*/
+#if !defined(Nsta) || !defined(Mobs)
+#error "Nsta and Mobs must be defined before ekf_hybrid.h, see gen_variant.sh"
+#endif
+
+#ifndef EKF_II
+#define EKF_II 1
+#endif
+
+#ifndef BSIZE_1
+#define BSIZE_1 Mobs
+#endif
+#ifndef BSIZE_2
+#define BSIZE_2 (Nsta/EKF_II)
+#endif
+#ifndef BSIZE_3
+#define BSIZE_3 Mobs
+#endif
+#ifndef BSIZE_4
+#define BSIZE_4 (Nsta/EKF_II)
+#endif
+#ifndef PART_N
+#define PART_N (BSIZE_4/EKF_II)
+#endif
+#ifndef PART_M
+#define PART_M Mobs
+#endif
+
+#if (Nsta % EKF_II != 0) || ((Nsta/EKF_II) % EKF_II != 0)
+#error "EKF_II must divide Nsta, and Nsta/EKF_II"
+#endif
+#if (BSIZE_1 > Mobs) || (Mobs % BSIZE_1 != 0) || (BSIZE_3 > Mobs) || (Mobs % BSIZE_3 != 0)
+#error "BSIZE_1 and BSIZE_3 must divide Mobs"
+#endif
+#if (BSIZE_2 > Nsta) || (Nsta % BSIZE_2 != 0) || (BSIZE_4 > Nsta) || (Nsta % BSIZE_4 != 0)
+#error "BSIZE_2 and BSIZE_4 must divide Nsta"
+#endif
+#if (Nsta % PART_N != 0) || (Mobs % PART_M != 0)
+#error "PART_N must divide Nsta and PART_M must divide Mobs"
+#endif
+
+/* 1 if the loops over Mobs (BSIZE_1) or Nsta (BSIZE_4) take more than one
+   block, so that only their inner block loop is pipelined */
+#define PARTIAL_M (BSIZE_1 != Mobs)
+#define PARTIAL_N_2 (BSIZE_4 != Nsta)
+
+/*  Structure of F:
+    --------------
+        F_STRUCT selects how step1 forms F P F^T. FS_DENSE takes F from F_i
+        (w1=Nsta when F or H change). The other two fix F at compile time,
+        so the product takes adds only and F_i is never transferred (w1
+        still sizes H_i):
+            FS_IDENTITY  F = I
+            FS_CV        F = kron(I, [[1,1],[0,1]]), i.e. (position,
+                         velocity) pairs, as in the GPS and light models
+*/
+#define FS_DENSE    0
+#define FS_IDENTITY 1
+#define FS_CV       2
+
+#ifndef F_STRUCT
+#define F_STRUCT FS_DENSE
+#endif
+
+#if (F_STRUCT == FS_CV) && (Nsta % 2 != 0)
+#error "FS_CV needs (position, velocity) pairs, i.e. an even Nsta"
+#endif
+
+/*  Structure of H:
+    --------------
+        With H_SPARSE=0, H_i carries the full H, Mobs x Nsta. With
+        H_SPARSE=1 only the NHC columns HCOL(k) of H may be nonzero, the
+        positions of (position, velocity) pairs as in the GPS, light and
+        constant velocity models. H_i then carries those columns packed,
+        Mobs x NHC row-major, and H Pp, H Pp H^T and the sequential update
+        loop over them only. The loops over the columns of H are blocked
+        by BSIZE_H, with (BSIZE_H <= NHC) and (NHC%BSIZE_H == 0).
+*/
+#ifndef H_SPARSE
+#define H_SPARSE 0
+#endif
+
+#if (H_SPARSE == 0)
+#define NHC Nsta
+#define HCOL(k) (k)
+#define BSIZE_H BSIZE_2
+#else
+#define NHC (Nsta/2)
+#define HCOL(k) (2*(k))
+#define BSIZE_H ((NHC < BSIZE_2) ? NHC : BSIZE_2)
+#endif
+
+#if (NHC % BSIZE_H != 0)
+#error "BSIZE_H must divide NHC; pick an EKF_II that divides Nsta/2"
+#endif
+
+/* 1 if the loops over the columns of H take more than one block */
+#define PARTIAL_H (BSIZE_H != NHC)
+
+#if (H_SPARSE == 1) && (Nsta % 2 != 0)
+#error "H_SPARSE needs (position, velocity) pairs, i.e. an even Nsta"
+#endif
+
+/*  Measurement update:
+    ------------------
+        SEQ_UPDATE=0 forms the gain K by a Cholesky factorisation of
+        H Pp H^T + R and a triangular solve per state, no inverse. With
+        SEQ_UPDATE=1, R must be diagonal (its off-diagonal entries are
+        ignored) and the update is done as Mobs scalar updates instead, one
+        reciprocal and one rank-1 update of P each, without any inverse.
+*/
+#ifndef SEQ_UPDATE
+#define SEQ_UPDATE 0
+#endif
+
+/*  With STEP34=1 the state update (step3) and the covariance update
+    (step4) of the SEQ_UPDATE=0 step run as one DATAFLOW region, at the
+    cost of a second copy of K for step3. step3 is short, so the overlap
+    saves 2-5% of a step for up to 8 states and well under 1% above,
+    where it is off by default.
+*/
+#ifndef STEP34
+#define STEP34 (Nsta <= 8)
+#endif
+
+/*  Square-root covariance:
+    ----------------------
+        With SQRT_COV=1 the kernel never forms P. It keeps its upper
+        triangular Cholesky factor S instead, P = S^T S, in the same packed
+        triangle, and Q and R hold upper triangular factors of the process
+        and measurement noise too (the square roots of their diagonals for
+        the bundled models). params, state_i and state_o then carry S, Qh
+        and Rh in place of P, Q and R, with zeros below the diagonal.
+        Both updates are Givens QR factorisations of a stacked array:
+            time         [S F^T; Qh] -> [S'; 0]
+            measurement  [Rh 0; S' H^T S'] -> [Re K'; 0 S+]
+        with x = fx + K'^T Re^-T (z - hx), one triangular solve of Mobs.
+        The factors span half the exponent range of P and stay positive
+        definite by construction, so the datapath can be narrower. The
+        rotation coefficients, all in [-2, 2), use rot_t: bit_width bits
+        with 2 integer bits. They and the rotated values are rounded to
+        nearest whatever DATA_Q, since truncation would shrink S by up to
+        an LSB per rotation. SEQ_UPDATE does not apply.
+*/
+#ifndef SQRT_COV
+#define SQRT_COV 0
+#endif
+
+#if (SQRT_COV == 1) && (SEQ_UPDATE == 1)
+#error "SQRT_COV has its own measurement update, build with SEQ_UPDATE=0"
+#endif
+
+#if (SQRT_COV == 1)
+typedef ap_fixed<bit_width, 2, AP_RND, AP_WRAP> rot_t;
+/* data_t, rounded to nearest: the outputs of the rotations */
+typedef ap_fixed<bit_width, (bit_width-frac_width), AP_RND, DATA_O> rnd_t;
+/* dividend of t = b/a, with the fractional bits of rot_t in the quotient */
+typedef ap_fixed<(2*bit_width)-frac_width-2, (bit_width-frac_width), DATA_Q, DATA_O> rdiv_t;
+#endif
+
+/*  Steady-state gain:
+    -----------------
+        With STEADY_GAIN=1 a context whose F, H, Q and R stay the same, as
+        in linear KF operation (w1=w2=0, or the same Jacobians sent again),
+        stops updating P once its gain has settled: after SS_WIN full steps
+        in a row in which no entry of K moved by more than SS_TOL, a step
+        is only x = fx + K (z - hx) with the context's last K, Nsta*Mobs
+        MACs, and P stays at its steady-state value. The next full step
+        follows an F or H that differs from the context's on load, an init
+        (ctrl without CTRL_KEEP) or a CTRL_RESTORE, since the settled gain
+        is not part of a spilled context. Needs SEQ_UPDATE=0, SQRT_COV=0.
+*/
+#ifndef STEADY_GAIN
+#define STEADY_GAIN 0
+#endif
+#ifndef SS_TOL
+#define SS_TOL 1e-4
+#endif
+#ifndef SS_WIN
+#define SS_WIN 8
+#endif
+
+#if (STEADY_GAIN == 1) && ((SEQ_UPDATE == 1) || (SQRT_COV == 1))
+#error "STEADY_GAIN caches the gain K of the dense update, build with SEQ_UPDATE=0 and SQRT_COV=0"
+#endif
+
+/*  Covariance storage:
+    -------------------
+        P and Pp are symmetric, so on chip they hold only their upper
+        triangle, NTRI words packed row by row: P[PTRI(i,j)] = P[i][j] for
+        i <= j. PSYM(i,j) takes either order. P in params, state_i and
+        state_o is still the full Nsta*Nsta matrix. With SQRT_COV=1 the
+        triangle is S, which is not symmetric: PSYM does not apply to it.
+*/
+#define NTRI ((Nsta*(Nsta+1))/2)
+#define PTRI(i,j) ((i)*Nsta - (((i)*((i)-1))/2) + (j) - (i))
+#define PSYM(i,j) (((i) <= (j)) ? PTRI(i,j) : PTRI(j,i))
+
+/*  Filter contexts:
+    ---------------
+        top_ekf keeps NCTX independent filters on chip, selected by ctx.
+        A context can be spilled to / filled from DDR through state_o /
+        state_i, as NSAVE words: x[Nsta] followed by P[Nsta*Nsta]. Each
+        port has its own length, w3i = NSAVE with CTRL_RESTORE and w3o =
+        NSAVE with CTRL_SAVE, 0 otherwise: a stream that is sent but not
+        read (or expected but not written) never completes its DMA.
+*/
+#ifndef NCTX
+#define NCTX 16
+#endif
+#define NSAVE (Nsta + Nsta*Nsta)
+
+/* ctrl bits; ctrl=0 initialises the context and steps, ctrl=1 just steps */
+#define CTRL_KEEP    1  /* keep P, Q, R, otherwise (re)load them from params */
+#define CTRL_RESTORE 2  /* load x, P from state_i before the step */
+#define CTRL_SAVE    4  /* write x, P to state_o after the step */
+#define CTRL_NOSTEP  8  /* skip the filter step, only init/restore/save */
+#define CTRL_MASK    16 /* only the measurements in the mask bits are present */
+
+/*  Observation masks:
+    -----------------
+        With CTRL_MASK, bit OBS_SHIFT+i of ctrl is set if measurement i is
+        present in this step, e.g. CTRL_KEEP | CTRL_OBS(0x5) for 0 and 2
+        only. obs and hx_i keep their Mobs entries, the absent ones being
+        ignored, and H_i, when sent, carries the present rows of H only, in
+        order: w2 is their count, and any other w2 but 0 refuses the call
+        with EKF_BAD_LEN. The update runs on the present rows packed in front, so
+        H Pp H^T + R and its Cholesky factorisation (the scalar updates with
+        SEQ_UPDATE, the rotations of Re with SQRT_COV) shrink with them, and
+        with no bit set the step is the prediction alone. With SQRT_COV, R
+        must be diagonal, as the rows of Rh are taken as the factor of the
+        present block of R. Without CTRL_MASK all Mobs are present.
+*/
+#define OBS_SHIFT    8
+#define CTRL_OBS(m)  (CTRL_MASK | ((m) << OBS_SHIFT))
+
+#if (Mobs > 31 - OBS_SHIFT)
+#error "the observation mask of ctrl holds up to 23 measurements"
+#endif
+
+/* top_ekf/ekf_step return values; on EKF_NOT_PD the step is dropped and
+   x, P keep their values from before it */
+#define EKF_OK        0
+#define EKF_NOT_PD    1  /* H P H^T + R (or one scalar s, or a pivot of Re) is not positive definite */
+
+/* a call refused whole: no context is touched, the output is zeros, and
+   every port still moves the words of its copy pragma below */
+#define EKF_BAD_CTX   2  /* ctx is not in [0, NCTX) */
+#define EKF_BAD_LEN   3  /* w1 not 0 or Nsta, w2 not 0 or the present rows,
+                             w3i/w3o not NSAVE with CTRL_RESTORE/CTRL_SAVE and 0 without */
+
+/*  Health word:
+    -----------
+        With CTRL_HEALTH in ctrl, top_ekf returns the status above in its
+        low byte and counters of the step in the other bits, all of them
+        saturating:
+            HL_STATUS  one of the EKF_ return values above
+            HL_RANGE   entries of x and of the diagonal of P (S with
+                       SQRT_COV) past RANGE_LIM, a quarter of the range of
+                       data_t: the next products of the filter are close
+                       to wrapping (or saturating, with DATA_O=AP_SAT)
+            HL_PIVOT   pivots of H Pp H^T + R below PIVOT_TOL, where a
+                       reciprocal keeps only half the fractional bits:
+                       Cholesky pivots, the scalar s of SEQ_UPDATE, the
+                       squared diagonal of Re with SQRT_COV; one that is
+                       not positive is also EKF_NOT_PD
+            HL_NEGP    diagonal entries of P that are not positive after
+                       the step (of S that are zero, with SQRT_COV)
+            HL_NIS     the normalised innovation squared over the present
+                       measurements, e^T (H Pp H^T + R)^-1 e / mo, in 1/16:
+                       about 16 for a consistent filter, far above for a
+                       diverging one; 0 when no update is formed (mo = 0,
+                       a frozen STEADY_GAIN step, EKF_NOT_PD)
+        A host can then re-initialise the one context whose word flags it,
+        e.g. HL_NEGP > 0 or HL_NIS past a chi-square bound, instead of
+        discarding the batch. Without CTRL_HEALTH the return is the status
+        alone. The counters are formed on every step, a few compares and
+        one extra substitution of Mobs; the packing is all CTRL_HEALTH adds.
+*/
+#define CTRL_HEALTH  32 /* return the health word instead of the status */
+
+#define HL_STATUS(r) ((r) & 0xff)
+#define HL_RANGE(r)  (((r) >> 8) & 0xf)
+#define HL_PIVOT(r)  (((r) >> 12) & 0xf)
+#define HL_NEGP(r)   (((r) >> 16) & 0xf)
+#define HL_NIS(r)    (((r) >> 20) & 0x7ff)
+
+#ifndef RANGE_LIM
+#define RANGE_LIM (1 << (bit_width-frac_width-3))
+#endif
+#ifndef PIVOT_TOL
+#define PIVOT_TOL (1.0/(1 << (frac_width/2)))
+#endif
+
+#if (bit_width-frac_width < 3)
+#error "RANGE_LIM needs at least 3 integer bits in data_t"
+#endif
+
+/* NIS accumulator: data_t that saturates instead of wrapping */
+typedef ap_fixed<bit_width, (bit_width-frac_width), AP_TRN, AP_SAT> nis_t;
+
+/* counters of one ekf_step, for the health word */
+struct ekf_health {
+    int pivots;     /* pivots below PIVOT_TOL */
+    nis_t nis;      /* e^T (H Pp H^T + R)^-1 e, 0 if not formed */
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#pragma SDS data access_pattern(obs:SEQUENTIAL, output:SEQUENTIAL)
+//#pragma SDS data access_pattern(F_i:SEQUENTIAL, H_i:SEQUENTIAL)
+#pragma SDS data copy(obs[0:Mobs], params[0: ((2*Nsta*Nsta)+(Mobs*Mobs))], output[0:Nsta])
+#if (F_STRUCT == FS_DENSE)
+#pragma SDS data copy(F_i[0:(w1*w1)])
+#else
+#pragma SDS data copy(F_i[0:0])
+#endif
+#if (H_SPARSE == 0)
+#pragma SDS data copy(H_i[0:(w1*w2)])
+#else
+#pragma SDS data copy(H_i[0:((w1/2)*w2)])
+#endif
+#pragma SDS data copy(state_i[0:w3i], state_o[0:w3o])
+#pragma SDS data data_mover(obs:AXIDMA_SIMPLE, params:AXIDMA_SIMPLE, output:AXIDMA_SIMPLE)
+#pragma SDS data data_mover(fx_i:AXIDMA_SIMPLE, hx_i:AXIDMA_SIMPLE, F_i:AXIDMA_SIMPLE, H_i:AXIDMA_SIMPLE)
+#pragma SDS data data_mover(state_i:AXIDMA_SIMPLE, state_o:AXIDMA_SIMPLE)
+
+/* P_CACHEABLE=2: cacheable buffers the host driver flushes and
+   invalidates itself (ekf_block.h), so the stub must not */
+#if P_CACHEABLE != 1
+#pragma SDS data mem_attribute(obs:PHYSICAL_CONTIGUOUS|NON_CACHEABLE, \
+    params:PHYSICAL_CONTIGUOUS|NON_CACHEABLE, \
+    output:PHYSICAL_CONTIGUOUS|NON_CACHEABLE)
+#pragma SDS data mem_attribute(fx_i:PHYSICAL_CONTIGUOUS|NON_CACHEABLE, \
+    hx_i:PHYSICAL_CONTIGUOUS|NON_CACHEABLE, \
+    F_i:PHYSICAL_CONTIGUOUS|NON_CACHEABLE, \
+    H_i:PHYSICAL_CONTIGUOUS|NON_CACHEABLE)
+#pragma SDS data mem_attribute(state_i:PHYSICAL_CONTIGUOUS|NON_CACHEABLE, \
+    state_o:PHYSICAL_CONTIGUOUS|NON_CACHEABLE)
+#else
+#pragma SDS data mem_attribute(obs:PHYSICAL_CONTIGUOUS, \
+    params:PHYSICAL_CONTIGUOUS, \
+    output:PHYSICAL_CONTIGUOUS)
+#pragma SDS data mem_attribute(fx_i:PHYSICAL_CONTIGUOUS, \
+    hx_i:PHYSICAL_CONTIGUOUS, \
+    F_i:PHYSICAL_CONTIGUOUS, \
+    H_i:PHYSICAL_CONTIGUOUS)
+#pragma SDS data mem_attribute(state_i:PHYSICAL_CONTIGUOUS, \
+    state_o:PHYSICAL_CONTIGUOUS)
+#endif
+
+int top_ekf(    port_t *obs,
+                port_t fx_i[Nsta],
+                port_t hx_i[Mobs],
+                port_t F_i[Nsta*Nsta],
+                port_t H_i[Mobs*NHC],
+                port_t params[(2*Nsta*Nsta)+(Mobs*Mobs)], 
+                port_t *output,
+                port_t state_i[NSAVE],
+                port_t state_o[NSAVE],
+                int ctrl,
+                int ctx,
+                int w1,
+                int w2,
+                int w3i,
+                int w3o
+            );
+
+#ifdef __cplusplus
+}
+#endif
+
+/* C simulation only: the words the last top_ekf call moved on each port of
+   a variable length, for the harnesses to hold against the copy pragmas */
+#ifndef __SYNTHESIS__
+struct ekf_ports { int F_i, H_i, state_i, state_o; };
+extern struct ekf_ports ekf_ports;
+#define PORT_WORDS(p, n) (ekf_ports.p += (n))
+#else
+#define PORT_WORDS(p, n)
+#endif
+
+/* C simulation only: the STEADY_GAIN steps run with a settled K, over all
+   calls, for the harnesses to check that the gain froze at all */
+#ifndef __SYNTHESIS__
+extern long ekf_frozen;
+#define FROZEN_STEP() (ekf_frozen++)
+#else
+#define FROZEN_STEP()
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif          
+int ekf_step(   data_t x[Nsta], 
+                data_t fx[Nsta],
+                data_t hx[Mobs],                
+                data_t F[Nsta][Nsta],
+                data_t H[Mobs][NHC],
+                data_t P[NTRI],
+                data_t Q[Nsta][Nsta], 
+                data_t R[Mobs][Mobs],
+                data_t Ft[Nsta][Nsta],   
+                data_t Ht[NHC][Mobs],
+                data_t din[Mobs],
+                data_t K[Nsta][Mobs],
+                int mo,
+                struct ekf_health *hl
+            );
+#if (STEADY_GAIN == 1)
+int ekf_step_steady(data_t x[Nsta],
+                data_t fx[Nsta],
+                data_t hx[Mobs],
+                data_t F[Nsta][Nsta],
+                data_t H[Mobs][NHC],
+                data_t P[NTRI],
+                data_t Q[Nsta][Nsta],
+                data_t R[Mobs][Mobs],
+                data_t Ft[Nsta][Nsta],
+                data_t Ht[NHC][Mobs],
+                data_t din[Mobs],
+                data_t K[Nsta][Mobs],
+                int *steady,
+                struct ekf_health *hl
+            );
+#endif
+#ifdef __cplusplus
+}
+#endif          
+
+void init(  data_t P[NTRI], 
+            data_t Q[Nsta][Nsta], 
+            data_t R[Mobs][Mobs], 
+            port_t params[(2*Nsta*Nsta)+(Mobs*Mobs)]
+        );
+
+void save_state(data_t x[Nsta], data_t P[NTRI], port_t state[NSAVE]);
+void restore_state(data_t x[Nsta], data_t P[NTRI], port_t state[NSAVE]);
+
+#endif
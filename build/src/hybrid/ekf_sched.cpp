@@ -0,0 +1,479 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* before ekf_config.h, whose Nsta/Mobs macros clash with its template
+   parameter names */
+#include "tiny_ekf.hpp"
+
+#include "sds_lib.h"
+#include "ekf_sched.h"
+#include "ekf_block.h"
+#include "../fxconv/fxconv.h"
+
+#define PARAMS_IN ((2*Nsta*Nsta)+(Mobs*Mobs))
+
+/* words of one buffer, rounded up to 64 bytes on the board */
+#define WORDS(n) (((n) + 15) & ~15)
+#define SET_WORDS (WORDS(Mobs) + WORDS(Nsta) + WORDS(Mobs) + WORDS(Nsta*Nsta) + \
+                   WORDS(Mobs*NHC) + WORDS(Nsta))
+#define FILT_WORDS (WORDS(NSAVE) + WORDS(PARAMS_IN))
+
+/* model outputs, packed H and one matrix, in doubles */
+#define SCRATCH (Nsta + Mobs + 2*Nsta*Nsta + Mobs*Nsta + Mobs*NHC)
+
+#if (SQRT_COV == 1)
+typedef tinyekf::EkfSqrt<Nsta, Mobs, double, F_STRUCT> cpu_ekf;
+#define CPU_P(e) ((e)->S)
+#define CPU_Q(e) ((e)->Qh)
+#define CPU_R(e) ((e)->Rh)
+#else
+typedef tinyekf::Ekf<Nsta, Mobs, double, F_STRUCT> cpu_ekf;
+#define CPU_P(e) ((e)->P)
+#define CPU_Q(e) ((e)->Q)
+#define CPU_R(e) ((e)->R)
+#endif
+
+
+struct filt {
+    port_t *state;              /* x, P between steps, as a spilled context */
+    port_t *params;             /* P, Q, R */
+    double x[Nsta];             /* last output, x0 before the first step */
+    int fresh;                  /* the next step starts from x0 and params */
+    int on_chip;                /* the last step ran in context f % NCTX */
+    int queued;                 /* on a backend queue or running */
+    long submitted;
+    long done;
+    double *rows;               /* [EKF_SCHED_QMAX][cols] */
+    double *xout[EKF_SCHED_QMAX];
+    int status[EKF_SCHED_QMAX];
+};
+
+/* a backend thread: 0 owns the kernel, the others are CPU workers */
+struct worker {
+    struct ekf_sched *s;
+    int id;
+    int *q;                     /* ring of filters, oldest at head */
+    int head;
+    int len;
+    int running;
+    long n;
+    double lat;                 /* us per step, moving average */
+    pthread_t thread;
+};
+
+struct ekf_sched {
+    int nfilt;
+    int cols;
+    int nw;                     /* workers, 1 + CPUs */
+    ekf_kernel_t kernel;
+    ekf_model_fn model;
+    void *user;
+
+    struct filt *filt;
+    struct worker w[1 + EKF_SCHED_CPUS];
+    int resident[NCTX];         /* filter whose state is in each context */
+
+    /* the kernel's inputs and output, then the filters' state and params */
+    struct ekf_block mem;
+    port_t *block;
+    port_t *obs, *fx_i, *hx_i, *F_i, *H_i, *xout;
+
+    long pending;               /* submitted and not done, all filters */
+    long steps[2];
+    long steals;
+    long restores;
+    long failures;
+    int stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;        /* a filter was queued, or stop */
+    pthread_cond_t done;        /* a step completed */
+};
+
+
+static double now_us()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1e6 + t.tv_nsec*1e-3;
+}
+
+/* queues f on the backend that should finish it first; lock held */
+static void dispatch(struct ekf_sched *s, int f)
+{
+    int best = 0;
+    double cost = 0;
+
+    for (int i=0; i<s->nw; i++) {
+        struct worker *w = &s->w[i];
+        double c = (w->len + w->running + 1)*w->lat;
+        if (i == 0 || c < cost) {
+            best = i;
+            cost = c;
+        }
+    }
+    struct worker *w = &s->w[best];
+    w->q[(w->head + w->len) % s->nfilt] = f;
+    w->len++;
+    s->filt[f].queued = 1;
+    pthread_cond_broadcast(&s->work);
+}
+
+/* the oldest filter of w's queue, else the newest of the longest other
+   queue; -1 if all are empty. lock held */
+static int take(struct ekf_sched *s, struct worker *w)
+{
+    if (w->len > 0) {
+        int f = w->q[w->head];
+        w->head = (w->head + 1) % s->nfilt;
+        w->len--;
+        return f;
+    }
+
+    struct worker *v = NULL;
+    for (int i=0; i<s->nw; i++)
+        if (i != w->id && s->w[i].len > (v ? v->len : 0))
+            v = &s->w[i];
+    if (v == NULL)
+        return -1;
+    v->len--;
+    s->steals++;
+    return v->q[(v->head + v->len) % s->nfilt];
+}
+
+/* one step of t on the kernel, in context ctx; its spilled words go in
+   with CTRL_RESTORE only, and come back with CTRL_SAVE, on every step */
+static int step_fpga(struct ekf_sched *s, struct filt *t, const double *row,
+                     double *m, int ctx, int ctrl)
+{
+    double *fx = m, *hx = fx + Nsta, *F = hx + Mobs, *H = F + Nsta*Nsta;
+    double *Hc = H + Mobs*Nsta;
+
+    s->model(t->x, row, fx, hx, F, H, s->user);
+    // the NHC columns of H the kernel reads, packed
+    for (int i=0; i<Mobs; i++)
+        for (int k=0; k<NHC; k++)
+            Hc[i*NHC + k] = H[i*Nsta + HCOL(k)];
+
+    port_from_double(s->obs, row + s->cols - Mobs, Mobs, bit_width, frac_width, FX_MODE);
+    port_from_double(s->fx_i, fx, Nsta, bit_width, frac_width, FX_MODE);
+    port_from_double(s->hx_i, hx, Mobs, bit_width, frac_width, FX_MODE);
+    port_from_double(s->F_i, F, Nsta*Nsta, bit_width, frac_width, FX_MODE);
+    port_from_double(s->H_i, Hc, Mobs*NHC, bit_width, frac_width, FX_MODE);
+
+    int w3i = (ctrl & CTRL_RESTORE) ? NSAVE : 0;
+    // the CPU engines write state and params too, so both go with the step
+    ekf_block_flush(&s->mem, s->obs, s->xout - s->obs);
+    ekf_block_flush(&s->mem, t->state, FILT_WORDS);
+    int status = s->kernel(s->obs, s->fx_i, s->hx_i, s->F_i, s->H_i, t->params,
+                           s->xout, t->state, t->state, ctrl, ctx, Nsta, Mobs,
+                           w3i, NSAVE);
+    ekf_block_invalidate(&s->mem, s->xout, Nsta);
+    ekf_block_invalidate(&s->mem, t->state, NSAVE);
+    port_to_double(t->x, s->xout, Nsta, bit_width, frac_width);
+    return status;
+}
+
+/* one step of t on the CPU engine e, from and back to its spilled words */
+static int step_cpu(struct ekf_sched *s, cpu_ekf *e, struct filt *t,
+                    const double *row, double *m)
+{
+    double *fx = m, *hx = fx + Nsta, *F = hx + Mobs, *H = F + Nsta*Nsta;
+    double *a = H + Mobs*Nsta + Mobs*NHC;
+
+    s->model(t->x, row, fx, hx, F, H, s->user);
+
+    // a fresh start spills x0 and the P of params, as a kernel init would
+    if (t->fresh) {
+        port_from_double(t->state, t->x, Nsta, bit_width, frac_width, FX_MODE);
+        memcpy(t->state + Nsta, t->params, Nsta*Nsta*sizeof(port_t));
+    }
+
+    port_to_double(a, t->state + Nsta, Nsta*Nsta, bit_width, frac_width);
+    for (int i=0; i<Nsta; i++)
+        for (int j=0; j<Nsta; j++)
+            CPU_P(e)[i][j] = a[i*Nsta + j];
+    port_to_double(a, t->params + Nsta*Nsta, Nsta*Nsta, bit_width, frac_width);
+    for (int i=0; i<Nsta; i++)
+        for (int j=0; j<Nsta; j++)
+            CPU_Q(e)[i][j] = a[i*Nsta + j];
+    port_to_double(a, t->params + 2*Nsta*Nsta, Mobs*Mobs, bit_width, frac_width);
+    for (int i=0; i<Mobs; i++)
+        for (int j=0; j<Mobs; j++)
+            CPU_R(e)[i][j] = a[i*Mobs + j];
+
+    for (int i=0; i<Nsta; i++) {
+        e->fx[i] = fx[i];
+        for (int j=0; j<Nsta; j++)
+            e->F[i][j] = F[i*Nsta + j];
+    }
+    for (int i=0; i<Mobs; i++) {
+        e->hx[i] = hx[i];
+        for (int j=0; j<Nsta; j++)
+            e->H[i][j] = H[i*Nsta + j];
+    }
+
+    // dropped: the spilled x, P stay as they were, as on the kernel
+    if (e->step(row + s->cols - Mobs) != 0) {
+        port_to_double(t->x, t->state, Nsta, bit_width, frac_width);
+        return EKF_NOT_PD;
+    }
+
+    port_from_double(t->state, e->x, Nsta, bit_width, frac_width, FX_MODE);
+    for (int i=0; i<Nsta; i++)
+        port_from_double(t->state + Nsta + i*Nsta, CPU_P(e)[i], Nsta,
+                         bit_width, frac_width, FX_MODE);
+    port_to_double(t->x, t->state, Nsta, bit_width, frac_width);
+    return EKF_OK;
+}
+
+static void *worker(void *arg)
+{
+    struct worker *w = (struct worker *)arg;
+    struct ekf_sched *s = w->s;
+    cpu_ekf *e = (w->id > 0) ? new cpu_ekf() : NULL;
+    double *m = (double *)malloc(SCRATCH*sizeof(double));
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        int f;
+        while ((f = take(s, w)) < 0 && !s->stop)
+            pthread_cond_wait(&s->work, &s->lock);
+        if (f < 0)
+            break;
+
+        struct filt *t = &s->filt[f];
+        long n = t->done;
+        int ctx = f % NCTX;
+        int ctrl = CTRL_SAVE;
+        if (!t->fresh)
+            ctrl |= (t->on_chip && s->resident[ctx] == f) ? CTRL_KEEP : CTRL_RESTORE;
+        w->running = 1;
+        pthread_mutex_unlock(&s->lock);
+
+        // only this worker touches t until it is done, and the row stays
+        // queued until then
+        const double *row = &t->rows[(n % EKF_SCHED_QMAX)*s->cols];
+        double t0 = now_us();
+        int status = (w->id == 0) ? step_fpga(s, t, row, m, ctx, ctrl)
+                                  : step_cpu(s, e, t, row, m);
+        double us = now_us() - t0;
+
+        pthread_mutex_lock(&s->lock);
+        w->running = 0;
+        w->lat = (w->n == 0) ? us : w->lat + (us - w->lat)/8;
+        w->n++;
+        if (w->id == 0) {
+            s->resident[ctx] = f;
+            s->restores += ((ctrl & CTRL_RESTORE) != 0);
+        }
+        s->steps[w->id > 0]++;
+        s->failures += (status != EKF_OK);
+
+        t->on_chip = (w->id == 0);
+        t->fresh = 0;
+        t->status[n % EKF_SCHED_QMAX] = status;
+        if (t->xout[n % EKF_SCHED_QMAX])
+            memcpy(t->xout[n % EKF_SCHED_QMAX], t->x, Nsta*sizeof(double));
+        t->done++;
+        t->queued = 0;
+        s->pending--;
+        if (t->done < t->submitted)
+            dispatch(s, f);
+        pthread_cond_broadcast(&s->done);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    delete e;
+    free(m);
+    return NULL;
+}
+
+static void stop_workers(struct ekf_sched *s, int started)
+{
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->work);
+    pthread_mutex_unlock(&s->lock);
+    for (int i=0; i<started; i++)
+        pthread_join(s->w[i].thread, NULL);
+}
+
+static void release(struct ekf_sched *s)
+{
+    ekf_block_free(&s->mem, s->block);
+    ekf_block_close(&s->mem);
+    if (s->filt)
+        for (int f=0; f<s->nfilt; f++)
+            free(s->filt[f].rows);
+    free(s->filt);
+    free(s->w[0].q);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->work);
+    pthread_cond_destroy(&s->done);
+    free(s);
+}
+
+struct ekf_sched *ekf_sched_open(int nfilt, int cols, int cpus,
+                                 ekf_kernel_t kernel, ekf_model_fn model,
+                                 void *user)
+{
+    if (nfilt < 1 || cols < Mobs || model == NULL)
+        return NULL;
+    if (cpus < 0)
+        cpus = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (cpus < 0)
+        cpus = 0;
+    if (cpus > EKF_SCHED_CPUS)
+        cpus = EKF_SCHED_CPUS;
+
+    struct ekf_sched *s = (struct ekf_sched *)calloc(1, sizeof(struct ekf_sched));
+    if (s == NULL)
+        return NULL;
+    s->nfilt = nfilt;
+    s->cols = cols;
+    s->nw = 1 + cpus;
+    s->kernel = kernel ? kernel : top_ekf;
+    s->model = model;
+    s->user = user;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->done, NULL);
+    for (int c=0; c<NCTX; c++)
+        s->resident[c] = -1;
+
+    /* one contiguous block: the kernel's buffers, then a state and params
+       per filter */
+    long words = SET_WORDS + (long)nfilt*FILT_WORDS;
+    if (ekf_block_open(&s->mem, words, 1) == 0)
+        s->block = ekf_block_alloc(&s->mem, words);
+    s->filt = (struct filt *)calloc(nfilt, sizeof(struct filt));
+    s->w[0].q = (int *)malloc(s->nw*nfilt*sizeof(int));
+    if (s->block == NULL || s->filt == NULL || s->w[0].q == NULL) {
+        release(s);
+        return NULL;
+    }
+    for (long i=0; i<words; i++)
+        s->block[i] = 0;
+
+    port_t *p = s->block;
+    s->obs = p;     p += WORDS(Mobs);
+    s->fx_i = p;    p += WORDS(Nsta);
+    s->hx_i = p;    p += WORDS(Mobs);
+    s->F_i = p;     p += WORDS(Nsta*Nsta);
+    s->H_i = p;     p += WORDS(Mobs*NHC);
+    s->xout = p;    p += WORDS(Nsta);
+    for (int f=0; f<nfilt; f++) {
+        struct filt *t = &s->filt[f];
+        t->state = p;   p += WORDS(NSAVE);
+        t->params = p;  p += WORDS(PARAMS_IN);
+        t->fresh = 1;
+        t->rows = (double *)malloc(EKF_SCHED_QMAX*cols*sizeof(double));
+        if (t->rows == NULL) {
+            release(s);
+            return NULL;
+        }
+    }
+
+    for (int i=0; i<s->nw; i++) {
+        struct worker *w = &s->w[i];
+        w->s = s;
+        w->id = i;
+        w->q = s->w[0].q + i*nfilt;
+        w->lat = 1.0;
+        if (pthread_create(&w->thread, NULL, worker, w)) {
+            stop_workers(s, i);
+            release(s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+void ekf_sched_close(struct ekf_sched *s)
+{
+    ekf_sched_drain(s);
+    stop_workers(s, s->nw);
+    release(s);
+}
+
+long ekf_sched_init(struct ekf_sched *s, int f, const double *x0,
+                    const double *P, const double *Q, const double *R)
+{
+    struct filt *t = &s->filt[f];
+    long ovf = 0;
+
+    pthread_mutex_lock(&s->lock);
+    memcpy(t->x, x0, Nsta*sizeof(double));
+    ovf += port_from_double(t->params, P, Nsta*Nsta, bit_width, frac_width, FX_MODE);
+    ovf += port_from_double(t->params + Nsta*Nsta, Q, Nsta*Nsta, bit_width, frac_width, FX_MODE);
+    ovf += port_from_double(t->params + 2*Nsta*Nsta, R, Mobs*Mobs, bit_width, frac_width, FX_MODE);
+    t->fresh = 1;
+    t->on_chip = 0;
+    pthread_mutex_unlock(&s->lock);
+    return ovf;
+}
+
+long ekf_sched_submit(struct ekf_sched *s, int f, const double *row,
+                      double *xout)
+{
+    struct filt *t = &s->filt[f];
+
+    pthread_mutex_lock(&s->lock);
+    while (t->submitted - t->done == EKF_SCHED_QMAX)
+        pthread_cond_wait(&s->done, &s->lock);
+    long n = t->submitted;
+    memcpy(&t->rows[(n % EKF_SCHED_QMAX)*s->cols], row, s->cols*sizeof(double));
+    t->xout[n % EKF_SCHED_QMAX] = xout;
+    t->submitted++;
+    s->pending++;
+    if (!t->queued)
+        dispatch(s, f);
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+int ekf_sched_wait(struct ekf_sched *s, int f, long n)
+{
+    struct filt *t = &s->filt[f];
+
+    pthread_mutex_lock(&s->lock);
+    while (t->done <= n)
+        pthread_cond_wait(&s->done, &s->lock);
+    int status = t->status[n % EKF_SCHED_QMAX];
+    pthread_mutex_unlock(&s->lock);
+    return status;
+}
+
+void ekf_sched_drain(struct ekf_sched *s)
+{
+    pthread_mutex_lock(&s->lock);
+    while (s->pending > 0)
+        pthread_cond_wait(&s->done, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void ekf_sched_get_stats(struct ekf_sched *s, struct ekf_sched_stats *st)
+{
+    pthread_mutex_lock(&s->lock);
+    st->steps[EKF_SCHED_FPGA] = s->steps[0];
+    st->steps[EKF_SCHED_CPU] = s->steps[1];
+    st->steals = s->steals;
+    st->restores = s->restores;
+    st->failures = s->failures;
+    // the CPU estimate is the mean of the workers that have run
+    st->lat_us[EKF_SCHED_FPGA] = s->w[0].n ? s->w[0].lat : 0;
+    double sum = 0;
+    int k = 0;
+    for (int i=1; i<s->nw; i++) {
+        if (s->w[i].n) {
+            sum += s->w[i].lat;
+            k++;
+        }
+    }
+    st->lat_us[EKF_SCHED_CPU] = k ? sum/k : 0;
+    pthread_mutex_unlock(&s->lock);
+}
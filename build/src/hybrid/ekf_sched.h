@@ -0,0 +1,102 @@
+/*  ekf_sched: runs a population of filters on the accelerator and on a
+    pool of CPU threads at once.
+
+    Each filter has a queue of measurement rows. A step takes the next row
+    of a filter, evaluates the model from the filter's last output, and
+    runs either on the kernel (as ekf_traj does, one thread owning it) or
+    on a CPU worker with the native engine of utils/tiny-ekf, Ekf<> in
+    double (EkfSqrt<> with SQRT_COV). Between steps a filter lives in DDR
+    as the NSAVE words of a spilled context, so any backend can take its
+    next step: the kernel restores and saves it (CTRL_RESTORE|CTRL_SAVE,
+    skipping the restore, and the NSAVE words of state_i with it, while the
+    filter still owns its context, f % NCTX), and the CPU converts it to double and back. The CPU steps
+    are not bit-exact with the kernel's, but within its fixed-point error.
+
+        struct ekf_sched *s = ekf_sched_open(nfilt, cols, -1, NULL, model, NULL);
+        for (f...) ekf_sched_init(s, f, x0, P, Q, R);
+        for (rows...) ekf_sched_submit(s, f, row, xout);   // blocks while the queue is full
+        ekf_sched_drain(s);
+        ekf_sched_close(s);
+
+    A filter has at most one step in flight, so its steps, and the writes
+    to their xout[Nsta], are in submission order. When a filter has a row
+    to run, it is queued on the backend with the earliest estimated finish:
+    (queued + running + 1) * latency, the latency of each backend being a
+    moving average of its measured steps. A backend whose queue is empty
+    steals the newest filter of the longest other queue.
+
+    rows have cols values, the last Mobs being the measurements, as for
+    ekf_run_trajectory(); model is called from several threads at once.
+    kernel is top_ekf if NULL; any function of its signature can be given,
+    e.g. the C model with the accelerator's latency, to test on the host.
+    cpus is the number of CPU workers, one less than the online cores if
+    negative, 0 for the accelerator alone. Nothing else may call top_ekf
+    while the scheduler is open.
+
+    The functions are extern "C", so they are exported by the kernel's
+    shared library for cffi.
+*/
+
+#ifndef EKF_SCHED_H
+#define EKF_SCHED_H
+
+#include "ekf_config.h"
+#include "ekf_async.h"
+#include "ekf_traj.h"
+
+/* rows queued per filter */
+#define EKF_SCHED_QMAX 64
+/* CPU workers */
+#define EKF_SCHED_CPUS 15
+
+/* backends, indices of ekf_sched_stats */
+#define EKF_SCHED_FPGA 0
+#define EKF_SCHED_CPU  1
+
+struct ekf_sched_stats {
+    long steps[2];          /* completed on the accelerator, on the CPUs */
+    long steals;            /* steps taken from the queue of another backend */
+    long restores;          /* accelerator steps that reloaded a spilled filter */
+    long failures;          /* steps dropped as EKF_NOT_PD */
+    double lat_us[2];       /* current latency estimate of a step */
+};
+
+struct ekf_sched;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* NULL if out of memory or the arguments do not fit */
+struct ekf_sched *ekf_sched_open(int nfilt, int cols, int cpus,
+                                 ekf_kernel_t kernel, ekf_model_fn model,
+                                 void *user);
+
+/* waits for every step, then frees everything */
+void ekf_sched_close(struct ekf_sched *s);
+
+/* state and P, Q, R (row-major, their upper factors with SQRT_COV) of
+   filter f for its next step, which starts it anew; returns the values
+   that did not fit data_t. Only between steps of f. */
+long ekf_sched_init(struct ekf_sched *s, int f, const double *x0,
+                    const double *P, const double *Q, const double *R);
+
+/* queues a step of f on row (copied); its state is written to xout, if
+   not NULL, once done. Returns the step's number for f, from 0. */
+long ekf_sched_submit(struct ekf_sched *s, int f, const double *row,
+                      double *xout);
+
+/* waits for step n of f, and returns its status, EKF_OK or EKF_NOT_PD,
+   valid until step n+EKF_SCHED_QMAX is submitted */
+int ekf_sched_wait(struct ekf_sched *s, int f, long n);
+
+/* waits for every submitted step */
+void ekf_sched_drain(struct ekf_sched *s);
+
+void ekf_sched_get_stats(struct ekf_sched *s, struct ekf_sched_stats *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sds_lib.h"
+
+#include "ekf_traj.h"
+#include "ekf_block.h"
+#include "../fxconv/fxconv.h"
+
+
+static ekf_model_fn user_fn;
+static void *user_arg;
+
+#define PARAMS_IN ((2*Nsta*Nsta)+(Mobs*Mobs))
+
+/* words of one buffer, rounded up to 64 bytes on the board */
+#define WORDS(n) (((n) + 15) & ~15)
+#define BUF_WORDS (WORDS(Mobs) + WORDS(Nsta) + WORDS(Mobs) + WORDS(Nsta*Nsta) + \
+                   WORDS(Mobs*NHC) + WORDS(PARAMS_IN) + WORDS(Nsta) + WORDS(NSAVE))
+
+/* as h() of ekf/gps_ekf.py: row holds the 4x3 satellite positions */
+static void gps_model(const double *x, const double *row, double *fx,
+                      double *hx, double *F, double *H, void *)
+{
+    memset(F, 0, 8*8*sizeof(double));
+    memset(H, 0, 4*8*sizeof(double));
+
+    for (int j=0; j<8; j+=2) {
+        fx[j] = x[j] + x[j+1];
+        fx[j+1] = x[j+1];
+        F[j*8 + j] = 1;
+        F[j*8 + j+1] = 1;
+        F[(j+1)*8 + j+1] = 1;
+    }
+
+    // pseudorange: || xyz - SV || + bias
+    for (int i=0; i<4; i++) {
+        double dx[3], d2 = 0;
+        for (int j=0; j<3; j++) {
+            dx[j] = fx[j*2] - row[i*3 + j];
+            d2 += dx[j]*dx[j];
+        }
+        hx[i] = sqrt(d2) + fx[6];
+        for (int j=0; j<3; j++)
+            H[i*8 + j*2] = dx[j]/hx[i];
+        H[i*8 + 6] = 1;
+    }
+}
+
+/* as f() and h() of ekf/light_ekf.py */
+static void light_model(const double *x, const double *, double *fx,
+                        double *hx, double *F, double *H, void *)
+{
+    fx[0] = x[0] + x[1];
+    fx[1] = x[1];
+    hx[0] = fx[0];
+    hx[1] = fx[0];
+
+    F[0] = 1; F[1] = 1;
+    F[2] = 0; F[3] = 1;
+    H[0] = 1; H[1] = 0;
+    H[2] = 1; H[3] = 0;
+}
+
+void ekf_set_model(ekf_model_fn fn, void *user)
+{
+    user_fn = fn;
+    user_arg = user;
+}
+
+long ekf_run_trajectory(const double *rows, long steps, int cols, int model,
+                        const double *x0, port_t *params, port_t *out,
+                        int ctrl, int ctx, long *overflows)
+{
+    ekf_model_fn fn;
+    void *arg = NULL;
+
+    // top_ekf would refuse every step as EKF_BAD_CTX or EKF_BAD_LEN
+    if (ctx < 0 || ctx >= NCTX || (ctrl & ~(CTRL_KEEP | CTRL_HEALTH)) != 0)
+        return -1;
+
+    switch (model) {
+    case EKF_MODEL_GPS:
+        if (Nsta != 8 || Mobs != 4 || cols != 12 + 4)
+            return -1;
+        fn = gps_model;
+        break;
+    case EKF_MODEL_LIGHT:
+        if (Nsta != 2 || Mobs != 2 || cols != 2)
+            return -1;
+        fn = light_model;
+        break;
+    case EKF_MODEL_USER:
+        if (user_fn == NULL || cols < Mobs)
+            return -1;
+        fn = user_fn;
+        arg = user_arg;
+        break;
+    default:
+        return -1;
+    }
+
+    /* the kernel's buffers in one contiguous block, inputs first, the
+       model's in doubles */
+    struct ekf_block mem;
+    if (ekf_block_open(&mem, BUF_WORDS, 1))
+        return -1;
+    port_t *block = ekf_block_alloc(&mem, BUF_WORDS);
+    double *m = (double *)malloc((2*Nsta + Mobs + Nsta*Nsta + Mobs*Nsta + Mobs*NHC)*sizeof(double));
+    if (block == NULL || m == NULL) {
+        ekf_block_free(&mem, block);
+        ekf_block_close(&mem);
+        free(m);
+        return -1;
+    }
+    port_t *p = block;
+    port_t *obs = p;        p += WORDS(Mobs);
+    port_t *fx_i = p;       p += WORDS(Nsta);
+    port_t *hx_i = p;       p += WORDS(Mobs);
+    port_t *F_i = p;        p += WORDS(Nsta*Nsta);
+    port_t *H_i = p;        p += WORDS(Mobs*NHC);
+    port_t *par = p;        p += WORDS(PARAMS_IN);
+    port_t *xout = p;       p += WORDS(Nsta);
+    port_t *state = p;
+
+    memcpy(par, params, PARAMS_IN*sizeof(port_t));
+    ekf_block_flush(&mem, par, PARAMS_IN);
+
+    double *x = m;
+    double *fx = x + Nsta;
+    double *hx = fx + Nsta;
+    double *F = hx + Mobs;
+    double *H = F + Nsta*Nsta;
+    double *Hc = H + Mobs*Nsta;
+    memcpy(x, x0, Nsta*sizeof(double));
+
+    long fails = 0, ovf = 0;
+    for (long s=0; s<steps; s++) {
+        const double *row = rows + s*cols;
+
+        fn(x, row, fx, hx, F, H, arg);
+        // the NHC columns of H the kernel reads, packed
+        for (int i=0; i<Mobs; i++)
+            for (int k=0; k<NHC; k++)
+                Hc[i*NHC + k] = H[i*Nsta + HCOL(k)];
+
+        ovf += port_from_double(obs, row + cols - Mobs, Mobs, bit_width, frac_width, FX_MODE);
+        ovf += port_from_double(fx_i, fx, Nsta, bit_width, frac_width, FX_MODE);
+        ovf += port_from_double(hx_i, hx, Mobs, bit_width, frac_width, FX_MODE);
+        ovf += port_from_double(F_i, F, Nsta*Nsta, bit_width, frac_width, FX_MODE);
+        ovf += port_from_double(H_i, Hc, Mobs*NHC, bit_width, frac_width, FX_MODE);
+
+        ekf_block_flush(&mem, obs, par - obs);
+        int st = HL_STATUS(top_ekf(obs, fx_i, hx_i, F_i, H_i, par, xout, state, state,
+                                   (s == 0) ? ctrl : CTRL_KEEP, ctx, Nsta, Mobs, 0, 0));
+        if (st == EKF_NOT_PD) {
+            fails++;
+        } else if (st != EKF_OK) {
+            fails = -1;
+            break;
+        }
+        ekf_block_invalidate(&mem, xout, Nsta);
+
+        memcpy(out + s*Nsta, xout, Nsta*sizeof(port_t));
+        port_to_double(x, xout, Nsta, bit_width, frac_width);
+    }
+
+    ekf_block_free(&mem, block);
+    ekf_block_close(&mem);
+    free(m);
+    if (overflows)
+        *overflows = ovf;
+    return fails;
+}
@@ -0,0 +1,71 @@
+/*  ekf_traj: whole-trajectory host driver for the hybrid top_ekf kernels.
+
+    Runs the loop of the Python drivers' run_hw() natively, one call for a
+    whole dataset: for every row, the model is evaluated in double from
+    the previous output, converted to port_t words (FX_MODE, src/fxconv)
+    and sent to top_ekf with the measurements, and the output words are
+    converted back for the model of the next row.
+
+        long fails = ekf_run_trajectory(rows, steps, 16, EKF_MODEL_GPS, x0,
+                                        params, out, 0, ctx, &ovf);
+
+    rows are row-major [steps][cols], the last Mobs columns of a row being
+    its measurements and the others inputs of the model. The output words
+    of step s are written to out[s*Nsta], as the drivers' out buffers; out
+    and params may be any memory, the kernel works on copies of its own
+    (kept coherent per step with P_CACHEABLE=2, see ekf_block.h). ctrl
+    is that of the first step, 0 to start from x0 and the P, Q and R of
+    params, or CTRL_KEEP to carry on with the context's state (x0 is then
+    only the point the first model is evaluated at), with CTRL_HEALTH
+    allowed too; the other steps are CTRL_KEEP. ctx is in [0, NCTX).
+    Returns the number of steps the kernel dropped as EKF_NOT_PD, or -1 if
+    the model does not fit the kernel's Nsta and Mobs, ctx is out of range,
+    ctrl has other bits, no memory is left, or the kernel refused a step
+    as EKF_BAD_* (the run then stops there). *overflows, if not NULL, gets
+    the number of model values and measurements that did not fit data_t.
+
+    Models:
+        EKF_MODEL_GPS    You Chong's GPS example, Nsta=8, Mobs=4; 4x3
+                         satellite positions then the 4 pseudoranges
+        EKF_MODEL_LIGHT  light sensor fusion, Nsta=2, Mobs=2; the 2 sensors
+        EKF_MODEL_USER   the function set by ekf_set_model(), any cols >= Mobs
+
+    The built-in models are those of ekf/gps_ekf.py and ekf/light_ekf.py.
+    A user model writes fx[Nsta], hx[Mobs] and the row-major F[Nsta*Nsta]
+    and H[Mobs*Nsta], fully, on each call; only the columns HCOL(k) of H
+    are sent. It may be a Python function (cffi callback), which puts the
+    interpreter back in the loop for the model only.
+
+    Nothing else may call top_ekf while a trajectory runs. The functions
+    are extern "C", so they are exported by the kernel's shared library
+    for cffi.
+*/
+
+#ifndef EKF_TRAJ_H
+#define EKF_TRAJ_H
+
+#include "ekf_config.h"
+
+#define EKF_MODEL_GPS   0
+#define EKF_MODEL_LIGHT 1
+#define EKF_MODEL_USER  2
+
+typedef void (*ekf_model_fn)(const double *x, const double *row, double *fx,
+                             double *hx, double *F, double *H, void *user);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the model of EKF_MODEL_USER; user is passed to every call */
+void ekf_set_model(ekf_model_fn fn, void *user);
+
+long ekf_run_trajectory(const double *rows, long steps, int cols, int model,
+                        const double *x0, port_t *params, port_t *out,
+                        int ctrl, int ctx, long *overflows);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
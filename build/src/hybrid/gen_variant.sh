@@ -0,0 +1,223 @@
+#!/bin/sh
+#  gen_variant.sh: nXmY variants of the hybrid kernel (src/hybrid).
+#
+#  usage: gen_variant.sh [-n|-s] N M [II] [NCTX]
+#         (II and NCTX may also come from the environment)
+#
+#  Prints a latency/resource estimate of the N-state, M-observable kernel
+#  for every EKF_II (see ekf_hybrid.h) that satisfies the BSIZE rules, and
+#  the fastest one per board within DSP_CAP percent of its DSP48 slices.
+#  Then writes src/nNmM/ekf_config.h for the given II. If none is given it
+#  keeps the EKF_II of an existing src/nNmM/ekf_config.h, as the shipped
+#  variants are the builds that were placed and checked on their boards,
+#  and otherwise takes the fastest on $BOARD (default Pynq-Z1); -n only
+#  prints the table, -s only the cycles of each stage of the step at every
+#  valid II.
+#  NCTX defaults to as many contexts (up to 64, at least 2) as fit in 2048
+#  words of x/P. The variant builds with `make nNmM`, with src/hybrid/main.cpp
+#  unless src/nNmM has its own.
+#
+#  The model is first order: one word per cycle on every stream, BSIZE_4
+#  terms per block in EKF_II cycles, a pipeline depth of DEPTH cycles for
+#  each row that takes more than one block, and one multiplier per unrolled
+#  product, ceil(W/25)*ceil(W/18) DSP48 each, without any sharing. That
+#  count is too high: it puts the shipped n8m4 at EKF_II=1 at 105% of the
+#  Pynq-Z1, where it is built. So the DSP48 shares are scaled to put that
+#  build at REF_PCT percent of the Pynq-Z1 (default DSP_CAP, the most it
+#  can take and still be picked); set REF_PCT from its HLS report when at
+#  hand. It is meant to rank variants; the HLS reports of the build are the
+#  reference.
+#  The stages run one after the other but for step3 and step4, which form
+#  a dataflow region (step34 in ekf.cpp) with STEP34, by default up to 8
+#  states, so a step takes the longer of the two: the cycles/step of the
+#  table are this critical path.
+#
+#  Run from build/ through `make variant N=.. M=..`.
+
+DEPTH=${DEPTH:-10}      # pipeline depth of a blocked dot product
+STEP34=${STEP34:--1}    # 1 or 0 as the kernel's STEP34, -1 for its default
+DIVSQ=${DIVSQ:-64}      # latency of the sqrt and reciprocal in choldc
+WIDTH=${WIDTH:-32}      # bit_width
+DSP_CAP=${DSP_CAP:-80}  # usable share of the DSP48 slices, percent
+REF_PCT=${REF_PCT:-$DSP_CAP}  # DSP48 share of the shipped n8m4 (II=1) on the Pynq-Z1
+BOARD=${BOARD:-Pynq-Z1}
+
+# board:clock MHz:DSP48 slices
+BOARDS="Pynq-Z1:100:220 Pynq-Z2:100:220 Ultra96:250:360 ZCU104:250:1728"
+
+write=1
+stages=0
+if [ "$1" = "-n" ]; then
+    write=0
+    shift
+elif [ "$1" = "-s" ]; then
+    write=0
+    stages=1
+    shift
+fi
+N=$1
+M=$2
+II=${3:-$II}
+NCTX=${4:-$NCTX}
+if [ -z "$N" ] || [ -z "$M" ]; then
+    echo "usage: gen_variant.sh [-n|-s] N M [II] [NCTX]" >&2
+    exit 2
+fi
+
+# est <N> <M> <II> [stages]: "cycles mults" of one dense step
+# (F_STRUCT=FS_DENSE, SEQ_UPDATE=0), or with stages a "name cycles" line per
+# stage, then the sum of the stages and the critical path, with step3 and
+# step4 overlapped if STEP34
+est() {
+    awk -v n=$1 -v m=$2 -v ii=$3 -v d=$DEPTH -v s=$DIVSQ -v all=${4:-0} -v s34=$STEP34 'BEGIN {
+        b = n/ii
+        ntri = n*(n+1)/2
+        # trips of a dot product over n terms in blocks of b
+        row = (b == n) ? 1 : ii*ii + d
+        k = 0
+        name[++k] = "step1";   c[k] = n*n*row + ntri*row    # F P, (F P) F^T
+        name[++k] = "step2_1"; c[k] = m*n*row               # H Pp
+        name[++k] = "step2_3"; c[k] = m*m*row               # H Pp H^T + R
+        name[++k] = "choldc";  c[k] = m*(s + d) + m*(m-1)/2
+        name[++k] = "step2_4"; c[k] = n + 2*m*d             # substitutions
+        name[++k] = "nis";     c[k] = m*(m+1)/2 + d         # nis_chol
+        name[++k] = "step3";   c[k] = n + d; s3 = k
+        name[++k] = "step4";   c[k] = ntri + d; s4 = k
+        name[++k] = "io";      c[k] = n*n + m*n + 2*n + 2*m # F_i, H_i, fx, hx, obs, output
+        sum = 0
+        for (i = 1; i <= k; i++)
+            sum += c[i]
+        if (s34 < 0)
+            s34 = (n <= 8)
+        crit = sum
+        if (s34)
+            crit = sum - c[s3] - c[s4] + (c[s3] > c[s4] ? c[s3] : c[s4])
+        if (all) {
+            for (i = 1; i <= k; i++)
+                printf "%s %d\n", name[i], c[i]
+            printf "sequential %d\ndataflow %d\n", sum, crit
+            exit
+        }
+        mults = 2*b + 2*b + m*m + 2*m + 2
+        printf "%d %d\n", crit, mults
+    }'
+}
+
+valid() {
+    [ $(( N % $1 )) -eq 0 ] && [ $(( (N / $1) % $1 )) -eq 0 ]
+}
+
+dsp_mult=$(( ((WIDTH+24)/25) * ((WIDTH+17)/18) ))
+
+# DSP48 of the shipped n8m4, 32 bits at EKF_II=1, by the count above, and
+# the slices of the Pynq-Z1 it is scaled against
+ref_dsp=$(( $(est 8 4 1 | cut -d' ' -f2) * 4 ))
+ref_avail=220
+
+if [ $stages -eq 1 ]; then
+    iis=""
+    for ii in $(seq 1 $N); do
+        valid $ii && iis="$iis $ii"
+    done
+    echo "n${N}m${M}: cycles per stage of one dense step, step3 and step4 overlapped with STEP34"
+    printf "%-11s" "II"
+    for ii in $iis; do
+        printf " %9d" $ii
+    done
+    printf "\n"
+    for st in step1 step2_1 step2_3 choldc step2_4 nis step3 step4 io sequential dataflow; do
+        printf "%-11s" $st
+        for ii in $iis; do
+            printf " %9d" $(est $N $M $ii 1 | awk -v st=$st '$1 == st { print $2 }')
+        done
+        printf "\n"
+    done
+    printf "%-11s" "saved"
+    for ii in $iis; do
+        printf " %8s%%" $(est $N $M $ii 1 | awk '$1 == "sequential" { a = $2 }
+            $1 == "dataflow" { printf "%.1f", 100*(a - $2)/a }')
+    done
+    printf "\n"
+    exit 0
+fi
+
+echo "n${N}m${M}: ${N} states, ${M} observables, ap_fixed<${WIDTH}>, ${dsp_mult} DSP48 per multiplier"
+printf "%4s %6s %6s %12s" "II" "block" "banks" "cycles/step"
+for b in $BOARDS; do
+    printf " %15s" "${b%%:*}"
+done
+printf "\n"
+
+best=""
+for ii in $(seq 1 $N); do
+    valid $ii || continue
+    set -- $(est $N $M $ii)
+    cyc=$1
+    dsp=$(( $2 * dsp_mult ))
+    printf "%4d %6d %6d %12d" $ii $(( N/ii )) $(( N/ii/ii )) $cyc
+    for b in $BOARDS; do
+        mhz=$(echo $b | cut -d: -f2)
+        avail=$(echo $b | cut -d: -f3)
+        pct=$(( REF_PCT*dsp*ref_avail/(ref_dsp*avail) ))
+        us=$(awk -v c=$cyc -v f=$mhz 'BEGIN { printf "%.1f", c/f }')
+        printf " %6sus %3d%%%s" $us $pct "$( [ $pct -le $DSP_CAP ] && echo " " || echo "!" )"
+        # the first II that fits is the fastest for the board
+        name=${b%%:*}
+        if [ $pct -le $DSP_CAP ] && ! echo "$best" | grep -q "$name="; then
+            best="$best $name=$ii"
+        fi
+    done
+    printf "\n"
+done
+echo "(us per step at the board clock, % of its DSP48 scaled to n8m4 II=1 at ${REF_PCT}% of the Pynq-Z1; ! over ${DSP_CAP}%)"
+echo "fastest within ${DSP_CAP}% DSP:${best:- none}"
+
+[ $write -eq 1 ] || exit 0
+
+dir=src/n${N}m${M}
+if [ -z "$II" ] && [ -f $dir/ekf_config.h ]; then
+    II=$(awk '$1 == "#define" && $2 == "EKF_II" { print $3 }' $dir/ekf_config.h)
+    [ -n "$II" ] && echo "keeping EKF_II=$II of $dir/ekf_config.h, give II to change it"
+fi
+if [ -z "$II" ]; then
+    II=$(echo "$best" | tr ' ' '\n' | grep "^$BOARD=" | cut -d= -f2)
+    if [ -z "$II" ]; then
+        echo "no II fits $BOARD, give one" >&2
+        exit 1
+    fi
+fi
+if ! valid $II; then
+    echo "II=$II must divide $N and $N/$II" >&2
+    exit 1
+fi
+
+if [ -z "$NCTX" ]; then
+    NCTX=64
+    while [ $NCTX -gt 2 ] && [ $(( NCTX*(N + N*N) )) -gt 2048 ]; do
+        NCTX=$(( NCTX/2 ))
+    done
+fi
+
+mkdir -p $dir
+cat > $dir/ekf_config.h <<EOF
+/*  n${N}m${M}: the hybrid kernel of src/hybrid for ${N} states and ${M} observables.
+    Generated by \`make variant N=${N} M=${M} II=${II} NCTX=${NCTX}\`. */
+
+#define Nsta ${N}
+#define Mobs ${M}
+#define EKF_II ${II}
+#define NCTX ${NCTX}
+
+/* blocking for EKF_II, see ekf_hybrid.h */
+#define BSIZE_1 ${M}
+#define BSIZE_2 $(( N/II ))
+#define BSIZE_3 ${M}
+#define BSIZE_4 $(( N/II ))
+#define PART_N $(( N/II/II ))
+#define PART_M ${M}
+
+#include "../hybrid/ekf_hybrid.h"
+EOF
+echo "wrote $dir/ekf_config.h (EKF_II=$II, NCTX=$NCTX)"
+
+exit 0
@@ -0,0 +1,122 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <strings.h>
+#include <time.h>
+#include <math.h>
+#include "sds_lib.h"
+
+#include "ekf_config.h"
+#include "../prof/prof.h"
+#include "../fxconv/fxconv.h"
+#include "ekf_block.h"
+
+#define SEC_TO_NS (1000000000)
+
+/* stages of a step, timed with PROF_ENABLE=1 (src/prof) */
+enum { ST_KERNEL, ST_OUTPUT };
+static struct prof prof;
+
+
+int main(int argc, char ** argv)
+{    
+
+    int datalen = 50;
+    int PARAMS_IN = (2*Nsta*Nsta)+(Mobs*Mobs);
+    
+    // hardware I/O
+    port_t *obs, *xout, *params;
+    port_t *fx_i, *hx_i, *F_i, *H_i;
+    port_t *state;
+
+    float *xout_fl;
+    
+    // one block, inputs first (P_CACHEABLE=2), see ekf_block.h
+    struct ekf_block mem;
+    if (ekf_block_open(&mem, datalen*Mobs + PARAMS_IN + Nsta + Mobs + Nsta*Nsta +
+                       Mobs*Nsta + NSAVE + datalen*Nsta, 8)) {
+        fprintf(stderr, "ekf: no CMA memory left\n");
+        return 1;
+    }
+    obs = ekf_block_alloc(&mem, datalen*Mobs);
+    params = ekf_block_alloc(&mem, PARAMS_IN);
+    fx_i = ekf_block_alloc(&mem, Nsta);
+    hx_i = ekf_block_alloc(&mem, Mobs);
+    F_i = ekf_block_alloc(&mem, Nsta*Nsta);
+    H_i = ekf_block_alloc(&mem, Mobs*Nsta);
+    state = ekf_block_alloc(&mem, NSAVE);
+    xout = ekf_block_alloc(&mem, datalen*Nsta);
+    if (!obs || !params || !fx_i || !hx_i || !F_i || !H_i || !state || !xout) {
+        fprintf(stderr, "ekf: cannot allocate the kernel buffers\n");
+        ekf_block_close(&mem);
+        return 1;
+    }
+
+    xout_fl = (float *)malloc(Nsta*sizeof(float));
+    
+    int ctrl;
+    int w1 = Nsta;
+    int w2 = Mobs;
+    int w3i = 0;    // no context restore
+    int w3o = 0;    // no context save
+    int ctx = 0;
+    
+    struct timespec * start = (struct timespec *)malloc(sizeof(struct timespec));
+    struct timespec * stop = (struct timespec *)malloc(sizeof(struct timespec));
+    prof_init(&prof, "kernel,output");
+    clock_gettime(CLOCK_MONOTONIC, start);
+    
+    //init
+    ctrl=0;
+    //model()
+    PROF_BEGIN(&prof);
+    ekf_block_flush(&mem, obs, datalen*Mobs);
+    ekf_block_flush(&mem, params, PARAMS_IN);
+    ekf_block_flush(&mem, fx_i, state - fx_i);
+    top_ekf(&obs[0*Mobs], fx_i, hx_i, F_i, H_i, params, &xout[0*Nsta], state, state, ctrl, ctx, w1, w2, w3i, w3o);
+    ekf_block_invalidate(&mem, &xout[0*Nsta], Nsta);
+    PROF_MARK(&prof, ST_KERNEL);
+    
+    // copy result from fixed to float
+    port_to_float(xout_fl, &xout[0*Nsta], Nsta, bit_width, frac_width);
+    PROF_MARK(&prof, ST_OUTPUT);
+    PROF_END(&prof);
+    
+    // run ekf
+    ctrl = 1; 
+    for (int i=1; i<datalen; i++) {
+        //model()
+        // step ekf
+        PROF_BEGIN(&prof);
+        ekf_block_flush(&mem, fx_i, state - fx_i);
+        top_ekf(&obs[1*Mobs], fx_i, hx_i, F_i, H_i, params, &xout[1*Nsta], state, state, ctrl, ctx, w1, w2, w3i, w3o);
+        ekf_block_invalidate(&mem, &xout[1*Nsta], Nsta);
+        PROF_MARK(&prof, ST_KERNEL);
+        // copy result from fixed to float
+        port_to_float(xout_fl, &xout[i*Nsta], Nsta, bit_width, frac_width);
+        PROF_MARK(&prof, ST_OUTPUT);
+        PROF_END(&prof);
+    }
+    clock_gettime(CLOCK_MONOTONIC, stop);
+    int totalTime = (stop->tv_sec*SEC_TO_NS + stop->tv_nsec) - (start->tv_sec*SEC_TO_NS + start->tv_nsec);
+    printf("time = %f s\n", ((float)totalTime/1000000000));
+#if PROF_ENABLE
+    prof_write(&prof, (argc > 1) ? argv[1] : "-");
+#endif
+
+    ekf_block_free(&mem, obs);
+    ekf_block_free(&mem, params);
+    ekf_block_free(&mem, xout);
+    ekf_block_free(&mem, fx_i);
+    ekf_block_free(&mem, hx_i);
+    ekf_block_free(&mem, F_i);
+    ekf_block_free(&mem, H_i);
+    ekf_block_free(&mem, state);
+    ekf_block_close(&mem);
+    free(xout_fl);
+    
+    // Done!
+    return 0;
+}
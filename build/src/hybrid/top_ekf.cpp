@@ -0,0 +1,542 @@
+#include "ekf_config.h"
+
+#ifndef __SYNTHESIS__
+struct ekf_ports ekf_ports;
+long ekf_frozen;
+#endif
+
+void init(	data_t P[NTRI], 
+			data_t Q[Nsta][Nsta], 
+			data_t R[Mobs][Mobs], 
+			port_t params[(2*Nsta*Nsta)+(Mobs*Mobs)]
+		)
+{
+	
+	#pragma HLS INLINE off
+	
+	data_t local_mem[(2*Nsta*Nsta)+(Mobs*Mobs)];
+	int ptotal = (2*Nsta*Nsta)+(Mobs*Mobs);
+	
+	// read params
+load_params: for (int i=0; i<ptotal; i++) {
+		#pragma HLS PIPELINE
+		local_mem[i].V = params[i].range(bit_width-1,0);
+	}
+	
+	
+	/* params[(2*Nsta*Nsta)+(Mobs*Mobs)]:
+		1 - P[Nsta*Nsta]
+		2 - Q[Nsta*Nsta]
+		3 - R[Mobs*Mobs]
+	*/
+	
+	int offset = 0;
+	
+	// read state vector x
+	//for (int i=0; i<Nsta; i++) {
+	//	#pragma HLS PIPELINE
+	//	x[i] = local_mem[i];
+	//}
+	//offset += Nsta;
+	
+	// read state/prediction covariance, upper triangle
+	for (int i=0; i<Nsta; i++) {
+		for (int j=i; j<Nsta; j++) {
+			#pragma HLS PIPELINE
+			P[PTRI(i,j)] = local_mem[i*Nsta + j + offset];
+		}
+	}
+	offset += (Nsta*Nsta);
+	
+	// read process covariance
+	for (int i=0; i<Nsta; i++) {
+		for (int j=0; j<Nsta; j++) {
+			#pragma HLS PIPELINE
+			Q[i][j] = local_mem[i*Nsta + j + offset];
+		}
+	}
+	offset += (Nsta*Nsta);
+	
+	// read process covariance
+	for (int i=0; i<Mobs; i++) {
+		for (int j=0; j<Mobs; j++) {
+			#pragma HLS PIPELINE
+			R[i][j] = local_mem[i*Mobs + j + offset];
+		}
+	}
+
+}
+
+/* spill x, P of the working set to DDR: state[NSAVE] = x[Nsta], P[Nsta*Nsta]
+   (S, zero below the diagonal, with SQRT_COV) */
+void save_state(data_t x[Nsta], data_t P[NTRI], port_t state[NSAVE])
+{
+
+	#pragma HLS INLINE off
+
+save_x: for (int i=0; i<Nsta; i++) {
+		#pragma HLS PIPELINE
+		port_t imm;
+		imm.range(bit_width-1,0) = x[i].V;
+		state[i] = imm;
+		PORT_WORDS(state_o, 1);
+	}
+save_P: for (int i=0; i<Nsta; i++) {
+		for (int j=0; j<Nsta; j++) {
+			#pragma HLS PIPELINE
+			port_t imm = 0;
+#if (SQRT_COV == 1)
+			// S is upper triangular
+			if (i <= j) {
+				imm.range(bit_width-1,0) = P[PTRI(i,j)].V;
+			}
+#else
+			imm.range(bit_width-1,0) = P[PSYM(i,j)].V;
+#endif
+			state[Nsta + i*Nsta + j] = imm;
+			PORT_WORDS(state_o, 1);
+		}
+	}
+}
+
+/* fill x, P of the working set from DDR, same layout as save_state(); every
+   word is read in order, only those of the upper triangle of P are kept */
+void restore_state(data_t x[Nsta], data_t P[NTRI], port_t state[NSAVE])
+{
+
+	#pragma HLS INLINE off
+
+restore_x: for (int i=0; i<Nsta; i++) {
+		#pragma HLS PIPELINE
+		x[i].V = state[i].range(bit_width-1,0);
+		PORT_WORDS(state_i, 1);
+	}
+restore_P: for (int i=0; i<Nsta; i++) {
+		for (int j=0; j<Nsta; j++) {
+			#pragma HLS PIPELINE
+			port_t imm = state[Nsta + i*Nsta + j];
+			PORT_WORDS(state_i, 1);
+			if (j >= i) {
+				P[PTRI(i,j)].V = imm.range(bit_width-1,0);
+			}
+		}
+	}
+}
+
+/* the health word of a step (see CTRL_HEALTH), from its status and hl and
+   the x, P it left */
+static int health_word(int status, data_t x[Nsta], data_t P[NTRI],
+				struct ekf_health *hl, int mo)
+{
+
+	#pragma HLS INLINE off
+
+	int range = 0, negp = 0;
+	data_t lim = RANGE_LIM;
+
+health_x: for (int i=0; i<Nsta; i++) {
+		#pragma HLS PIPELINE
+		data_t v = x[i];
+		data_t d = P[PTRI(i,i)];
+		range += (v > lim) || (v < -lim);
+		range += (d > lim) || (d < -lim);
+#if (SQRT_COV == 1)
+		negp += (d == 0);
+#else
+		negp += (d <= 0);
+#endif
+	}
+
+	// NIS/mo in 1/16
+	int nis = 0;
+	if (mo > 0) {
+		nis_t r = hl->nis / mo;
+		nis_t q = r * 16;
+		nis = q.to_int();
+	}
+
+	int pivots = hl->pivots;
+	range = (range > 0xf) ? 0xf : range;
+	pivots = (pivots > 0xf) ? 0xf : pivots;
+	negp = (negp > 0xf) ? 0xf : negp;
+	nis = (nis > 0x7ff) ? 0x7ff : nis;
+
+	return (status & 0xff) | (range << 8) | (pivots << 12) | (negp << 16) | (nis << 20);
+}
+
+// top function
+int top_ekf( 	port_t obs[Mobs], 
+				port_t fx_i[Nsta],
+				port_t hx_i[Mobs],
+				port_t F_i[Nsta*Nsta],
+				port_t H_i[Mobs*NHC],
+				port_t params[(2*Nsta*Nsta)+(Mobs*Mobs)], 
+				port_t output[Nsta],
+				port_t state_i[NSAVE],
+				port_t state_o[NSAVE],
+				int ctrl,
+				int ctx,
+				int w1,
+				int w2,
+				int w3i,
+				int w3o
+			)
+{
+
+	// inputs
+    data_t din[Mobs];
+
+    /* ---------------- Application Specific Variables ------------------ */
+
+	static data_t x[Nsta];
+	
+	// output of state-transition function
+	static data_t fx[Nsta] = {0};
+	
+	// output of observation/measurement function
+	static data_t hx[Mobs] = {0};
+	
+	// Jacobians (F unused unless F_STRUCT is FS_DENSE)
+	static data_t F[Nsta][Nsta] = {{0}};
+	static data_t H[Mobs][NHC] = {{0}};
+	
+	/* ------------------ Fixed Covariance Matrices -------------------- */
+	
+	// prediction error covariance, i.e. x_new ~ N(fx, P), upper triangle
+	static data_t P[NTRI] = {0};
+	
+	// process/state noise covariance, i.e. x ~ N(u, Q) 
+	static data_t Q[Nsta][Nsta] = {{0}};
+	
+	// measurement/observed error covariance, i.e. z ~ N(u, R)
+	static data_t R[Mobs][Mobs] = {{0}};
+	
+	/* ------------------ Transposed Jacobians -------------------------- */
+	
+	static data_t Ft[Nsta][Nsta] = {{0}};
+	static data_t Ht[NHC][Mobs] = {{0}};
+
+	/* ------------------ Masked Step ----------------------------------- */
+
+	// the present measurements of a masked step, packed in front
+	static data_t hxm[Mobs] = {0};
+	static data_t dinm[Mobs] = {0};
+	static data_t Hm[Mobs][NHC] = {{0}};
+	static data_t Htm[NHC][Mobs] = {{0}};
+	static data_t Rm[Mobs][Mobs] = {{0}};
+
+	/* ------------------ Kalman Gain ---------------------------------- */
+
+	// unused with SEQ_UPDATE or SQRT_COV
+	static data_t K[Nsta][Mobs] = {{0}};
+#if (STEADY_GAIN == 1)
+	// full steps in a row with a settled K, see ekf_step_steady()
+	static int steady = 0;
+#endif
+
+	/* ------------------ Context Banks --------------------------------- */
+
+	/* The arrays above are the working set of context cur. Every other
+	   context lives in the banks below and is swapped in when selected, so
+	   back-to-back calls on one context pay nothing extra. Ft and Ht are
+	   rebuilt from F and H on a swap. */
+	static int cur = 0;
+	static data_t x_bank[NCTX][Nsta];
+	static data_t P_bank[NCTX][NTRI];
+	static data_t Q_bank[NCTX][Nsta][Nsta];
+	static data_t R_bank[NCTX][Mobs][Mobs];
+#if (F_STRUCT == FS_DENSE)
+	static data_t F_bank[NCTX][Nsta][Nsta];
+#endif
+	static data_t H_bank[NCTX][Mobs][NHC];
+#if (STEADY_GAIN == 1)
+	static data_t K_bank[NCTX][Nsta][Mobs];
+	static int steady_bank[NCTX];
+#endif
+
+	/* ---------------------- Control Inputs --------------------------- */
+	
+	int sig = ctrl;
+	int status = EKF_OK;
+	struct ekf_health hl = {0, 0};
+
+#ifndef __SYNTHESIS__
+	ekf_ports.F_i = ekf_ports.H_i = ekf_ports.state_i = ekf_ports.state_o = 0;
+#endif
+
+	/* measurement rows[r] is row r of the update, for the mo present ones */
+	int rows[Mobs];
+	int mo = 0;
+obs_rows:	for (int i=0; i<Mobs; i++) {
+		#pragma HLS PIPELINE
+		if (!(sig & CTRL_MASK) || ((sig >> (OBS_SHIFT + i)) & 1)) {
+			rows[mo] = i;
+			mo++;
+		}
+	}
+
+	/* a bad context or length refuses the call: no context is touched and
+	   the output is zeros, but every port still moves the words its copy
+	   pragma gives (up to the size of the port), or its DMA would hang */
+	int valid = 0;
+	if ((ctx < 0) || (ctx >= NCTX)) {
+		status = EKF_BAD_CTX;
+	} else if (((w1 != 0) && (w1 != Nsta)) || ((w2 != 0) && (w2 != mo)) ||
+			   (w3i != ((sig & CTRL_RESTORE) ? NSAVE : 0)) ||
+			   (w3o != ((sig & CTRL_SAVE) ? NSAVE : 0))) {
+		// H_i carries the present rows only
+		status = EKF_BAD_LEN;
+	} else {
+		valid = 1;
+	}
+	if (!valid) {
+		sig = CTRL_KEEP | CTRL_NOSTEP;
+		w1 = (w1 < 0) ? 0 : (w1 > Nsta) ? Nsta : w1;
+		w2 = (w2 < 0) ? 0 : (w2 > Mobs) ? Mobs : w2;
+		w3i = (w3i < 0) ? 0 : (w3i > NSAVE) ? NSAVE : w3i;
+		w3o = (w3o < 0) ? 0 : (w3o > NSAVE) ? NSAVE : w3o;
+	}
+
+	/* ---------------------- HLS PRAGMAs ----------------------------- */
+	//step1_1
+	#pragma HLS array_partition variable=F block factor=PART_N dim=2
+	#pragma HLS array_partition variable=P cyclic factor=PART_N dim=1
+	
+	//step1_2
+	//#pragma HLS array_partition variable=tmp0 block factor=PART_N dim=2
+	#pragma HLS array_partition variable=Ft block factor=PART_N dim=1
+	
+	//step2_1
+	#pragma HLS array_partition variable=H block factor=PART_N dim=2
+	//#pragma HLS array_partition variable=Pp cyclic factor=PART_N dim=1
+	
+	//step2_3
+	//#pragma HLS array_partition variable=tmp6 block factor=PART_N dim=2
+	#pragma HLS array_partition variable=Ht block factor=PART_N dim=1
+	#pragma HLS array_partition variable=Hm block factor=PART_N dim=2
+	#pragma HLS array_partition variable=Htm block factor=PART_N dim=1
+	
+	//step2_4
+	//#pragma HLS array_partition variable=tmp6 block factor=PART_M dim=1
+	//#pragma HLS array_partition variable=tmp4 block factor=PART_M dim=1
+	
+	//step4_1
+	#pragma HLS array_partition variable=K block factor=PART_M dim=2
+	//#pragma HLS array_partition variable=tmp6 block factor=PART_M dim=1
+	
+	//#pragma HLS RESOURCE variable=H core=RAM_S2P_BRAM
+	
+	/* ----------------------- Switch Context -------------------------- */
+
+	if (valid && ctx != cur) {
+store_ctx:	for (int i=0; i<Nsta; i++) {
+			x_bank[cur][i] = x[i];
+			for (int j=0; j<Nsta; j++) {
+				#pragma HLS PIPELINE
+				Q_bank[cur][i][j] = Q[i][j];
+#if (F_STRUCT == FS_DENSE)
+				F_bank[cur][i][j] = F[i][j];
+#endif
+			}
+		}
+store_ctx_m:	for (int i=0; i<Mobs; i++) {
+			for (int j=0; j<NHC; j++) {
+				#pragma HLS PIPELINE
+				H_bank[cur][i][j] = H[i][j];
+			}
+			for (int j=0; j<Mobs; j++) {
+				#pragma HLS PIPELINE
+				R_bank[cur][i][j] = R[i][j];
+			}
+		}
+#if (STEADY_GAIN == 1)
+store_ctx_k:	for (int i=0; i<Nsta; i++) {
+			for (int j=0; j<Mobs; j++) {
+				#pragma HLS PIPELINE
+				K_bank[cur][i][j] = K[i][j];
+			}
+		}
+		steady_bank[cur] = steady;
+#endif
+store_ctx_p:	for (int t=0; t<NTRI; t++) {
+			#pragma HLS PIPELINE
+			P_bank[cur][t] = P[t];
+		}
+load_ctx:	for (int i=0; i<Nsta; i++) {
+			x[i] = x_bank[ctx][i];
+			for (int j=0; j<Nsta; j++) {
+				#pragma HLS PIPELINE
+				Q[i][j] = Q_bank[ctx][i][j];
+#if (F_STRUCT == FS_DENSE)
+				F[i][j] = F_bank[ctx][i][j];
+				Ft[j][i] = F_bank[ctx][i][j];
+#endif
+			}
+		}
+load_ctx_m:	for (int i=0; i<Mobs; i++) {
+			for (int j=0; j<NHC; j++) {
+				#pragma HLS PIPELINE
+				data_t imm = H_bank[ctx][i][j];
+				H[i][j] = imm;
+				Ht[j][i] = imm;
+			}
+			for (int j=0; j<Mobs; j++) {
+				#pragma HLS PIPELINE
+				R[i][j] = R_bank[ctx][i][j];
+			}
+		}
+#if (STEADY_GAIN == 1)
+load_ctx_k:	for (int i=0; i<Nsta; i++) {
+			for (int j=0; j<Mobs; j++) {
+				#pragma HLS PIPELINE
+				K[i][j] = K_bank[ctx][i][j];
+			}
+		}
+		steady = steady_bank[ctx];
+#endif
+load_ctx_p:	for (int t=0; t<NTRI; t++) {
+			#pragma HLS PIPELINE
+			P[t] = P_bank[ctx][t];
+		}
+		cur = ctx;
+	}
+
+	/* ----------------------- Read Input Data ------------------------- */
+
+	// read H and F Jacobians
+	/* w1=0 and w2=0 when KF only; F_i is not read for a fixed F_STRUCT.
+	   A row of H_i holds the NHC columns of H, w1/2 of them for H_SPARSE */
+	int wh = (NHC == Nsta) ? w1 : w1/2;
+	// set if F or H differ from those of the context
+	int moved = 0;
+#if (F_STRUCT == FS_DENSE)
+load_F:	for (int i=0; i<w1; i++) {
+load_F_i:	for (int j=0; j<w1; j++) {
+			#pragma HLS PIPELINE
+			data_t imm;
+			imm.V = F_i[i*w1 + j].range(bit_width-1,0);
+			PORT_WORDS(F_i, 1);
+			if (valid) {
+				moved |= (imm != F[i][j]);
+				F[i][j] = imm;
+				Ft[j][i] = imm;
+			}
+		}
+	}
+#endif
+load_H:	for (int i=0; i<w2; i++) {
+load_H_i:	for (int j=0; j<wh; j++) {
+			#pragma HLS PIPELINE
+			data_t imm;
+			imm.V = H_i[i*wh + j].range(bit_width-1,0);
+			PORT_WORDS(H_i, 1);
+			if (valid) {
+				moved |= (imm != H[rows[i]][j]);
+				H[rows[i]][j] = imm;
+				Ht[j][rows[i]] = imm;
+			}
+		}
+	}
+	
+	// read state function fx
+load_fx:	for (int i=0; i<Nsta; i++) {
+		#pragma HLS PIPELINE
+		fx[i].V = fx_i[i].range(bit_width-1,0);
+	}
+	
+	// read measurement function hx
+load_hx:	for (int i=0; i<Mobs; i++) {
+		#pragma HLS PIPELINE
+		hx[i].V = hx_i[i].range(bit_width-1,0);
+	}
+	
+	/* ------------------------ Init --------------------------------- */
+	if (!(sig & CTRL_KEEP)) {
+		init(P, Q, R, params);
+	}
+
+	if (sig & CTRL_RESTORE) {
+		restore_state(x, P, state_i);
+	} else {
+		// only a refused call gets here with w3i > 0
+drain_state: for (int i=0; i<w3i; i++) {
+			#pragma HLS PIPELINE
+			port_t imm = state_i[i];
+			PORT_WORDS(state_i, 1);
+		}
+	}
+
+#if (STEADY_GAIN == 1)
+	// a new F, H, P, Q or R: full steps until K settles again
+	if (moved || !(sig & CTRL_KEEP) || (sig & CTRL_RESTORE)) {
+		steady = 0;
+	}
+#endif
+
+	/* --------------------------------------------------------------- */
+	
+
+	// read measurements
+	for (int i=0; i<Mobs; i++) {
+		#pragma HLS PIPELINE
+		din[i].V = obs[i].range(bit_width-1, 0);
+	}
+
+	// ekf_step
+	#pragma HLS allocation instances=ekf_step limit=1 function
+	if (!(sig & CTRL_NOSTEP) && (mo < Mobs)) {
+pack_m:	for (int r=0; r<mo; r++) {
+			int i = rows[r];
+			hxm[r] = hx[i];
+			dinm[r] = din[i];
+			for (int j=0; j<NHC; j++) {
+				#pragma HLS PIPELINE
+				Hm[r][j] = H[i][j];
+				Htm[j][r] = Ht[j][i];
+			}
+			for (int c=0; c<mo; c++) {
+				#pragma HLS PIPELINE
+				Rm[r][c] = R[i][rows[c]];
+			}
+		}
+#if (STEADY_GAIN == 1)
+		// the settled K is that of all Mobs
+		steady = 0;
+#endif
+		status = ekf_step(x, fx, hxm, F, Hm, P, Q, Rm, Ft, Htm, dinm, K, mo, &hl);
+	} else if (!(sig & CTRL_NOSTEP)) {
+#if (STEADY_GAIN == 1)
+		status = ekf_step_steady(x, fx, hx, F, H, P, Q, R, Ft, Ht, din, K, &steady, &hl);
+#else
+		status = ekf_step(x, fx, hx, F, H, P, Q, R, Ft, Ht, din, K, Mobs, &hl);
+#endif
+	}
+
+	if (sig & CTRL_SAVE) {
+		save_state(x, P, state_o);
+	} else {
+fill_state: for (int i=0; i<w3o; i++) {
+			#pragma HLS PIPELINE
+			state_o[i] = 0;
+			PORT_WORDS(state_o, 1);
+		}
+	}
+
+
+	// write output
+	for (int k=0; k<Nsta; k++) {
+		#pragma HLS PIPELINE
+		port_t imm = 0;
+		if (valid) {
+			imm.range(bit_width-1,0) = x[k].V;
+		}
+		output[k] = imm;
+	}
+
+	if (sig & CTRL_HEALTH) {
+		status = health_word(status, x, P, &hl, mo);
+	}
+
+	return status;
+	
+}
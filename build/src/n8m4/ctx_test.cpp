@@ -0,0 +1,510 @@
+/*  ctx_test: C-simulation test of the top_ekf filter contexts.
+
+    Runs NTRK independent tracks through top_ekf and checks that every
+    output word matches running each track alone in context 0:
+
+        1. the first NCTX tracks interleaved in random order, one per context,
+           in KF mode (F and H are sent on the first step only, w1=w2=0 after)
+        2. all NTRK tracks multiplexed over the NCTX contexts, spilling x/P
+           to DDR after every step and filling them back before the next
+
+        3. the first NCTX tracks again, through the ekf_async ring
+           (src/hybrid/ekf_async.h), RING_DEPTH steps in flight; built with
+           P_CACHEABLE=2, every step must come with one flush of its
+           inputs and one invalidate of its outputs
+
+    It also checks that an out-of-range ctx leaves every context untouched,
+    that a save-only call (CTRL_NOSTEP) returns the state of step 2, and
+    that a step with a non positive definite H P H^T + R returns EKF_NOT_PD
+    and leaves x/P as they were, and that ekf_poll reports a step as pending
+    until the kernel returns.
+
+    With CTRL_HEALTH, the outputs must not change, healthy steps must come
+    with clean health words, and a context given a negative R or an
+    outlying measurement must be the only one flagged.
+
+    Tracks use a constant velocity model with a per-track H and Q.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "sds_lib.h"
+
+#include "ekf_config.h"
+#include "ekf_async.h"
+#if P_CACHEABLE == 2
+#include "xlnk.h"
+#endif
+
+#define NTRK (3*NCTX)
+#define RING_DEPTH 4
+#define NSTEP 40
+#define PARAMS_IN ((2*Nsta*Nsta)+(Mobs*Mobs))
+
+
+static int32_t toFixed(double a)
+{
+    return (int32_t)(a*(1 << frac_width));
+}
+
+static double toDouble(port_t a)
+{
+    return (int32_t)(uint32_t)a / (double)(1 << frac_width);
+}
+
+static uint32_t lcg(uint32_t *seed)
+{
+    *seed = *seed*1664525 + 1013904223;
+    return *seed >> 8;
+}
+
+static double urand(uint32_t *seed)
+{
+    return (double)lcg(seed)/(1 << 24) - 0.5;
+}
+
+struct track {
+    double F[Nsta][Nsta];
+    double H[Mobs][Nsta];
+    port_t params[PARAMS_IN];
+    port_t z[NSTEP][Mobs];
+    port_t x[Nsta];                 // last output
+    port_t ref[NSTEP][Nsta];        // outputs when run alone
+    port_t *state;                  // x/P spill area in DDR
+    int step;
+    int health;                     // last return word
+};
+
+static void make_track(struct track *t, int k)
+{
+    uint32_t seed = 12345 + k;
+
+    memset(t->F, 0, sizeof(t->F));
+    for (int i=0; i<Nsta; i+=2) {
+        t->F[i][i] = 1;
+        t->F[i][i+1] = 1;
+        t->F[i+1][i+1] = 1;
+    }
+    for (int i=0; i<Mobs; i++) {
+        for (int j=0; j<Nsta; j++)
+            t->H[i][j] = 0.5*urand(&seed);
+        t->H[i][(2*i) % Nsta] += 1;
+    }
+
+    /* params: P, Q, R; Q differs between tracks so the slots must keep it */
+    double qval = 0.05 + 0.01*(k % 5);
+    for (int i=0; i<PARAMS_IN; i++)
+        t->params[i] = 0;
+    for (int i=0; i<Nsta; i++) {
+        t->params[i*Nsta + i] = toFixed(0.5);
+        t->params[Nsta*Nsta + i*Nsta + i] = toFixed(qval);
+    }
+    for (int i=0; i<Mobs; i++)
+        t->params[2*Nsta*Nsta + i*Mobs + i] = toFixed(20.0);
+
+    for (int s=0; s<NSTEP; s++)
+        for (int i=0; i<Mobs; i++)
+            t->z[s][i] = toFixed(0.1*s + urand(&seed));
+
+    t->step = 0;
+}
+
+/* fx = F x, hx = H fx, evaluated from the last output of the track */
+static void model(struct track *t, port_t *fx_i, port_t *hx_i,
+                  port_t *F_i, port_t *H_i)
+{
+    double x[Nsta], fx[Nsta];
+
+    for (int i=0; i<Nsta; i++)
+        x[i] = (t->step == 0) ? 0.0 : toDouble(t->x[i]);
+    for (int i=0; i<Nsta; i++) {
+        fx[i] = 0;
+        for (int j=0; j<Nsta; j++)
+            fx[i] += t->F[i][j]*x[j];
+        fx_i[i] = toFixed(fx[i]);
+    }
+    for (int i=0; i<Mobs; i++) {
+        double hx = 0;
+        for (int j=0; j<Nsta; j++)
+            hx += t->H[i][j]*fx[j];
+        hx_i[i] = toFixed(hx);
+    }
+    for (int i=0; i<Nsta*Nsta; i++)
+        F_i[i] = toFixed(t->F[i/Nsta][i%Nsta]);
+    for (int i=0; i<Mobs*Nsta; i++)
+        H_i[i] = toFixed(t->H[i/Nsta][i%Nsta]);
+}
+
+struct ports {
+    port_t *obs, *fx_i, *hx_i, *F_i, *H_i, *params, *output;
+};
+
+/* the ports of the last top_ekf call against the lengths of its copy
+   pragmas; returns the ports that moved another number of words */
+static int ports_moved(int w1, int w2, int w3i, int w3o)
+{
+    int wf = (F_STRUCT == FS_DENSE) ? w1*w1 : 0;
+    int wh = ((NHC == Nsta) ? w1 : w1/2) * w2;
+
+    return (ekf_ports.F_i != wf) + (ekf_ports.H_i != wh)
+         + (ekf_ports.state_i != w3i) + (ekf_ports.state_o != w3o);
+}
+
+/* one top_ekf call for the next step of track t, state_i/state_o sized by
+   the CTRL_RESTORE/CTRL_SAVE bits of ctrl; returns the mismatches, counting
+   a failed step and a port that moved the wrong number of words as one */
+static int run(struct track *t, struct ports *p, int ctx, int ctrl, int jac,
+               int check)
+{
+    int errors = 0;
+    int w = jac ? Nsta : 0, m = jac ? Mobs : 0;
+    int w3i = (ctrl & CTRL_RESTORE) ? NSAVE : 0, w3o = (ctrl & CTRL_SAVE) ? NSAVE : 0;
+
+    model(t, p->fx_i, p->hx_i, p->F_i, p->H_i);
+    memcpy(p->obs, t->z[t->step], Mobs*sizeof(port_t));
+    memcpy(p->params, t->params, PARAMS_IN*sizeof(port_t));
+
+    t->health = top_ekf(p->obs, p->fx_i, p->hx_i, p->F_i, p->H_i, p->params, p->output,
+                        t->state, t->state, ctrl, ctx, w, m, w3i, w3o);
+    if (HL_STATUS(t->health) != EKF_OK)
+        errors++;
+    errors += ports_moved(w, m, w3i, w3o);
+
+    for (int i=0; i<Nsta; i++) {
+        if (check && (uint32_t)p->output[i] != (uint32_t)t->ref[t->step][i])
+            errors++;
+        else if (!check)
+            t->ref[t->step][i] = p->output[i];
+        t->x[i] = p->output[i];
+    }
+    t->step++;
+    return errors;
+}
+
+/* 3. the first NCTX tracks, one per context, through the ring: the model
+   of the next track is evaluated while the kernel runs the last ones */
+static int run_ring(struct track *trk)
+{
+    struct ekf_ring *r = ekf_ring_open(RING_DEPTH, NULL);
+    struct ekf_buf *buf[RING_DEPTH];    // in flight, oldest at head
+    int owner[RING_DEPTH], busy[NCTX];
+    int head = 0, inflight = 0, left = NCTX*NSTEP, k = 0;
+    int errors = 0;
+
+    if (r == NULL)
+        return 1;
+#if P_CACHEABLE == 2
+    long flushes = xlnk_flushes, invalidates = xlnk_invalidates;
+#endif
+    for (int j=0; j<NCTX; j++) {
+        trk[j].step = 0;
+        busy[j] = 0;
+    }
+
+    while (left > 0) {
+        // the next track round-robin that is not waiting for its last step
+        int next = -1;
+        for (int j=0; j<NCTX && next < 0; j++) {
+            int c = (k + j) % NCTX;
+            if (!busy[c] && trk[c].step < NSTEP)
+                next = c;
+        }
+
+        if (next < 0 || inflight == RING_DEPTH) {
+            // take the oldest step back
+            struct ekf_buf *b = buf[head];
+            struct track *t = &trk[owner[head]];
+            errors += (ekf_wait(r, b->ticket) != EKF_OK);
+            for (int i=0; i<Nsta; i++) {
+                errors += ((uint32_t)b->xout[i] != (uint32_t)t->ref[t->step][i]);
+                t->x[i] = b->xout[i];
+            }
+            t->step++;
+            busy[owner[head]] = 0;
+            head = (head + 1) % RING_DEPTH;
+            inflight--;
+            left--;
+            continue;
+        }
+
+        struct track *t = &trk[next];
+        int first = (t->step == 0);
+        struct ekf_buf *b = ekf_acquire(r);
+        model(t, b->fx_i, b->hx_i, b->F_i, b->H_i);
+        memcpy(b->obs, t->z[t->step], Mobs*sizeof(port_t));
+        memcpy(b->params, t->params, PARAMS_IN*sizeof(port_t));
+        b->ctrl = first ? 0 : CTRL_KEEP;
+        b->ctx = next;
+        b->w1 = first ? Nsta : 0;
+        b->w2 = first ? Mobs : 0;
+        b->w3i = b->w3o = 0;
+        ekf_submit(r, b);
+
+        buf[(head + inflight) % RING_DEPTH] = b;
+        owner[(head + inflight) % RING_DEPTH] = next;
+        inflight++;
+        busy[next] = 1;
+        k = next + 1;
+    }
+    ekf_ring_close(r);
+#if P_CACHEABLE == 2
+    errors += (xlnk_flushes - flushes != NCTX*NSTEP);
+    errors += (xlnk_invalidates - invalidates != NCTX*NSTEP);
+#endif
+    return errors;
+}
+
+/* a kernel that holds every call until the gate is opened */
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static int gate_open;
+
+static int gated_ekf(port_t *obs, port_t *fx_i, port_t *hx_i, port_t *F_i,
+                     port_t *H_i, port_t *params, port_t *output,
+                     port_t *state_i, port_t *state_o,
+                     int ctrl, int ctx, int w1, int w2, int w3i, int w3o)
+{
+    pthread_mutex_lock(&gate_lock);
+    while (!gate_open)
+        pthread_cond_wait(&gate_cond, &gate_lock);
+    pthread_mutex_unlock(&gate_lock);
+    return top_ekf(obs, fx_i, hx_i, F_i, H_i, params, output, state_i, state_o,
+                   ctrl, ctx, w1, w2, w3i, w3o);
+}
+
+/* a step is pending until the kernel returns, and wait returns its status */
+static int run_gated(void)
+{
+    struct ekf_ring *r = ekf_ring_open(2, gated_ekf);
+    int errors = 0;
+
+    if (r == NULL)
+        return 1;
+    struct ekf_buf *b = ekf_acquire(r);
+    b->ctrl = CTRL_KEEP | CTRL_NOSTEP;
+    b->ctx = 0;
+    b->w1 = b->w2 = b->w3i = b->w3o = 0;
+    long t = ekf_submit(r, b);
+    errors += (ekf_poll(r, t) != 0);
+
+    pthread_mutex_lock(&gate_lock);
+    gate_open = 1;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+
+    errors += (ekf_wait(r, t) != EKF_OK);
+    errors += (ekf_poll(r, t) != 1);
+    ekf_ring_close(r);
+    return errors;
+}
+
+/* 4. the first NCTX tracks interleaved again with CTRL_HEALTH; at step
+   NSTEP/2, track 1 gets an outlier and track 2 a negative R. Returns the
+   mismatches, counting a health word that is wrong as one */
+static int run_health(struct track *trk, struct ports *p)
+{
+    int errors = 0;
+    int nis_max = 0;
+
+    for (int k=0; k<NCTX; k++)
+        trk[k].step = 0;
+    for (int s=0; s<NSTEP; s++) {
+        for (int k=0; k<NCTX; k++) {
+            struct track *t = &trk[k];
+            int ctrl = ((s == 0) ? 0 : CTRL_KEEP) | CTRL_HEALTH;
+
+            if (s == NSTEP/2 && (k == 1 || k == 2)) {
+                port_t bad = t->z[s][0];
+                int r;
+                if (k == 1) {
+                    t->z[s][0] = toFixed(toDouble(bad) + 100.0);
+                } else {
+                    for (int i=0; i<Mobs; i++)
+                        t->params[2*Nsta*Nsta + i*Mobs + i] = toFixed(-20.0);
+                    ctrl = CTRL_HEALTH;
+                }
+                // the flagged step, not checked against the reference
+                model(t, p->fx_i, p->hx_i, p->F_i, p->H_i);
+                memcpy(p->obs, t->z[s], Mobs*sizeof(port_t));
+                memcpy(p->params, t->params, PARAMS_IN*sizeof(port_t));
+                r = top_ekf(p->obs, p->fx_i, p->hx_i, p->F_i, p->H_i, p->params,
+                            p->output, t->state, t->state, ctrl, k, 0, 0, 0, 0);
+                if (k == 1)
+                    errors += (HL_STATUS(r) != EKF_OK) || (HL_NIS(r) < 16*16);
+                else
+                    errors += (HL_STATUS(r) != EKF_NOT_PD) || (HL_PIVOT(r) == 0)
+                            || (HL_NIS(r) != 0);
+                t->z[s][0] = bad;
+                continue;
+            }
+            if (s > NSTEP/2 && (k == 1 || k == 2))
+                continue;
+
+            errors += run(t, p, k, ctrl, s == 0, 1);
+            errors += (HL_RANGE(t->health) != 0) || (HL_PIVOT(t->health) != 0)
+                    || (HL_NEGP(t->health) != 0);
+            if (s > 0 && HL_NIS(t->health) > nis_max)
+                nis_max = HL_NIS(t->health);
+        }
+    }
+    // healthy steps stay below the outlier's bound
+    errors += (nis_max >= 16*16);
+    printf("%-40s max NIS/m of healthy steps %.2f\n", "", nis_max/16.0);
+
+    // restore track 2
+    for (int i=0; i<Mobs; i++)
+        trk[2].params[2*Nsta*Nsta + i*Mobs + i] = toFixed(20.0);
+    return errors;
+}
+
+static int report(const char *name, int errors)
+{
+    printf("%-40s %s (%d mismatches)\n", name, errors ? "FAIL" : "PASS", errors);
+    return errors != 0;
+}
+
+int main(int argc, char ** argv)
+{
+    struct ports p;
+    struct track *trk = (struct track *)malloc(NTRK*sizeof(struct track));
+    port_t *saved = (port_t *)malloc(NCTX*NSAVE*sizeof(port_t));
+    int failed = 0, errors;
+
+    p.obs = (port_t *)sds_alloc(Mobs*sizeof(port_t));
+    p.fx_i = (port_t *)sds_alloc(Nsta*sizeof(port_t));
+    p.hx_i = (port_t *)sds_alloc(Mobs*sizeof(port_t));
+    p.F_i = (port_t *)sds_alloc(Nsta*Nsta*sizeof(port_t));
+    p.H_i = (port_t *)sds_alloc(Mobs*Nsta*sizeof(port_t));
+    p.params = (port_t *)sds_alloc(PARAMS_IN*sizeof(port_t));
+    p.output = (port_t *)sds_alloc(Nsta*sizeof(port_t));
+
+    for (int k=0; k<NTRK; k++) {
+        make_track(&trk[k], k);
+        trk[k].state = (port_t *)sds_alloc(NSAVE*sizeof(port_t));
+    }
+
+    // reference: every track alone in context 0
+    for (int k=0; k<NTRK; k++) {
+        for (int s=0; s<NSTEP; s++)
+            run(&trk[k], &p, 0, (s == 0) ? 0 : CTRL_KEEP, s == 0, 0);
+        trk[k].step = 0;
+    }
+
+    // 1. one track per context, random interleaving, KF mode
+    uint32_t seed = 777;
+    int left = NCTX*NSTEP;
+    errors = 0;
+    while (left > 0) {
+        int k = lcg(&seed) % NCTX;
+        if (trk[k].step == NSTEP)
+            continue;
+        int first = (trk[k].step == 0);
+        errors += run(&trk[k], &p, k, first ? 0 : CTRL_KEEP, first, 1);
+        left--;
+
+        /* refused calls must not disturb anything, and still move the
+           words of every port: an out-of-range context, a state port sent
+           without CTRL_RESTORE, one not sized for CTRL_SAVE, H_i with more
+           or fewer rows than the mask has present */
+        if (left % 7 == 0) {
+            static const int bad[6][6] = {
+                // ctx, ctrl, w2, w3i, w3o, status
+                {NCTX, 0, Mobs, 0, 0, EKF_BAD_CTX},
+                {-1, CTRL_RESTORE | CTRL_SAVE, Mobs, NSAVE, NSAVE, EKF_BAD_CTX},
+                {0, CTRL_KEEP | CTRL_SAVE, Mobs, NSAVE, NSAVE, EKF_BAD_LEN},
+                {0, CTRL_KEEP | CTRL_SAVE, Mobs, 0, 0, EKF_BAD_LEN},
+                {0, CTRL_KEEP | CTRL_OBS(0x5), Mobs, 0, 0, EKF_BAD_LEN},
+                {0, CTRL_KEEP | CTRL_OBS(0x5), 1, 0, 0, EKF_BAD_LEN},
+            };
+            const int *b = bad[(left / 7) % 6];
+            errors += (top_ekf(p.obs, p.fx_i, p.hx_i, p.F_i, p.H_i, p.params, p.output,
+                               saved, saved, b[1], b[0], Nsta, b[2], b[3], b[4]) != b[5]);
+            errors += ports_moved(Nsta, b[2], b[3], b[4]);
+            for (int i=0; i<Nsta; i++)
+                errors += ((uint32_t)p.output[i] != 0);
+        }
+    }
+    failed += report("interleaved contexts", errors);
+
+    // save-only calls return the final x of every context
+    errors = 0;
+    for (int k=0; k<NCTX; k++) {
+        top_ekf(p.obs, p.fx_i, p.hx_i, p.F_i, p.H_i, p.params, p.output,
+                &saved[k*NSAVE], &saved[k*NSAVE], CTRL_KEEP | CTRL_NOSTEP | CTRL_SAVE,
+                k, 0, 0, 0, NSAVE);
+        errors += ports_moved(0, 0, 0, NSAVE);
+        for (int i=0; i<Nsta; i++) {
+            errors += ((uint32_t)saved[k*NSAVE + i] != (uint32_t)trk[k].ref[NSTEP-1][i]);
+            errors += ((uint32_t)p.output[i] != (uint32_t)trk[k].ref[NSTEP-1][i]);
+        }
+    }
+    failed += report("save without step", errors);
+
+    // 2. NTRK tracks over NCTX contexts with spill/fill to DDR
+    for (int k=0; k<NTRK; k++)
+        trk[k].step = 0;
+    left = NTRK*NSTEP;
+    errors = 0;
+    while (left > 0) {
+        int k = lcg(&seed) % NTRK;
+        if (trk[k].step == NSTEP)
+            continue;
+        int ctrl = ((trk[k].step == 0) ? 0 : CTRL_RESTORE) | CTRL_SAVE;
+        errors += run(&trk[k], &p, lcg(&seed) % NCTX, ctrl, 1, 1);
+        left--;
+    }
+    failed += report("spilled contexts", errors);
+
+    // the covariances spilled in 2. match the ones kept on chip in 1.
+    errors = 0;
+    for (int k=0; k<NCTX; k++)
+        for (int i=0; i<NSAVE; i++)
+            errors += ((uint32_t)trk[k].state[i] != (uint32_t)saved[k*NSAVE + i]);
+    failed += report("spilled x/P match on-chip x/P", errors);
+
+    // a negative R makes H P H^T + R indefinite: the step is dropped
+    port_t *before = (port_t *)sds_alloc(NSAVE*sizeof(port_t));
+    port_t *after = (port_t *)sds_alloc(NSAVE*sizeof(port_t));
+    trk[0].step = 0;
+    model(&trk[0], p.fx_i, p.hx_i, p.F_i, p.H_i);
+    memcpy(p.obs, trk[0].z[0], Mobs*sizeof(port_t));
+    memcpy(p.params, trk[0].params, PARAMS_IN*sizeof(port_t));
+    for (int i=0; i<Mobs; i++)
+        p.params[2*Nsta*Nsta + i*Mobs + i] = toFixed(-20.0);
+    errors = 0;
+    errors += (top_ekf(p.obs, p.fx_i, p.hx_i, p.F_i, p.H_i, p.params, p.output,
+                       before, before, CTRL_NOSTEP | CTRL_SAVE, 0, Nsta, Mobs, 0, NSAVE) != EKF_OK);
+    errors += (top_ekf(p.obs, p.fx_i, p.hx_i, p.F_i, p.H_i, p.params, p.output,
+                       after, after, CTRL_KEEP | CTRL_SAVE, 0, 0, 0, 0, NSAVE) != EKF_NOT_PD);
+    for (int i=0; i<NSAVE; i++)
+        errors += ((uint32_t)after[i] != (uint32_t)before[i]);
+    for (int i=0; i<Nsta; i++)
+        errors += ((uint32_t)p.output[i] != (uint32_t)before[i]);
+    failed += report("not positive definite", errors);
+    sds_free(before);
+    sds_free(after);
+
+    // 3. contexts served through the ring; they are reinitialised by ctrl=0
+    failed += report("async ring", run_ring(trk));
+    failed += report("async poll/wait", run_gated());
+
+    // 4. health words; the tracks are started again from ctrl=0
+    failed += report("health word", run_health(trk, &p));
+
+    for (int k=0; k<NTRK; k++)
+        sds_free(trk[k].state);
+    sds_free(p.obs);
+    sds_free(p.fx_i);
+    sds_free(p.hx_i);
+    sds_free(p.F_i);
+    sds_free(p.H_i);
+    sds_free(p.params);
+    sds_free(p.output);
+    free(saved);
+    free(trk);
+
+    return failed;
+}
@@ -6,7 +6,13 @@
   
         http://www.mathworks.com/matlabcentral/fileexchange/31487-extended-kalman-filter-ekf--for-gps
  
-    Reads file gps.csv of satellite data and writes file ekf.csv of mean-subtracted estimated positions.
+    Streams the satellite data of gps_data.trc, written from gps_data.csv by csv2trace
+    (src/trace), through the kernel and prints the estimated positions of the first steps,
+    then a summary of the health words of all steps (CTRL_HEALTH, see ekf_hybrid.h).
+    
+    usage: ekf_n8m4.elf [gps_data.trc] [prof.csv|prof.json]
+    Built with PROF_ENABLE=1 (make PROF=1), also writes the per-stage timings of every
+    step (src/prof), to stdout if no file is given.
     
 */
 
@@ -20,102 +26,114 @@
 #include "sds_lib.h"
 
 #include "ekf_config.h"
+#include "../trace/trace.h"
+#include "../prof/prof.h"
+#include "../fxconv/fxconv.h"
+#include "../hybrid/ekf_block.h"
 
 #define SEC_TO_NS (1000000000)
 
-
-static void readline(char * line, FILE * fp)
+/* trace columns: satellite positions [Nsats][Nxyz], then the Mobs pseudoranges */
+#define MEAS 12
+#define COLS (MEAS + Mobs)
+/* rows per trace_read() */
+#define CHUNK 256
+/* steps printed at the end */
+#define PRINT_STEPS 50
+
+/* stages of a step: trace_read (on the first step of a chunk), satellite
+   positions to float, model and its conversion to fixed point, top_ekf
+   (DMA and compute), output to float */
+enum { ST_READ, ST_CONVERT, ST_MODEL, ST_KERNEL, ST_OUTPUT };
+static struct prof prof;
+
+/* model values that did not fit data_t, handled as FX_MODE says (src/fxconv) */
+static long overflows;
+
+/* health words of the steps: the first flagged step, the flagged steps and
+   the largest NIS/m (in 1/16) */
+static long hl_first = -1, hl_flagged;
+static int hl_nis_max;
+
+static void health(int hw, long i)
 {
-    fgets(line, 1000, fp);
+    int flagged = (HL_STATUS(hw) != EKF_OK) || HL_RANGE(hw) || HL_PIVOT(hw) || HL_NEGP(hw);
+    if (flagged) {
+        if (hl_first < 0) {
+            hl_first = i;
+        }
+        hl_flagged++;
+    }
+    if (HL_NIS(hw) > hl_nis_max) {
+        hl_nis_max = HL_NIS(hw);
+    }
 }
 
-static void skipline(FILE * fp)
+static void writedata(float *output_fl, long datalen)
 {
-    char line[1000];
-    readline(line, fp);
-}
+    // write filtered positions
+    for (long i=0; i<datalen && i<PRINT_STEPS; i++) {
+        printf("[%ld] %f %f %f\n", i, output_fl[i*Nsta + 0], output_fl[i*Nsta + 2], output_fl[i*Nsta + 4]);
+    }
+    printf("Finished EKF, %ld steps\n", datalen);
 
-static float toFloat(int32_t a)
-{
-    float result;
-    float val = 1 << frac_width;
-    result = a/val;
-    
-    return result;
 }
 
-
-static int32_t toFixed(float a)
-{
-    int32_t result;
-    int32_t val = 1 << frac_width; //logical shift
-    
-    //if (a<0) result = a*val-0.5; //rounding
-    //else result = a*val +0.5;
-    result = a*val;
-    
-    return result;
+static void append_result(port_t *xout, port_t *output, int i)
+{   
+    for (int j=0; j<Nsta; j++) {
+        output[i*Nsta + j] = xout[j];
+    }
 }
 
-static void readdata(port_t *obs, float *meas, const char fname[], int datalen)
+/* H_i in the layout top_ekf reads: Mobs x NHC row-major, the columns
+   HCOL(k) of H, i.e. all of H unless H_SPARSE */
+static void pack_H(float H[Mobs][Nsta], port_t *H_i)
 {
-    FILE * fp = fopen(fname, "r");
-
-    // Skip CSV header
-    skipline(fp);
-
-    for (int i=0; i<datalen; i++) {
-
-        char line[1000];
-
-        readline(line, fp);
-
-        char * p = strtok(line, ",");
-
-        // read transpose, i.e. [Nxyz][Nsats] instead of [Nsats][Nxyz] like csv
-        for (int j=0; j<12; j++) {
-            float imm = atof(p);
-            p = strtok(NULL, ",");
-            meas[i*12 + j] = imm; 
-        }
-        
-        for (int j=0; j<Mobs; j++) {
-            float imm = atof(p);
-            int32_t imm_fx = toFixed(imm);
-            p = strtok(NULL, ",");
-            obs[i*Mobs+ j] = imm_fx; 
+    float Hc[Mobs*NHC];
+    for (int i=0; i<Mobs; i++) {
+        for (int k=0; k<NHC; k++) {
+            Hc[i*NHC + k] = H[i][HCOL(k)];
         }
-
     }
-
-    fclose(fp);
+    overflows += port_from_float(H_i, Hc, Mobs*NHC, bit_width, frac_width, FX_MODE);
 }
 
-static void writedata(port_t *output, float *output_fl, int datalen)
+#if (SQRT_COV == 1)
+/* P, Q and R of params, in place, to the upper triangular factors the
+   SQRT_COV kernel takes, A = U^T U, by a Cholesky factorisation of each */
+static void factor_params(port_t *params)
 {
-    int i,j;
-
-    // convert outputs to float
-    for (i=0; i<datalen*Nsta; i++) {
-        uint32_t oval_uint = output[i];
-        int32_t oval_fx = (int32_t) oval_uint;
-        output_fl[i] = toFloat(oval_fx);
-    }
-
-    // write filtered positions measus means
-    for (i=0; i<datalen; i++) {
-        printf("[%d] %f %f %f\n", i, output_fl[i*Nsta + 0], output_fl[i*Nsta + 2], output_fl[i*Nsta + 4]);
-    }
-    printf("Finished EKF\n");
-
-}
-
-static void append_result(port_t *xout, port_t *output, int i)
-{   
-    for (int j=0; j<Nsta; j++) {
-        output[i*Nsta + j] = xout[j];
+    const int off[3] = {0, Nsta*Nsta, 2*Nsta*Nsta};
+    const int dim[3] = {Nsta, Nsta, Mobs};
+    float a[Nsta*Nsta];
+
+    for (int b=0; b<3; b++) {
+        int n = dim[b];
+        port_to_float(a, params + off[b], n*n, bit_width, frac_width);
+        // row j of U from rows 0..j-1 and the upper triangle of row j of A
+        for (int j=0; j<n; j++) {
+            float d = a[j*n + j];
+            for (int k=0; k<j; k++) {
+                d -= a[k*n + j]*a[k*n + j];
+            }
+            d = (d > 0) ? sqrtf(d) : 0;
+            a[j*n + j] = d;
+            for (int i=j+1; i<n; i++) {
+                float s = a[j*n + i];
+                for (int k=0; k<j; k++) {
+                    s -= a[k*n + j]*a[k*n + i];
+                }
+                a[j*n + i] = (d > 0) ? s/d : 0;
+            }
+            for (int i=0; i<j; i++) {
+                a[j*n + i] = 0;
+            }
+        }
+        overflows += port_from_float(params + off[b], a, n*n, bit_width, frac_width, FX_MODE);
     }
 }
+#endif
 
 static void model( float x[Nsta], float meas[12], port_t *fx_i, port_t *hx_i, 
             port_t *F_i, port_t *H_i )
@@ -159,59 +177,58 @@ static void model( float x[Nsta], float meas[12], port_t *fx_i, port_t *hx_i,
     }
     
     // copy to fixed point 
-    for (int i=0; i<Nsta; i++) {
-        int32_t imm_fx = toFixed(fx[i]);
-        fx_i[i] = imm_fx;
-    }
+    overflows += port_from_float(fx_i, fx, Nsta, bit_width, frac_width, FX_MODE);
+    overflows += port_from_float(hx_i, hx, Mobs, bit_width, frac_width, FX_MODE);
     
-    for (int i=0; i<Mobs; i++) {
-        int32_t imm_fx = toFixed(hx[i]);
-        hx_i[i] = imm_fx;
-    }
-    
-    for (int i=0; i<Mobs; i++) {
-        for (int j=0; j<Nsta; j++) {
-            int32_t imm_fx = toFixed(H[i][j]);
-            H_i[i*Nsta + j] = imm_fx;
-        }
-    }
+    pack_H(H, H_i);
 }
 
 int main(int argc, char ** argv)
 {    
-    // input data file
-    static const char INFILE[] = "gps_data.csv";
+    // input trace, see src/trace/csv2trace.c
+    const char *infile = (argc > 1) ? argv[1] : "gps_data.trc";
+    
+    struct trace tr;
+    if (trace_open(&tr, infile, bit_width, frac_width, COLS)) {
+        return 1;
+    }
     
-    // Make a place to store the data from the file and the output of the EKF
-    int datalen = 50;
+    // the trace is streamed CHUNK rows at a time, whatever its length
+    long datalen = tr.hdr.rows;
     int PARAMS_IN = (2*Nsta*Nsta)+(Mobs*Mobs);
     
     // hardware I/O
-    port_t *obs, *xout, *params;
+    port_t *rows, *xout, *params;
     port_t *fx_i, *hx_i, *F_i, *H_i;
+    port_t *state;
     // software I/O
-    float *meas, *xout_fl, *output_fl; 
+    float meas[MEAS];
+    float *xout_fl, *output_fl; 
     
-    meas= (float *)malloc(datalen*12*sizeof(float));
     xout_fl = (float *)malloc(Nsta*sizeof(float));
-    output_fl = (float *)malloc(datalen*Nsta*sizeof(float));
-#if P_CACHEABLE == 0
-    obs= (port_t *)sds_alloc_non_cacheable(datalen*Mobs*sizeof(port_t));
-    params = (port_t *)sds_alloc_non_cacheable(PARAMS_IN*sizeof(port_t));
-    xout = (port_t *)sds_alloc_non_cacheable(datalen*Nsta*sizeof(port_t));
-    fx_i = (port_t *)sds_alloc_non_cacheable(Nsta*sizeof(port_t));
-    hx_i = (port_t *)sds_alloc_non_cacheable(Mobs*sizeof(port_t));
-    F_i = (port_t *)sds_alloc_non_cacheable(Nsta*Nsta*sizeof(port_t));
-    H_i = (port_t *)sds_alloc_non_cacheable(Mobs*Nsta*sizeof(port_t));
-#else
-    obs= (port_t *)sds_alloc(datalen*Mobs*sizeof(port_t));
-    params = (port_t *)sds_alloc(PARAMS_IN*sizeof(port_t));
-    xout = (port_t *)sds_alloc(datalen*Nsta*sizeof(port_t));
-    fx_i = (port_t *)sds_alloc(Nsta*sizeof(port_t));
-    hx_i = (port_t *)sds_alloc(Mobs*sizeof(port_t));
-    F_i = (port_t *)sds_alloc(Nsta*Nsta*sizeof(port_t));
-    H_i = (port_t *)sds_alloc(Mobs*Nsta*sizeof(port_t));
-#endif
+    output_fl = (float *)malloc(PRINT_STEPS*Nsta*sizeof(float));
+    // one block, inputs first (P_CACHEABLE=2), see ekf_block.h
+    struct ekf_block mem;
+    if (ekf_block_open(&mem, PARAMS_IN + CHUNK*COLS + Nsta + Mobs + Nsta*Nsta +
+                       Mobs*Nsta + NSAVE + Nsta, 8)) {
+        fprintf(stderr, "ekf: no CMA memory left\n");
+        trace_close(&tr);
+        return 1;
+    }
+    params = ekf_block_alloc(&mem, PARAMS_IN);
+    rows = ekf_block_alloc(&mem, CHUNK*COLS);
+    fx_i = ekf_block_alloc(&mem, Nsta);
+    hx_i = ekf_block_alloc(&mem, Mobs);
+    F_i = ekf_block_alloc(&mem, Nsta*Nsta);
+    H_i = ekf_block_alloc(&mem, Mobs*Nsta);
+    state = ekf_block_alloc(&mem, NSAVE);
+    xout = ekf_block_alloc(&mem, Nsta);
+    if (!params || !rows || !fx_i || !hx_i || !F_i || !H_i || !state || !xout) {
+        fprintf(stderr, "ekf: cannot allocate the kernel buffers\n");
+        ekf_block_close(&mem);
+        trace_close(&tr);
+        return 1;
+    }
 
     // set params
     xout_fl[0] = 0.2574;
@@ -229,6 +246,9 @@ int main(int argc, char ** argv)
         3 - R[Mobs*Mobs]
     */
     #include "params.dat"
+#if (SQRT_COV == 1)
+    factor_params(params);
+#endif
     
     for (int i=0; i<Nsta; i++) {
         fx_i[i] = 0;
@@ -240,64 +260,90 @@ int main(int argc, char ** argv)
         H_i[i] = 0;
     }
     
-    
-    // read csv data into obs
-    readdata(obs, meas, INFILE, datalen);
-    
     // control registers
-    int ctrl;
+    int ctrl = 0;   // init on the first step
     int w1 = Nsta;
     int w2 = Mobs;
+    int w3i = 0;    // no context restore
+    int w3o = 0;    // no context save
+    int ctx = 0;
     //int w3 = (2*Nsta*Nsta)+(Mobs*Mobs);
 
     struct timespec * start = (struct timespec *)malloc(sizeof(struct timespec));
     struct timespec * stop = (struct timespec *)malloc(sizeof(struct timespec));
-    clock_gettime(CLOCK_REALTIME, start);
+    clock_gettime(CLOCK_MONOTONIC, start);
     
-    // init
-    ctrl=0;
-    model(xout_fl, &meas[0*12], fx_i, hx_i, F_i, H_i);
-    top_ekf(&obs[0*Mobs], fx_i, hx_i, F_i, H_i, params, &xout[0*Nsta], ctrl, w1, w2);
+    prof_init(&prof, "read,convert,model,kernel,output");
+    ekf_block_flush(&mem, params, PARAMS_IN);
     
-    // copy result from fixed to float
-    for (int j=0; j<Nsta; j++) {        
-        uint32_t oval_uint = xout[0*Nsta + j];
-        int32_t oval_fx = (int32_t) oval_uint;
-        xout_fl[j] = toFloat(oval_fx);
-    }
-
     // run ekf
-    ctrl = 1; 
-    for (int i=1; i<datalen; i++) { 
-        // compute model
-        model(xout_fl, &meas[i*12], fx_i, hx_i, F_i, H_i);
-        // step ekf
-        top_ekf(&obs[i*Mobs], fx_i, hx_i, F_i, H_i, params, &xout[i*Nsta], ctrl, w1, w2);
-        // copy result from fixed to float
-        for (int j=0; j<Nsta; j++) {        
-            uint32_t oval_uint = xout[i*Nsta + j];
-            int32_t oval_fx = (int32_t) oval_uint;
-            xout_fl[j] = toFloat(oval_fx);
+    for (long i0=0; i0<datalen; i0+=CHUNK) {
+        PROF_BEGIN(&prof);
+        long n = trace_read(&tr, i0, CHUNK, rows);
+        ekf_block_flush(&mem, rows, n*COLS);
+        PROF_MARK(&prof, ST_READ);
+        
+        for (long r=0; r<n; r++) {
+            port_t *row = &rows[r*COLS];
+            long i = i0 + r;
+            if (r > 0) {
+                PROF_BEGIN(&prof);
+            }
+            
+            // satellite positions back to float for the model
+            port_to_float(meas, row, MEAS, bit_width, frac_width);
+            PROF_MARK(&prof, ST_CONVERT);
+            // compute model
+            model(xout_fl, meas, fx_i, hx_i, F_i, H_i);
+            PROF_MARK(&prof, ST_MODEL);
+            // step ekf, the pseudoranges go straight from the chunk
+            ekf_block_flush(&mem, fx_i, state - fx_i);
+            int hw = top_ekf(&row[MEAS], fx_i, hx_i, F_i, H_i, params, xout, state, state,
+                             ctrl | CTRL_HEALTH, ctx, w1, w2, w3i, w3o);
+            ekf_block_invalidate(&mem, xout, Nsta);
+            PROF_MARK(&prof, ST_KERNEL);
+            health(hw, i);
+            ctrl = 1;
+            // copy result from fixed to float
+            port_to_float(xout_fl, xout, Nsta, bit_width, frac_width);
+            if (i < PRINT_STEPS) {
+                memcpy(&output_fl[i*Nsta], xout_fl, Nsta*sizeof(float));
+            }
+            PROF_MARK(&prof, ST_OUTPUT);
+            PROF_END(&prof);
         }
     }
-    clock_gettime(CLOCK_REALTIME, stop);
+    clock_gettime(CLOCK_MONOTONIC, stop);
     
-    writedata(xout, output_fl, datalen);
+    writedata(output_fl, datalen);
     
-    int totalTime = (stop->tv_sec*SEC_TO_NS + stop->tv_nsec) - (start->tv_sec*SEC_TO_NS + start->tv_nsec);
-    printf("time = %f s\n", ((float)totalTime/1000000000));
+    long long totalTime = (stop->tv_sec*(long long)SEC_TO_NS + stop->tv_nsec) - (start->tv_sec*(long long)SEC_TO_NS + start->tv_nsec);
+    printf("time = %f s, %f steps/s\n", ((float)totalTime/1000000000), datalen/((float)totalTime/1000000000));
+    if (overflows) {
+        printf("%ld model values overflowed data_t\n", overflows);
+    }
+    printf("health: %ld steps flagged", hl_flagged);
+    if (hl_first >= 0) {
+        printf(", first at step %ld", hl_first);
+    }
+    printf(", max NIS/m %.2f\n", hl_nis_max/16.0);
+#if PROF_ENABLE
+    prof_write(&prof, (argc > 2) ? argv[2] : "-");
+#endif
 
 
-    sds_free(obs);
-    free(meas);
-    sds_free(params);
-    sds_free(xout);
+    trace_close(&tr);
     free(xout_fl);
     free(output_fl);
-    sds_free(fx_i);
-    sds_free(hx_i);
-    sds_free(F_i);
-    sds_free(H_i);
+    ekf_block_free(&mem, rows);
+    ekf_block_free(&mem, params);
+    ekf_block_free(&mem, xout);
+    ekf_block_free(&mem, fx_i);
+    ekf_block_free(&mem, hx_i);
+    ekf_block_free(&mem, F_i);
+    ekf_block_free(&mem, H_i);
+    ekf_block_free(&mem, state);
+    ekf_block_close(&mem);
     
     // Done!
     return 0;
@@ -0,0 +1,287 @@
+/*  sched_test: C-simulation test of the CPU+accelerator scheduler
+    (src/hybrid/ekf_sched.h).
+
+    Runs NTRK constant velocity tracks, more than there are contexts, with
+    steps submitted round-robin over the tracks:
+
+        1. on the accelerator alone: every output must match, word for
+           word, running each track alone in spilled context mode, and
+           state_i/state_o must move NSAVE words exactly on the steps with
+           CTRL_RESTORE/CTRL_SAVE
+        2. with CPU workers and an accelerator that takes SLOW_US per step,
+           as the DMA round trip on the boards: most steps must move to the
+           CPUs
+        3. with CPU workers and the C model of the kernel as is
+
+    In 2 and 3 every state of every step must be within TOL of a
+    double-precision Ekf<> run of its track, which also checks that the
+    steps of a track ran in order.
+*/
+
+/* before ekf_config.h, whose Nsta/Mobs macros clash with its template
+   parameter names */
+#include "tiny_ekf.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "sds_lib.h"
+
+#include "ekf_config.h"
+#include "ekf_sched.h"
+#include "models.h"
+#include "../fxconv/fxconv.h"
+
+#define NTRK (3*NCTX)
+#define NSTEP 40
+#define CPUS 3
+#define SLOW_US 100
+#define TOL 2e-3
+#define PARAMS_IN ((2*Nsta*Nsta)+(Mobs*Mobs))
+
+struct track {
+    double x0[Nsta];
+    double P[Nsta*Nsta], Q[Nsta*Nsta], R[Mobs*Mobs];
+    double z[NSTEP][Mobs];
+    double ref[NSTEP][Nsta];        // double-precision filter
+    double out[NSTEP][Nsta];
+};
+
+static uint32_t lcg(uint32_t *seed)
+{
+    *seed = *seed*1664525 + 1013904223;
+    return *seed >> 8;
+}
+
+static double urand(uint32_t *seed)
+{
+    return (double)lcg(seed)/(1 << 24) - 0.5;
+}
+
+static void model(const double *x, const double *, double *fx, double *hx,
+                  double *F, double *H, void *)
+{
+    cv_model(Nsta, Mobs, x, fx, hx, F, H);
+}
+
+static void make_track(struct track *t, int k)
+{
+    uint32_t seed = 4321 + k;
+    double truth[Nsta], fx[Nsta], hx[Mobs], F[Nsta*Nsta], H[Mobs*Nsta];
+
+    memset(t->P, 0, sizeof(t->P));
+    memset(t->Q, 0, sizeof(t->Q));
+    memset(t->R, 0, sizeof(t->R));
+    for (int i=0; i<Nsta; i+=2) {
+        truth[i] = urand(&seed);
+        truth[i+1] = 0.1*urand(&seed);
+    }
+    // Q differs between tracks, so a context must not carry one to another
+    for (int i=0; i<Nsta; i++) {
+        t->x0[i] = 0;
+        t->P[i*Nsta + i] = 0.5;
+        t->Q[i*Nsta + i] = 0.001*(1 + k % 5);
+    }
+    for (int i=0; i<Mobs; i++)
+        t->R[i*Mobs + i] = 1.0;
+
+    for (int s=0; s<NSTEP; s++) {
+        cv_model(Nsta, Mobs, truth, fx, hx, F, H);
+        memcpy(truth, fx, sizeof(truth));
+        for (int i=0; i<Mobs; i++)
+            t->z[s][i] = hx[i] + 0.5*urand(&seed);
+    }
+
+    tinyekf::Ekf<Nsta, Mobs, double> *e = new tinyekf::Ekf<Nsta, Mobs, double>();
+    double x[Nsta];
+    memcpy(x, t->x0, sizeof(x));
+    for (int i=0; i<Nsta; i++) {
+        for (int j=0; j<Nsta; j++) {
+            e->P[i][j] = t->P[i*Nsta + j];
+            e->Q[i][j] = t->Q[i*Nsta + j];
+        }
+    }
+    for (int i=0; i<Mobs; i++)
+        for (int j=0; j<Mobs; j++)
+            e->R[i][j] = t->R[i*Mobs + j];
+    for (int s=0; s<NSTEP; s++) {
+        cv_model(Nsta, Mobs, x, fx, hx, F, H);
+        for (int i=0; i<Nsta; i++) {
+            e->fx[i] = fx[i];
+            for (int j=0; j<Nsta; j++)
+                e->F[i][j] = F[i*Nsta + j];
+        }
+        for (int i=0; i<Mobs; i++) {
+            e->hx[i] = hx[i];
+            for (int j=0; j<Nsta; j++)
+                e->H[i][j] = H[i*Nsta + j];
+        }
+        e->step(t->z[s]);
+        for (int i=0; i<Nsta; i++)
+            x[i] = t->ref[s][i] = e->x[i];
+    }
+    delete e;
+}
+
+/* the outputs of track t run alone through top_ekf, spilled after every
+   step, with the conversions of the scheduler */
+static void run_alone(struct track *t, double out[NSTEP][Nsta])
+{
+    port_t *obs = (port_t *)sds_alloc(Mobs*sizeof(port_t));
+    port_t *fx_i = (port_t *)sds_alloc(Nsta*sizeof(port_t));
+    port_t *hx_i = (port_t *)sds_alloc(Mobs*sizeof(port_t));
+    port_t *F_i = (port_t *)sds_alloc(Nsta*Nsta*sizeof(port_t));
+    port_t *H_i = (port_t *)sds_alloc(Mobs*NHC*sizeof(port_t));
+    port_t *params = (port_t *)sds_alloc(PARAMS_IN*sizeof(port_t));
+    port_t *xout = (port_t *)sds_alloc(Nsta*sizeof(port_t));
+    port_t *state = (port_t *)sds_alloc(NSAVE*sizeof(port_t));
+    double x[Nsta], fx[Nsta], hx[Mobs], F[Nsta*Nsta], H[Mobs*Nsta], Hc[Mobs*NHC];
+
+    port_from_double(params, t->P, Nsta*Nsta, bit_width, frac_width, FX_MODE);
+    port_from_double(params + Nsta*Nsta, t->Q, Nsta*Nsta, bit_width, frac_width, FX_MODE);
+    port_from_double(params + 2*Nsta*Nsta, t->R, Mobs*Mobs, bit_width, frac_width, FX_MODE);
+    memcpy(x, t->x0, sizeof(x));
+    for (int s=0; s<NSTEP; s++) {
+        model(x, NULL, fx, hx, F, H, NULL);
+        for (int i=0; i<Mobs; i++)
+            for (int k=0; k<NHC; k++)
+                Hc[i*NHC + k] = H[i*Nsta + HCOL(k)];
+        port_from_double(obs, t->z[s], Mobs, bit_width, frac_width, FX_MODE);
+        port_from_double(fx_i, fx, Nsta, bit_width, frac_width, FX_MODE);
+        port_from_double(hx_i, hx, Mobs, bit_width, frac_width, FX_MODE);
+        port_from_double(F_i, F, Nsta*Nsta, bit_width, frac_width, FX_MODE);
+        port_from_double(H_i, Hc, Mobs*NHC, bit_width, frac_width, FX_MODE);
+        top_ekf(obs, fx_i, hx_i, F_i, H_i, params, xout, state, state,
+                CTRL_SAVE | ((s == 0) ? 0 : CTRL_RESTORE), 0, Nsta, Mobs,
+                (s == 0) ? 0 : NSAVE, NSAVE);
+        port_to_double(x, xout, Nsta, bit_width, frac_width);
+        memcpy(out[s], x, sizeof(x));
+    }
+
+    sds_free(obs);
+    sds_free(fx_i);
+    sds_free(hx_i);
+    sds_free(F_i);
+    sds_free(H_i);
+    sds_free(params);
+    sds_free(xout);
+    sds_free(state);
+}
+
+/* the C model of the kernel, then a sleep for the accelerator's round
+   trip, which leaves the core to the CPU workers as the DMA wait does */
+static int slow_ekf(port_t *obs, port_t *fx_i, port_t *hx_i, port_t *F_i,
+                    port_t *H_i, port_t *params, port_t *output,
+                    port_t *state_i, port_t *state_o,
+                    int ctrl, int ctx, int w1, int w2, int w3i, int w3o)
+{
+    struct timespec t = {0, SLOW_US*1000};
+    int status = top_ekf(obs, fx_i, hx_i, F_i, H_i, params, output,
+                         state_i, state_o, ctrl, ctx, w1, w2, w3i, w3o);
+    nanosleep(&t, NULL);
+    return status;
+}
+
+/* the C model of the kernel, counting the calls whose state ports did not
+   move the words their ctrl bits call for */
+static int bad_ports;
+
+static int port_ekf(port_t *obs, port_t *fx_i, port_t *hx_i, port_t *F_i,
+                    port_t *H_i, port_t *params, port_t *output,
+                    port_t *state_i, port_t *state_o,
+                    int ctrl, int ctx, int w1, int w2, int w3i, int w3o)
+{
+    int status = top_ekf(obs, fx_i, hx_i, F_i, H_i, params, output,
+                         state_i, state_o, ctrl, ctx, w1, w2, w3i, w3o);
+    bad_ports += (ekf_ports.state_i != ((ctrl & CTRL_RESTORE) ? NSAVE : 0))
+              || (ekf_ports.state_o != ((ctrl & CTRL_SAVE) ? NSAVE : 0));
+    return status;
+}
+
+/* all steps of all tracks, submitted round-robin; returns the failed steps */
+static long run(struct track *trk, int cpus, ekf_kernel_t kernel,
+                struct ekf_sched_stats *st)
+{
+    struct ekf_sched *s = ekf_sched_open(NTRK, Mobs, cpus, kernel, model, NULL);
+    if (s == NULL)
+        return -1;
+    for (int k=0; k<NTRK; k++) {
+        ekf_sched_init(s, k, trk[k].x0, trk[k].P, trk[k].Q, trk[k].R);
+        memset(trk[k].out, 0, sizeof(trk[k].out));
+    }
+    for (int n=0; n<NSTEP; n++)
+        for (int k=0; k<NTRK; k++)
+            ekf_sched_submit(s, k, trk[k].z[n], trk[k].out[n]);
+    ekf_sched_drain(s);
+    ekf_sched_get_stats(s, st);
+    ekf_sched_close(s);
+    return st->failures;
+}
+
+/* states off by more than TOL from the double filter */
+static int check_ref(struct track *trk)
+{
+    int errors = 0;
+    for (int k=0; k<NTRK; k++)
+        for (int n=0; n<NSTEP; n++)
+            for (int i=0; i<Nsta; i++)
+                errors += !(fabs(trk[k].out[n][i] - trk[k].ref[n][i]) <= TOL);
+    return errors;
+}
+
+static int report(const char *name, int errors, const struct ekf_sched_stats *st)
+{
+    printf("%-40s %s (%d mismatches)\n", name, errors ? "FAIL" : "PASS", errors);
+    printf("%-40s steps %ld/%ld (fpga/cpu), steals %ld, restores %ld, "
+           "us/step %.2f/%.2f\n", "", st->steps[EKF_SCHED_FPGA],
+           st->steps[EKF_SCHED_CPU], st->steals, st->restores,
+           st->lat_us[EKF_SCHED_FPGA], st->lat_us[EKF_SCHED_CPU]);
+    return errors != 0;
+}
+
+int main(int argc, char ** argv)
+{
+    struct track *trk = (struct track *)malloc(NTRK*sizeof(struct track));
+    double (*alone)[Nsta] = (double (*)[Nsta])malloc(NTRK*NSTEP*Nsta*sizeof(double));
+    struct ekf_sched_stats st;
+    int failed = 0, errors;
+
+    for (int k=0; k<NTRK; k++) {
+        make_track(&trk[k], k);
+        run_alone(&trk[k], &alone[k*NSTEP]);
+    }
+
+    // 1. the accelerator alone, word for word; tracks share contexts
+    errors = (run(trk, 0, port_ekf, &st) != 0);
+    errors += bad_ports;
+    for (int k=0; k<NTRK; k++)
+        for (int n=0; n<NSTEP; n++)
+            for (int i=0; i<Nsta; i++)
+                errors += (trk[k].out[n][i] != alone[k*NSTEP + n][i]);
+    errors += (st.steps[EKF_SCHED_FPGA] != NTRK*NSTEP) || (st.restores == 0);
+    failed += report("sched accelerator only", errors, &st);
+
+    // 2. a slow accelerator: the CPUs take most of the steps
+    errors = (run(trk, CPUS, slow_ekf, &st) != 0);
+    errors += check_ref(trk);
+    errors += (st.steps[EKF_SCHED_FPGA] + st.steps[EKF_SCHED_CPU] != NTRK*NSTEP);
+    errors += (st.steps[EKF_SCHED_CPU] < NTRK*NSTEP/2);
+    // on one core the CPU workers may steal every step before the
+    // accelerator's worker runs, leaving it no latency to compare
+    errors += (st.steps[EKF_SCHED_FPGA] > 0 &&
+               !(st.lat_us[EKF_SCHED_FPGA] > st.lat_us[EKF_SCHED_CPU]));
+    failed += report("sched slow accelerator + cpus", errors, &st);
+
+    // 3. the C model of the kernel as is
+    errors = (run(trk, CPUS, NULL, &st) != 0);
+    errors += check_ref(trk);
+    errors += (st.steps[EKF_SCHED_FPGA] + st.steps[EKF_SCHED_CPU] != NTRK*NSTEP);
+    failed += report("sched accelerator + cpus", errors, &st);
+
+    free(alone);
+    free(trk);
+    return failed;
+}
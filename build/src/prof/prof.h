@@ -0,0 +1,183 @@
+/*  prof: per-step stage timings for the EKF drivers.
+
+    A step is split into up to PROF_STAGES stages, named when the profile
+    is set up. PROF_BEGIN starts a step, PROF_MARK(p, s) charges the time
+    since the last mark to stage s, and PROF_END stores the step:
+
+        static struct prof prof;
+        prof_init(&prof, "convert,model,kernel,output");
+        for (...) {
+            PROF_BEGIN(&prof);
+            ...             PROF_MARK(&prof, 0);
+            model(...);     PROF_MARK(&prof, 1);
+            top_ekf(...);   PROF_MARK(&prof, 2);
+            ...             PROF_MARK(&prof, 3);
+            PROF_END(&prof);
+        }
+        prof_write(&prof, "prof.json");     // or .csv
+
+    Times come from CLOCK_MONOTONIC in ns. The last PROF_RING steps are kept
+    in a ring, from which prof_write() takes exact p50/p90/p99 per stage;
+    count, mean and max cover every step, as does a log2 histogram. The
+    ring has a single writer and publishes each step with a release store
+    of its count, so another thread can report without a lock, reading a
+    few steps that are overwritten meanwhile at worst.
+
+    The macros compile to nothing unless PROF_ENABLE is 1 (make PROF=1).
+*/
+
+#ifndef EKF_PROF_H
+#define EKF_PROF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef PROF_ENABLE
+#define PROF_ENABLE 0
+#endif
+#ifndef PROF_RING
+#define PROF_RING 4096      /* steps kept for the percentiles, a power of 2 */
+#endif
+#define PROF_STAGES 8
+#define PROF_BUCKETS 32     /* log2 histogram, bucket b holds [2^b, 2^(b+1)) ns */
+
+struct prof {
+    int nstages;
+    char names[PROF_STAGES][16];
+    uint64_t last;                      /* time of the last mark */
+    uint32_t cur[PROF_STAGES];          /* the step being timed */
+    uint32_t ring[PROF_RING][PROF_STAGES];
+    uint64_t steps;                     /* published steps */
+    uint64_t sum[PROF_STAGES];
+    uint32_t max[PROF_STAGES];
+    uint64_t hist[PROF_STAGES][PROF_BUCKETS];
+};
+
+static inline uint64_t prof_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+/* names: comma-separated stage names, at most PROF_STAGES */
+static inline void prof_init(struct prof *p, const char *names)
+{
+    memset(p, 0, sizeof(*p));
+    while (*names && p->nstages < PROF_STAGES) {
+        int n = strcspn(names, ",");
+        int k = (n < 15) ? n : 15;
+        memcpy(p->names[p->nstages++], names, k);
+        names += n + (names[n] == ',');
+    }
+}
+
+static inline void prof_begin(struct prof *p)
+{
+    memset(p->cur, 0, sizeof(p->cur));
+    p->last = prof_now();
+}
+
+static inline void prof_mark(struct prof *p, int stage)
+{
+    uint64_t t = prof_now();
+    p->cur[stage] += (uint32_t)(t - p->last);
+    p->last = t;
+}
+
+static inline void prof_end(struct prof *p)
+{
+    uint64_t s = p->steps;
+    uint32_t *row = p->ring[s & (PROF_RING-1)];
+
+    for (int k=0; k<p->nstages; k++) {
+        uint32_t ns = p->cur[k];
+        int b = 0;
+        while (b < PROF_BUCKETS-1 && (ns >> (b+1)))
+            b++;
+        row[k] = ns;
+        p->sum[k] += ns;
+        if (ns > p->max[k])
+            p->max[k] = ns;
+        p->hist[k][b]++;
+    }
+    __atomic_store_n(&p->steps, s + 1, __ATOMIC_RELEASE);
+}
+
+#if PROF_ENABLE
+#define PROF_BEGIN(p)       prof_begin(p)
+#define PROF_MARK(p, s)     prof_mark(p, s)
+#define PROF_END(p)         prof_end(p)
+#else
+#define PROF_BEGIN(p)       do {} while (0)
+#define PROF_MARK(p, s)     do {} while (0)
+#define PROF_END(p)         do {} while (0)
+#endif
+
+static inline int prof_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* stage k over the steps in the ring: q[0..2] = p50, p90, p99 in ns */
+static inline void prof_percentiles(struct prof *p, int k, uint64_t steps, uint32_t q[3])
+{
+    uint64_t n = (steps < PROF_RING) ? steps : PROF_RING;
+    uint32_t *v = (uint32_t *)malloc((n ? n : 1)*sizeof(uint32_t));
+
+    for (uint64_t i=0; i<n; i++)
+        v[i] = p->ring[i][k];
+    qsort(v, n, sizeof(uint32_t), prof_cmp);
+    q[0] = n ? v[(n-1)*50/100] : 0;
+    q[1] = n ? v[(n-1)*90/100] : 0;
+    q[2] = n ? v[(n-1)*99/100] : 0;
+    free(v);
+}
+
+/* writes the summary to fname, as JSON if it ends in .json, else as CSV;
+   fname "-" is stdout (CSV). Returns 0, or -1 if it cannot be written. */
+static inline int prof_write(struct prof *p, const char *fname)
+{
+    uint64_t steps = __atomic_load_n(&p->steps, __ATOMIC_ACQUIRE);
+    size_t len = strlen(fname);
+    int json = (len > 5 && !strcmp(fname + len - 5, ".json"));
+    FILE *fp = strcmp(fname, "-") ? fopen(fname, "w") : stdout;
+    if (fp == NULL)
+        return -1;
+
+    if (json)
+        fprintf(fp, "{\"steps\": %llu, \"ring\": %d, \"stages\": [\n",
+                (unsigned long long)steps, PROF_RING);
+    else
+        fprintf(fp, "stage,count,mean_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+
+    for (int k=0; k<p->nstages; k++) {
+        uint32_t q[3];
+        prof_percentiles(p, k, steps, q);
+        double mean = steps ? (double)p->sum[k]/steps : 0;
+        if (!json) {
+            fprintf(fp, "%s,%llu,%.0f,%u,%u,%u,%u\n", p->names[k],
+                    (unsigned long long)steps, mean, q[0], q[1], q[2], p->max[k]);
+            continue;
+        }
+        fprintf(fp, "  {\"stage\": \"%s\", \"count\": %llu, \"mean_ns\": %.0f, "
+                "\"p50_ns\": %u, \"p90_ns\": %u, \"p99_ns\": %u, \"max_ns\": %u,\n"
+                "   \"log2_hist\": [", p->names[k], (unsigned long long)steps,
+                mean, q[0], q[1], q[2], p->max[k]);
+        for (int b=0; b<PROF_BUCKETS; b++)
+            fprintf(fp, "%s%llu", b ? ", " : "", (unsigned long long)p->hist[k][b]);
+        fprintf(fp, "]}%s\n", (k < p->nstages-1) ? "," : "");
+    }
+    if (json)
+        fprintf(fp, "]}\n");
+
+    if (fp != stdout)
+        fclose(fp);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,208 @@
+/*  arena_test: host test of the CMA arena (cma_arena.c).
+
+    Built against the sds_lib.h stand-in of src/csim, with the xlnk
+    physical address and cache functions stubbed: a physical address is
+    the virtual one plus PHYS_OFFSET, and cache operations are recorded.
+    Checks packing and alignment, reuse of freed pieces by a second filter
+    of the same shape, a full block and frees from its tail, coalesced
+    cache maintenance, the counters, and filters opened and closed by
+    several threads at once.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "cma_arena.h"
+
+#define PHYS_OFFSET 0x10000000ul
+#define N 8
+#define M 4
+
+static int ncalls;
+static void *last_buf;
+static int last_size;
+
+unsigned long xlnkGetBufPhyAddr(void *buf)
+{
+    return (unsigned long)buf + PHYS_OFFSET;
+}
+
+void cma_flush_cache(void *buf, unsigned int phys_addr, int size)
+{
+    ncalls++;
+    last_buf = buf;
+    last_size = size;
+}
+
+void cma_invalidate_cache(void *buf, unsigned int phys_addr, int size)
+{
+    cma_flush_cache(buf, phys_addr, size);
+}
+
+/* the port buffers of one n8m4 filter, inputs first */
+struct filter {
+    int32_t *obs, *fx_i, *hx_i, *F_i, *H_i, *params, *xout;
+};
+
+static int open_filter(void *arena, struct filter *f)
+{
+    f->obs = (int32_t *)cma_arena_alloc(arena, M*4);
+    f->fx_i = (int32_t *)cma_arena_alloc(arena, N*4);
+    f->hx_i = (int32_t *)cma_arena_alloc(arena, M*4);
+    f->F_i = (int32_t *)cma_arena_alloc(arena, N*N*4);
+    f->H_i = (int32_t *)cma_arena_alloc(arena, M*N*4);
+    f->params = (int32_t *)cma_arena_alloc(arena, (2*N*N + M*M)*4);
+    f->xout = (int32_t *)cma_arena_alloc(arena, N*4);
+    return f->obs && f->fx_i && f->hx_i && f->F_i && f->H_i && f->params && f->xout;
+}
+
+static void close_filter(void *arena, struct filter *f)
+{
+    int32_t *p[] = {f->obs, f->fx_i, f->hx_i, f->F_i, f->H_i, f->params, f->xout};
+    for (int i=0; i<7; i++)
+        cma_arena_free(arena, p[i]);
+}
+
+/* THREADS threads open a filter, fill it with their id and check it, then
+   close it, ROUNDS times each; a piece handed out twice shows as a word
+   of another thread */
+#define THREADS 4
+#define ROUNDS 2000
+
+struct worker {
+    void *arena;
+    int id;
+    int errors;
+};
+
+static void *churn(void *arg)
+{
+    struct worker *w = (struct worker *)arg;
+    struct filter f;
+    for (int r=0; r<ROUNDS; r++) {
+        if (!open_filter(w->arena, &f)) {
+            w->errors++;
+            continue;
+        }
+        int32_t *p[] = {f.obs, f.fx_i, f.hx_i, f.F_i, f.H_i, f.params, f.xout};
+        int len[] = {M, N, M, N*N, M*N, 2*N*N + M*M, N};
+        for (int i=0; i<7; i++)
+            for (int k=0; k<len[i]; k++)
+                p[i][k] = w->id;
+        cma_arena_flush(w->arena, f.obs, (char *)f.xout - (char *)f.obs);
+        for (int i=0; i<7; i++)
+            for (int k=0; k<len[i]; k++)
+                w->errors += (p[i][k] != w->id);
+        close_filter(w->arena, &f);
+    }
+    return NULL;
+}
+
+static int report(const char *name, int errors)
+{
+    printf("%-40s %s (%d mismatches)\n", name, errors ? "FAIL" : "PASS", errors);
+    return errors != 0;
+}
+
+int main(int argc, char ** argv)
+{
+    struct cma_arena_stats st;
+    struct filter a, b, c;
+    int failed = 0, errors;
+
+    void *arena = cma_arena_create(4096, 1);
+    if (arena == NULL)
+        return 1;
+
+    // pieces are packed in order, 64-byte aligned, physically contiguous
+    errors = !open_filter(arena, &a);
+    int32_t *p[] = {a.obs, a.fx_i, a.hx_i, a.F_i, a.H_i, a.params, a.xout};
+    for (int i=0; i<7; i++) {
+        errors += ((uintptr_t)p[i] % CMA_ARENA_ALIGN != 0);
+        errors += (cma_arena_phy_addr(arena, p[i]) != (unsigned long)p[i] + PHYS_OFFSET);
+        if (i > 0)
+            errors += (p[i] <= p[i-1]);
+    }
+    errors += (a.fx_i - a.obs != CMA_ARENA_ALIGN/4);
+    errors += (a.params - a.H_i != 2*CMA_ARENA_ALIGN/4);
+    failed += report("arena packing", errors);
+
+    // a second filter of the same shape gets the first one's memory back,
+    // from the tail of the block
+    close_filter(arena, &a);
+    cma_arena_get_stats(arena, &st);
+    errors = (st.bytes != 0);
+    errors += !open_filter(arena, &b);
+    errors += (b.obs != p[0] || b.xout != p[6]);
+    // ... or from the freed pieces when it is not the last one in the block
+    errors += !open_filter(arena, &c);
+    close_filter(arena, &b);
+    errors += !open_filter(arena, &a);
+    errors += (a.obs != p[0] || a.params != p[5]);
+    cma_arena_get_stats(arena, &st);
+    errors += (st.allocs != 28 || st.reuses != 7);
+    failed += report("arena reuse", errors);
+
+    // a full block refuses, and frees from the tail give the space back
+    errors = (cma_arena_alloc(arena, 4096) != NULL);
+    cma_arena_get_stats(arena, &st);
+    errors += (st.misses != 1);
+    close_filter(arena, &c);
+    close_filter(arena, &a);
+    errors += (cma_arena_alloc(arena, 4096) != p[0]);
+    errors += (cma_arena_free(arena, p[1]) != -1);
+    errors += (cma_arena_free(arena, p[0]) != 0);
+    errors += (cma_arena_free(arena, p[0]) != -1);
+    failed += report("arena full/free", errors);
+
+    // one cache operation over all the inputs of a step
+    errors = !open_filter(arena, &a);
+    ncalls = 0;
+    cma_arena_flush(arena, a.obs, (char *)a.xout - (char *)a.obs);
+    errors += (ncalls != 1 || last_buf != a.obs ||
+               last_size != (char *)a.xout - (char *)a.obs);
+    cma_arena_invalidate(arena, a.xout, N*4);
+    cma_arena_flush(arena, NULL, 0);
+    errors += (ncalls != 3 || last_buf != a.obs ||
+               last_size != (char *)a.xout + CMA_ARENA_ALIGN - (char *)a.obs);
+    cma_arena_get_stats(arena, &st);
+    errors += (st.flushes != 2 || st.invalidates != 1);
+    failed += report("arena cache maintenance", errors);
+    cma_arena_destroy(arena);
+
+    // nothing to maintain on a non-cacheable arena
+    arena = cma_arena_create(4096, 0);
+    ncalls = 0;
+    errors = !open_filter(arena, &a);
+    cma_arena_flush(arena, NULL, 0);
+    cma_arena_get_stats(arena, &st);
+    errors += (ncalls != 0 || st.flushes != 0);
+    failed += report("arena non-cacheable", errors);
+    cma_arena_destroy(arena);
+
+    // filters opened and closed by several threads, room for all of them
+    arena = cma_arena_create(THREADS*2048, 1);
+    pthread_t th[THREADS];
+    struct worker w[THREADS];
+    errors = 0;
+    for (int i=0; i<THREADS; i++) {
+        w[i].arena = arena;
+        w[i].id = i + 1;
+        w[i].errors = 0;
+        errors += (pthread_create(&th[i], NULL, churn, &w[i]) != 0);
+    }
+    for (int i=0; i<THREADS; i++) {
+        pthread_join(th[i], NULL);
+        errors += w[i].errors;
+    }
+    cma_arena_get_stats(arena, &st);
+    errors += (st.bytes != 0 || st.misses != 0);
+    errors += (st.allocs != THREADS*ROUNDS*7);
+    errors += (st.flushes != THREADS*ROUNDS);
+    failed += report("arena threads", errors);
+    cma_arena_destroy(arena);
+
+    return failed;
+}
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "sds_lib.h"
+
+#include "cma_arena.h"
+
+/* from xlnk and pynqlib.c, acting on the block itself */
+unsigned long xlnkGetBufPhyAddr(void*);
+void cma_flush_cache(void* buf, unsigned int phys_addr, int size);
+void cma_invalidate_cache(void* buf, unsigned int phys_addr, int size);
+
+
+struct piece {
+    uint32_t off;
+    uint32_t len;
+    int free;
+};
+
+struct arena {
+    pthread_mutex_t lock;   /* the pieces, top and stats; base to size is fixed */
+    char *base;
+    unsigned long phys;
+    uint32_t size;
+    uint32_t top;           /* end of the last piece */
+    uint32_t cacheable;
+    int npieces;
+    struct piece pieces[CMA_ARENA_PIECES];     /* in order of offset */
+    struct cma_arena_stats stats;
+};
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+void *cma_arena_create(uint32_t len, uint32_t cacheable)
+{
+    struct arena *a = (struct arena *)calloc(1, sizeof(struct arena));
+    if (a == NULL)
+        return NULL;
+
+    len = (len + CMA_ARENA_ALIGN - 1) & ~(CMA_ARENA_ALIGN - 1);
+    a->base = (char *)(cacheable ? sds_alloc_cacheable(len)
+                                 : sds_alloc_non_cacheable(len));
+    if (a->base == NULL) {
+        free(a);
+        return NULL;
+    }
+    a->phys = xlnkGetBufPhyAddr(a->base);
+    a->size = len;
+    a->cacheable = cacheable;
+    a->stats.size = len;
+    pthread_mutex_init(&a->lock, NULL);
+    return a;
+}
+
+void cma_arena_destroy(void *arena)
+{
+    struct arena *a = (struct arena *)arena;
+    if (a == NULL)
+        return;
+    sds_free(a->base);
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+}
+
+void *cma_arena_alloc(void *arena, uint32_t len)
+{
+    struct arena *a = (struct arena *)arena;
+    if (a == NULL)
+        return NULL;
+    len = (len + CMA_ARENA_ALIGN - 1) & ~(CMA_ARENA_ALIGN - 1);
+    if (len == 0)
+        len = CMA_ARENA_ALIGN;
+
+    pthread_mutex_lock(&a->lock);
+    // a freed piece of the same size, else the end of the block
+    struct piece *p = NULL;
+    for (int i=0; i<a->npieces && p == NULL; i++)
+        if (a->pieces[i].free && a->pieces[i].len == len)
+            p = &a->pieces[i];
+    if (p != NULL) {
+        a->stats.reuses++;
+    } else {
+        if (a->npieces == CMA_ARENA_PIECES || len > a->size - a->top) {
+            a->stats.misses++;
+            pthread_mutex_unlock(&a->lock);
+            return NULL;
+        }
+        p = &a->pieces[a->npieces++];
+        p->off = a->top;
+        p->len = len;
+        a->top += len;
+    }
+    p->free = 0;
+
+    a->stats.allocs++;
+    a->stats.bytes += len;
+    if (a->stats.bytes > a->stats.peak)
+        a->stats.peak = a->stats.bytes;
+    char *buf = a->base + p->off;
+    pthread_mutex_unlock(&a->lock);
+    return buf;
+}
+
+int cma_arena_owns(void *arena, void *buf)
+{
+    struct arena *a = (struct arena *)arena;
+    return a && (char *)buf >= a->base && (char *)buf < a->base + a->size;
+}
+
+int cma_arena_free(void *arena, void *buf)
+{
+    struct arena *a = (struct arena *)arena;
+    if (!cma_arena_owns(a, buf))
+        return -1;
+
+    // pieces are sorted by offset
+    uint32_t off = (char *)buf - a->base;
+    pthread_mutex_lock(&a->lock);
+    int lo = 0, hi = a->npieces - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi)/2;
+        if (a->pieces[mid].off < off)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    if (lo == a->npieces || a->pieces[lo].off != off || a->pieces[lo].free) {
+        pthread_mutex_unlock(&a->lock);
+        return -1;
+    }
+
+    a->pieces[lo].free = 1;
+    a->stats.bytes -= a->pieces[lo].len;
+    // give the free tail back to the block
+    while (a->npieces > 0 && a->pieces[a->npieces-1].free) {
+        a->npieces--;
+        a->top = a->pieces[a->npieces].off;
+    }
+    pthread_mutex_unlock(&a->lock);
+    return 0;
+}
+
+unsigned long cma_arena_phy_addr(void *arena, void *buf)
+{
+    struct arena *a = (struct arena *)arena;
+    return a->phys + ((char *)buf - a->base);
+}
+
+void cma_arena_flush(void *arena, void *buf, uint32_t len)
+{
+    struct arena *a = (struct arena *)arena;
+    if (a == NULL || !a->cacheable)
+        return;
+    if (buf == NULL) {
+        buf = a->base;
+        pthread_mutex_lock(&a->lock);
+        len = a->top;
+        pthread_mutex_unlock(&a->lock);
+    }
+    uint64_t t0 = now_ns();
+    cma_flush_cache(buf, cma_arena_phy_addr(a, buf), len);
+    uint64_t t = now_ns() - t0;
+    pthread_mutex_lock(&a->lock);
+    a->stats.flush_ns += t;
+    a->stats.flushes++;
+    pthread_mutex_unlock(&a->lock);
+}
+
+void cma_arena_invalidate(void *arena, void *buf, uint32_t len)
+{
+    struct arena *a = (struct arena *)arena;
+    if (a == NULL || !a->cacheable)
+        return;
+    if (buf == NULL) {
+        buf = a->base;
+        pthread_mutex_lock(&a->lock);
+        len = a->top;
+        pthread_mutex_unlock(&a->lock);
+    }
+    uint64_t t0 = now_ns();
+    cma_invalidate_cache(buf, cma_arena_phy_addr(a, buf), len);
+    uint64_t t = now_ns() - t0;
+    pthread_mutex_lock(&a->lock);
+    a->stats.invalidate_ns += t;
+    a->stats.invalidates++;
+    pthread_mutex_unlock(&a->lock);
+}
+
+void cma_arena_get_stats(void *arena, struct cma_arena_stats *stats)
+{
+    struct arena *a = (struct arena *)arena;
+    if (a) {
+        pthread_mutex_lock(&a->lock);
+        *stats = a->stats;
+        pthread_mutex_unlock(&a->lock);
+    } else
+        memset(stats, 0, sizeof(*stats));
+}
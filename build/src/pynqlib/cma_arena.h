@@ -0,0 +1,79 @@
+/*
+ * cma_arena: port buffers carved out of one contiguous CMA block.
+ *
+ * Every sds_alloc/cma_alloc is a separate CMA buffer and an entry in the
+ * xlnk buffer pool (XLNK_BUFPOOL_SIZE), and every cacheable buffer is
+ * flushed on its own. An arena takes one block up front and hands out
+ * 64-byte aligned pieces of it; a freed piece is reused by the next
+ * request of the same size, so a filter that is closed and reopened, or
+ * a second filter of the same shape, gets the same memory back. Pieces
+ * allocated one after the other are adjacent, so the inputs of a step
+ * can be flushed, and its outputs invalidated, in one operation.
+ *
+ * Arenas are opt-in: a driver creates one, allocates its buffers from it
+ * with cma_arena_alloc(), and keeps them coherent itself around each
+ * kernel call (P_CACHEABLE=2, see src/hybrid/ekf_block.h and the arena
+ * argument of the Python drivers). cma_alloc(), and so pynq's
+ * Xlnk.cma_array, still takes a CMA buffer of its own. An xlnk reset
+ * releases the blocks: destroy the arenas first.
+ *
+ * All functions are thread safe; a piece may be flushed or invalidated
+ * while others are allocated or freed.
+ */
+
+#ifndef CMA_ARENA_H
+#define CMA_ARENA_H
+
+#include <stdint.h>
+
+#define CMA_ARENA_ALIGN 64
+#define CMA_ARENA_PIECES 1024
+
+struct cma_arena_stats {
+    uint64_t allocs;        /* pieces handed out */
+    uint64_t reuses;        /* of which recycled from freed pieces */
+    uint64_t misses;        /* requests that did not fit */
+    uint64_t bytes;         /* bytes handed out and not freed */
+    uint64_t peak;          /* maximum of bytes */
+    uint64_t size;          /* bytes of the block */
+    uint64_t flushes;
+    uint64_t flush_ns;
+    uint64_t invalidates;
+    uint64_t invalidate_ns;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* an arena over a new CMA block of len bytes; NULL on failure */
+void *cma_arena_create(uint32_t len, uint32_t cacheable);
+
+/* frees the block and everything carved out of it */
+void cma_arena_destroy(void *arena);
+
+/* a piece of len bytes, NULL if the arena is full or NULL */
+void *cma_arena_alloc(void *arena, uint32_t len);
+
+/* returns buf to the arena; 0, or -1 if buf is not one of its pieces */
+int cma_arena_free(void *arena, void *buf);
+
+/* whether buf points into the arena's block */
+int cma_arena_owns(void *arena, void *buf);
+
+/* physical address of buf, which may point into a piece */
+unsigned long cma_arena_phy_addr(void *arena, void *buf);
+
+/* one cache flush / invalidate over [buf, buf+len), e.g. across all the
+   inputs of a step; the whole used part of the block if buf is NULL.
+   No-ops, not counted, on a non-cacheable arena. */
+void cma_arena_flush(void *arena, void *buf, uint32_t len);
+void cma_arena_invalidate(void *arena, void *buf, uint32_t len);
+
+void cma_arena_get_stats(void *arena, struct cma_arena_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+/*  csv2trace: converts a CSV trajectory into an EKF trace (trace.h).
+
+    usage: csv2trace [-w bit_width] [-f frac_width] data.csv data.trc
+
+    Every field becomes one fixed-point word, rounded to nearest and
+    saturated to bit_width bits (defaults 32 and 20, the kernels' data_t);
+    an infinity saturates too and a NaN becomes 0, both counted. The
+    number of columns is taken from the first row, and a row with fewer or
+    more is an error; a first line that does not start with a number is
+    taken as a header. Rows are converted as they are read, so the CSV may
+    be of any length.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "trace.h"
+
+static int numeric(const char *p)
+{
+    while (*p == ' ')
+        p++;
+    return isdigit(*p) || *p == '-' || *p == '+' || *p == '.';
+}
+
+int main(int argc, char ** argv)
+{
+    int bit_width = 32, frac_width = 20;
+    int a = 1;
+
+    for (; a+1 < argc && argv[a][0] == '-'; a += 2) {
+        if (!strcmp(argv[a], "-w"))
+            bit_width = atoi(argv[a+1]);
+        else if (!strcmp(argv[a], "-f"))
+            frac_width = atoi(argv[a+1]);
+        else
+            break;
+    }
+    if (argc - a != 2 || bit_width < 2 || bit_width > 32 ||
+        frac_width < 0 || frac_width >= bit_width) {
+        fprintf(stderr, "usage: csv2trace [-w bit_width] [-f frac_width] data.csv data.trc\n");
+        return 2;
+    }
+
+    FILE *in = fopen(argv[a], "r");
+    if (in == NULL) {
+        fprintf(stderr, "csv2trace: cannot read %s\n", argv[a]);
+        return 1;
+    }
+    FILE *out = fopen(argv[a+1], "wb");
+    if (out == NULL) {
+        fprintf(stderr, "csv2trace: cannot write %s\n", argv[a+1]);
+        return 1;
+    }
+
+    struct trace_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = TRACE_MAGIC;
+    h.version = TRACE_VERSION;
+    h.width = bit_width;
+    h.frac = frac_width;
+    fwrite(&h, sizeof(h), 1, out);
+
+    const long long maxv = (1LL << (bit_width-1)) - 1;
+    const double scale = ldexp(1.0, frac_width);
+    unsigned long long saturated = 0, nonfinite = 0;
+    uint32_t *row = NULL;
+    size_t rcap = 0;
+    char *line = NULL;
+    size_t cap = 0;
+
+    while (getline(&line, &cap, in) > 0) {
+        if (!numeric(line))
+            continue;
+
+        char *p = line;
+        uint32_t n = 0;
+        while (*p && *p != '\n' && *p != '\r') {
+            char *q = p;
+            double d = strtod(q, &p);
+            if (p == q)
+                break;
+            if (h.cols == 0 || n < h.cols) {
+                if (n == rcap) {
+                    rcap = rcap ? 2*rcap : 16;
+                    row = (uint32_t *)realloc(row, rcap*sizeof(uint32_t));
+                }
+                // llround is undefined past 2^63, so clamp before it
+                double y = d*scale;
+                long long v;
+                if (isnan(y)) {
+                    nonfinite++;
+                    v = 0;
+                } else if (fabs(y) >= 0x1p63) {
+                    nonfinite += isinf(y);
+                    saturated++;
+                    v = (y > 0) ? maxv : -maxv-1;
+                } else {
+                    v = llround(y);
+                    if (v > maxv || v < -maxv-1) {
+                        saturated++;
+                        v = (v > maxv) ? maxv : -maxv-1;
+                    }
+                }
+                row[n] = (uint32_t)v;
+            }
+            n++;
+            while (*p == ',' || *p == ' ')
+                p++;
+        }
+
+        if (h.cols == 0)
+            h.cols = n;
+        if (n != h.cols) {
+            fprintf(stderr, "csv2trace: row %llu has %u of %u columns\n",
+                    (unsigned long long)h.rows + 1, n, h.cols);
+            return 1;
+        }
+        fwrite(row, sizeof(uint32_t), h.cols, out);
+        h.rows++;
+    }
+
+    // now that rows and cols are known
+    fseek(out, 0, SEEK_SET);
+    fwrite(&h, sizeof(h), 1, out);
+    fclose(out);
+    fclose(in);
+    free(row);
+    free(line);
+
+    printf("csv2trace: %s: %llu rows of %u words, ap_fixed<%d,%d>",
+           argv[a+1], (unsigned long long)h.rows, h.cols, bit_width, bit_width-frac_width);
+    if (saturated)
+        printf(", %llu values saturated", saturated);
+    if (nonfinite)
+        printf(", %llu not finite", nonfinite);
+    printf("\n");
+    return 0;
+}
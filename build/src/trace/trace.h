@@ -0,0 +1,137 @@
+/*  EKF trace: a trajectory stored as the kernels' port_t words.
+
+    A trace file is a trace_header followed by rows*cols little-endian
+    32-bit words, row-major, each the fixed-point value of one CSV field
+    (width/frac of the header, sign-extended to 32 bits). It is
+    written from a CSV file by csv2trace (src/trace/csv2trace.c), so the
+    host does no parsing or float conversion at run time.
+
+    trace_open() maps the file and checks its header against the kernel's
+    format; trace_read() copies a chunk of rows into a caller's buffer,
+    typically sds_alloc'd so that it is handed to top_ekf without another
+    copy, and releases the pages it has passed, so that resident memory
+    stays at about one chunk however long the trace is.
+*/
+
+#ifndef EKF_TRACE_H
+#define EKF_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_MAGIC   0x54464b45u   /* "EKFT" */
+#define TRACE_VERSION 1
+
+struct trace_header {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t  width;         /* bit_width of the values, <= 32 */
+    uint8_t  frac;          /* frac_width */
+    uint32_t cols;          /* words per row */
+    uint32_t reserved;
+    uint64_t rows;
+};
+
+#ifdef __cplusplus
+
+struct trace {
+    struct trace_header hdr;
+    const uint32_t *words;  /* rows*cols words */
+    void *map;
+    size_t size;
+    size_t released;        /* bytes of the mapping already released */
+};
+
+/* Maps fname and checks that it holds cols words per row of width-bit
+   values with frac fractional bits. Returns 0, or -1 after a message on
+   stderr. */
+static inline int trace_open(struct trace *t, const char *fname,
+                             int width, int frac, int cols)
+{
+    memset(t, 0, sizeof(*t));
+
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "trace: cannot open %s\n", fname);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct trace_header)) {
+        fprintf(stderr, "trace: %s is not a trace\n", fname);
+        close(fd);
+        return -1;
+    }
+    t->size = st.st_size;
+    t->map = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (t->map == MAP_FAILED) {
+        fprintf(stderr, "trace: cannot map %s\n", fname);
+        t->map = NULL;
+        return -1;
+    }
+    madvise(t->map, t->size, MADV_SEQUENTIAL);
+
+    memcpy(&t->hdr, t->map, sizeof(t->hdr));
+    t->words = (const uint32_t *)((const char *)t->map + sizeof(t->hdr));
+
+    const struct trace_header *h = &t->hdr;
+    const char *err = NULL;
+    if (h->magic != TRACE_MAGIC || h->version != TRACE_VERSION)
+        err = "is not a trace";
+    else if (h->width != width || h->frac != frac)
+        err = "has another fixed-point format, rerun csv2trace";
+    else if (h->cols != (uint32_t)cols)
+        err = "has another number of columns";
+    else if (t->size < sizeof(*h) + h->rows*h->cols*sizeof(uint32_t))
+        err = "is truncated";
+    if (err) {
+        fprintf(stderr, "trace: %s %s (%d-bit, %d fractional, %u columns)\n",
+                fname, err, h->width, h->frac, h->cols);
+        munmap(t->map, t->size);
+        t->map = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Copies rows [row, row+n) into dst, fewer at the end of the trace, and
+   returns how many. Pages before the copied rows are released, so reads
+   are expected in increasing order. W is port_t, or any integer type. */
+template <typename W>
+static inline long trace_read(struct trace *t, uint64_t row, long n, W *dst)
+{
+    if (row >= t->hdr.rows)
+        return 0;
+    if ((uint64_t)n > t->hdr.rows - row)
+        n = t->hdr.rows - row;
+
+    const uint32_t *src = t->words + row*t->hdr.cols;
+    long words = n*t->hdr.cols;
+    for (long i=0; i<words; i++)
+        dst[i] = src[i];
+
+    // drop the whole pages that are behind this chunk
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t end = ((const char *)src - (const char *)t->map) / page * page;
+    if (end > t->released) {
+        madvise((char *)t->map + t->released, end - t->released, MADV_DONTNEED);
+        t->released = end;
+    }
+    return n;
+}
+
+static inline void trace_close(struct trace *t)
+{
+    if (t->map)
+        munmap(t->map, t->size);
+    t->map = NULL;
+}
+
+#endif
+
+#endif
@@ -1,7 +1,10 @@
 
 from abc import ABCMeta, abstractmethod
+from collections import namedtuple
 import cffi
+import json
 import os
+import time
 import numpy as np
 from pynq import Overlay, Xlnk
 
@@ -9,6 +12,299 @@ from pynq import Overlay, Xlnk
 __author__ = "Sean Fox"
 
 
+# ctrl bits of the hybrid top_ekf kernels, see ekf_config.h
+CTRL_KEEP = 1
+CTRL_RESTORE = 2
+CTRL_SAVE = 4
+CTRL_NOSTEP = 8
+CTRL_MASK = 16
+OBS_SHIFT = 8
+CTRL_HEALTH = 32
+
+
+def ctrl_obs(mask):
+    """ctrl bits of a step with only the measurements in mask present.
+
+    Bit i of mask is measurement i. The absent entries of obs and hx are
+    ignored, and H, if sent, carries the present rows only, with w2 their
+    number; a mask of 0 is a prediction alone.
+
+    """
+    return CTRL_MASK | (int(mask) << OBS_SHIFT)
+
+
+# return values of the hybrid top_ekf kernels
+EKF_OK = 0
+EKF_NOT_PD = 1
+# a refused call: ctx out of range, or lengths that do not match ctrl
+EKF_BAD_CTX = 2
+EKF_BAD_LEN = 3
+
+
+class Health(namedtuple("Health", "status range pivot negp nis")):
+    """Decoded health word of a step run with CTRL_HEALTH.
+
+    status is one of the EKF_ return values; range, pivot and negp count the
+    entries of x and diag(P) near the end of the fixed-point range, the
+    pivots of H P H^T + R near zero and the diagonal entries of P that are
+    not positive (each up to 15); nis is the normalised innovation squared
+    per measurement, about 1 for a consistent filter and 0 when the step
+    formed none. See ekf_hybrid.h.
+
+    """
+    __slots__ = ()
+
+    @classmethod
+    def decode(cls, word):
+        word = int(word)
+        return cls(word & 0xff, (word >> 8) & 0xf, (word >> 12) & 0xf,
+                   (word >> 16) & 0xf, ((word >> 20) & 0x7ff) / 16.0)
+
+    def faulty(self, nis_max=16.0):
+        """Whether the filter should be re-initialised.
+
+        Parameters
+        ----------
+        nis_max : float
+            bound on nis, e.g. a chi-square quantile over m
+
+        """
+        return (self.status != EKF_OK or self.negp > 0 or self.range > 0
+                or self.nis > nis_max)
+
+# stages of a step timed by StageProfile; run_hw() uses convert, model,
+# kernel and output, run_sw() convert, step and output
+PROF_STAGES = ("convert", "model", "kernel", "step", "output")
+ST_CONVERT, ST_MODEL, ST_KERNEL, ST_STEP, ST_OUTPUT = range(5)
+
+# modes of the fixed-point conversions, see fxconv.h
+FX_TRN = 0
+FX_RND = 1
+FX_SAT = 2
+
+# bulk fixed-point conversions in the kernel libraries, see fxconv.h
+FXCONV_CDEF = """
+long fx_from_double(int32_t *dst, const double *src, long n, int width,
+                    int frac, int mode);
+void fx_to_double(double *dst, const int32_t *src, long n, int width,
+                  int frac);
+"""
+
+# CMA arenas in the kernel libraries, see cma_arena.h
+CMA_ARENA_CDEF = """
+struct cma_arena_stats {
+    uint64_t allocs, reuses, misses, bytes, peak, size;
+    uint64_t flushes, flush_ns, invalidates, invalidate_ns;
+};
+void *cma_arena_create(uint32_t len, uint32_t cacheable);
+void cma_arena_destroy(void *arena);
+void *cma_arena_alloc(void *arena, uint32_t len);
+void cma_arena_flush(void *arena, void *buf, uint32_t len);
+void cma_arena_invalidate(void *arena, void *buf, uint32_t len);
+void cma_arena_get_stats(void *arena, struct cma_arena_stats *stats);
+"""
+
+# bytes of the arena of EKF(arena=True)
+ARENA_SIZE = 1 << 20
+
+
+class ArenaArray(np.ndarray):
+    """A numpy view of a piece of a CMA arena, with the `pointer` of a
+    cma_array; slices keep the pointer of the piece."""
+    pointer = None
+
+    def __array_finalize__(self, obj):
+        self.pointer = getattr(obj, "pointer", None)
+
+# models of ekf_run_trajectory in the hybrid kernel libraries, see ekf_traj.h
+EKF_MODEL_GPS = 0
+EKF_MODEL_LIGHT = 1
+EKF_MODEL_USER = 2
+
+TRAJ_CDEF = """
+typedef void (*ekf_model_fn)(const double *x, const double *row, double *fx,
+                             double *hx, double *F, double *H, void *user);
+void ekf_set_model(ekf_model_fn fn, void *user);
+long ekf_run_trajectory(const double *rows, long steps, int cols, int model,
+                        const double *x0, void *params, void *out,
+                        int ctrl, int ctx, long *overflows);
+"""
+
+
+class StageProfile(object):
+    """Per-step stage timings, the Python side of build/src/prof/prof.h.
+
+    `begin()` starts a step, `mark(stage)` charges the time since the last
+    mark to a stage, and `end()` stores the step. The last `ring` steps are
+    kept for exact percentiles; count, mean and max cover every step. The
+    kernel stage of run_hw() includes the cffi call, so comparing it with
+    the kernel stage of the C drivers (make PROF=1) gives the cffi overhead.
+
+    """
+    def __init__(self, stages=PROF_STAGES, ring=4096):
+        self.stages = tuple(stages)
+        self.ring = np.zeros((ring, len(self.stages)), dtype=np.int64)
+        self.steps = 0
+        self.sum = np.zeros(len(self.stages), dtype=np.int64)
+        self.max = np.zeros(len(self.stages), dtype=np.int64)
+        self.cur = [0] * len(self.stages)
+        self.last = 0
+
+    @staticmethod
+    def now():
+        return int(time.perf_counter() * 1e9)
+
+    def begin(self):
+        self.cur = [0] * len(self.stages)
+        self.last = self.now()
+
+    def mark(self, stage):
+        t = self.now()
+        self.cur[stage] += t - self.last
+        self.last = t
+
+    def end(self):
+        self.ring[self.steps % len(self.ring)] = self.cur
+        self.sum += self.cur
+        np.maximum(self.max, self.cur, out=self.max)
+        self.steps += 1
+
+    def summary(self):
+        """Count, mean, p50, p90, p99 and max in ns of every stage used."""
+        rows = self.ring[:min(self.steps, len(self.ring))]
+        out = []
+        for k, name in enumerate(self.stages):
+            if self.sum[k] == 0:
+                continue
+            v = np.sort(rows[:, k])
+            q = [v[(len(v) - 1) * pc // 100] for pc in (50, 90, 99)]
+            out.append({"stage": name, "count": self.steps,
+                        "mean_ns": int(self.sum[k] // self.steps),
+                        "p50_ns": int(q[0]), "p90_ns": int(q[1]),
+                        "p99_ns": int(q[2]), "max_ns": int(self.max[k])})
+        return out
+
+    def write(self, fname):
+        """Write `summary()` as JSON if fname ends in .json, else as CSV."""
+        stats = self.summary()
+        with open(fname, "w") as f:
+            if fname.endswith(".json"):
+                json.dump({"steps": self.steps, "ring": len(self.ring),
+                           "stages": stats}, f, indent=1)
+                return
+            keys = ("stage", "count", "mean_ns", "p50_ns", "p90_ns",
+                    "p99_ns", "max_ns")
+            f.write(",".join(keys) + "\n")
+            for st in stats:
+                f.write(",".join(str(st[k]) for k in keys) + "\n")
+
+
+class FixedConverter(object):
+    """Conversion of numpy arrays to and from the kernel's fixed point.
+
+    A word holds a value with `frac` fractional bits in `width` bits,
+    sign-extended to int32. The conversions run in the kernel library
+    (build/src/fxconv) in one call per array, or in numpy with the same
+    results if the library predates them. Values that do not fit are
+    counted in `overflows`.
+
+    Parameters
+    ----------
+    width : int
+        bits of a word, the kernel's bit_width
+    frac : int
+        fractional bits, the kernel's frac_width
+    mode : int
+        FX_RND to round to nearest (halves away from zero) instead of
+        truncating, FX_SAT to saturate instead of wrapping around
+    ffi : cffi.FFI
+        the FFI of dlib, with FXCONV_CDEF declared
+    dlib : cffi library
+        the kernel library, or None for numpy only
+
+    """
+    def __init__(self, width=32, frac=20, mode=FX_RND | FX_SAT, ffi=None,
+                 dlib=None):
+        self.width = width
+        self.frac = frac
+        self.mode = mode
+        self.overflows = 0
+        self._ffi = ffi
+        self._lib = None
+        if dlib is not None:
+            try:
+                dlib.fx_from_double
+                self._lib = dlib
+            except AttributeError:
+                pass
+
+    def to_fixed(self, values, out=None):
+        """Words of values, into out (int32, contiguous) if given."""
+        x = np.ascontiguousarray(values, dtype=np.float64)
+        if out is None:
+            out = np.empty(x.shape, dtype=np.int32)
+        if self._lib is not None:
+            self.overflows += self._lib.fx_from_double(
+                self._ffi.cast("int32_t *", out.ctypes.data),
+                self._ffi.cast("double *", x.ctypes.data), x.size,
+                self.width, self.frac, self.mode)
+            return out
+
+        lo = -(1 << (self.width - 1))
+        hi = (1 << (self.width - 1)) - 1
+        y = x.ravel() * 2.0 ** self.frac
+        with np.errstate(invalid="ignore"):
+            if self.mode & FX_RND:
+                r = np.trunc(y + np.copysign(0.5, y))
+            else:
+                r = np.trunc(y)
+            ovf = ~((r >= lo) & (r <= hi))
+            if ovf.any():
+                self.overflows += int(np.count_nonzero(ovf))
+                if self.mode & FX_SAT:
+                    r[ovf] = np.where(y[ovf] > 0, hi, lo)
+                else:
+                    # as fxconv.c: beyond 2^31 LSBs, wrap the value
+                    # clamped to 2^32
+                    c = np.clip(r[ovf], -2.0 ** 32, 2.0 ** 32)
+                    c[np.isnan(c)] = -2.0 ** 32
+                    r[ovf] = (c.astype(np.int64) - lo) % (1 << self.width) + lo
+        out.reshape(-1)[:] = r.astype(np.int32)
+        return out
+
+    def to_float(self, values, out=None):
+        """Values (float64) of words, into out if given."""
+        w = np.ascontiguousarray(values, dtype=np.int32)
+        if out is None:
+            out = np.empty(w.shape, dtype=np.float64)
+        if self._lib is not None:
+            self._lib.fx_to_double(
+                self._ffi.cast("double *", out.ctypes.data),
+                self._ffi.cast("int32_t *", w.ctypes.data), w.size,
+                self.width, self.frac)
+            return out
+
+        shift = 32 - self.width
+        s = (w.ravel() << shift) >> shift
+        out.reshape(-1)[:] = s * 2.0 ** -self.frac
+        return out
+
+
+class NoProfile(object):
+    """Stand-in for StageProfile while profiling is off."""
+    def begin(self):
+        pass
+
+    def mark(self, stage):
+        pass
+
+    def end(self):
+        pass
+
+
+NO_PROFILE = NoProfile()
+
+
 class EKF(object):
     """EKF abstract class.
 
@@ -20,7 +316,7 @@ class EKF(object):
     __metaclass__ = ABCMeta
 
     def __init__(self, n, m, pval=0.5, qval=0.1, rval=20.0,
-                 bitstream=None, library=None, cacheable=0):
+                 bitstream=None, library=None, cacheable=0, arena=False):
         """Initialize the EKF object.
 
         Parameters
@@ -41,6 +337,12 @@ class EKF(object):
             string identifier of the C library
         cacheable : int
             Whether the buffers should be cacheable - defaults to 0
+        arena : bool or int
+            Carve the buffers out of one cacheable CMA arena of
+            ARENA_SIZE bytes, or of this many, and flush the inputs and
+            invalidate the outputs of every kernel call in one operation
+            each. For bitstreams built with P_CACHEABLE=2 - defaults to
+            False, one CMA buffer per array
 
         """
         self.bitstream_name = bitstream
@@ -57,6 +359,14 @@ class EKF(object):
         # Whether to use sds_alloc or sds_alloc_non_cacheable
         self.cacheable = cacheable
 
+        # the cacheable CMA arena of the buffers, see cma_array()
+        self.arena = None
+        self.arena_size = 0
+        if arena:
+            self._ffi.cdef(CMA_ARENA_CDEF)
+            self.arena_size = ARENA_SIZE if arena is True else int(arena)
+            self.open_arena()
+
         # No previous prediction noise covariance
         self.P_pre = None
 
@@ -71,6 +381,247 @@ class EKF(object):
         # Identity matrix
         self.I = np.eye(n)
 
+        # per-stage timings of run_hw()/run_sw(), see enable_profiling()
+        self.prof_hw = NO_PROFILE
+        self.prof_sw = NO_PROFILE
+
+        # health words of run_hw(), see enable_health()
+        self.health_ctrl = 0
+        self.health = None
+
+    def enable_profiling(self, ring=4096):
+        """Time every stage of every step of `run_hw()` and `run_sw()`.
+
+        The timings are in `prof_hw` and `prof_sw`, see `StageProfile`.
+
+        Parameters
+        ----------
+        ring : int
+            number of steps kept for the percentiles
+
+        """
+        self.prof_hw = StageProfile(ring=ring)
+        self.prof_sw = StageProfile(ring=ring)
+
+    def enable_health(self):
+        """Ask the kernel for the health word of every step of `run_hw()`.
+
+        The decoded words are appended to `health`, one `Health` per step,
+        so that a faulty filter can be found and re-initialised alone.
+        `run_hw()` then takes the Python loop, as `run_trajectory()`
+        returns the failures only.
+
+        """
+        self.health_ctrl = CTRL_HEALTH
+        self.health = []
+
+    def check_status(self, status):
+        """Count a failed step and keep the health word of a step.
+
+        Parameters
+        ----------
+        status : int
+            return value of top_ekf, a health word with CTRL_HEALTH
+
+        Returns
+        -------
+        int
+            EKF_OK, EKF_NOT_PD, EKF_BAD_CTX or EKF_BAD_LEN
+
+        """
+        hl = Health.decode(status)
+        if self.health is not None:
+            self.health.append(hl)
+        self.failures += (hl.status != EKF_OK)
+        return hl.status
+
+    def fixed_converter(self, width=32, frac=20, mode=FX_RND | FX_SAT):
+        """A `FixedConverter` that runs in this filter's kernel library.
+
+        Parameters
+        ----------
+        width : int
+            bits of a word, the kernel's bit_width
+        frac : int
+            fractional bits, the kernel's frac_width
+        mode : int
+            FX_RND and/or FX_SAT, see `FixedConverter`
+
+        """
+        if not getattr(self, "_fxconv_cdef", False):
+            self._ffi.cdef(FXCONV_CDEF)
+            self._fxconv_cdef = True
+        return FixedConverter(width, frac, mode, self._ffi, self.dlib)
+
+    def open_arena(self):
+        """Create the arena of the buffers; `cma_array()` does so again
+        after `close_arena()`."""
+        self.arena = self.dlib.cma_arena_create(self.arena_size, 1)
+        if self.arena == self._ffi.NULL:
+            self.arena = None
+            raise MemoryError("no CMA block of %d bytes" % self.arena_size)
+
+    def close_arena(self):
+        """Free the arena and every buffer in it, before an xlnk reset."""
+        if self.arena is not None:
+            self.dlib.cma_arena_destroy(self.arena)
+            self.arena = None
+
+    def cma_array(self, shape, dtype=np.int32):
+        """Physically contiguous memory for a port of the kernel.
+
+        A piece of the arena if the filter has one, in order of
+        allocation, so that allocating the inputs first lets
+        `flush_inputs()` cover them in one operation; else a cma_array.
+
+        """
+        if self.arena is None and self.arena_size:
+            self.open_arena()
+        if self.arena is None:
+            return self.xlnk.cma_array(shape=shape, dtype=dtype,
+                                       cacheable=self.cacheable)
+        nbytes = int(np.prod(shape)) * np.dtype(dtype).itemsize
+        ptr = self.dlib.cma_arena_alloc(self.arena, nbytes)
+        if ptr == self._ffi.NULL:
+            raise MemoryError("the CMA arena is full")
+        buf = np.frombuffer(self._ffi.buffer(ptr, nbytes), dtype=dtype)
+        buf = buf.reshape(shape).view(ArenaArray)
+        buf.pointer = ptr
+        return buf
+
+    def flush_inputs(self):
+        """Write the buffers back to memory before a kernel call.
+
+        One flush over the used part of the arena; nothing without one.
+
+        """
+        if self.arena is not None:
+            self.dlib.cma_arena_flush(self.arena, self._ffi.NULL, 0)
+
+    def invalidate_outputs(self, ptr, nbytes):
+        """Drop the cached lines of what a kernel call wrote to
+        [ptr, ptr+nbytes), after it; nothing without an arena."""
+        if self.arena is not None:
+            self.dlib.cma_arena_invalidate(self.arena, ptr, nbytes)
+
+    def cma_stats(self):
+        """Counters of the arena of the buffers.
+
+        Returns
+        -------
+        dict
+            allocs, reuses, misses, bytes, peak, size, flushes, flush_ns,
+            invalidates and invalidate_ns; empty without an arena.
+
+        """
+        if self.arena is None:
+            return {}
+        st = self._ffi.new("struct cma_arena_stats *")
+        self.dlib.cma_arena_get_stats(self.arena, st)
+        return {k: getattr(st, k) for k in
+                ("allocs", "reuses", "misses", "bytes", "peak", "size",
+                 "flushes", "flush_ns", "invalidates", "invalidate_ns")}
+
+    def _traj_lib(self):
+        """The kernel library if it exports ekf_run_trajectory, else None."""
+        if not getattr(self, "_traj_cdef", False):
+            self._ffi.cdef(TRAJ_CDEF)
+            self._traj_cdef = True
+        try:
+            self.dlib.ekf_run_trajectory
+        except AttributeError:
+            return None
+        return self.dlib
+
+    def set_model(self, fn):
+        """Set the model of `run_trajectory()` with EKF_MODEL_USER.
+
+        Parameters
+        ----------
+        fn: cffi function pointer or callable
+            A C function of type ekf_model_fn (see ekf_traj.h), e.g. from
+            another library, which keeps the whole loop native; or a Python
+            function fn(x, row) returning fx (n,), hx (m,), F (n,n) and
+            H (m,n), which is called back once per step.
+
+        """
+        lib = self._traj_lib()
+        if lib is None:
+            raise RuntimeError("the kernel library has no ekf_set_model")
+        if not isinstance(fn, self._ffi.CData):
+            py = fn
+            ffi = self._ffi
+
+            def array(p, k):
+                return np.frombuffer(ffi.buffer(p, k * 8), dtype=np.float64)
+
+            def model(x, row, fx, hx, F, H, user):
+                n, m = self.n, self.m
+                f, h, Fm, Hm = py(array(x, n), array(row, self._traj_cols))
+                array(fx, n)[:] = np.ravel(f)
+                array(hx, m)[:] = np.ravel(h)
+                array(F, n * n)[:] = np.ravel(Fm)
+                array(H, m * n)[:] = np.ravel(Hm)
+
+            fn = ffi.callback("ekf_model_fn", model)
+        # the callback must outlive the calls
+        self._model_fn = fn
+        lib.ekf_set_model(fn, self._ffi.NULL)
+
+    def run_trajectory(self, rows, out, model, ctrl=0):
+        """Run a whole dataset through the kernel in one native call.
+
+        The model, the conversions and the kernel calls of every step run
+        in the kernel library (ekf_run_trajectory, see ekf_traj.h), from
+        the current state `x` and the `params` and `ctx` of the filter.
+        Raises ValueError if the model does not fit the kernel, `ctx` or
+        `ctrl` is not valid, or the kernel refused a step.
+
+        Parameters
+        ----------
+        rows: np.ndarray
+            One row per step, the inputs of the model followed by the m
+            observations, shape=(steps, cols).
+        out: xlnk.cma_array
+            Output words, one row of n per step.
+        model: int
+            EKF_MODEL_GPS, EKF_MODEL_LIGHT, or EKF_MODEL_USER for the
+            model of `set_model()`.
+        ctrl: int
+            ctrl of the first step, 0 to start from `x` and params, or
+            CTRL_KEEP to carry on with the state of the context;
+            CTRL_HEALTH may be added, no other bits.
+
+        Returns
+        -------
+        int
+            steps not positive definite, also added to `failures`; None
+            if the library predates ekf_run_trajectory.
+
+        """
+        lib = self._traj_lib()
+        if lib is None:
+            return None
+        rows = np.ascontiguousarray(rows, dtype=np.float64)
+        if rows.ndim != 2 or len(rows) > out.shape[0]:
+            raise ValueError("rows must be 2-D, with at most %d rows"
+                             % out.shape[0])
+        x0 = np.ascontiguousarray(self.x, dtype=np.float64)
+        ovf = self._ffi.new("long *")
+        self._traj_cols = rows.shape[1]
+        fails = lib.ekf_run_trajectory(
+            self._ffi.cast("double *", rows.ctypes.data), len(rows),
+            rows.shape[1], model, self._ffi.cast("double *", x0.ctypes.data),
+            self.params.pointer, out.pointer, ctrl, self.ctx, ovf)
+        if fails < 0:
+            raise ValueError("model %d, ctrl %d or ctx %d not valid for "
+                             "this kernel" % (model, ctrl, self.ctx))
+        self.fixed.overflows += ovf[0]
+        self.failures += fails
+        if len(rows):
+            self.x = self.toFloat(out[len(rows) - 1])
+        return fails
+
     def reload_overlay(self):
         """Reloading the bitstream onto PL.
 
@@ -131,12 +682,10 @@ class EKF(object):
         Returns
         -------
         xlnk.cma_array
-            Physically contiguous memory.
+            Physically contiguous memory, see `cma_array()`.
 
         """
-        size = x.shape
-        data_buffer = self.xlnk.cma_array(shape=size, dtype=dtype,
-                                          cacheable=self.cacheable)
+        data_buffer = self.cma_array(x.shape, dtype)
         np.copyto(data_buffer, x.astype(dtype), casting="unsafe")
         return data_buffer
 
@@ -1,8 +1,10 @@
 
 import os
 import numpy as np
-from rig.type_casts import NumpyFloatToFixConverter, NumpyFixToFloatConverter
 from . import EKF
+from .ekf import CTRL_KEEP, CTRL_RESTORE, CTRL_SAVE, CTRL_NOSTEP
+from .ekf import EKF_MODEL_GPS, NO_PROFILE
+from .ekf import ST_CONVERT, ST_MODEL, ST_KERNEL, ST_STEP, ST_OUTPUT
 
 
 __author__ = "Sean Fox"
@@ -42,9 +44,9 @@ class GPS_EKF(EKF):
             library = os.path.join(ROOT_DIR, "gps", "libekf_gps.so")
         super().__init__(n, m, pval, qval, rval, bitstream, library, cacheable)
 
-        self.toFixed = NumpyFloatToFixConverter(signed=True, n_bits=32,
-                                                n_frac=20)
-        self.toFloat = NumpyFixToFloatConverter(20)
+        self.fixed = self.fixed_converter(32, FRAC_WIDTH)
+        self.toFixed = self.fixed.to_fixed
+        self.toFloat = self.fixed.to_float
         self.n = n
         self.m = m
         self.pval = pval
@@ -99,12 +101,8 @@ class GPS_EKF(EKF):
 
         params = self.toFixed(params)
         self.param_buffer = self.copy_array(params)
-        self.pout_buffer = self.xlnk.cma_array(shape=(64, 1),
-                                               dtype=dtype,
-                                               cacheable=self.cacheable)
-        self.out_buffer_hw = self.xlnk.cma_array(shape=(MAX_LENGTH, 3),
-                                                 dtype=dtype,
-                                                 cacheable=self.cacheable)
+        self.pout_buffer = self.cma_array((64, 1), dtype)
+        self.out_buffer_hw = self.cma_array((MAX_LENGTH, 3), dtype)
         self.out_buffer_sw = np.zeros((MAX_LENGTH, 3))
 
     def reset(self):
@@ -129,11 +127,15 @@ class GPS_EKF(EKF):
         """
         datalen = len(x)
         in_buffer = x.pointer
+        # the whole trajectory is a single kernel call
+        self.prof_hw.begin()
         self.dlib._p0_top_ekf_1_noasync(in_buffer,
                                         self.param_buffer.pointer,
                                         self.out_buffer_hw.pointer,
                                         self.pout_buffer.pointer,
                                         datalen)
+        self.prof_hw.mark(ST_KERNEL)
+        self.prof_hw.end()
         return self.out_buffer_hw[:datalen]
 
     def run_sw(self, x):
@@ -142,11 +144,17 @@ class GPS_EKF(EKF):
         This method uses a designated buffer to store the outputs.
 
         """
+        prof = self.prof_sw
         for i, line in enumerate(x):
+            prof.begin()
             SV_pos = np.array(line[:12]).astype(np.float32).reshape(4, 3)
             SV_rho = np.array(line[12:]).astype(np.float32)
+            prof.mark(ST_CONVERT)
             state = self.step(SV_rho, SV_pos=SV_pos)
+            prof.mark(ST_STEP)
             self.out_buffer_sw[i,:] = [state[0], state[2], state[4]]
+            prof.mark(ST_OUTPUT)
+            prof.end()
         return self.out_buffer_sw[:len(x)]
 
     def f(self, x, **kwargs):
@@ -204,15 +212,37 @@ class GPS_EKF_HWSW(EKF):
         flattened array containing P,Q,R
     cacheable : int
         Whether the buffers should be cacheable - defaults to 0
+    ctx : int
+        on-chip filter context used by `run_hw()` - defaults to 0
+    failures : int
+        steps dropped by `run_hw()` because H P H^T + R was not positive
+        definite; x and P are left unchanged on those steps
+    health : list
+        `Health` of every step of `run_hw()`, after `enable_health()`
+    h_sparse : bool
+        whether the bitstream was built with H_SPARSE=1, i.e. only takes
+        the position columns 0, 2, 4, 6 of H - defaults to False
+    sqrt_cov : bool
+        whether the bitstream was built with SQRT_COV=1, i.e. keeps the
+        upper Cholesky factor S of P = S^T S; params then carry the
+        factors of P, Q and R, and `save_context()` returns S in place
+        of P - defaults to False
+    arena : bool or int
+        whether the bitstream was built with P_CACHEABLE=2: the buffers
+        are then carved out of one cacheable CMA arena, of this many
+        bytes if an int, and kept coherent once per step, see
+        `EKF.cma_array()` - defaults to False
 
     """
     def __init__(self, n=8, m=4, pval=0.5, qval=0.1, rval=20,
-                 bitstream=None, library=None, cacheable=0):
+                 bitstream=None, library=None, cacheable=0, h_sparse=False,
+                 sqrt_cov=False, arena=False):
         if bitstream is None:
             bitstream = os.path.join(ROOT_DIR, "n8m4", "ekf_n8m4.bit")
         if library is None:
             library = os.path.join(ROOT_DIR, "n8m4", "libekf_n8m4.so")
-        super().__init__(n, m, pval, qval, rval, bitstream, library, cacheable)
+        super().__init__(n, m, pval, qval, rval, bitstream, library, cacheable,
+                         arena)
 
         self.n = n
         self.m = m
@@ -222,14 +252,16 @@ class GPS_EKF_HWSW(EKF):
         self.P = np.eye(n) * pval
         self.Q = np.eye(n) * qval
         self.R = np.eye(m) * rval
-        self.toFixed = NumpyFloatToFixConverter(signed=True, n_bits=32,
-                                                n_frac=20)
-        self.toFloat = NumpyFixToFloatConverter(20)
-
-        # hw params
+        self.fixed = self.fixed_converter(32, FRAC_WIDTH)
+        self.toFixed = self.fixed.to_fixed
+        self.toFloat = self.fixed.to_float
+
+        # hw params, or their upper triangular factors for SQRT_COV
+        hw = (self.P, self.Q, self.R)
+        if sqrt_cov:
+            hw = [np.linalg.cholesky(a).T for a in hw]
         self.pars = np.concatenate(
-            (self.P.flatten(), self.Q.flatten(), self.R.flatten()),
-            axis=0) * (1 << 20)
+            [a.flatten() for a in hw], axis=0) * (1 << 20)
         self.params = None
         self.F_hw = None
         self.fx_hw = None
@@ -238,14 +270,20 @@ class GPS_EKF_HWSW(EKF):
         self.out_buffer_hw = None
         self.out_buffer_sw = None
         self.obs = None
+        self.state_hw = None
+        self.ctx = 0
+        self.failures = 0
+        self.h_sparse = h_sparse
+        self.sqrt_cov = sqrt_cov
 
         self.configure()
 
     @property
     def ffi_interface(self):
-        return """void _p0_top_ekf_1_noasync(int obs[4], int fx_i[8], 
+        return """int _p0_top_ekf_1_noasync(int obs[4], int fx_i[8], 
         int hx_i[4], int F_i[64], int H_i[32], int params[144], int output[8], 
-        int ctrl, int w1, int w2);"""
+        int state_i[72], int state_o[72], int ctrl, int ctx, int w1, int w2,
+        int w3i, int w3o);"""
 
     def set_state(self, x=None):
         """Method to set the state
@@ -273,12 +311,13 @@ class GPS_EKF_HWSW(EKF):
         self.F_hw = self.copy_array(self.toFixed(self.F.flatten()))
         self.fx_hw = self.copy_array(np.zeros(self.n))
         self.hx_hw = self.copy_array(np.zeros(self.m))
-        self.H_hw = self.copy_array(np.zeros(self.n * self.m))
-        self.out_buffer_hw = self.xlnk.cma_array(shape=(50, self.n),
-                                                 dtype=np.int32,
-                                                 cacheable=self.cacheable)
-        self.out_buffer_sw = np.zeros((50, 3))
+        self.H_hw = self.copy_array(
+            np.zeros(self.pack_H(np.zeros((self.m, self.n))).size))
         self.obs = self.copy_array(np.zeros(self.m))
+        self.state_hw = self.copy_array(np.zeros(self.n + self.n * self.n))
+        # outputs last, see cma_array()
+        self.out_buffer_hw = self.cma_array((50, self.n))
+        self.out_buffer_sw = np.zeros((50, 3))
 
     def reset(self):
         """Reset all the contiguous memory.
@@ -287,25 +326,82 @@ class GPS_EKF_HWSW(EKF):
         able to run any computation.
 
         """
+        self.close_arena()
         self.xlnk.xlnk_reset()
 
+    def save_context(self):
+        """Copy the state of the current context out of the accelerator.
+
+        Returns
+        -------
+        np.ndarray
+            fixed point x followed by the row-major P, shape=(n + n*n,)
+
+        """
+        nsave = self.n + self.n * self.n
+        self.flush_inputs()
+        self.dlib._p0_top_ekf_1_noasync(self.obs.pointer,
+                                        self.fx_hw.pointer,
+                                        self.hx_hw.pointer,
+                                        self.F_hw.pointer,
+                                        self.H_hw.pointer,
+                                        self.params.pointer,
+                                        self.out_buffer_hw.pointer,
+                                        self.state_hw.pointer,
+                                        self.state_hw.pointer,
+                                        CTRL_KEEP | CTRL_NOSTEP | CTRL_SAVE,
+                                        self.ctx, 0, 0, 0, nsave)
+        self.invalidate_outputs(self.state_hw.pointer, 4 * nsave)
+        return np.array(self.state_hw)
+
+    def restore_context(self, state):
+        """Load a state returned by `save_context()` into the current context.
+
+        Q and R of the context are kept, so the context must have been
+        initialised by `run_hw()` before.
+
+        """
+        nsave = self.n + self.n * self.n
+        np.copyto(self.state_hw, state)
+        self.flush_inputs()
+        self.dlib._p0_top_ekf_1_noasync(self.obs.pointer,
+                                        self.fx_hw.pointer,
+                                        self.hx_hw.pointer,
+                                        self.F_hw.pointer,
+                                        self.H_hw.pointer,
+                                        self.params.pointer,
+                                        self.out_buffer_hw.pointer,
+                                        self.state_hw.pointer,
+                                        self.state_hw.pointer,
+                                        CTRL_KEEP | CTRL_NOSTEP | CTRL_RESTORE,
+                                        self.ctx, 0, 0, nsave, 0)
+        self.x = self.toFloat(np.array(self.state_hw[:self.n]))
+
     def run_sw(self, x):
         """Run the software version of the computation.
 
         This method uses a designated buffer to store the outputs.
 
         """
+        prof = self.prof_sw
         for i, line in enumerate(x):
+            prof.begin()
             obs = np.array(line[12:])
             pos = np.array(line[:12]).reshape(4, 3)
+            prof.mark(ST_CONVERT)
             state = self.step(obs, SV_pos=pos)
+            prof.mark(ST_STEP)
             self.out_buffer_sw[i, :] = [state[0], state[2], state[4]]
+            prof.mark(ST_OUTPUT)
+            prof.end()
         return self.out_buffer_sw[:len(x)]
 
     def run_hw(self, x):
         """Run the hardware-accelerated computation.
 
-        Error checking is removed to improve the performance.
+        Error checking is removed to improve the performance, except that
+        steps the hardware reports as not positive definite are counted in
+        `failures`.
 
         The following steps are performed in the hardware computation:
 
@@ -321,50 +417,74 @@ class GPS_EKF_HWSW(EKF):
 
         5. Repeat for len(x)-1 iterations.
 
+        Unless profiling or the health words are enabled, the whole loop
+        runs natively in one `run_trajectory()` call if the kernel library
+        provides it.
+
         """
+        if self.prof_hw is NO_PROFILE and not self.health_ctrl:
+            if self.run_trajectory(x, self.out_buffer_hw,
+                                   EKF_MODEL_GPS) is not None:
+                return self.out_buffer_hw[:len(x), [0, 2, 4]]
+
+        prof = self.prof_hw
+        prof.begin()
         line = x[0]
         pos = np.array(line[:12]).reshape(4, 3)
         rho = np.array(line[12:])
-        np.copyto(self.obs, self.toFixed(rho).astype(np.int32))
+        self.toFixed(rho, out=self.obs)
+        prof.mark(ST_CONVERT)
 
         self.compute_model(self.x, pos)
+        prof.mark(ST_MODEL)
 
         offset = 0
         out_ptr = self.out_buffer_hw.pointer
 
-        self.dlib._p0_top_ekf_1_noasync(self.obs.pointer,
-                                        self.fx_hw.pointer,
-                                        self.hx_hw.pointer,
-                                        self.F_hw.pointer,
-                                        self.H_hw.pointer,
-                                        self.params.pointer,
-                                        out_ptr, 0, self.n, self.m)
+        self.flush_inputs()
+        status = self.dlib._p0_top_ekf_1_noasync(
+            self.obs.pointer, self.fx_hw.pointer, self.hx_hw.pointer,
+            self.F_hw.pointer, self.H_hw.pointer, self.params.pointer,
+            out_ptr, self.state_hw.pointer, self.state_hw.pointer,
+            self.health_ctrl, self.ctx, self.n, self.m, 0, 0)
+        self.invalidate_outputs(out_ptr, 4 * self.n)
+        prof.mark(ST_KERNEL)
+        self.check_status(status)
         self.x = self.toFloat(self.out_buffer_hw[0])
+        prof.mark(ST_OUTPUT)
+        prof.end()
 
         for i, line in enumerate(x[1:]):
+            prof.begin()
             # fetch next observation and measurement, convert and copy
             pos = np.array(line[:12]).reshape(4, 3)
             rho = np.array(line[12:])
-            np.copyto(self.obs, self.toFixed(rho).astype(np.int32))
+            self.toFixed(rho, out=self.obs)
+            prof.mark(ST_CONVERT)
 
             # compute fx, hx, F, H in python floating point, convert and copy
             self.compute_model(self.x, pos)
+            prof.mark(ST_MODEL)
 
             # output point offset adjustment
             offset += 32
             out_ptr = self.out_buffer_hw.pointer + offset
 
             # run next iteration in HW by setting ctrl=1
-            self.dlib._p0_top_ekf_1_noasync(self.obs.pointer,
-                                            self.fx_hw.pointer,
-                                            self.hx_hw.pointer,
-                                            self.F_hw.pointer,
-                                            self.H_hw.pointer,
-                                            self.params.pointer,
-                                            out_ptr, 1, self.n, self.m)
+            self.flush_inputs()
+            status = self.dlib._p0_top_ekf_1_noasync(
+                self.obs.pointer, self.fx_hw.pointer, self.hx_hw.pointer,
+                self.F_hw.pointer, self.H_hw.pointer, self.params.pointer,
+                out_ptr, self.state_hw.pointer, self.state_hw.pointer,
+                CTRL_KEEP | self.health_ctrl, self.ctx, self.n, self.m, 0, 0)
+            self.invalidate_outputs(out_ptr, 4 * self.n)
+            prof.mark(ST_KERNEL)
+            self.check_status(status)
 
             # convert state into float for next iteration model
             self.x = self.toFloat(self.out_buffer_hw[i + 1])
+            prof.mark(ST_OUTPUT)
+            prof.end()
         return self.out_buffer_hw[:len(x), [0, 2, 4]]
 
     def compute_model(self, x, pos):
@@ -376,9 +496,21 @@ class GPS_EKF_HWSW(EKF):
         """
         fx, F = self.f(x)
         hx, H = self.h(fx, SV_pos=pos)
-        np.copyto(self.fx_hw, self.toFixed(fx.flatten()).astype(np.int32))
-        np.copyto(self.hx_hw, self.toFixed(hx.flatten()).astype(np.int32))
-        np.copyto(self.H_hw, self.toFixed(H.flatten()).astype(np.int32))
+        self.toFixed(fx, out=self.fx_hw)
+        self.toFixed(hx, out=self.hx_hw)
+        self.toFixed(self.pack_H(H), out=self.H_hw)
+
+    def pack_H(self, H):
+        """Return the columns of H that `top_ekf` reads.
+
+        That is all of H, or only the position columns if the bitstream
+        was built with H_SPARSE=1. The other columns are zero in the GPS
+        model, so the transfer and the H P products shrink by half.
+
+        """
+        if self.h_sparse:
+            return H[:, 0::2]
+        return H
 
     def f(self, x, **kwargs):
         F = self.F
@@ -1,8 +1,10 @@
 
 import os
 import numpy as np
-from rig.type_casts import NumpyFloatToFixConverter, NumpyFixToFloatConverter
 from . import EKF
+from .ekf import CTRL_KEEP, CTRL_RESTORE, CTRL_SAVE, CTRL_NOSTEP
+from .ekf import EKF_MODEL_LIGHT, NO_PROFILE
+from .ekf import ST_CONVERT, ST_MODEL, ST_KERNEL, ST_STEP, ST_OUTPUT
 
 
 __author__ = "Sean Fox"
@@ -37,24 +39,37 @@ class Light_EKF(EKF):
         flattened array containing P,Q,R, shape=(n*n + n*n + m*m, 1)
     cacheable : int
         Whether the buffers should be cacheable - defaults to 0
+    ctx : int
+        on-chip filter context used by `run_hw()` - defaults to 0
+    failures : int
+        steps dropped by `run_hw()` because H P H^T + R was not positive
+        definite; x and P are left unchanged on those steps
+    health : list
+        `Health` of every step of `run_hw()`, after `enable_health()`
+    arena : bool or int
+        whether the bitstream was built with P_CACHEABLE=2: the buffers
+        are then carved out of one cacheable CMA arena, of this many
+        bytes if an int, and kept coherent once per step, see
+        `EKF.cma_array()` - defaults to False
 
     """
     def __init__(self, n=2, m=2, pval=0.01, qval=0.01, rval=2.5,
-                 bitstream=None, library=None, cacheable=0):
+                 bitstream=None, library=None, cacheable=0, arena=False):
         if bitstream is None:
             bitstream = os.path.join(ROOT_DIR, "n2m2", "ekf_n2m2.bit")
         if library is None:
             library = os.path.join(ROOT_DIR, "n2m2", "libekf_n2m2.so")
-        super().__init__(n, m, pval, qval, rval, bitstream, library, cacheable)
+        super().__init__(n, m, pval, qval, rval, bitstream, library, cacheable,
+                         arena)
 
         self.n = n
         self.m = m
         self.P = np.eye(self.n) * pval
         self.Q = np.eye(self.n) * qval
         self.R = np.eye(self.m) * np.array([0.1, 1.0])
-        self.toFixed = NumpyFloatToFixConverter(signed=True, n_bits=32,
-                                                n_frac=FRAC_WIDTH)
-        self.toFloat = NumpyFixToFloatConverter(FRAC_WIDTH)
+        self.fixed = self.fixed_converter(32, FRAC_WIDTH)
+        self.toFixed = self.fixed.to_fixed
+        self.toFloat = self.fixed.to_float
         self.pars = np.concatenate(
             (self.P.flatten(), self.Q.flatten(), self.R.flatten()),
             axis=0) * (1 << 20)
@@ -66,14 +81,18 @@ class Light_EKF(EKF):
         self.out_buffer_hw = None
         self.out_buffer_sw = None
         self.obs = None
+        self.state_hw = None
+        self.ctx = 0
+        self.failures = 0
 
         self.configure()
 
     @property
     def ffi_interface(self):
-        return """void _p0_top_ekf_1_noasync(int obs[2], int fx_i[2], 
+        return """int _p0_top_ekf_1_noasync(int obs[2], int fx_i[2], 
         int hx_i[2], int F_i[4], int H_i[4], int params[12], int output[2], 
-        int ctrl, int w1, int w2);"""
+        int state_i[6], int state_o[6], int ctrl, int ctx, int w1, int w2,
+        int w3i, int w3o);"""
 
     def set_state(self, x=None):
         """Method to set the state
@@ -99,8 +118,7 @@ class Light_EKF(EKF):
         self.params = self.copy_array(self.pars)
 
         self.obs = self.copy_array(np.zeros(self.m))
-        self.out_buffer_hw = self.copy_array(np.zeros((MAX_OUT, self.n)))
-        self.out_buffer_sw = np.zeros((MAX_OUT, 3))
+        self.state_hw = self.copy_array(np.zeros(self.n + self.n * self.n))
 
         self.F_hw = self.copy_array(
             self.toFixed(np.array([[1, 1], [0, 1]]).flatten()))
@@ -110,6 +128,10 @@ class Light_EKF(EKF):
         self.fx_hw = self.copy_array(np.zeros(self.n))
         self.hx_hw = self.copy_array(np.zeros(self.m))
 
+        # outputs last, see cma_array()
+        self.out_buffer_hw = self.copy_array(np.zeros((MAX_OUT, self.n)))
+        self.out_buffer_sw = np.zeros((MAX_OUT, 3))
+
     def reset(self):
         """Reset all the contiguous memory.
 
@@ -117,24 +139,81 @@ class Light_EKF(EKF):
         able to run any computation.
 
         """
+        self.close_arena()
         self.xlnk.xlnk_reset()
 
+    def save_context(self):
+        """Copy the state of the current context out of the accelerator.
+
+        Returns
+        -------
+        np.ndarray
+            fixed point x followed by the row-major P, shape=(n + n*n,)
+
+        """
+        nsave = self.n + self.n * self.n
+        self.flush_inputs()
+        self.dlib._p0_top_ekf_1_noasync(self.obs.pointer,
+                                        self.fx_hw.pointer,
+                                        self.hx_hw.pointer,
+                                        self.F_hw.pointer,
+                                        self.H_hw.pointer,
+                                        self.params.pointer,
+                                        self.out_buffer_hw.pointer,
+                                        self.state_hw.pointer,
+                                        self.state_hw.pointer,
+                                        CTRL_KEEP | CTRL_NOSTEP | CTRL_SAVE,
+                                        self.ctx, 0, 0, 0, nsave)
+        self.invalidate_outputs(self.state_hw.pointer, 4 * nsave)
+        return np.array(self.state_hw)
+
+    def restore_context(self, state):
+        """Load a state returned by `save_context()` into the current context.
+
+        Q and R of the context are kept, so the context must have been
+        initialised by `run_hw()` before.
+
+        """
+        nsave = self.n + self.n * self.n
+        np.copyto(self.state_hw, state)
+        self.flush_inputs()
+        self.dlib._p0_top_ekf_1_noasync(self.obs.pointer,
+                                        self.fx_hw.pointer,
+                                        self.hx_hw.pointer,
+                                        self.F_hw.pointer,
+                                        self.H_hw.pointer,
+                                        self.params.pointer,
+                                        self.out_buffer_hw.pointer,
+                                        self.state_hw.pointer,
+                                        self.state_hw.pointer,
+                                        CTRL_KEEP | CTRL_NOSTEP | CTRL_RESTORE,
+                                        self.ctx, 0, 0, nsave, 0)
+        self.x = self.toFloat(np.array(self.state_hw[:self.n]))
+
     def run_sw(self, x):
         """Run the software version of the computation.
 
         This method uses a designated buffer to store the outputs.
 
         """
+        prof = self.prof_sw
         for i, line in enumerate(x):
+            prof.begin()
             obs = np.array(line).astype(np.float32)
+            prof.mark(ST_CONVERT)
             state = self.step(obs)
+            prof.mark(ST_STEP)
             self.out_buffer_sw[i][0:2] = [state[0], state[1]]
+            prof.mark(ST_OUTPUT)
+            prof.end()
         return self.out_buffer_sw[:len(x)]
 
     def run_hw(self, x):
         """Run the hardware-accelerated computation.
 
-        Error checking is removed to improve the performance.
+        Error checking is removed to improve the performance, except that
+        steps the hardware reports as not positive definite are counted in
+        `failures`.
 
         The following steps are performed in the hardware computation:
 
@@ -150,47 +229,70 @@ class Light_EKF(EKF):
 
         5. Repeat for len(x)-1 iterations.
 
+        Unless profiling or the health words are enabled, the whole loop
+        runs natively in one `run_trajectory()` call if the kernel library
+        provides it.
+
         """
+        if self.prof_hw is NO_PROFILE and not self.health_ctrl:
+            if self.run_trajectory(x, self.out_buffer_hw,
+                                   EKF_MODEL_LIGHT) is not None:
+                return self.out_buffer_hw[:len(x), :]
+
+        prof = self.prof_hw
+        prof.begin()
         line = x[0]
-        np.copyto(self.obs, self.toFixed(line))
+        self.toFixed(line, out=self.obs)
+        prof.mark(ST_CONVERT)
 
         self.compute_model(self.x)
+        prof.mark(ST_MODEL)
 
         offset = 0
         out_ptr = self.out_buffer_hw.pointer
 
-        self.dlib._p0_top_ekf_1_noasync(self.obs.pointer,
-                                        self.fx_hw.pointer,
-                                        self.hx_hw.pointer,
-                                        self.F_hw.pointer,
-                                        self.H_hw.pointer,
-                                        self.params.pointer,
-                                        out_ptr, 0, self.n, self.m)
+        self.flush_inputs()
+        status = self.dlib._p0_top_ekf_1_noasync(
+            self.obs.pointer, self.fx_hw.pointer, self.hx_hw.pointer,
+            self.F_hw.pointer, self.H_hw.pointer, self.params.pointer,
+            out_ptr, self.state_hw.pointer, self.state_hw.pointer,
+            self.health_ctrl, self.ctx, self.n, self.m, 0, 0)
+        self.invalidate_outputs(out_ptr, 4 * self.n)
+        prof.mark(ST_KERNEL)
+        self.check_status(status)
         self.x = self.toFloat(self.out_buffer_hw[0])
+        prof.mark(ST_OUTPUT)
+        prof.end()
 
         for i, line in enumerate(x[1:]):
+            prof.begin()
             # fetch next observation and measurement, convert and copy
-            obs = (self.toFixed(line))
-            np.copyto(self.obs, obs)
+            self.toFixed(line, out=self.obs)
+            prof.mark(ST_CONVERT)
 
             # compute fx, hx, F, H in python floating point, convert and copy
             self.compute_model(self.x)
+            prof.mark(ST_MODEL)
 
             # output point offset adjustment
             offset += 8
             out_ptr = self.out_buffer_hw.pointer + offset
 
             # run next iteration in HW by setting ctrl=1
-            self.dlib._p0_top_ekf_1_noasync(self.obs.pointer,
-                                            self.fx_hw.pointer,
-                                            self.hx_hw.pointer,
-                                            self.F_hw.pointer,
-                                            self.H_hw.pointer,
-                                            self.params.pointer,
-                                            out_ptr, 1, self.n, self.m)
+            self.flush_inputs()
+            status = self.dlib._p0_top_ekf_1_noasync(
+                self.obs.pointer, self.fx_hw.pointer, self.hx_hw.pointer,
+                self.F_hw.pointer, self.H_hw.pointer, self.params.pointer,
+                out_ptr, self.state_hw.pointer, self.state_hw.pointer,
+                CTRL_KEEP | self.health_ctrl, self.ctx, self.n, self.m, 0, 0)
+            self.invalidate_outputs(out_ptr, 4 * self.n)
+            prof.mark(ST_KERNEL)
+            self.check_status(status)
 
             # convert state into float for next iteration model
             self.x = self.toFloat(self.out_buffer_hw[i + 1])
+            prof.mark(ST_OUTPUT)
+            prof.end()
         return self.out_buffer_hw[:len(x), :]
 
     def compute_model(self, x):
@@ -203,11 +305,8 @@ class Light_EKF(EKF):
         fx, _ = self.f(x)
         hx, _ = self.h(fx)
 
-        fx_hw = self.toFixed(fx.flatten())
-        hx_hw = self.toFixed(hx.flatten())
-
-        np.copyto(self.fx_hw, fx_hw)
-        np.copyto(self.hx_hw, hx_hw)
+        self.toFixed(fx, out=self.fx_hw)
+        self.toFixed(hx, out=self.hx_hw)
 
     def f(self, x, **kwargs):
         F = np.array([[1, 1], [0, 1]])
@@ -64,7 +64,6 @@ setup(
     name="pynq-ekf",
     version='1.0',
     install_requires=[
-          'rig',
           'pynq>=2.3'
     ],
     url='https://github.com/sfox14/pynq-ekf',
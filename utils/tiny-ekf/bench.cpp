@@ -0,0 +1,705 @@
+/* bench: steps/sec of the templated Ekf<Nsta, Mobs> engine against the
+ * runtime-sized ekf_step() in tiny_ekf.c, at the sizes built in build/src.
+ *
+ * Both run the same random (but well conditioned) linear model in float,
+ * and the final state of each is compared to check they agree.
+ *
+ * The second table advances a population of independent 8x4 filters and
+ * reports filters*steps/sec for EkfBank<> against looping ekf_step() (and
+ * Ekf<>::step()) over every filter.
+ *
+ * The third table runs an undamped constant velocity model through
+ * Ekf<> with a dense F and with the adds-only F_CV structure.
+ *
+ * The fourth compares the square-root EkfSqrt<> with Ekf<>, both in float:
+ * steps/sec, and the max state error of each over the run against Ekf<> in
+ * double, relative to the largest state.
+ *
+ * The fifth runs the same linear model through Ekf<> with and without the
+ * steady-state gain (kss_win 8, kss_tol 1e-6), and gives the step from
+ * which the gain was kept.
+ *
+ * The sixth times each stage of Ekf<>::step() alone, in ns, with their sum
+ * and the path left when the state update runs alongside the covariance
+ * update. The seventh runs the same steps through step(team, e, z) of
+ * ekf_team.hpp at every team size up to the cores found (at least 2), and
+ * checks that x and P come out the same to the bit as the serial step;
+ * 8x4 is below TINYEKF_TEAM_MIN, so there the team falls back to it.
+ *
+ * The eighth filters one long trajectory of the linear model with the
+ * time-parallel EkfScan<> of ekf_scan.hpp, on teams of 1, 2, 4, .. threads
+ * up to the cores found (at least 4), against Ekf<> stepping through it:
+ * steps/sec, and the max error of the state over every step, relative to
+ * the largest state.
+ *
+ * MIT License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <thread>
+
+extern "C" {
+#include "tiny_ekf.h"
+}
+#include "tiny_ekf.hpp"
+#include "ekf_bank.hpp"
+#include "ekf_team.hpp"
+#include "ekf_scan.hpp"
+
+#define SEC_TO_NS (1000000000)
+
+using tinyekf::Ekf;
+using tinyekf::EkfBank;
+using tinyekf::EkfSqrt;
+using tinyekf::EkfScan;
+using tinyekf::Team;
+
+static double now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + (double)t.tv_nsec/SEC_TO_NS;
+}
+
+static float urand()
+{
+    return (float)rand()/RAND_MAX - 0.5f;
+}
+
+/* Same layout as unpack() in tiny_ekf.c: n, m then the packed matrices */
+struct blob {
+    int n, m;
+    void * v;
+    float * x, * P, * Q, * R, * F, * H, * fx, * hx;
+
+    blob(int n_, int m_) : n(n_), m(m_)
+    {
+        int total = n + n*n + n*n + m*m + n*m + n*n + m*n + n*m + n*n + n*n
+                    + n + m + n*n + n*m + m*n + m*m + m*m + m;
+        v = calloc(1, 2*sizeof(int) + total*sizeof(float));
+        ekf_init(v, n, m);
+
+        float * d = (float *)((char *)v + 2*sizeof(int));
+        x = d;   d += n;
+        P = d;   d += n*n;
+        Q = d;   d += n*n;
+        R = d;   d += m*m;
+        d += n*m;                   /* G */
+        F = d;   d += n*n;
+        H = d;   d += m*n;
+        d += n*m + n*n + n*n;       /* Ht, Ft, Pp */
+        fx = d;  d += n;
+        hx = d;
+    }
+    ~blob() { free(v); }
+};
+
+struct model {
+    int n, m;
+    float * F, * H, * P, * Q, * R, * z;
+
+    model(int n_, int m_, int steps) : n(n_), m(m_)
+    {
+        F = new float[n*n]();
+        H = new float[m*n]();
+        P = new float[n*n]();
+        Q = new float[n*n]();
+        R = new float[m*m]();
+        z = new float[steps*m];
+
+        /* damped constant velocity blocks, so long runs stay bounded */
+        for (int i=0; i<n; ++i) {
+            F[i*n+i] = (i % 2 == 0) ? 1.0f : 0.9f;
+            if ((i % 2 == 0) && (i+1 < n))
+                F[i*n+i+1] = 0.1f;
+            P[i*n+i] = 0.5f;
+            Q[i*n+i] = 0.1f;
+        }
+        for (int i=0; i<m; ++i) {
+            for (int j=0; j<n; ++j)
+                H[i*n+j] = urand();
+            H[i*n + (2*i) % n] += 1;
+            R[i*m+i] = 20.0f;
+        }
+        for (int i=0; i<steps*m; ++i)
+            z[i] = urand();
+    }
+    ~model() { delete[] F; delete[] H; delete[] P; delete[] Q; delete[] R; delete[] z; }
+};
+
+/* one linear step: fx = F x, hx = H fx */
+template <typename T>
+static void predict(const float * F, const float * H, const T * x,
+                    T * fx, T * hx, int n, int m)
+{
+    for (int i=0; i<n; ++i) {
+        fx[i] = 0;
+        for (int j=0; j<n; ++j)
+            fx[i] += F[i*n+j] * x[j];
+    }
+    for (int i=0; i<m; ++i) {
+        hx[i] = 0;
+        for (int j=0; j<n; ++j)
+            hx[i] += H[i*n+j] * fx[j];
+    }
+}
+
+static double run_tiny(const model & md, int steps, float * xout)
+{
+    int n = md.n, m = md.m;
+    blob b(n, m);
+    memcpy(b.F, md.F, n*n*sizeof(float));
+    memcpy(b.H, md.H, m*n*sizeof(float));
+    memcpy(b.P, md.P, n*n*sizeof(float));
+    memcpy(b.Q, md.Q, n*n*sizeof(float));
+    memcpy(b.R, md.R, m*m*sizeof(float));
+
+    double t0 = now();
+    for (int s=0; s<steps; ++s) {
+        predict(md.F, md.H, b.x, b.fx, b.hx, n, m);
+        ekf_step(b.v, &md.z[s*m]);
+    }
+    double t1 = now();
+
+    memcpy(xout, b.x, n*sizeof(float));
+    return t1 - t0;
+}
+
+template <int N, int M, int FS = tinyekf::F_DENSE>
+static double run_engine(const model & md, int steps, float * xout)
+{
+    Ekf<N, M, float, FS> * e = new Ekf<N, M, float, FS>();
+    for (int i=0; i<N; ++i) {
+        for (int j=0; j<N; ++j) {
+            e->F[i][j] = md.F[i*N+j];
+            e->P[i][j] = md.P[i*N+j];
+            e->Q[i][j] = md.Q[i*N+j];
+        }
+    }
+    for (int i=0; i<M; ++i) {
+        for (int j=0; j<N; ++j)
+            e->H[i][j] = md.H[i*N+j];
+        for (int j=0; j<M; ++j)
+            e->R[i][j] = md.R[i*M+j];
+    }
+
+    double t0 = now();
+    for (int s=0; s<steps; ++s) {
+        predict(md.F, md.H, e->x, e->fx, e->hx, N, M);
+        e->step(&md.z[s*M]);
+    }
+    double t1 = now();
+
+    memcpy(xout, e->x, N*sizeof(float));
+    delete e;
+    return t1 - t0;
+}
+
+template <int N, int M>
+static void bench(int steps)
+{
+    model md(N, M, steps);
+    float xa[N], xb[N];
+
+    double ta = run_tiny(md, steps, xa);
+    double tb = run_engine<N, M>(md, steps, xb);
+
+    /* relative to the largest state, since the positions integrate z */
+    float err = 0, mag = 1e-30f;
+    for (int i=0; i<N; ++i) {
+        err = fmaxf(err, fabsf(xa[i] - xb[i]));
+        mag = fmaxf(mag, fabsf(xa[i]));
+    }
+    err /= mag;
+
+    printf("n%dm%d\t%8d\t%12.0f\t%12.0f\t%6.2fx\t%g\n", N, M, steps,
+           steps/ta, steps/tb, ta/tb, err);
+}
+
+/* steps/sec of Ekf<> with F = kron(I, [[1, 1], [0, 1]]), dense vs F_CV */
+template <int N, int M>
+static void bench_fcv(int steps)
+{
+    model md(N, M, steps);
+    float xa[N], xb[N];
+
+    for (int i=0; i<N; ++i)
+        md.F[i*N+i] = 1.0f;
+    for (int i=0; i<N; i+=2)
+        md.F[i*N+i+1] = 1.0f;
+
+    double ta = run_engine<N, M>(md, steps, xa);
+    double tb = run_engine<N, M, tinyekf::F_CV>(md, steps, xb);
+
+    float err = 0, mag = 1e-30f;
+    for (int i=0; i<N; ++i) {
+        err = fmaxf(err, fabsf(xa[i] - xb[i]));
+        mag = fmaxf(mag, fabsf(xa[i]));
+    }
+    err /= mag;
+
+    printf("n%dm%d\t%8d\t%12.0f\t%12.0f\t%6.2fx\t%g\n", N, M, steps,
+           steps/ta, steps/tb, ta/tb, err);
+}
+
+/* E loaded with the model: P, Q, R as given, or as S, Qh, Rh for EkfSqrt
+   (the model's are diagonal) */
+template <int N, int M, typename T>
+static void load(Ekf<N, M, T> * e, const model & md)
+{
+    for (int i=0; i<N; ++i)
+        for (int j=0; j<N; ++j) {
+            e->F[i][j] = md.F[i*N+j];
+            e->P[i][j] = md.P[i*N+j];
+            e->Q[i][j] = md.Q[i*N+j];
+        }
+    for (int i=0; i<M; ++i) {
+        for (int j=0; j<N; ++j)
+            e->H[i][j] = md.H[i*N+j];
+        for (int j=0; j<M; ++j)
+            e->R[i][j] = md.R[i*M+j];
+    }
+}
+
+template <int N, int M, typename T>
+static void load(EkfSqrt<N, M, T> * e, const model & md)
+{
+    for (int i=0; i<N; ++i) {
+        for (int j=0; j<N; ++j)
+            e->F[i][j] = md.F[i*N+j];
+        e->S[i][i] = sqrtf(md.P[i*N+i]);
+        e->Qh[i][i] = sqrtf(md.Q[i*N+i]);
+    }
+    for (int i=0; i<M; ++i) {
+        for (int j=0; j<N; ++j)
+            e->H[i][j] = md.H[i*N+j];
+        e->Rh[i][i] = sqrtf(md.R[i*M+i]);
+    }
+}
+
+template <int N, int M>
+static double run_sqrt(const model & md, int steps, float * xout)
+{
+    EkfSqrt<N, M, float> * e = new EkfSqrt<N, M, float>();
+    load(e, md);
+
+    double t0 = now();
+    for (int s=0; s<steps; ++s) {
+        predict(md.F, md.H, e->x, e->fx, e->hx, N, M);
+        e->step(&md.z[s*M]);
+    }
+    double t1 = now();
+
+    memcpy(xout, e->x, N*sizeof(float));
+    delete e;
+    return t1 - t0;
+}
+
+/* steps/sec and accuracy of EkfSqrt<> against Ekf<>, both in float */
+template <int N, int M>
+static void bench_sqrt(int steps)
+{
+    model md(N, M, steps);
+    float xa[N], xb[N];
+
+    double ta = run_engine<N, M>(md, steps, xa);
+    double tb = run_sqrt<N, M>(md, steps, xb);
+
+    /* every step of both against double */
+    Ekf<N, M, double> * ref = new Ekf<N, M, double>();
+    Ekf<N, M, float> * e = new Ekf<N, M, float>();
+    EkfSqrt<N, M, float> * q = new EkfSqrt<N, M, float>();
+    load(ref, md);
+    load(e, md);
+    load(q, md);
+
+    double ea = 0, eb = 0, mag = 1e-30;
+    for (int s=0; s<steps; ++s) {
+        double z[M];
+        for (int j=0; j<M; ++j)
+            z[j] = md.z[s*M+j];
+        predict(md.F, md.H, ref->x, ref->fx, ref->hx, N, M);
+        predict(md.F, md.H, e->x, e->fx, e->hx, N, M);
+        predict(md.F, md.H, q->x, q->fx, q->hx, N, M);
+        ref->step(z);
+        e->step(&md.z[s*M]);
+        q->step(&md.z[s*M]);
+        for (int i=0; i<N; ++i) {
+            ea = fmax(ea, fabs(e->x[i] - ref->x[i]));
+            eb = fmax(eb, fabs(q->x[i] - ref->x[i]));
+            mag = fmax(mag, fabs(ref->x[i]));
+        }
+    }
+
+    printf("n%dm%d\t%8d\t%12.0f\t%12.0f\t%6.2fx\t%g\t%g\n", N, M, steps,
+           steps/ta, steps/tb, ta/tb, ea/mag, eb/mag);
+
+    delete ref;
+    delete e;
+    delete q;
+}
+
+/* filters*steps/sec for a population of independent filters */
+template <int N, int M>
+static void bench_bank(int filters, int steps)
+{
+    typedef EkfBank<N, M> bank_t;
+    const int W = 8;
+
+    model ** md = new model * [filters];
+    for (int f=0; f<filters; ++f)
+        md[f] = new model(N, M, steps);
+
+    /* z[step][filter][Mobs], as the bank consumes it */
+    float * z = new float[steps*filters*M];
+    for (int s=0; s<steps; ++s)
+        for (int f=0; f<filters; ++f)
+            memcpy(&z[(s*filters + f)*M], &md[f]->z[s*M], M*sizeof(float));
+
+    /* looping ekf_step() */
+    blob ** b = new blob * [filters];
+    for (int f=0; f<filters; ++f) {
+        b[f] = new blob(N, M);
+        memcpy(b[f]->F, md[f]->F, N*N*sizeof(float));
+        memcpy(b[f]->H, md[f]->H, M*N*sizeof(float));
+        memcpy(b[f]->P, md[f]->P, N*N*sizeof(float));
+        memcpy(b[f]->Q, md[f]->Q, N*N*sizeof(float));
+        memcpy(b[f]->R, md[f]->R, M*M*sizeof(float));
+    }
+    double t0 = now();
+    for (int s=0; s<steps; ++s)
+        for (int f=0; f<filters; ++f) {
+            predict(b[f]->F, b[f]->H, b[f]->x, b[f]->fx, b[f]->hx, N, M);
+            ekf_step(b[f]->v, &z[(s*filters + f)*M]);
+        }
+    double ta = now() - t0;
+
+    /* looping Ekf<>::step() */
+    Ekf<N, M> * e = new Ekf<N, M>[filters];
+    for (int f=0; f<filters; ++f)
+        for (int i=0; i<N; ++i) {
+            for (int j=0; j<N; ++j) {
+                e[f].F[i][j] = md[f]->F[i*N+j];
+                e[f].P[i][j] = md[f]->P[i*N+j];
+                e[f].Q[i][j] = md[f]->Q[i*N+j];
+            }
+            for (int j=0; j<M; ++j) {
+                if (i < M) {
+                    e[f].R[j][i] = md[f]->R[j*M+i];
+                }
+                e[f].H[j][i] = md[f]->H[j*N+i];
+            }
+        }
+    t0 = now();
+    for (int s=0; s<steps; ++s)
+        for (int f=0; f<filters; ++f) {
+            predict(md[f]->F, md[f]->H, e[f].x, e[f].fx, e[f].hx, N, M);
+            e[f].step(&z[(s*filters + f)*M]);
+        }
+    double tb = now() - t0;
+
+    /* one EkfBank<> over all filters, with the model evaluated lane-wise */
+    bank_t * bank = new bank_t(filters);
+    if (!bank->valid()) {
+        fprintf(stderr, "ekf_bench: no memory for %d filters\n", filters);
+        exit(1);
+    }
+    for (int f=0; f<filters; ++f)
+        for (int i=0; i<N; ++i) {
+            for (int j=0; j<N; ++j) {
+                bank->F(f, i, j) = md[f]->F[i*N+j];
+                bank->P(f, i, j) = md[f]->P[i*N+j];
+                bank->Q(f, i, j) = md[f]->Q[i*N+j];
+            }
+            for (int j=0; j<M; ++j) {
+                if (i < M)
+                    bank->R(f, j, i) = md[f]->R[j*M+i];
+                bank->H(f, j, i) = md[f]->H[j*N+i];
+            }
+        }
+    t0 = now();
+    for (int s=0; s<steps; ++s) {
+        typename bank_t::block * blk = bank->data();
+        for (int k=0; k*W<filters; ++k) {
+            typename bank_t::block & q = blk[k];
+            for (int i=0; i<N; ++i)
+                for (int l=0; l<W; ++l) {
+                    float sum = 0;
+                    for (int j=0; j<N; ++j)
+                        sum += q.F[i][j][l] * q.x[j][l];
+                    q.fx[i][l] = sum;
+                }
+            for (int i=0; i<M; ++i)
+                for (int l=0; l<W; ++l) {
+                    float sum = 0;
+                    for (int j=0; j<N; ++j)
+                        sum += q.H[i][j][l] * q.fx[j][l];
+                    q.hx[i][l] = sum;
+                }
+        }
+        bank->step(&z[s*filters*M], filters);
+    }
+    double tc = now() - t0;
+
+    float err = 0, mag = 1e-30f;
+    for (int f=0; f<filters; ++f)
+        for (int i=0; i<N; ++i) {
+            err = fmaxf(err, fabsf(b[f]->x[i] - bank->x(f, i)));
+            mag = fmaxf(mag, fabsf(b[f]->x[i]));
+        }
+    err /= mag;
+
+    double work = (double)filters*steps;
+    printf("n%dm%d\t%8d\t%12.0f\t%12.0f\t%12.0f\t%6.2fx\t%g\n", N, M, filters,
+           work/ta, work/tb, work/tc, ta/tc, err);
+
+    for (int f=0; f<filters; ++f) {
+        delete md[f];
+        delete b[f];
+    }
+    delete[] md;
+    delete[] b;
+    delete[] e;
+    delete[] z;
+    delete bank;
+}
+
+/* steps/sec of Ekf<> with the gain kept once it settles, against every step in full */
+template <int N, int M>
+static void bench_kss(int steps)
+{
+    model md(N, M, steps);
+    float xa[N];
+
+    double ta = run_engine<N, M>(md, steps, xa);
+
+    Ekf<N, M, float> * e = new Ekf<N, M, float>();
+    load(e, md);
+    e->kss_win = 8;
+    e->kss_tol = 1e-6f;
+
+    int from = -1;
+    double t0 = now();
+    for (int s=0; s<steps; ++s) {
+        predict(md.F, md.H, e->x, e->fx, e->hx, N, M);
+        e->step(&md.z[s*M]);
+        if (from < 0 && e->frozen())
+            from = s;
+    }
+    double tb = now() - t0;
+
+    float err = 0, mag = 1e-30f;
+    for (int i=0; i<N; ++i) {
+        err = fmaxf(err, fabsf(xa[i] - e->x[i]));
+        mag = fmaxf(mag, fabsf(xa[i]));
+    }
+    err /= mag;
+
+    printf("n%dm%d\t%8d\t%12.0f\t%12.0f\t%6.2fx\t%g\t%d\n", N, M, steps,
+           steps/ta, steps/tb, ta/tb, err, from);
+
+    delete e;
+}
+
+/* ns of each stage of Ekf<>::step(), each repeated on the state reached
+   after a run of steps, since every stage rewrites the same outputs */
+template <int N, int M>
+static void bench_stages(int steps, int reps)
+{
+    model md(N, M, steps);
+    float xa[N];
+    run_engine<N, M>(md, steps, xa);
+
+    Ekf<N, M, float> * e = new Ekf<N, M, float>();
+    load(e, md);
+    for (int s=0; s<steps; ++s) {
+        predict(md.F, md.H, e->x, e->fx, e->hx, N, M);
+        e->step(&md.z[s*M]);
+    }
+    const float * z = &md.z[(steps-1)*M];
+
+    double ns[5];
+    double t0 = now();
+    for (int r=0; r<reps; ++r)
+        e->predict();
+    double t1 = now();
+    for (int r=0; r<reps; ++r)
+        e->innovation();
+    double t2 = now();
+    for (int r=0; r<reps; ++r)
+        e->gain();
+    double t3 = now();
+    for (int r=0; r<reps; ++r)
+        e->update(z);
+    double t4 = now();
+    for (int r=0; r<reps; ++r)
+        e->correct();
+    double t5 = now();
+    ns[0] = t1 - t0;
+    ns[1] = t2 - t1;
+    ns[2] = t3 - t2;
+    ns[3] = t4 - t3;
+    ns[4] = t5 - t4;
+
+    double sum = 0;
+    for (int k=0; k<5; ++k) {
+        ns[k] *= 1e9/reps;
+        sum += ns[k];
+    }
+    double path = sum - ns[3] - ns[4] + fmax(ns[3], ns[4]);
+
+    printf("n%dm%d\t%8.0f\t%8.0f\t%8.0f\t%8.0f\t%8.0f\t%8.0f\t%8.0f\t%5.1f%%\n",
+           N, M, ns[0], ns[1], ns[2], ns[3], ns[4], sum, path, 100*(sum - path)/sum);
+
+    delete e;
+}
+
+/* steps/sec of Ekf<>::step() alone and over teams of 2..threads */
+template <int N, int M>
+static void bench_team(int steps, int threads)
+{
+    model md(N, M, steps);
+
+    Ekf<N, M, float> * a = new Ekf<N, M, float>();
+    load(a, md);
+    double t0 = now();
+    for (int s=0; s<steps; ++s) {
+        predict(md.F, md.H, a->x, a->fx, a->hx, N, M);
+        a->step(&md.z[s*M]);
+    }
+    double ta = now() - t0;
+
+    for (int n=2; n<=threads; ++n) {
+        Ekf<N, M, float> * b = new Ekf<N, M, float>();
+        load(b, md);
+        Team team(n);
+        t0 = now();
+        for (int s=0; s<steps; ++s) {
+            predict(md.F, md.H, b->x, b->fx, b->hx, N, M);
+            tinyekf::step(team, *b, &md.z[s*M]);
+        }
+        double tb = now() - t0;
+
+        int same = memcmp(a->x, b->x, sizeof(a->x)) == 0 &&
+                   memcmp(a->P, b->P, sizeof(a->P)) == 0;
+        printf("n%dm%d\t%8d\t%7d\t%12.0f\t%12.0f\t%6.2fx\t%s\n", N, M, steps, n,
+               steps/ta, steps/tb, ta/tb, same ? "yes" : "NO");
+        delete b;
+    }
+
+    delete a;
+}
+
+/* steps/sec of EkfScan<> over a trajectory, against Ekf<>, for each team size */
+template <int N, int M>
+static void bench_scan(int steps, int threads)
+{
+    model md(N, M, steps);
+    float * xa = new float[steps*N];
+    float * xb = new float[steps*N];
+
+    /* the model as EkfScan<> evaluates it, so that one thread matches */
+    Ekf<N, M, float> * e = new Ekf<N, M, float>();
+    load(e, md);
+    double t0 = now();
+    for (int s=0; s<steps; ++s) {
+        for (int i=0; i<N; ++i)
+            e->fx[i] = tinyekf::rdot<Ekf<N, M, float>::NP>(e->F[i], e->x);
+        for (int j=0; j<M; ++j)
+            e->hx[j] = tinyekf::rdot<Ekf<N, M, float>::NP>(e->H[j], e->fx);
+        e->step(&md.z[s*M]);
+        memcpy(&xa[s*N], e->x, N*sizeof(float));
+    }
+    double ta = now() - t0;
+
+    float mag = 1e-30f;
+    for (int i=0; i<steps*N; ++i)
+        mag = fmaxf(mag, fabsf(xa[i]));
+
+    for (int n=1; n<=threads; n = (n*2 > threads && n < threads) ? threads : n*2) {
+        Team team(n);
+        EkfScan<N, M, float> * q = new EkfScan<N, M, float>(team);
+        for (int i=0; i<N; ++i)
+            for (int j=0; j<N; ++j) {
+                q->F[i][j] = md.F[i*N+j];
+                q->P[i][j] = md.P[i*N+j];
+                q->Q[i][j] = md.Q[i*N+j];
+            }
+        for (int i=0; i<M; ++i) {
+            for (int j=0; j<N; ++j)
+                q->H[i][j] = md.H[i*N+j];
+            for (int j=0; j<M; ++j)
+                q->R[i][j] = md.R[i*M+j];
+        }
+
+        t0 = now();
+        int fail = q->run(md.z, steps, xb);
+        double tb = now() - t0;
+
+        float err = 0;
+        for (int i=0; i<steps*N; ++i)
+            err = fmaxf(err, fabsf(xa[i] - xb[i]));
+        err /= mag;
+
+        printf("n%dm%d\t%8d\t%7d\t%12.0f\t%12.0f\t%6.2fx\t%g%s\n", N, M, steps, n,
+               steps/ta, steps/tb, ta/tb, err, fail ? "\tfailed" : "");
+        delete q;
+    }
+
+    delete e;
+    delete[] xa;
+    delete[] xb;
+}
+
+int main(int argc, char ** argv)
+{
+    int scale = (argc > 1) ? atoi(argv[1]) : 1;
+
+    srand(42);
+    printf("size\t   steps\t ekf_step/s\t    Ekf<>/s\tspeedup\trel.err\n");
+    bench<2, 2>(scale*1000000);
+    bench<8, 4>(scale*200000);
+    bench<72, 8>(scale*2000);
+
+    printf("\nsize\t filters\t ekf_step/s\t    Ekf<>/s\t  EkfBank/s\tspeedup\trel.err\n");
+    bench_bank<8, 4>(64, scale*2000);
+    bench_bank<8, 4>(1024, scale*200);
+    bench_bank<8, 4>(4096, scale*50);
+
+    printf("\nsize\t   steps\t  dense F/s\t     F_CV/s\tspeedup\trel.err\n");
+    bench_fcv<2, 2>(scale*1000000);
+    bench_fcv<8, 4>(scale*200000);
+    bench_fcv<72, 8>(scale*2000);
+
+    printf("\nsize\t   steps\t    Ekf<>/s\t  EkfSqrt/s\tspeedup\terr Ekf\terr EkfSqrt\n");
+    bench_sqrt<2, 2>(scale*100000);
+    bench_sqrt<8, 4>(scale*20000);
+    bench_sqrt<72, 8>(scale*200);
+
+    printf("\nsize\t   steps\t    Ekf<>/s\t   steady/s\tspeedup\trel.err\tfrom\n");
+    bench_kss<2, 2>(scale*1000000);
+    bench_kss<8, 4>(scale*200000);
+    bench_kss<72, 8>(scale*2000);
+
+    int threads = std::thread::hardware_concurrency();
+    if (threads < 2)
+        threads = 2;
+
+    printf("\nsize\t predict\t   innov\t    gain\t  update\t correct\t     sum\t    path\tsaved\n");
+    bench_stages<8, 4>(1000, scale*200000);
+    bench_stages<72, 8>(1000, scale*2000);
+
+    printf("\nsize\t   steps\tthreads\t    Ekf<>/s\t     team/s\tspeedup\tsame\n");
+    bench_team<8, 4>(scale*20000, threads);
+    bench_team<72, 8>(scale*2000, threads);
+
+    printf("\nsize\t   steps\tthreads\t    Ekf<>/s\t     scan/s\tspeedup\trel.err\n");
+    bench_scan<8, 4>(scale*200000, threads < 4 ? 4 : threads);
+    bench_scan<72, 8>(scale*2000, threads < 4 ? 4 : threads);
+
+    return 0;
+}
@@ -0,0 +1,291 @@
+/*
+ * TinyEKF: Extended Kalman Filter for embedded processors.
+ *
+ * ekf_bank.hpp: a bank of independent filters stored structure-of-arrays
+ *
+ * EkfBank<Nsta, Mobs, T, W> advances many filters of the same size with one
+ * call. Filters are grouped into blocks of W lanes and every matrix entry of
+ * a block is a contiguous run of W values, i.e. P[i][j][lane]. The step is
+ * the same sequence as Ekf<>::step(), but the innermost loop of every
+ * product runs across lanes, so it vectorises across filters instead of
+ * across the (small) matrices. Each filter has its own x, fx, hx, F, H, P,
+ * Q and R. FS selects the structure of F as for Ekf<>; with F_IDENTITY or
+ * F_CV the F of every filter is ignored.
+ *
+ * Copyright (C) 2026 the pynq-ekf authors, on Ekf<> from TinyEKF,
+ * Copyright (C) 2015 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#ifndef EKF_BANK_HPP
+#define EKF_BANK_HPP
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tiny_ekf.hpp"
+
+namespace tinyekf {
+
+template <int Nsta, int Mobs, typename T = float, int W = 8, int FS = F_DENSE>
+class EkfBank {
+
+    static_assert(FS != F_CV || Nsta % 2 == 0, "F_CV needs (position, velocity) pairs");
+
+public:
+
+    struct block {
+        alignas(64) T x[Nsta][W];          /* state vector */
+        alignas(64) T fx[Nsta][W];         /* output of f() */
+        alignas(64) T hx[Mobs][W];         /* output of h() */
+        alignas(64) T F[Nsta][Nsta][W];    /* Jacobian of process model */
+        alignas(64) T H[Mobs][Nsta][W];    /* Jacobian of measurement model */
+        alignas(64) T P[Nsta][Nsta][W];    /* prediction error covariance */
+        alignas(64) T Q[Nsta][Nsta][W];    /* process noise covariance */
+        alignas(64) T R[Mobs][Mobs][W];    /* measurement error covariance */
+    };
+
+    /* count filters, all zero; a bank whose blocks could not be allocated
+       has valid() false and no filters */
+    explicit EkfBank(int count) : size(count < 0 ? 0 : count),
+                                  nblocks((size + W - 1) / W), blocks(NULL)
+    {
+        if (nblocks > 0 &&
+            posix_memalign((void **)&blocks, 64, nblocks*sizeof(block))) {
+            blocks = NULL;
+            size = 0;
+            return;
+        }
+        if (blocks != NULL)
+            memset(blocks, 0, nblocks*sizeof(block));
+    }
+
+    ~EkfBank() { free(blocks); }
+
+    bool valid() const { return blocks != NULL || nblocks == 0; }
+
+    int count() const { return size; }
+
+    /* per-filter element access, e.g. bank.P(f, i, j) = 0.5 */
+    T & x(int f, int i)         { return blocks[f/W].x[i][f%W]; }
+    T & fx(int f, int i)        { return blocks[f/W].fx[i][f%W]; }
+    T & hx(int f, int i)        { return blocks[f/W].hx[i][f%W]; }
+    T & F(int f, int i, int j)  { return blocks[f/W].F[i][j][f%W]; }
+    T & H(int f, int i, int j)  { return blocks[f/W].H[i][j][f%W]; }
+    T & P(int f, int i, int j)  { return blocks[f/W].P[i][j][f%W]; }
+    T & Q(int f, int i, int j)  { return blocks[f/W].Q[i][j][f%W]; }
+    T & R(int f, int i, int j)  { return blocks[f/W].R[i][j][f%W]; }
+
+    /* raw block access for models that fill whole lanes at once */
+    block * data() { return blocks; }
+
+    /**
+      * Runs one step of EKF prediction and update on the first <tt>count</tt> filters.
+      * The model of every filter (fx, F, hx, H) must be set beforehand.
+      * @param z measurements, z[f*Mobs + j] for filter f
+      * @param count number of filters to advance, at most count()
+      * @return number of filters whose innovation covariance was not positive definite;
+      * those filters keep their previous x and P.
+      */
+    int step(const T * z, int count)
+    {
+        if (count > size)
+            count = size;
+        int failed = 0;
+        for (int b=0; b*W<count; ++b) {
+            int lanes = (count - b*W < W) ? (count - b*W) : W;
+            for (int j=0; j<Mobs; ++j)
+                for (int l=0; l<W; ++l)
+                    zb[j][l] = (l < lanes) ? z[(b*W + l)*Mobs + j] : T(0);
+            failed += step_block(blocks[b], lanes);
+        }
+        return failed;
+    }
+
+private:
+
+    EkfBank(const EkfBank &);
+    EkfBank & operator=(const EkfBank &);
+
+    /* C[i][j][:] = sum_k A[i][k][:] * B[k][j][:] */
+    template <int R_, int K_, int C_>
+    static inline void mul(T (*C)[C_][W], const T (*A)[K_][W], const T (*B)[C_][W])
+    {
+        for (int i=0; i<R_; ++i)
+            for (int j=0; j<C_; ++j) {
+                T acc[W] = {0};
+                for (int k=0; k<K_; ++k)
+                    for (int l=0; l<W; ++l)
+                        acc[l] += A[i][k][l] * B[k][j][l];
+                for (int l=0; l<W; ++l)
+                    C[i][j][l] = acc[l];
+            }
+    }
+
+    /* C[i][j][:] = sum_k A[i][k][:] * B[j][k][:] + D[i][j][:] */
+    template <int R_, int K_, int C_>
+    static inline void mul_t(T (*C)[C_][W], const T (*A)[K_][W], const T (*B)[K_][W],
+                             const T (*D)[C_][W])
+    {
+        for (int i=0; i<R_; ++i)
+            for (int j=0; j<C_; ++j) {
+                T acc[W];
+                for (int l=0; l<W; ++l)
+                    acc[l] = D[i][j][l];
+                for (int k=0; k<K_; ++k)
+                    for (int l=0; l<W; ++l)
+                        acc[l] += A[i][k][l] * B[j][k][l];
+                for (int l=0; l<W; ++l)
+                    C[i][j][l] = acc[l];
+            }
+    }
+
+    int step_block(block & s, int lanes)
+    {
+        /* P_k = F_{k-1} P_{k-1} F^T_{k-1} + Q_{k-1} */
+        if (FS == F_IDENTITY) {
+            for (int i=0; i<Nsta; ++i)
+                for (int c=0; c<Nsta; ++c)
+                    for (int l=0; l<W; ++l)
+                        Pp[i][c][l] = s.P[i][c][l] + s.Q[i][c][l];
+        }
+        else if (FS == F_CV) {
+            /* row and column 2k gain row and column 2k+1 */
+            for (int i=0; i<Nsta; ++i)
+                for (int c=0; c<Nsta; ++c) {
+                    int ri = (i % 2 == 0), rc = (c % 2 == 0);
+                    for (int l=0; l<W; ++l) {
+                        T a = s.P[i][c][l], b = rc ? s.P[i][c+1][l] : T(0);
+                        if (ri) {
+                            a += s.P[i+1][c][l];
+                            b += rc ? s.P[i+1][c+1][l] : T(0);
+                        }
+                        Pp[i][c][l] = s.Q[i][c][l] + a + b;
+                    }
+                }
+        }
+        else {
+            mul<Nsta, Nsta, Nsta>(tmp0, s.F, s.P);
+            mul_t<Nsta, Nsta, Nsta>(Pp, tmp0, s.F, s.Q);
+        }
+
+        /* Y = H_k P_k, S = Y H^T_k + R */
+        mul<Mobs, Nsta, Nsta>(Y, s.H, Pp);
+        mul_t<Mobs, Nsta, Mobs>(S, Y, s.H, s.R);
+
+        /* S = L L^T; a lane with a non-positive pivot is flagged and
+           carried through with a unit pivot, then discarded below */
+        for (int l=0; l<W; ++l)
+            ok[l] = 1;
+        for (int j=0; j<Mobs; ++j) {
+            for (int i=j; i<Mobs; ++i) {
+                T acc[W];
+                for (int l=0; l<W; ++l)
+                    acc[l] = S[i][j][l];
+                for (int k=0; k<j; ++k)
+                    for (int l=0; l<W; ++l)
+                        acc[l] -= L[i][k][l] * L[j][k][l];
+                if (i == j) {
+                    for (int l=0; l<W; ++l) {
+                        T good = (acc[l] > 0);
+                        ok[l] *= good;
+                        dinv[j][l] = T(1) / sqrt(good*acc[l] + (1 - good));
+                    }
+                }
+                else {
+                    for (int l=0; l<W; ++l)
+                        L[i][j][l] = acc[l] * dinv[j][l];
+                }
+            }
+        }
+
+        /* L Z = Y, L^T G^T = Z */
+        for (int i=0; i<Mobs; ++i)
+            for (int c=0; c<Nsta; ++c) {
+                T acc[W];
+                for (int l=0; l<W; ++l)
+                    acc[l] = Y[i][c][l];
+                for (int k=0; k<i; ++k)
+                    for (int l=0; l<W; ++l)
+                        acc[l] -= L[i][k][l] * Gt[k][c][l];
+                for (int l=0; l<W; ++l)
+                    Gt[i][c][l] = acc[l] * dinv[i][l];
+            }
+        for (int i=Mobs-1; i>=0; --i)
+            for (int c=0; c<Nsta; ++c) {
+                T acc[W];
+                for (int l=0; l<W; ++l)
+                    acc[l] = Gt[i][c][l];
+                for (int k=i+1; k<Mobs; ++k)
+                    for (int l=0; l<W; ++l)
+                        acc[l] -= L[k][i][l] * Gt[k][c][l];
+                for (int l=0; l<W; ++l)
+                    Gt[i][c][l] = acc[l] * dinv[i][l];
+            }
+
+        /* \hat{x}_k = \hat{x_k} + G_k(z_k - h(\hat{x}_k)) */
+        for (int j=0; j<Mobs; ++j)
+            for (int l=0; l<W; ++l)
+                err[j][l] = zb[j][l] - s.hx[j][l];
+        for (int i=0; i<Nsta; ++i) {
+            T acc[W];
+            for (int l=0; l<W; ++l)
+                acc[l] = s.fx[i][l];
+            for (int j=0; j<Mobs; ++j)
+                for (int l=0; l<W; ++l)
+                    acc[l] += Gt[j][i][l] * err[j][l];
+            for (int l=0; l<W; ++l)
+                s.x[i][l] = ok[l] ? acc[l] : s.x[i][l];
+        }
+
+        /* P_k = (I - G_k H_k) P_k = P_k - G_k Y */
+        for (int i=0; i<Nsta; ++i)
+            for (int c=0; c<Nsta; ++c) {
+                T acc[W];
+                for (int l=0; l<W; ++l)
+                    acc[l] = Pp[i][c][l];
+                for (int j=0; j<Mobs; ++j)
+                    for (int l=0; l<W; ++l)
+                        acc[l] -= Gt[j][i][l] * Y[j][c][l];
+                for (int l=0; l<W; ++l)
+                    s.P[i][c][l] = ok[l] ? acc[l] : s.P[i][c][l];
+            }
+
+        int failed = 0;
+        for (int l=0; l<lanes; ++l)
+            failed += (ok[l] == 0);
+        return failed;
+    }
+
+    int size;
+    int nblocks;
+    block * blocks;
+
+    /* temporary storage, shared by all blocks */
+    alignas(64) T zb[Mobs][W];
+    alignas(64) T err[Mobs][W];
+    alignas(64) T tmp0[Nsta][Nsta][W];
+    alignas(64) T Pp[Nsta][Nsta][W];
+    alignas(64) T Y[Mobs][Nsta][W];
+    alignas(64) T S[Mobs][Mobs][W];
+    alignas(64) T L[Mobs][Mobs][W];
+    alignas(64) T Gt[Mobs][Nsta][W];
+    alignas(64) T dinv[Mobs][W];
+    alignas(64) T ok[W];
+};
+
+/**
+  * Runs one step on the first <tt>count</tt> filters of a bank.
+  * @return number of filters that failed with a non-positive-definite matrix
+  */
+template <int Nsta, int Mobs, typename T, int W, int FS>
+int ekf_bank_step(EkfBank<Nsta, Mobs, T, W, FS> & bank, const T * z, int count)
+{
+    return bank.step(z, count);
+}
+
+} // namespace tinyekf
+
+#endif
@@ -0,0 +1,531 @@
+/*
+ * TinyEKF: Extended Kalman Filter for embedded processors.
+ *
+ * ekf_scan.hpp: a whole trajectory of a linear filter, split in time
+ *
+ * EkfScan<Nsta, Mobs, T> filters z[0..steps-1] with the model of Ekf<>
+ * taken as linear and fixed, fx = F x and hx = H fx, over a Team of
+ * threads (ekf_team.hpp), after Sarkka and Garcia-Fernandez, "Temporal
+ * parallelization of Bayesian smoothers" (2021). Step k is the element
+ *
+ *     e_k = (A, K z_k, C, G z_k, J)      S = H Q H^T + R,  K = Q H^T S^-1,
+ *                                        G = F^T H^T S^-1, A = (I - K H) F,
+ *                                        C = (I - K H) Q,  J = G H F
+ *
+ * of an associative operator (combine() below) whose prefix e_0 .. e_k
+ * holds the filtered x and P of step k, e_0 being the step from the prior.
+ * The trajectory is cut into one chunk per member, and the scan is
+ * partitioned by work, not by element:
+ *
+ *     1. member 0 runs Ekf<> over the first chunk; every other member but
+ *        the last folds its chunk into one element
+ *     2. member 0 takes the state at the end of each chunk to the next one
+ *        through these elements, one combine() per chunk
+ *     3. every other member runs Ekf<> over its chunk from that state
+ *
+ * A combine() costs two to five steps of Ekf<> from 8x4 to 72x8, so member
+ * 0, which runs Ekf<> while the others fold, takes lead times the chunk of
+ * the others, and n members filter (lead + n - 1) / (lead + 1) times as
+ * fast as one at best: the scan does more work than the serial filter,
+ * gains from three cores on and doubles the rate at lead + 3. The x of
+ * each step agree with Ekf<> but for rounding; the states at the cuts are
+ * not those of the serial run to the bit. All scratch, one Ekf<> and two
+ * elements per member, is allocated with the object; run() allocates
+ * nothing.
+ *
+ * Copyright (C) 2026 the pynq-ekf authors, on Ekf<> from TinyEKF,
+ * Copyright (C) 2015 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#ifndef EKF_SCAN_HPP
+#define EKF_SCAN_HPP
+
+#include <math.h>
+#include <string.h>
+#include <limits>
+
+#include "tiny_ekf.hpp"
+#include "ekf_team.hpp"
+
+namespace tinyekf {
+
+template <int Nsta, int Mobs, typename T = float>
+class EkfScan {
+
+public:
+
+    static const int NP = TINYEKF_PAD(Nsta, T);
+    static const int MP = TINYEKF_PAD(Mobs, T);
+
+    alignas(64) T x[NP];           /* prior, then the state of the last step */
+
+    alignas(64) T P[Nsta][NP];     /* prior, then the covariance of the last step */
+    alignas(64) T Q[Nsta][NP];     /* process noise covariance */
+    alignas(64) T R[Mobs][MP];     /* measurement error covariance */
+
+    alignas(64) T F[Nsta][NP];     /* state transition */
+    alignas(64) T H[Mobs][NP];     /* measurement model */
+
+    int lead;                      /* share of member 0 against the others, >= 1 */
+
+    EkfScan(Team & t) : team(t), members(t.size())
+    {
+        init();
+        wk = new work[members];
+        for (int w=0; w<members; ++w)
+            memset((void *)&wk[w], 0, sizeof(wk[w]));
+    }
+
+    ~EkfScan() { delete[] wk; }
+
+    /* zero-out every matrix, and lead to its default */
+    void init()
+    {
+        memset(x, 0, sizeof(x));
+        memset(P, 0, sizeof(P));
+        memset(Q, 0, sizeof(Q));
+        memset(R, 0, sizeof(R));
+        memset(F, 0, sizeof(F));
+        memset(H, 0, sizeof(H));
+        lead = 4;
+    }
+
+    /**
+      * Filters z[steps][Mobs] from the prior x, P, which are left as the
+      * state and covariance of the last step.
+      * @param xs if not NULL, gets the state of every step, xs[steps][Nsta]
+      * @return 0 on success, 1 if a step fails as in Ekf<>::step(); x and P
+      * are then unchanged.
+      */
+    int run(const T * z, int steps, T * xs)
+    {
+        /* every chunk at least two steps long */
+        int n = members;
+        if (steps < 2*(lead + n))
+            n = 1;
+        if (n > 1 && elements())
+            return 1;
+
+        /* member 0 takes lead shares of the steps, the others one each */
+        for (int w=0; w<n; ++w) {
+            wk[w].k0 = cut(w, n, steps);
+            wk[w].k1 = cut(w+1, n, steps);
+        }
+
+        scan s = {this, z, xs};
+        if (n == 1)
+            s(0, 1);
+        else
+            team.run(s);
+
+        for (int w=0; w<n; ++w)
+            if (wk[w].fail)
+                return 1;
+        memcpy(x, wk[n-1].e.x, sizeof(x));
+        memcpy(P, wk[n-1].e.P, sizeof(P));
+        return 0;
+    }
+
+private:
+
+    /* first step of chunk w of n */
+    int cut(int w, int n, int steps) const
+    {
+        if (w == 0 || w == n)
+            return (w == 0) ? 0 : steps;
+        return (int)((long)steps * (lead + w - 1) / (lead + n - 1));
+    }
+
+    /* (A, b, C, eta, J) of the scan, with A^T for an element on the right */
+    struct elem {
+        alignas(64) T A[Nsta][NP];
+        alignas(64) T At[Nsta][NP];
+        alignas(64) T C[Nsta][NP];
+        alignas(64) T J[Nsta][NP];
+        alignas(64) T b[NP];
+        alignas(64) T eta[NP];
+        int live;                      /* A has an entry left */
+    };
+
+    /* scratch of one member */
+    struct work {
+        Ekf<Nsta, Mobs, T> e;          /* filter over the chunk */
+        elem agg[2];                   /* the chunk folded so far, and the next */
+        alignas(64) T Z[Nsta][NP];     /* I + J_j C_i, LU factors */
+        alignas(64) T W[Nsta][NP];
+        alignas(64) T AM[Nsta][NP];    /* A_j (I + C_i J_j)^-1 */
+        alignas(64) T Tm[Nsta][NP];
+        alignas(64) T b[NP], eta[NP], u[NP], v[NP];
+        int perm[Nsta];
+        int k0, k1;                    /* steps of the chunk */
+        int cur;                       /* agg[cur] is the chunk */
+        int fail;
+    };
+
+    /* the run on one member */
+    struct scan {
+        EkfScan * s;
+        const T * z;
+        T * xs;
+
+        void operator()(int w, int n)
+        {
+            work & m = s->wk[w];
+            m.fail = 0;
+            if (w == 0) {
+                s->load(m.e);
+                memcpy(m.e.x, s->x, sizeof(m.e.x));
+                memcpy(m.e.P, s->P, sizeof(m.e.P));
+                m.fail = s->filter(m, z, xs);
+            }
+            else {
+                s->load(m.e);
+                if (w < n-1)
+                    m.fail = s->fold(m, z);
+            }
+            if (n == 1)
+                return;
+            s->team.sync();
+
+            /* the state at the start of each chunk, chained through the others */
+            if (w == 0 && !m.fail) {
+                for (int t=1; t<n && !m.fail; ++t) {
+                    work & p = s->wk[t-1];
+                    if (t == 1) {
+                        memcpy(s->wk[t].e.x, p.e.x, sizeof(p.e.x));
+                        memcpy(s->wk[t].e.P, p.e.P, sizeof(p.e.P));
+                    }
+                    else
+                        m.fail = p.fail || s->advance(m, p, s->wk[t].e);
+                }
+            }
+            s->team.sync();
+
+            if (w > 0 && !s->wk[0].fail && !m.fail)
+                m.fail = s->filter(m, z, xs);
+        }
+    };
+
+    /* A, C, J and K^T, G^T of the elements of every step past the first */
+    int elements()
+    {
+        alignas(64) T HQ[Mobs][NP];
+        alignas(64) T HF[Mobs][NP];
+        T S[Mobs][Mobs], Si[Mobs][Mobs];
+
+        for (int a=0; a<Mobs; ++a) {
+            rzero<NP>(HQ[a]);
+            rzero<NP>(HF[a]);
+            for (int k=0; k<Nsta; ++k) {
+                raxpy<NP>(HQ[a], H[a][k], Q[k]);
+                raxpy<NP>(HF[a], H[a][k], F[k]);
+            }
+            for (int b=0; b<Mobs; ++b)
+                S[a][b] = rdot<NP>(HQ[a], H[b]) + R[a][b];
+        }
+
+        /* S^-1, by Cholesky factorisation and a solve per column */
+        for (int j=0; j<Mobs; ++j) {
+            T sum = S[j][j];
+            for (int k=0; k<j; ++k)
+                sum -= S[j][k] * S[j][k];
+            if (sum <= 0)
+                return 1;
+            S[j][j] = sqrt(sum);
+            for (int i=j+1; i<Mobs; ++i) {
+                T t = S[i][j];
+                for (int k=0; k<j; ++k)
+                    t -= S[i][k] * S[j][k];
+                S[i][j] = t / S[j][j];
+            }
+        }
+        for (int c=0; c<Mobs; ++c) {
+            T y[Mobs];
+            for (int i=0; i<Mobs; ++i) {
+                T t = (i == c) ? 1 : 0;
+                for (int k=0; k<i; ++k)
+                    t -= S[i][k] * y[k];
+                y[i] = t / S[i][i];
+            }
+            for (int i=Mobs-1; i>=0; --i) {
+                T t = y[i];
+                for (int k=i+1; k<Mobs; ++k)
+                    t -= S[k][i] * y[k];
+                y[i] = t / S[i][i];
+            }
+            for (int i=0; i<Mobs; ++i)
+                Si[i][c] = y[i];
+        }
+
+        /* K^T = S^-1 H Q, G^T = S^-1 H F */
+        for (int a=0; a<Mobs; ++a) {
+            rzero<NP>(Kt[a]);
+            rzero<NP>(Gt[a]);
+            for (int b=0; b<Mobs; ++b) {
+                raxpy<NP>(Kt[a], Si[a][b], HQ[b]);
+                raxpy<NP>(Gt[a], Si[a][b], HF[b]);
+            }
+        }
+
+        /* A = F - K H F, C = Q - K H Q, J = (H F)^T G^T */
+        for (int r=0; r<Nsta; ++r) {
+            memcpy(el.A[r], F[r], sizeof(el.A[r]));
+            memcpy(el.C[r], Q[r], sizeof(el.C[r]));
+            rzero<NP>(el.J[r]);
+            for (int a=0; a<Mobs; ++a) {
+                raxpy<NP>(el.A[r], -Kt[a][r], HF[a]);
+                raxpy<NP>(el.C[r], -Kt[a][r], HQ[a]);
+                raxpy<NP>(el.J[r], HF[a][r], Gt[a]);
+            }
+        }
+        transpose(el.At, el.A);
+        return 0;
+    }
+
+    /* the per-step parts of e_k: b = K z_k, eta = G z_k */
+    void vectors(T * b, T * eta, const T * zk) const
+    {
+        rzero<NP>(b);
+        rzero<NP>(eta);
+        for (int a=0; a<Mobs; ++a) {
+            raxpy<NP>(b, zk[a], Kt[a]);
+            raxpy<NP>(eta, zk[a], Gt[a]);
+        }
+    }
+
+    /* e_k0 .. e_k1-1 into m.agg[m.cur] */
+    int fold(work & m, const T * z)
+    {
+        elem & a = m.agg[0];
+        memcpy(a.A, el.A, sizeof(a.A));
+        memcpy(a.C, el.C, sizeof(a.C));
+        memcpy(a.J, el.J, sizeof(a.J));
+        vectors(a.b, a.eta, &z[m.k0*Mobs]);
+        a.live = 1;
+        m.cur = 0;
+        for (int k=m.k0+1; k<m.k1; ++k) {
+            vectors(m.b, m.eta, &z[k*Mobs]);
+            if (combine(m, m.agg[1-m.cur], m.agg[m.cur], el, m.b, m.eta))
+                return 1;
+            m.cur = 1 - m.cur;
+        }
+        transpose(m.agg[m.cur].At, m.agg[m.cur].A);
+        return 0;
+    }
+
+    /* e = the state of p.e advanced over the chunk of p, on the scratch of m */
+    int advance(work & m, work & p, Ekf<Nsta, Mobs, T> & e)
+    {
+        elem & s = m.agg[0];
+        elem & o = m.agg[1];
+        const elem & j = p.agg[p.cur];
+        memset(s.A, 0, sizeof(s.A));
+        memset(s.J, 0, sizeof(s.J));
+        memset(s.eta, 0, sizeof(s.eta));
+        s.live = 0;
+        memcpy(s.b, p.e.x, sizeof(s.b));
+        memcpy(s.C, p.e.P, sizeof(s.C));
+        if (combine(m, o, s, j, j.b, j.eta))
+            return 1;
+        memcpy(e.x, o.b, sizeof(e.x));
+        memcpy(e.P, o.C, sizeof(e.P));
+        return 0;
+    }
+
+    /* Ekf<> over steps k0 .. k1-1 from the state in m.e */
+    int filter(work & m, const T * z, T * xs)
+    {
+        Ekf<Nsta, Mobs, T> & e = m.e;
+        for (int k=m.k0; k<m.k1; ++k) {
+            for (int i=0; i<Nsta; ++i)
+                e.fx[i] = rdot<NP>(F[i], e.x);
+            for (int j=0; j<Mobs; ++j)
+                e.hx[j] = rdot<NP>(H[j], e.fx);
+            if (e.step(&z[k*Mobs]))
+                return 1;
+            if (xs != NULL)
+                memcpy(&xs[k*Nsta], e.x, Nsta*sizeof(T));
+        }
+        return 0;
+    }
+
+    void load(Ekf<Nsta, Mobs, T> & e) const
+    {
+        memcpy(e.F, F, sizeof(e.F));
+        memcpy(e.H, H, sizeof(e.H));
+        memcpy(e.Q, Q, sizeof(e.Q));
+        memcpy(e.R, R, sizeof(e.R));
+    }
+
+    static void transpose(T (*d)[NP], const T (*s)[NP])
+    {
+        for (int r=0; r<Nsta; ++r)
+            for (int c=0; c<Nsta; ++c)
+                d[r][c] = s[c][r];
+    }
+
+    /**
+      * o = i (x) j, with b, eta of j given apart:
+      *     M   = (I + C_i J_j)^-1, and M^T = (I + J_j C_i)^-1 = Z^-1
+      *     A   = A_j M A_i
+      *     b   = A_j M (b_i + C_i eta_j) + b_j
+      *     C   = A_j M C_i A_j^T + C_j
+      *     eta = A_i^T M^T (eta_j - J_j b_i) + eta_i
+      *     J   = A_i^T M^T J_j A_i + J_i
+      * @return 1 if Z is singular, which it is not for C_i, J_j positive
+      * semi-definite but for rounding.
+      */
+    static int combine(work & m, elem & o, const elem & i, const elem & j,
+                       const T * bj, const T * etaj)
+    {
+        /* Z = I + J_j C_i, LU with partial pivoting */
+        for (int r=0; r<Nsta; ++r) {
+            rzero<NP>(m.Z[r]);
+            m.Z[r][r] = 1;
+            for (int k=0; k<Nsta; ++k)
+                raxpy<NP>(m.Z[r], j.J[r][k], i.C[k]);
+            m.perm[r] = r;
+        }
+        for (int c=0; c<Nsta; ++c) {
+            int p = c;
+            for (int r=c+1; r<Nsta; ++r)
+                if (fabs(m.Z[r][c]) > fabs(m.Z[p][c]))
+                    p = r;
+            if (m.Z[p][c] == 0)
+                return 1;
+            if (p != c) {
+                memcpy(m.W[0], m.Z[p], sizeof(m.W[0]));
+                memcpy(m.Z[p], m.Z[c], sizeof(m.Z[p]));
+                memcpy(m.Z[c], m.W[0], sizeof(m.Z[c]));
+                int t = m.perm[p];
+                m.perm[p] = m.perm[c];
+                m.perm[c] = t;
+            }
+            T d = T(1) / m.Z[c][c];
+            /* L is kept left of the diagonal, so only the columns right of c */
+            for (int r=c+1; r<Nsta; ++r) {
+                T l = m.Z[r][c] * d;
+                m.Z[r][c] = l;
+                for (int k=c+1; k<Nsta; ++k)
+                    m.Z[r][k] -= l * m.Z[c][k];
+            }
+        }
+
+        /* AM = (Z^-1 A_j^T)^T */
+        solve(m, j.At);
+        transpose(m.AM, m.W);
+
+        /* b = AM (b_i + C_i eta_j) + b_j */
+        for (int r=0; r<Nsta; ++r)
+            m.u[r] = i.b[r] + rdot<NP>(i.C[r], etaj);
+        for (int r=0; r<Nsta; ++r)
+            o.b[r] = rdot<NP>(m.AM[r], m.u) + bj[r];
+
+        /* C = (AM C_i) A_j^T + C_j */
+        for (int r=0; r<Nsta; ++r) {
+            rzero<NP>(m.Tm[r]);
+            for (int k=0; k<Nsta; ++k)
+                raxpy<NP>(m.Tm[r], m.AM[r][k], i.C[k]);
+            for (int c=0; c<Nsta; ++c)
+                o.C[r][c] = rdot<NP>(m.Tm[r], j.A[c]) + j.C[r][c];
+        }
+
+        /* with A_i gone, so are the terms of A, eta and J */
+        if (!i.live) {
+            memset(o.A, 0, sizeof(o.A));
+            memcpy(o.eta, i.eta, sizeof(o.eta));
+            memcpy(o.J, i.J, sizeof(o.J));
+            o.live = 0;
+            return 0;
+        }
+
+        /* eta = A_i^T Z^-1 (eta_j - J_j b_i) + eta_i */
+        for (int r=0; r<Nsta; ++r)
+            m.u[r] = etaj[r] - rdot<NP>(j.J[r], i.b);
+        for (int r=0; r<Nsta; ++r)
+            m.v[r] = m.u[m.perm[r]];
+        lu_solve(m.Z, m.v);
+        memcpy(o.eta, i.eta, sizeof(o.eta));
+        for (int k=0; k<Nsta; ++k)
+            raxpy<NP>(o.eta, m.v[k], i.A[k]);
+
+        /* J = A_i^T (Z^-1 J_j A_i) + J_i */
+        solve(m, j.J);
+        for (int r=0; r<Nsta; ++r) {
+            rzero<NP>(m.Tm[r]);
+            for (int k=0; k<Nsta; ++k)
+                raxpy<NP>(m.Tm[r], m.W[r][k], i.A[k]);
+        }
+        for (int r=0; r<Nsta; ++r)
+            memcpy(o.J[r], i.J[r], sizeof(o.J[r]));
+        for (int k=0; k<Nsta; ++k)
+            for (int r=0; r<Nsta; ++r)
+                raxpy<NP>(o.J[r], i.A[k][r], m.Tm[k]);
+
+        /* A = AM A_i. A stable filter forgets where a chunk started, so A
+           shrinks over a long chunk: entries far below rounding are dropped
+           before they turn into denormals, which are slow on most cores */
+        const T tiny = sqrt(std::numeric_limits<T>::min());
+        o.live = 0;
+        for (int r=0; r<Nsta; ++r) {
+            rzero<NP>(o.A[r]);
+            for (int k=0; k<Nsta; ++k)
+                raxpy<NP>(o.A[r], m.AM[r][k], i.A[k]);
+            for (int c=0; c<Nsta; ++c) {
+                if (fabs(o.A[r][c]) < tiny)
+                    o.A[r][c] = 0;
+                else
+                    o.live = 1;
+            }
+        }
+
+        return 0;
+    }
+
+    /* W = Z^-1 B, a whole row of B at a time */
+    static void solve(work & m, const T (*B)[NP])
+    {
+        for (int r=0; r<Nsta; ++r)
+            memcpy(m.W[r], B[m.perm[r]], sizeof(m.W[r]));
+        for (int r=0; r<Nsta; ++r)
+            for (int k=0; k<r; ++k)
+                raxpy<NP>(m.W[r], -m.Z[r][k], m.W[k]);
+        for (int r=Nsta-1; r>=0; --r) {
+            for (int k=r+1; k<Nsta; ++k)
+                raxpy<NP>(m.W[r], -m.Z[r][k], m.W[k]);
+            T d = T(1) / m.Z[r][r];
+            for (int c=0; c<NP; ++c)
+                m.W[r][c] *= d;
+        }
+    }
+
+    /* v = Z^-1 v, v already permuted */
+    static void lu_solve(const T (*Z)[NP], T * v)
+    {
+        for (int r=0; r<Nsta; ++r)
+            for (int k=0; k<r; ++k)
+                v[r] -= Z[r][k] * v[k];
+        for (int r=Nsta-1; r>=0; --r) {
+            for (int k=r+1; k<Nsta; ++k)
+                v[r] -= Z[r][k] * v[k];
+            v[r] /= Z[r][r];
+        }
+    }
+
+    EkfScan(const EkfScan &);
+    EkfScan & operator=(const EkfScan &);
+
+    Team & team;
+    int members;
+    work * wk;
+
+    elem el;                       /* A, A^T, C, J of every step past the first */
+    alignas(64) T Kt[Mobs][NP];    /* K^T */
+    alignas(64) T Gt[Mobs][NP];    /* G^T */
+};
+
+} // namespace tinyekf
+
+#endif
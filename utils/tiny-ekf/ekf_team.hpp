@@ -0,0 +1,195 @@
+/*
+ * TinyEKF: Extended Kalman Filter for embedded processors.
+ *
+ * ekf_team.hpp: one Ekf<> step spread over a team of threads
+ *
+ * Team is a fixed set of threads that run one function together, with a
+ * barrier between the stages of it. step(team, e, z) runs Ekf<>::step(z)
+ * as a task graph over the stages of Ekf<>:
+ *
+ *     predict      rows of Pp = F P F^T + Q     split over the team
+ *     innovation   rows of Y = H Pp, S          split over the team
+ *     gain         G^T = S^-1 Y                 first member
+ *     update       x = fx + G (z - hx)          last member, alongside
+ *     correct      rows of P = Pp - G Y         split over the team
+ *
+ * Each row is computed as in the serial step, so the result is the same to
+ * the bit whatever the size of the team. Each barrier moves cache lines
+ * between cores, which costs about as much as a whole 8x4 step, so a team
+ * pays off on large filters such as 72x8 only: below TINYEKF_TEAM_MIN
+ * states step(team, e, z) is e.step(z) on the caller. Small filters are
+ * better run whole, one filter per thread or lane (EkfBank<>).
+ *
+ * Copyright (C) 2026 the pynq-ekf authors, on Ekf<> from TinyEKF,
+ * Copyright (C) 2015 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#ifndef EKF_TEAM_HPP
+#define EKF_TEAM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tiny_ekf.hpp"
+
+/* barrier polls before a waiting member sleeps until the barrier opens */
+#ifndef TINYEKF_SPIN
+#define TINYEKF_SPIN 4096
+#endif
+
+/* states from which step(team, e, z) spreads a step over the team */
+#ifndef TINYEKF_TEAM_MIN
+#define TINYEKF_TEAM_MIN 32
+#endif
+
+namespace tinyekf {
+
+/* run(f) calls f(member, size) on every member, the caller being member 0,
+ * and returns once all have; inside f, sync() waits for all members to
+ * reach it. A waiting member polls TINYEKF_SPIN times, then sleeps on a
+ * condition variable until the last one arrives, so an idle team costs
+ * no CPU; a team kept for a run of steps rarely gets that far. */
+class Team {
+
+public:
+
+    explicit Team(int n) : members(n < 1 ? 1 : n), count(0), phase(0),
+                           sleepers(0), quit(false), call(NULL), arg(NULL)
+    {
+        for (int w=1; w<members; ++w)
+            threads.push_back(std::thread(&Team::loop, this, w));
+    }
+
+    ~Team()
+    {
+        quit = true;
+        sync();
+        for (size_t w=0; w<threads.size(); ++w)
+            threads[w].join();
+    }
+
+    int size() const { return members; }
+
+    template <typename Fn>
+    void run(Fn & f)
+    {
+        call = &invoke<Fn>;
+        arg = &f;
+        sync();
+        f(0, members);
+        sync();
+    }
+
+    void sync()
+    {
+        if (members == 1)
+            return;
+        int p = phase.load(std::memory_order_acquire);
+        if (count.fetch_add(1, std::memory_order_acq_rel) == members - 1) {
+            count.store(0, std::memory_order_relaxed);
+            // seq_cst against sleepers: either a sleeper sees the new
+            // phase before it waits, or it is counted and woken here
+            phase.store(p + 1);
+            if (sleepers.load() > 0) {
+                std::lock_guard<std::mutex> lock(mtx);
+                wake.notify_all();
+            }
+            return;
+        }
+        for (int spin=0; spin < TINYEKF_SPIN; ++spin)
+            if (phase.load(std::memory_order_acquire) != p)
+                return;
+        std::unique_lock<std::mutex> lock(mtx);
+        sleepers.fetch_add(1);
+        while (phase.load() == p)
+            wake.wait(lock);
+        sleepers.fetch_sub(1);
+    }
+
+    /* first of n items of member w, in units of g items but for the last */
+    static int split(int n, int w, int size, int g = 1)
+    {
+        return (w >= size) ? n : (n/g * w / size) * g;
+    }
+
+private:
+
+    Team(const Team &);
+    Team & operator=(const Team &);
+
+    template <typename Fn>
+    static void invoke(void * f, int w, int n) { (*(Fn *)f)(w, n); }
+
+    void loop(int w)
+    {
+        for (;;) {
+            sync();
+            if (quit)
+                return;
+            call(arg, w, members);
+            sync();
+        }
+    }
+
+    int members;
+    std::atomic<int> count;
+    std::atomic<int> phase;
+    std::atomic<int> sleepers;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool quit;
+    void (*call)(void *, int, int);
+    void * arg;
+    std::vector<std::thread> threads;
+};
+
+/* the body of step(team, e, z) on one member */
+template <int Nsta, int Mobs, typename T, int FS>
+struct TeamStep {
+
+    Team * team;
+    Ekf<Nsta, Mobs, T, FS> * e;
+    const T * z;
+    int fail;
+
+    void operator()(int w, int n)
+    {
+        const int g = (FS == F_CV) ? 2 : 1;
+        int i0 = Team::split(Nsta, w, n, g), i1 = Team::split(Nsta, w+1, n, g);
+
+        e->predict(i0, i1);
+        team->sync();
+        e->innovation(Team::split(Mobs, w, n), Team::split(Mobs, w+1, n));
+        team->sync();
+        if (w == 0)
+            fail = e->gain();
+        team->sync();
+        if (fail)
+            return;
+        if (w == n-1)
+            e->update(z);
+        e->correct(i0, i1);
+    }
+};
+
+/* e.step(z) over the members of team; the same result, bit for bit. Below
+ * TINYEKF_TEAM_MIN states, or with a frozen gain, the caller steps alone
+ * and the other members stay asleep */
+template <int Nsta, int Mobs, typename T, int FS>
+int step(Team & team, Ekf<Nsta, Mobs, T, FS> & e, const T * z)
+{
+    if (team.size() == 1 || Nsta < TINYEKF_TEAM_MIN || e.frozen())
+        return e.step(z);
+    TeamStep<Nsta, Mobs, T, FS> s = {&team, &e, z, 0};
+    team.run(s);
+    return s.fail;
+}
+
+} // namespace tinyekf
+
+#endif
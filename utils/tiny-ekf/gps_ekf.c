@@ -26,6 +26,11 @@
 
 #include "tinyekf_config.h"
 #include "tiny_ekf.h"
+#include "prof.h"
+
+/* stages of a step, timed with PROF_ENABLE=1 (make PROF=1) */
+enum { ST_READ, ST_MODEL, ST_STEP, ST_OUTPUT };
+struct prof gps_ekf_prof;
 
 // positioning interval
 static const data_t T = 1;
@@ -132,8 +137,10 @@ void gps_ekf(data_t *xin, data_t *output, int datalen)
     ekf_t ekf;
     ekf_init(&ekf, Nsta, Mobs);
     init(&ekf);
+    prof_init(&gps_ekf_prof, "read,model,step,output");
 
     for (int i=0; i<datalen; i++) {
+        PROF_BEGIN(&gps_ekf_prof);
         // read xin into SV_Pos and SV_Rho
         for (int j=0; j<Nsats; j++) {
             for (int k=0; k<Nxyz; k++) {
@@ -144,16 +151,22 @@ void gps_ekf(data_t *xin, data_t *output, int datalen)
             SV_Rho[j] = xin[i*(Nsats*(Nxyz+1)) + (Nsats*Nxyz) + j];
         }
 
+        PROF_MARK(&gps_ekf_prof, ST_READ);
+
         // model
         model(&ekf, SV_Pos);
+        PROF_MARK(&gps_ekf_prof, ST_MODEL);
 
         // ekf_step
         ekf_step(&ekf, SV_Rho);
+        PROF_MARK(&gps_ekf_prof, ST_STEP);
 
         // return positions, ignoring velocities
         for (int k=0; k<Nxyz; k++) {
             output[i*Nxyz + k] = ekf.x[2*k];
         }
+        PROF_MARK(&gps_ekf_prof, ST_OUTPUT);
+        PROF_END(&gps_ekf_prof);
 
     }
 
@@ -3,6 +3,8 @@
  *   http://www.mathworks.com/matlabcentral/fileexchange/31487-extended-kalman-filter-ekf--for-gps
  * 
  * Reads file gps.csv of satellite data and writes file ekf.csv of mean-subtracted estimated positions.
+ * Built with `make PROF=1`, also prints the per-stage timings of every step (build/src/prof),
+ * or writes them to the file given as the first argument (.csv or .json).
  *
  *
  * References:
@@ -27,9 +29,12 @@
 
 #include "tinyekf_config.h"
 //#include "tiny_ekf.h"
+#include "prof.h"
 
 #define SEC_TO_NS (1000000000)
 
+extern struct prof gps_ekf_prof;
+
 // positioning interval
 //static const data_t T = 1;
 
@@ -117,14 +122,17 @@ int main(int argc, char ** argv)
     // write csv data to xin
     readdata(xin, INFILE, datalen);
 
-	clock_gettime(CLOCK_REALTIME, start);
+	clock_gettime(CLOCK_MONOTONIC, start);
     gps_ekf(xin, output, datalen);
-	clock_gettime(CLOCK_REALTIME, stop);
+	clock_gettime(CLOCK_MONOTONIC, stop);
 
 	writedata(output, OUTFILE, datalen);
 	
 	int totalTime = (stop->tv_sec*SEC_TO_NS + stop->tv_nsec) - (start->tv_sec*SEC_TO_NS + start->tv_nsec);
     printf("time = %f s\n", ((data_t)totalTime/1000000000));
+#if PROF_ENABLE
+    prof_write(&gps_ekf_prof, (argc > 1) ? argv[1] : "-");
+#endif
 	
     free(xin);
     free(output);
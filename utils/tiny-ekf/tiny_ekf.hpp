@@ -0,0 +1,721 @@
+/*
+ * TinyEKF: Extended Kalman Filter for embedded processors.
+ *
+ * tiny_ekf.hpp: header-only engine with compile-time dimensions
+ *
+ * Ekf<Nsta, Mobs, T> is a drop-in replacement for ekf_step() in tiny_ekf.c.
+ * All matrices are fixed-size members, aligned and zero-padded to a whole
+ * number of SIMD registers per row, so the step does no heap allocation,
+ * no unpacking and no transposes. Every product is written either as a row
+ * axpy (C[i][:] += a * B[k][:]) or as a row dot product, which lets the
+ * same loop body run on AVX, SSE, NEON or plain scalar code.
+ *
+ * Copyright (C) 2026 the pynq-ekf authors, on tiny_ekf.c from TinyEKF,
+ * Copyright (C) 2015 Simon D. Levy
+ *
+ * MIT License
+ */
+
+#ifndef TINY_EKF_HPP
+#define TINY_EKF_HPP
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define TINYEKF_UNROLL _Pragma("GCC unroll 16")
+#else
+#define TINYEKF_UNROLL
+#endif
+
+namespace tinyekf {
+
+/* SIMD lane abstraction ---------------------------------------------------- */
+
+/* scalar fallback, also used for any T without a specialisation */
+template <typename T>
+struct vec {
+    typedef T reg;
+    static const int lanes = 1;
+    static reg load(const T * p) { return *p; }
+    static void store(T * p, reg a) { *p = a; }
+    static reg set1(T a) { return a; }
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, reg b) { return a * b; }
+    static reg madd(reg a, reg b, reg c) { return a * b + c; }
+    static T hsum(reg a) { return a; }
+};
+
+#if defined(__AVX__)
+
+template <>
+struct vec<float> {
+    typedef __m256 reg;
+    static const int lanes = 8;
+    static reg load(const float * p) { return _mm256_load_ps(p); }
+    static void store(float * p, reg a) { _mm256_store_ps(p, a); }
+    static reg set1(float a) { return _mm256_set1_ps(a); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+#if defined(__FMA__)
+    static reg madd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+    static reg madd(reg a, reg b, reg c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+    static float hsum(reg a) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+};
+
+template <>
+struct vec<double> {
+    typedef __m256d reg;
+    static const int lanes = 4;
+    static reg load(const double * p) { return _mm256_load_pd(p); }
+    static void store(double * p, reg a) { _mm256_store_pd(p, a); }
+    static reg set1(double a) { return _mm256_set1_pd(a); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+#if defined(__FMA__)
+    static reg madd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+#else
+    static reg madd(reg a, reg b, reg c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+#endif
+    static double hsum(reg a) {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+};
+
+#elif defined(__SSE2__)
+
+template <>
+struct vec<float> {
+    typedef __m128 reg;
+    static const int lanes = 4;
+    static reg load(const float * p) { return _mm_load_ps(p); }
+    static void store(float * p, reg a) { _mm_store_ps(p, a); }
+    static reg set1(float a) { return _mm_set1_ps(a); }
+    static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg madd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static float hsum(reg a) {
+        __m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+};
+
+template <>
+struct vec<double> {
+    typedef __m128d reg;
+    static const int lanes = 2;
+    static reg load(const double * p) { return _mm_load_pd(p); }
+    static void store(double * p, reg a) { _mm_store_pd(p, a); }
+    static reg set1(double a) { return _mm_set1_pd(a); }
+    static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+    static reg madd(reg a, reg b, reg c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static double hsum(reg a) { return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a))); }
+};
+
+#elif defined(__ARM_NEON)
+
+template <>
+struct vec<float> {
+    typedef float32x4_t reg;
+    static const int lanes = 4;
+    static reg load(const float * p) { return vld1q_f32(p); }
+    static void store(float * p, reg a) { vst1q_f32(p, a); }
+    static reg set1(float a) { return vdupq_n_f32(a); }
+    static reg add(reg a, reg b) { return vaddq_f32(a, b); }
+    static reg sub(reg a, reg b) { return vsubq_f32(a, b); }
+    static reg mul(reg a, reg b) { return vmulq_f32(a, b); }
+    static reg madd(reg a, reg b, reg c) { return vmlaq_f32(c, a, b); }
+    static float hsum(reg a) {
+        float32x2_t s = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+        return vget_lane_f32(vpadd_f32(s, s), 0);
+    }
+};
+
+#if defined(__aarch64__)
+template <>
+struct vec<double> {
+    typedef float64x2_t reg;
+    static const int lanes = 2;
+    static reg load(const double * p) { return vld1q_f64(p); }
+    static void store(double * p, reg a) { vst1q_f64(p, a); }
+    static reg set1(double a) { return vdupq_n_f64(a); }
+    static reg add(reg a, reg b) { return vaddq_f64(a, b); }
+    static reg sub(reg a, reg b) { return vsubq_f64(a, b); }
+    static reg mul(reg a, reg b) { return vmulq_f64(a, b); }
+    static reg madd(reg a, reg b, reg c) { return vfmaq_f64(c, a, b); }
+    static double hsum(reg a) { return vaddvq_f64(a); }
+};
+#endif
+
+#endif
+
+/* row length rounded up to a whole number of registers */
+#define TINYEKF_PAD(n, T) ((((n) + vec<T>::lanes - 1) / vec<T>::lanes) * vec<T>::lanes)
+
+/* Row kernels -------------------------------------------------------------- */
+
+/* c[0:W] = 0 */
+template <int W, typename T>
+static inline void rzero(T * c)
+{
+    typedef vec<T> V;
+    TINYEKF_UNROLL
+    for (int j=0; j<W; j+=V::lanes)
+        V::store(c+j, V::set1(0));
+}
+
+/* c[0:W] += a * b[0:W] */
+template <int W, typename T>
+static inline void raxpy(T * c, T a, const T * b)
+{
+    typedef vec<T> V;
+    typename V::reg va = V::set1(a);
+    TINYEKF_UNROLL
+    for (int j=0; j<W; j+=V::lanes)
+        V::store(c+j, V::madd(va, V::load(b+j), V::load(c+j)));
+}
+
+/* c[0:W] = a[0:W] + b[0:W] */
+template <int W, typename T>
+static inline void radd(T * c, const T * a, const T * b)
+{
+    typedef vec<T> V;
+    TINYEKF_UNROLL
+    for (int j=0; j<W; j+=V::lanes)
+        V::store(c+j, V::add(V::load(a+j), V::load(b+j)));
+}
+
+/* c[0:W] = a[0:W] - b[0:W] */
+template <int W, typename T>
+static inline void rsub(T * c, const T * a, const T * b)
+{
+    typedef vec<T> V;
+    TINYEKF_UNROLL
+    for (int j=0; j<W; j+=V::lanes)
+        V::store(c+j, V::sub(V::load(a+j), V::load(b+j)));
+}
+
+/* a[0:W], b[0:W] = c a + s b, c b - s a: a Givens rotation of two rows */
+template <int W, typename T>
+static inline void rrot(T * a, T * b, T c, T s)
+{
+    typedef vec<T> V;
+    typename V::reg vc = V::set1(c), vs = V::set1(s);
+    TINYEKF_UNROLL
+    for (int j=0; j<W; j+=V::lanes) {
+        typename V::reg va = V::load(a+j), vb = V::load(b+j);
+        V::store(a+j, V::madd(vc, va, V::mul(vs, vb)));
+        V::store(b+j, V::sub(V::mul(vc, vb), V::mul(vs, va)));
+    }
+}
+
+/* c, s of the rotation taking (a, b) to (r, 0); returns r */
+template <typename T>
+static inline T givens(T a, T b, T & c, T & s)
+{
+    if (b == 0) {
+        c = 1;
+        s = 0;
+        return a;
+    }
+    if (fabs(a) >= fabs(b)) {
+        T t = b / a, u = sqrt(1 + t*t);
+        c = 1 / u;
+        s = t * c;
+        return a * u;
+    }
+    T t = a / b, u = sqrt(1 + t*t);
+    s = 1 / u;
+    c = t * s;
+    return b * u;
+}
+
+/* a[0:W] . b[0:W] */
+template <int W, typename T>
+static inline T rdot(const T * a, const T * b)
+{
+    typedef vec<T> V;
+    typename V::reg acc = V::set1(0);
+    TINYEKF_UNROLL
+    for (int j=0; j<W; j+=V::lanes)
+        acc = V::madd(V::load(a+j), V::load(b+j), acc);
+    return V::hsum(acc);
+}
+
+/* Engine ------------------------------------------------------------------- */
+
+/* Structure of F, fixed at compile time. Anything but F_DENSE ignores the F
+ * member and forms F P F^T with adds only:
+ *     F_IDENTITY  F = I, e.g. a random walk
+ *     F_CV        F = kron(I, [[1, 1], [0, 1]]), constant velocity with the
+ *                 state as (position, velocity) pairs; needs an even Nsta
+ */
+enum { F_DENSE, F_IDENTITY, F_CV };
+
+template <int Nsta, int Mobs, typename T = float, int FS = F_DENSE>
+class Ekf {
+
+    static_assert(FS != F_CV || Nsta % 2 == 0, "F_CV needs (position, velocity) pairs");
+
+public:
+
+    /* padded row strides */
+    static const int NP = TINYEKF_PAD(Nsta, T);
+    static const int MP = TINYEKF_PAD(Mobs, T);
+
+    alignas(64) T x[NP];           /* state vector */
+
+    alignas(64) T P[Nsta][NP];     /* prediction error covariance */
+    alignas(64) T Q[Nsta][NP];     /* process noise covariance */
+    alignas(64) T R[Mobs][MP];     /* measurement error covariance */
+
+    alignas(64) T F[Nsta][NP];     /* Jacobian of process model, F_DENSE only */
+    alignas(64) T H[Mobs][NP];     /* Jacobian of measurement model */
+
+    alignas(64) T fx[NP];          /* output of user defined f() state-transition function */
+    alignas(64) T hx[MP];          /* output of user defined h() measurement function */
+
+    alignas(64) T Gt[Mobs][NP];    /* transposed Kalman gain; a.k.a. K^T */
+
+    /* Steady-state gain, off while kss_win is 0: once kss_win full steps
+     * in a row have moved no entry of G by more than kss_tol, step() keeps
+     * G and P and only updates x, as STEADY_GAIN=1 does in the hybrid
+     * kernels. Call thaw() after changing F, H, P, Q or R. */
+    int kss_win;
+    T kss_tol;
+    int kss;                       /* full steps in a row with a settled G */
+
+    Ekf() { init(); }
+
+    /* zero-out every matrix, including the row padding */
+    void init()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    /* Kalman gain entry K[i][j] */
+    T gain(int i, int j) const { return Gt[j][i]; }
+
+    /* steps with the gain kept, see kss_win */
+    bool frozen() const { return kss_win > 0 && kss >= kss_win; }
+
+    /* full steps again until the gain settles */
+    void thaw() { kss = 0; }
+
+    /**
+      * Runs one step of EKF prediction and update. Your code should first build a model, setting
+      * the contents of <tt>fx</tt>, <tt>F</tt>, <tt>hx</tt>, and <tt>H</tt> to appropriate values
+      * (<tt>F</tt> only with F_DENSE).
+      * @param z array of measurement (observation) values
+      * @return 0 on success, 1 on failure caused by non-positive-definite matrix.
+      */
+    int step(const T * z)
+    {
+        /* a settled gain: the state update only */
+        if (frozen()) {
+            update(z);
+            return 0;
+        }
+
+        /* P_k = F_{k-1} P_{k-1} F^T_{k-1} + Q_{k-1} */
+        predict();
+
+        /* Y = H_k P_k, S = Y H^T_k + R  (Y = (P_k H^T_k)^T since P_k is symmetric) */
+        innovation();
+
+        /* G^T_k = S^{-1} Y, by Cholesky factorisation and two triangular solves */
+        if (gain())
+            return 1;
+
+        /* \hat{x}_k = \hat{x_k} + G_k(z_k - h(\hat{x}_k)) */
+        update(z);
+
+        /* P_k = (I - G_k H_k) P_k = P_k - G_k Y */
+        correct();
+
+        /* success */
+        return 0;
+    }
+
+    /**
+      * step() with only the measurements whose bit is set in mask present,
+      * e.g. the satellites in view. z, hx, H and R keep their Mobs rows and
+      * the absent ones are ignored; the update runs on the present rows
+      * alone, and with no bit set the step is the prediction alone. Gt then
+      * holds the gain of the present rows, in order. A mask of every row is
+      * step(z).
+      * @return 0 on success, 1 on failure caused by non-positive-definite matrix.
+      */
+    int step(const T * z, unsigned mask)
+    {
+        int rows[Mobs], m = 0;
+        for (int j=0; j<Mobs; ++j)
+            if ((mask >> j) & 1)
+                rows[m++] = j;
+        if (m == Mobs)
+            return step(z);
+
+        /* the settled gain is that of every row */
+        kss = 0;
+
+        predict();
+
+        if (m == 0) {
+            memcpy(x, fx, sizeof(x));
+            memcpy(P, Pp, sizeof(P));
+            return 0;
+        }
+
+        /* Y = H_k P_k, S = Y H^T_k + R over the present rows */
+        for (int a=0; a<m; ++a) {
+            rzero<NP>(Y[a]);
+            for (int k=0; k<Nsta; ++k)
+                raxpy<NP>(Y[a], H[rows[a]][k], Pp[k]);
+            for (int b=0; b<m; ++b)
+                S[a][b] = rdot<NP>(Y[a], H[rows[b]]) + R[rows[a]][rows[b]];
+        }
+
+        if (chol(m))
+            return 1;
+        solve(m);
+
+        memcpy(x, fx, sizeof(x));
+        for (int a=0; a<m; ++a)
+            raxpy<NP>(x, z[rows[a]] - hx[rows[a]], Gt[a]);
+
+        for (int i=0; i<Nsta; ++i) {
+            memcpy(P[i], Pp[i], sizeof(P[i]));
+            for (int a=0; a<m; ++a)
+                raxpy<NP>(P[i], -Gt[a][i], Y[a]);
+        }
+
+        return 0;
+    }
+
+    /* The stages of step(z), each but gain() over a range of rows, so that
+     * one step can be spread over threads (see ekf_team.hpp). A stage
+     * reads only what the stages before it wrote; update() and correct()
+     * share nothing and may run together. With F_CV, predict() takes its
+     * rows in (position, velocity) pairs. */
+
+    /* rows i0..i1-1 of Pp = F P F^T + Q */
+    void predict(int i0 = 0, int i1 = Nsta)
+    {
+        if (FS == F_IDENTITY) {
+            for (int i=i0; i<i1; ++i)
+                radd<NP>(Pp[i], P[i], Q[i]);
+        }
+        else if (FS == F_CV) {
+            /* F P: row 2k gains row 2k+1 */
+            for (int i=i0; i<i1; i+=2) {
+                radd<NP>(tmp0[i], P[i], P[i+1]);
+                memcpy(tmp0[i+1], P[i+1], sizeof(tmp0[i+1]));
+            }
+            /* (F P) F^T: column 2k gains column 2k+1 */
+            for (int i=i0; i<i1; ++i)
+                for (int j=0; j<Nsta; j+=2) {
+                    Pp[i][j] = tmp0[i][j] + tmp0[i][j+1] + Q[i][j];
+                    Pp[i][j+1] = tmp0[i][j+1] + Q[i][j+1];
+                }
+        }
+        else {
+            /* row i of F P, then of (F P) F^T + Q */
+            for (int i=i0; i<i1; ++i) {
+                rzero<NP>(tmp0[i]);
+                TINYEKF_UNROLL
+                for (int k=0; k<Nsta; ++k)
+                    raxpy<NP>(tmp0[i], F[i][k], P[k]);
+                TINYEKF_UNROLL
+                for (int j=0; j<Nsta; ++j)
+                    Pp[i][j] = rdot<NP>(tmp0[i], F[j]) + Q[i][j];
+            }
+        }
+    }
+
+    /* rows a0..a1-1 of Y = H Pp and S = Y H^T + R */
+    void innovation(int a0 = 0, int a1 = Mobs)
+    {
+        for (int a=a0; a<a1; ++a) {
+            rzero<NP>(Y[a]);
+            TINYEKF_UNROLL
+            for (int k=0; k<Nsta; ++k)
+                raxpy<NP>(Y[a], H[a][k], Pp[k]);
+            TINYEKF_UNROLL
+            for (int b=0; b<Mobs; ++b)
+                S[a][b] = rdot<NP>(Y[a], H[b]) + R[a][b];
+        }
+    }
+
+    /* G^T = S^-1 Y, and the settled-gain count; 1 if S is not positive definite */
+    int gain()
+    {
+        if (chol()) {
+            kss = 0;
+            return 1;
+        }
+        if (kss_win > 0)
+            memcpy(Gp, Gt, sizeof(Gp));
+        solve();
+        if (kss_win > 0)
+            kss = settled() ? kss + 1 : 0;
+        return 0;
+    }
+
+    /* x = fx + G (z - hx) */
+    void update(const T * z)
+    {
+        memcpy(x, fx, sizeof(x));
+        for (int j=0; j<Mobs; ++j)
+            raxpy<NP>(x, z[j] - hx[j], Gt[j]);
+    }
+
+    /* rows i0..i1-1 of P = Pp - G Y */
+    void correct(int i0 = 0, int i1 = Nsta)
+    {
+        for (int i=i0; i<i1; ++i) {
+            memcpy(P[i], Pp[i], sizeof(P[i]));
+            TINYEKF_UNROLL
+            for (int j=0; j<Mobs; ++j)
+                raxpy<NP>(P[i], -Gt[j][i], Y[j]);
+        }
+    }
+
+private:
+
+    /* no entry of G moved by more than kss_tol from Gp */
+    bool settled() const
+    {
+        for (int j=0; j<Mobs; ++j)
+            for (int i=0; i<Nsta; ++i)
+                if (!(fabs(Gt[j][i] - Gp[j][i]) <= kss_tol))
+                    return false;
+        return true;
+    }
+
+    /* S = L L^T over its leading m x m block, with the reciprocal of the
+       diagonal kept in dinv */
+    int chol(int m = Mobs)
+    {
+        for (int j=0; j<m; ++j) {
+            T sum = S[j][j];
+            for (int k=0; k<j; ++k)
+                sum -= L[j][k] * L[j][k];
+            if (sum <= 0)
+                return 1; /* error */
+            T d = sqrt(sum);
+            L[j][j] = d;
+            dinv[j] = T(1) / d;
+            for (int i=j+1; i<m; ++i) {
+                T s = S[i][j];
+                for (int k=0; k<j; ++k)
+                    s -= L[i][k] * L[j][k];
+                L[i][j] = s * dinv[j];
+            }
+        }
+        return 0;
+    }
+
+    /* L Z = Y, then L^T G^T = Z, one whole row of length Nsta at a time,
+       over the first m rows */
+    void solve(int m = Mobs)
+    {
+        for (int i=0; i<m; ++i) {
+            memcpy(Gt[i], Y[i], sizeof(Gt[i]));
+            for (int k=0; k<i; ++k)
+                raxpy<NP>(Gt[i], -L[i][k], Gt[k]);
+            scale(Gt[i], dinv[i]);
+        }
+        for (int i=m-1; i>=0; --i) {
+            for (int k=i+1; k<m; ++k)
+                raxpy<NP>(Gt[i], -L[k][i], Gt[k]);
+            scale(Gt[i], dinv[i]);
+        }
+    }
+
+    static void scale(T * c, T a)
+    {
+        typedef vec<T> V;
+        typename V::reg va = V::set1(a);
+        TINYEKF_UNROLL
+        for (int j=0; j<NP; j+=V::lanes)
+            V::store(c+j, V::mul(va, V::load(c+j)));
+    }
+
+    /* temporary storage */
+    alignas(64) T Pp[Nsta][NP];    /* P, post-prediction, pre-update */
+    alignas(64) T tmp0[Nsta][NP];  /* F P, unused with F_IDENTITY */
+    alignas(64) T Y[Mobs][NP];     /* H P */
+    alignas(64) T S[Mobs][MP];     /* innovation covariance */
+    T L[Mobs][Mobs];               /* Cholesky factor of S */
+    T dinv[Mobs];
+    alignas(64) T Gp[Mobs][NP];    /* G^T of the previous step, with kss_win only */
+};
+
+/* Square-root engine: the same filter as Ekf<>, but it keeps the upper
+ * triangular Cholesky factor S of P = S^T S instead of P, and takes upper
+ * triangular factors Qh, Rh of Q = Qh^T Qh and R = Rh^T Rh (the square
+ * roots of their diagonals when Q and R are diagonal). Both updates are
+ * Givens QR factorisations, as in the SQRT_COV build of the hybrid kernel:
+ *
+ *     time         [S F^T; Qh] -> [Sp; 0]
+ *     measurement  [Rh 0; Sp H^T Sp] -> [Re U; 0 S]
+ *
+ * and x = fx + U^T Re^-T (z - hx). P is never formed, so it stays
+ * symmetric and positive definite in any precision, and S spans half the
+ * exponent range of P.
+ */
+template <int Nsta, int Mobs, typename T = float, int FS = F_DENSE>
+class EkfSqrt {
+
+    static_assert(FS != F_CV || Nsta % 2 == 0, "F_CV needs (position, velocity) pairs");
+
+public:
+
+    static const int NP = TINYEKF_PAD(Nsta, T);
+    static const int MP = TINYEKF_PAD(Mobs, T);
+
+    alignas(64) T x[NP];           /* state vector */
+
+    alignas(64) T S[Nsta][NP];     /* upper triangular, P = S^T S */
+    alignas(64) T Qh[Nsta][NP];    /* upper triangular, Q = Qh^T Qh */
+    alignas(64) T Rh[Mobs][MP];    /* upper triangular, R = Rh^T Rh */
+
+    alignas(64) T F[Nsta][NP];     /* Jacobian of process model, F_DENSE only */
+    alignas(64) T H[Mobs][NP];     /* Jacobian of measurement model */
+
+    alignas(64) T fx[NP];
+    alignas(64) T hx[MP];
+
+    EkfSqrt() { init(); }
+
+    void init()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    /* covariance entry P[i][j] = S[:][i] . S[:][j] */
+    T cov(int i, int j) const
+    {
+        T sum = 0;
+        for (int k=0; k<=i && k<=j; ++k)
+            sum += S[k][i] * S[k][j];
+        return sum;
+    }
+
+    /**
+      * Runs one step of prediction and update, as Ekf<>::step().
+      * @param z array of measurement (observation) values
+      * @return 0 on success, 1 if a pivot of Re is zero; x and S are then unchanged.
+      */
+    int step(const T * z)
+    {
+        /* Sp^T Sp = F P F^T + Q */
+        predict();
+
+        /* Re^T Re = H Pp H^T + R, U = Re^-T H Pp, S^T S = Pp - U^T U. The rows
+         * of Sp are taken from the last up, so that every row of U is zero
+         * left of the row of Sp it is rotated against */
+        memcpy(Re, Rh, sizeof(Re));
+        memset(U, 0, sizeof(U));
+        for (int i=Nsta-1; i>=0; --i) {
+            for (int j=0; j<Mobs; ++j)
+                b[j] = rdot<NP>(Sp[i], H[j]);
+            for (int j=0; j<Mobs; ++j) {
+                T c, s;
+                Re[j][j] = givens(Re[j][j], b[j], c, s);
+                for (int k=j+1; k<Mobs; ++k) {
+                    T p = Re[j][k];
+                    Re[j][k] = c*p + s*b[k];
+                    b[k] = c*b[k] - s*p;
+                }
+                rrot<NP>(U[j], Sp[i], c, s);
+            }
+        }
+        for (int j=0; j<Mobs; ++j)
+            if (Re[j][j] == 0)
+                return 1;
+
+        /* x = fx + U^T w, Re^T w = z - hx */
+        memcpy(x, fx, sizeof(x));
+        for (int i=0; i<Mobs; ++i) {
+            T w = z[i] - hx[i];
+            for (int k=0; k<i; ++k)
+                w -= Re[k][i] * b[k];
+            b[i] = w / Re[i][i];
+            raxpy<NP>(x, b[i], U[i]);
+        }
+
+        memcpy(S, Sp, sizeof(S));
+        return 0;
+    }
+
+private:
+
+    /* Sp = Qh, then each row of S F^T rotated into it from the left */
+    void predict()
+    {
+        memcpy(Sp, Qh, sizeof(Sp));
+        for (int i=0; i<Nsta; ++i) {
+            int j0 = 0;
+            if (FS == F_IDENTITY) {
+                memcpy(a, S[i], sizeof(a));
+                j0 = i;
+            }
+            else if (FS == F_CV) {
+                /* column 2k of S F^T gains column 2k+1 */
+                for (int j=0; j<Nsta; j+=2) {
+                    a[j] = S[i][j] + S[i][j+1];
+                    a[j+1] = S[i][j+1];
+                }
+                j0 = i - i % 2;
+            }
+            else {
+                for (int j=0; j<Nsta; ++j)
+                    a[j] = rdot<NP>(S[i], F[j]);
+            }
+            for (int j=j0; j<Nsta; ++j) {
+                T c, s;
+                if (a[j] == 0)
+                    continue;
+                givens(Sp[j][j], a[j], c, s);
+                /* entries left of j are zero in both rows */
+                rrot<NP>(Sp[j], a, c, s);
+                a[j] = 0;
+            }
+        }
+    }
+
+    /* temporary storage */
+    alignas(64) T Sp[Nsta][NP];    /* S, post-prediction, pre-update */
+    alignas(64) T a[NP];           /* a row of S F^T */
+    alignas(64) T U[Mobs][NP];
+    alignas(64) T Re[Mobs][MP];    /* upper triangular, Re^T Re = H Pp H^T + R */
+    T b[Mobs];                     /* a row of Sp H^T, then Re^-T (z - hx) */
+};
+
+} // namespace tinyekf
+
+#endif